@@ -21,6 +21,7 @@
 #include <linux/of.h>
 #include <linux/sched.h>
 #include <linux/slab.h>
+#include <linux/timer.h>
 
 #include <asm/cputype.h>
 #include <asm/smp_plat.h>
@@ -376,6 +377,10 @@ void __init arch_get_hmp_domains(struct list_head *hmp_domains_list)
 
 	arch_get_fast_and_slow_cpus(&hmp_fast_cpu_mask, &hmp_slow_cpu_mask);
 
+	/* keep deferrable housekeeping timers off the big cluster */
+	if (!cpumask_empty(&hmp_slow_cpu_mask))
+		timer_set_housekeeping_cpus(&hmp_slow_cpu_mask);
+
 	/*
 	 * Initialize hmp_domains
 	 * Must be ordered with respect to compute capacity.
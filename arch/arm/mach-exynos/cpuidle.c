@@ -48,6 +48,7 @@
 #include <mach/cpufreq.h>
 #include <mach/exynos-pm.h>
 #include <mach/devfreq.h>
+#include <mach/cpuidle_profiler.h>
 #ifdef CONFIG_SND_SAMSUNG_AUDSS
 #include <sound/exynos.h>
 #endif
@@ -263,6 +264,20 @@ static bool cluster_off_flag = false;
 
 #define DEFAULT_CLUSTER_OFF_TARGET_RESIDENCY 5000
 static int cluster_off_target_residency = DEFAULT_CLUSTER_OFF_TARGET_RESIDENCY * 100;
+
+/*
+ * With cluster_off_predict set, the last cpu only powers the cluster down
+ * when the predicted wakeup of every sibling, from its next timer and its
+ * recent idle history, leaves at least cluster_off_target_residency of
+ * shared idle. Otherwise only the siblings' next timers are considered.
+ */
+static u32 cluster_off_predict = 1;
+static DEFINE_PER_CPU(ktime_t, c2_entry_time);
+
+/* bumped by each cpu on its own, summed when read */
+static DEFINE_PER_CPU(unsigned int, cluster_off_count);
+static DEFINE_PER_CPU(unsigned int, cluster_off_early_wakeup);
+static DEFINE_PER_CPU(unsigned int, cluster_off_declined);
 #endif
 
 #define REG_DIRECTGO_ADDR	(S5P_VA_SYSRAM_NS + 0x24)
@@ -738,6 +753,44 @@ static __maybe_unused int check_matched_state(int cpu_id, struct cpumask *matche
 	}
 	return 1;
 }
+
+/*
+ * Predict the time in us until the first cpu of @cpu_group wakes up.
+ * Callers must hold c2_state_lock and have checked that all siblings are
+ * in C2.
+ */
+static s64 exynos_cluster_expected_idle(int cpu_id, const struct cpumask *cpu_group)
+{
+	ktime_t now = ktime_get();
+	struct clock_event_device *dev;
+	unsigned int avg;
+	s64 expected = LLONG_MAX, wakeup, predicted;
+	int cpu;
+
+	for_each_cpu_and(cpu, cpu_possible_mask, cpu_group) {
+		if (cpumask_test_cpu(cpu, &cpu_down_state))
+			continue;
+
+		dev = per_cpu(tick_cpu_device, cpu).evtdev;
+		wakeup = ktime_to_us(ktime_sub(dev->next_event, now));
+
+		/*
+		 * A sibling that already stayed idle longer than usual gives
+		 * no hint beyond its timer.
+		 */
+		avg = cpuidle_profile_get_avg_residency(cpu);
+		if (avg) {
+			predicted = ktime_to_us(ktime_sub(ktime_add_us(
+					per_cpu(c2_entry_time, cpu), avg), now));
+			if (predicted > 0 && predicted < wakeup)
+				wakeup = predicted;
+		}
+
+		expected = min(expected, wakeup);
+	}
+
+	return expected;
+}
 #endif
 #endif	/* CONFIG_EXYNOS_CLUSTER_POWER_DOWN */
 
@@ -1283,7 +1336,9 @@ static int exynos_enter_idle(struct cpuidle_device *dev,
 	u64 time_start = local_clock();
 #endif
 
+	cpuidle_profile_start(CPUIDLE_PROFILE_C1, dev->cpu);
 	cpu_do_idle();
+	cpuidle_profile_finish(CPUIDLE_PROFILE_C1, dev->cpu, 0);
 
 #ifdef CPUIDLE_PROFILING
 	per_cpu(c1_data, dev->cpu).duration += (local_clock() - time_start);
@@ -1361,8 +1416,17 @@ static int exynos_enter_c2(struct cpuidle_device *dev,
 	if (index == 2) {
 		spin_lock(&c2_state_lock);
 		cpumask_set_cpu(cpuid, &cpu_c2_state);
-		if ((cpuid & 0x4) && check_matched_state(cpuid, &cpu_c2_state, cpu_coregroup_mask(cpuid)))
-			flags |= L2_CCI_OFF;
+		per_cpu(c2_entry_time, cpuid) = ktime_get();
+		if ((cpuid & 0x4) && check_matched_state(cpuid, &cpu_c2_state, cpu_coregroup_mask(cpuid))) {
+			if (!cluster_off_predict ||
+				exynos_cluster_expected_idle(cpuid, cpu_coregroup_mask(cpuid)) >=
+				cluster_off_target_residency) {
+				flags |= L2_CCI_OFF;
+				this_cpu_inc(cluster_off_count);
+			} else {
+				this_cpu_inc(cluster_off_declined);
+			}
+		}
 		if (check_matched_state(cpuid, &cpu_c2_state, cpu_possible_mask) && !exynos_check_lpc()
 #ifdef CONFIG_EXYNOS_DECON_DISPLAY
 				&& ref_power_status != NULL && (*ref_power_status) == POWER_HIBER_DOWN
@@ -1376,11 +1440,28 @@ static int exynos_enter_c2(struct cpuidle_device *dev,
 		spin_unlock(&c2_state_lock);
 	}
 #endif
+	cpuidle_profile_start(CPUIDLE_PROFILE_C2, cpuid);
+#if defined (CONFIG_EXYNOS_CLUSTER_POWER_DOWN)
+	if (flags & L2_CCI_OFF)
+		cpuidle_profile_start(CPUIDLE_PROFILE_CPD, cpuid);
+#endif
+
 	ret = cpu_suspend(flags, c2_finisher);
+
+#if defined (CONFIG_EXYNOS_CLUSTER_POWER_DOWN)
+	if (flags & L2_CCI_OFF)
+		cpuidle_profile_finish(CPUIDLE_PROFILE_CPD, cpuid, ret);
+#endif
+	cpuidle_profile_finish(CPUIDLE_PROFILE_C2, cpuid, ret);
+
 	if (ret) {
 		temp = __raw_readl(EXYNOS_ARM_CORE_CONFIGURATION(cpu_offset));
 		temp |= 0xf;
 		__raw_writel(temp, EXYNOS_ARM_CORE_CONFIGURATION(cpu_offset));
+#if defined (CONFIG_EXYNOS_CLUSTER_POWER_DOWN)
+		if (flags & L2_CCI_OFF)
+			this_cpu_inc(cluster_off_early_wakeup);
+#endif
 #ifdef CONFIG_CPUIDLE_TEST_SYSFS
 		if (test_start != 0)
 			early_wakeup_counter[cpuid]++;
@@ -1469,8 +1550,21 @@ static struct dentry *cluster_off_time_debugfs;
 
 static int cluster_off_time_show(struct seq_file *s, void *unused)
 {
+	unsigned int count = 0, early_wakeup = 0, declined = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		count += per_cpu(cluster_off_count, cpu);
+		early_wakeup += per_cpu(cluster_off_early_wakeup, cpu);
+		declined += per_cpu(cluster_off_declined, cpu);
+	}
+
 	seq_printf(s, "CA15_cluster_off %llu\n",
 			(unsigned long long) cputime64_to_clock_t(cluster_off_time));
+	seq_printf(s, "predict %u\n", cluster_off_predict);
+	seq_printf(s, "entry %u\n", count);
+	seq_printf(s, "early_wakeup %u\n", early_wakeup);
+	seq_printf(s, "declined %u\n", declined);
 
 	return 0;
 }
@@ -1887,6 +1981,9 @@ static int __init exynos_init_cpuidle(void)
 		pr_err("%s: debugfs_create_file() failed\n", __func__);
 	}
 
+	if (IS_ERR_OR_NULL(debugfs_create_bool("cluster_off_predict",
+				S_IRUGO | S_IWUSR, NULL, &cluster_off_predict)))
+		pr_err("%s: debugfs_create_bool() failed\n", __func__);
 #endif
 	spin_lock_init(&c2_state_lock);
 
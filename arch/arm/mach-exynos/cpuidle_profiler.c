@@ -23,6 +23,14 @@
 static DEFINE_PER_CPU(struct cpuidle_profile_info, profile_info);
 static struct cpuidle_profile_info cpd_info[NUM_CLUSTER];
 
+/*
+ * Recent C2 residency of every cpu. This is maintained whether or not a
+ * profile is ongoing, since the idle driver uses it to predict when idle
+ * siblings will wake up.
+ */
+static DEFINE_PER_CPU(ktime_t, idle_entry_time);
+static DEFINE_PER_CPU(unsigned int, avg_residency);
+
 static bool cpuidle_profile_ongoing;
 static ktime_t profile_start_time;
 static ktime_t profile_finish_time;
@@ -52,6 +60,11 @@ void cpuidle_profile_start(unsigned int state, unsigned int cpu)
 	struct cpuidle_profile_info *info;
 	ktime_t cur_time;
 
+	cur_time = ktime_get();
+
+	if (state == CPUIDLE_PROFILE_C2)
+		per_cpu(idle_entry_time, cpu) = cur_time;
+
 	if (!cpuidle_profile_ongoing)
 		return;
 
@@ -60,10 +73,40 @@ void cpuidle_profile_start(unsigned int state, unsigned int cpu)
 	info->cur_state = state;
 	info->entered = 1;
 
-	cur_time = ktime_get();
 	__cpuidle_profile_start(info, state, cur_time);
 }
 
+static void cpuidle_profile_update_history(unsigned int cpu, ktime_t cur_time)
+{
+	unsigned int avg = per_cpu(avg_residency, cpu);
+	s64 diff;
+
+	diff = ktime_to_us(ktime_sub(cur_time, per_cpu(idle_entry_time, cpu)));
+	if (diff < 0)
+		return;
+
+	diff = min_t(s64, diff, UINT_MAX);
+
+	/* exponential moving average with 1/8 weight for the new sample */
+	if (avg)
+		avg = avg - (avg >> 3) + ((unsigned int)diff >> 3);
+	else
+		avg = (unsigned int)diff;
+
+	per_cpu(avg_residency, cpu) = avg;
+}
+
+/**
+ * cpuidle_profile_get_avg_residency - recent average C2 residency of a cpu
+ * @cpu: target cpu
+ *
+ * Returns the average in us, or 0 when no history is available yet.
+ */
+unsigned int cpuidle_profile_get_avg_residency(unsigned int cpu)
+{
+	return ACCESS_ONCE(per_cpu(avg_residency, cpu));
+}
+
 static void __cpuidle_profile_finish(struct cpuidle_profile_info *info,
 					unsigned int state, ktime_t cur_time)
 {
@@ -84,6 +127,11 @@ void cpuidle_profile_finish(unsigned int state, unsigned int cpu,
 	struct cpuidle_profile_info *info;
 	ktime_t cur_time;
 
+	if (state == CPUIDLE_PROFILE_C2 && !early_wakeup) {
+		cur_time = ktime_get();
+		cpuidle_profile_update_history(cpu, cur_time);
+	}
+
 	if (!cpuidle_profile_ongoing)
 		return;
 
@@ -158,6 +206,19 @@ static void cpuidle_profile_show_result(void)
 				calculate_percent(info, CPUIDLE_PROFILE_CPD));
 	}
 	pr_info("==========================================================================\n");
+#ifdef CONFIG_CPU_IDLE_GOV_HISTOGRAM
+	pr_info("|      | timer wakeup |  irq wakeup  |   too deep   |  too shallow   |\n");
+	pr_info("--------------------------------------------------------------------------\n");
+	for_each_possible_cpu(cpu) {
+		struct cpuidle_hist_stats stats;
+
+		cpuidle_hist_get_stats(cpu, &stats);
+		pr_info("| cpu%u | %12u | %12u | %12u | %14u |\n",
+				cpu, stats.timer_wakeups, stats.irq_wakeups,
+				stats.too_deep, stats.too_shallow);
+	}
+	pr_info("==========================================================================\n");
+#endif
 }
 
 static void cpuidle_profile_clear_single(struct cpuidle_profile_info *info)
@@ -180,6 +241,7 @@ static void cpuidle_profile_single_start(void *p)
 	struct cpuidle_profile_info *info = &per_cpu(profile_info, cpu);
 
 	cpuidle_profile_clear_single(info);
+	cpuidle_hist_reset_stats();
 
 	/* The first cpu in cluster clear own cluster data */
 	if (cpumask_first(cpu_coregroup_mask(cpu))) {
@@ -212,6 +274,7 @@ static void cpuidle_profile_main_start(void)
 	/* Wakeup all cpus and clear own profile data to start profile */
 	preempt_disable();
 	cpuidle_profile_clear_single(&per_cpu(profile_info, smp_processor_id()));
+	cpuidle_hist_reset_stats();
 	smp_call_function(cpuidle_profile_single_start, NULL, 1);
 	preempt_enable();
 }
@@ -310,14 +373,32 @@ static int __init cpuidle_profile_init(void)
 	struct device *dev;
 	int ret;
 
-	class = class_create(THIS_MODULE, "cpuidle");
+	/* "cpuidle" is taken by the cpuidle test sysfs class */
+	class = class_create(THIS_MODULE, "cpuidle_profiler");
+	if (IS_ERR(class)) {
+		pr_err("CPUIDLE Profiler : error to create class\n");
+		return PTR_ERR(class);
+	}
+
 	dev = device_create(class, NULL, 0, NULL, "cpuidle_profiler");
+	if (IS_ERR(dev)) {
+		pr_err("CPUIDLE Profiler : error to create device\n");
+		ret = PTR_ERR(dev);
+		goto err_class;
+	}
+
 	ret = sysfs_create_group(&dev->kobj, &cpuidle_profile_group);
 	if (ret) {
 		pr_err("CPUIDLE Profiler : error to create sysfs\n");
-		return -EINVAL;
+		goto err_dev;
 	}
 
 	return 0;
+
+err_dev:
+	device_destroy(class, 0);
+err_class:
+	class_destroy(class);
+	return ret;
 }
 late_initcall(cpuidle_profile_init);
@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2014 Samsung Electronics Co., Ltd.
+ *		http://www.samsung.com
+ *
+ * EXYNOS - CPUIDLE profiler support
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef __ASM_ARCH_CPUIDLE_PROFILER_H
+#define __ASM_ARCH_CPUIDLE_PROFILER_H
+
+#include <linux/ktime.h>
+
+#define NUM_CLUSTER	2
+
+enum cpuidle_profile_state {
+	CPUIDLE_PROFILE_C1,
+	CPUIDLE_PROFILE_C2,
+	CPUIDLE_PROFILE_CPD,
+	NUM_STATE,
+};
+
+struct cpuidle_profile_info {
+	unsigned int cur_state;
+	int entered;
+	ktime_t entry_time;
+
+	unsigned int entry_count[NUM_STATE];
+	unsigned int early_wakeup_count[NUM_STATE];
+	unsigned long long residency[NUM_STATE];
+};
+
+extern void cpuidle_profile_start(unsigned int state, unsigned int cpu);
+extern void cpuidle_profile_finish(unsigned int state, unsigned int cpu,
+					bool early_wakeup);
+extern unsigned int cpuidle_profile_get_avg_residency(unsigned int cpu);
+
+#endif /* __ASM_ARCH_CPUIDLE_PROFILER_H */
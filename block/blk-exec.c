@@ -5,6 +5,7 @@
 #include <linux/module.h>
 #include <linux/bio.h>
 #include <linux/blkdev.h>
+#include <linux/blk-mq.h>
 #include <linux/sched/sysctl.h>
 
 #include "blk.h"
@@ -65,6 +66,17 @@ void blk_execute_rq_nowait(struct request_queue *q, struct gendisk *bd_disk,
 	 */
 	is_pm_resume = rq->cmd_type == REQ_TYPE_PM_RESUME;
 
+	if (q->mq_ops) {
+		if (unlikely(blk_queue_dying(q))) {
+			rq->errors = -ENXIO;
+			if (rq->end_io)
+				rq->end_io(rq, rq->errors);
+			return;
+		}
+		blk_mq_insert_request(rq, true, false);
+		return;
+	}
+
 	spin_lock_irq(q->queue_lock);
 
 	if (unlikely(blk_queue_dying(q))) {
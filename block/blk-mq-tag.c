@@ -0,0 +1,205 @@
+/*
+ * Tag allocation for blk-mq hardware queues
+ *
+ * A hardware queue has a fixed number of tags, each naming one of its
+ * preallocated requests.  Free tags are the clear bits of a bitmap that
+ * is searched and claimed with atomic bitops, starting at a per-cpu hint,
+ * so submitters on different CPUs normally touch different words and
+ * never share a lock.  The first @reserved_tags tags are kept for callers
+ * that must not wait behind regular I/O.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/bitops.h>
+#include <linux/bitmap.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+#include <linux/wait.h>
+#include <linux/sched.h>
+
+#include <linux/blk-mq.h>
+#include "blk-mq.h"
+
+struct blk_mq_tags {
+	unsigned int		nr_tags;
+	unsigned int		nr_reserved_tags;
+	unsigned int __percpu	*hint;		/* where to start looking */
+	unsigned long		*map;		/* set bit: tag in use */
+	/* waiting for a free tag: [0] regular, [1] reserved */
+	wait_queue_head_t	wait[2];
+};
+
+/* claim a clear bit in [start, end), beginning at this CPU's hint */
+static unsigned int __blk_mq_get_tag(struct blk_mq_tags *tags,
+				     unsigned int start, unsigned int end)
+{
+	unsigned int hint, tag;
+
+	hint = this_cpu_read(*tags->hint);
+	if (hint < start || hint >= end)
+		hint = start;
+
+	tag = hint;
+	for (;;) {
+		tag = find_next_zero_bit(tags->map, end, tag);
+		if (tag >= end) {
+			if (hint == start)
+				return BLK_MQ_TAG_FAIL;
+			/* wrap around once and look below the hint */
+			end = hint;
+			hint = tag = start;
+			continue;
+		}
+		if (!test_and_set_bit_lock(tag, tags->map))
+			break;
+		tag++;
+	}
+
+	this_cpu_write(*tags->hint, tag + 1);
+	return tag;
+}
+
+static unsigned int blk_mq_try_get_tag(struct blk_mq_tags *tags, bool reserved)
+{
+	if (reserved)
+		return __blk_mq_get_tag(tags, 0, tags->nr_reserved_tags);
+	return __blk_mq_get_tag(tags, tags->nr_reserved_tags, tags->nr_tags);
+}
+
+/**
+ * blk_mq_get_tag - allocate a tag
+ * @tags: tag set of the hardware queue
+ * @gfp: allocation mask, sleep for a free tag if it contains __GFP_WAIT
+ * @reserved: allocate from the reserved tags
+ *
+ * Returns the tag, or %BLK_MQ_TAG_FAIL if none was free and @gfp does
+ * not allow waiting for one.
+ */
+unsigned int blk_mq_get_tag(struct blk_mq_tags *tags, gfp_t gfp,
+			    bool reserved)
+{
+	unsigned int tag;
+	DEFINE_WAIT(wait);
+
+	if (reserved && !tags->nr_reserved_tags) {
+		WARN_ON_ONCE(1);
+		return BLK_MQ_TAG_FAIL;
+	}
+
+	tag = blk_mq_try_get_tag(tags, reserved);
+	if (tag != BLK_MQ_TAG_FAIL || !(gfp & __GFP_WAIT))
+		return tag;
+
+	for (;;) {
+		prepare_to_wait_exclusive(&tags->wait[reserved], &wait,
+					  TASK_UNINTERRUPTIBLE);
+		tag = blk_mq_try_get_tag(tags, reserved);
+		if (tag != BLK_MQ_TAG_FAIL)
+			break;
+		io_schedule();
+	}
+	finish_wait(&tags->wait[reserved], &wait);
+
+	return tag;
+}
+
+/**
+ * blk_mq_put_tag - free a tag
+ * @tags: tag set of the hardware queue
+ * @tag: tag returned by blk_mq_get_tag()
+ *
+ * May be called from any context.
+ */
+void blk_mq_put_tag(struct blk_mq_tags *tags, unsigned int tag)
+{
+	wait_queue_head_t *wq = &tags->wait[tag < tags->nr_reserved_tags];
+
+	BUG_ON(tag >= tags->nr_tags);
+
+	clear_bit_unlock(tag, tags->map);
+
+	/* pairs with the barrier in prepare_to_wait_exclusive() */
+	smp_mb__after_clear_bit();
+	if (waitqueue_active(wq))
+		wake_up(wq);
+}
+
+/**
+ * blk_mq_tags_busy - check for allocated tags
+ * @tags: tag set of the hardware queue
+ */
+bool blk_mq_tags_busy(struct blk_mq_tags *tags)
+{
+	return !bitmap_empty(tags->map, tags->nr_tags);
+}
+
+/**
+ * blk_mq_tag_busy_iter - call a function for each allocated tag
+ * @tags: tag set of the hardware queue
+ * @fn: function to call
+ * @data: passed to @fn
+ *
+ * This is a snapshot: tags may be freed and allocated again while it
+ * runs, @fn has to cope with that.
+ */
+void blk_mq_tag_busy_iter(struct blk_mq_tags *tags,
+			  void (*fn)(void *data, unsigned int tag), void *data)
+{
+	unsigned int tag;
+
+	for_each_set_bit(tag, tags->map, tags->nr_tags)
+		fn(data, tag);
+}
+
+struct blk_mq_tags *blk_mq_init_tags(unsigned int nr_tags,
+				     unsigned int reserved_tags, int node)
+{
+	struct blk_mq_tags *tags;
+	unsigned int cpu;
+
+	if (reserved_tags >= nr_tags) {
+		pr_err("blk-mq: %u reserved tags leave none of %u for I/O\n",
+		       reserved_tags, nr_tags);
+		return NULL;
+	}
+
+	tags = kzalloc_node(sizeof(*tags), GFP_KERNEL, node);
+	if (!tags)
+		return NULL;
+
+	tags->map = kzalloc_node(BITS_TO_LONGS(nr_tags) * sizeof(long),
+				 GFP_KERNEL, node);
+	if (!tags->map)
+		goto err_free_tags;
+
+	tags->hint = alloc_percpu(unsigned int);
+	if (!tags->hint)
+		goto err_free_map;
+
+	tags->nr_tags = nr_tags;
+	tags->nr_reserved_tags = reserved_tags;
+	init_waitqueue_head(&tags->wait[0]);
+	init_waitqueue_head(&tags->wait[1]);
+
+	/* spread the CPUs' starting points over the regular tags */
+	for_each_possible_cpu(cpu)
+		*per_cpu_ptr(tags->hint, cpu) = reserved_tags +
+			cpu * (nr_tags - reserved_tags) / nr_cpu_ids;
+
+	return tags;
+
+err_free_map:
+	kfree(tags->map);
+err_free_tags:
+	kfree(tags);
+	return NULL;
+}
+
+void blk_mq_free_tags(struct blk_mq_tags *tags)
+{
+	if (!tags)
+		return;
+	free_percpu(tags->hint);
+	kfree(tags->map);
+	kfree(tags);
+}
@@ -0,0 +1,836 @@
+/*
+ * Multi-queue block layer
+ *
+ * Bios are turned into requests on per-cpu software queues (struct
+ * blk_mq_ctx) and handed to the driver through one or more hardware
+ * queues (struct blk_mq_hw_ctx), each CPU mapping to exactly one of
+ * them.  Requests are preallocated per hardware queue and named by a tag
+ * (blk-mq-tag.c).  Submission takes only the lock of the local software
+ * queue, completion takes none: q->queue_lock and the elevator are not
+ * used at all.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/bio.h>
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+#include <linux/cpu.h>
+#include <linux/delay.h>
+#include <linux/init.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+#include <linux/smp.h>
+#include <linux/workqueue.h>
+
+#include <trace/events/block.h>
+
+#include "blk.h"
+#include "blk-mq.h"
+
+/* how far back a new bio looks for a request to merge with */
+#define BLK_MQ_MERGE_DEPTH	8
+
+static bool blk_mq_hctx_has_pending(struct blk_mq_hw_ctx *hctx)
+{
+	return find_first_bit(hctx->ctx_map, hctx->nr_ctx) != hctx->nr_ctx ||
+		!list_empty_careful(&hctx->dispatch);
+}
+
+static void blk_mq_hctx_mark_pending(struct blk_mq_hw_ctx *hctx,
+				     struct blk_mq_ctx *ctx)
+{
+	if (!test_bit(ctx->index_hw, hctx->ctx_map))
+		set_bit(ctx->index_hw, hctx->ctx_map);
+}
+
+/**
+ * blk_mq_map_queue - default cpu to hardware queue mapping
+ * @q: the queue
+ * @cpu: the cpu
+ *
+ * Uses the map built by blk_mq_init_queue(), which gives neighbouring
+ * CPUs the same hardware queue.
+ */
+struct blk_mq_hw_ctx *blk_mq_map_queue(struct request_queue *q, const int cpu)
+{
+	return q->queue_hw_ctx[q->mq_map[cpu]];
+}
+EXPORT_SYMBOL(blk_mq_map_queue);
+
+static struct request *__blk_mq_alloc_request(struct request_queue *q,
+					      int rw, gfp_t gfp, bool reserved)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	struct request *rq;
+	unsigned int tag;
+
+	ctx = blk_mq_get_ctx(q);
+	hctx = q->mq_ops->map_queue(q, ctx->cpu);
+	blk_mq_put_ctx(ctx);
+
+	/*
+	 * This may sleep and wake up on another CPU.  The request stays
+	 * with @ctx all the same: its tag belongs to the hardware queue
+	 * @ctx maps to, and that is where it has to go back on free.
+	 */
+	tag = blk_mq_get_tag(hctx->tags, gfp, reserved);
+	if (tag == BLK_MQ_TAG_FAIL)
+		return NULL;
+
+	rq = hctx->rqs[tag];
+	blk_rq_init(q, rq);
+	rq->tag = tag;
+	rq->mq_ctx = ctx;
+	rq->cmd_flags = rw;
+	if (blk_queue_io_stat(q))
+		rq->cmd_flags |= REQ_IO_STAT;
+
+	return rq;
+}
+
+/**
+ * blk_mq_alloc_request - allocate a request on a blk-mq queue
+ * @q: the queue
+ * @rw: request flags, at least the data direction
+ * @gfp: sleep for a free tag if it contains __GFP_WAIT
+ * @reserved: allocate from the tags set aside by blk_mq_reg.reserved_tags
+ */
+struct request *blk_mq_alloc_request(struct request_queue *q, int rw,
+				     gfp_t gfp, bool reserved)
+{
+	if (unlikely(blk_queue_dying(q)))
+		return NULL;
+
+	return __blk_mq_alloc_request(q, rw, gfp, reserved);
+}
+EXPORT_SYMBOL(blk_mq_alloc_request);
+
+/**
+ * blk_mq_free_request - free a request and its tag
+ * @rq: the request
+ *
+ * May be called from any context.
+ */
+void blk_mq_free_request(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+	struct blk_mq_hw_ctx *hctx = q->mq_ops->map_queue(q, rq->mq_ctx->cpu);
+
+	clear_bit(REQ_ATOM_STARTED, &rq->atomic_flags);
+	blk_mq_put_tag(hctx->tags, rq->tag);
+}
+EXPORT_SYMBOL(blk_mq_free_request);
+
+/**
+ * blk_mq_end_io - end all of a request
+ * @rq: the request
+ * @error: 0 or a negative errno, passed to every bio of @rq
+ *
+ * Completes the bios of @rq, accounts it and calls its ->end_io, or frees
+ * it if there is none.  May be called from any context.
+ */
+void blk_mq_end_io(struct request *rq, int error)
+{
+	blk_update_request(rq, error, blk_rq_bytes(rq));
+	blk_account_io_done(rq);
+
+	if (rq->end_io)
+		rq->end_io(rq, error);
+	else
+		blk_mq_free_request(rq);
+}
+EXPORT_SYMBOL(blk_mq_end_io);
+
+static void __blk_mq_complete_request(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+
+	if (q->mq_ops->complete)
+		q->mq_ops->complete(rq);
+	else
+		blk_mq_end_io(rq, rq->errors);
+}
+
+#if defined(CONFIG_SMP) && defined(CONFIG_USE_GENERIC_SMP_HELPERS)
+static void blk_mq_complete_request_remote(void *data)
+{
+	__blk_mq_complete_request(data);
+}
+
+/* finish on the submitting CPU, where the bio's data is still cache hot */
+static bool blk_mq_complete_remote(struct request *rq)
+{
+	int cpu = rq->mq_ctx->cpu;
+	bool remote = false;
+
+	if (!test_bit(QUEUE_FLAG_SAME_COMP, &rq->q->queue_flags))
+		return false;
+
+	if (cpu != get_cpu() && cpu_online(cpu)) {
+		rq->csd.func = blk_mq_complete_request_remote;
+		rq->csd.info = rq;
+		rq->csd.flags = 0;
+		__smp_call_function_single(cpu, &rq->csd, 0);
+		remote = true;
+	}
+	put_cpu();
+
+	return remote;
+}
+#else
+static bool blk_mq_complete_remote(struct request *rq)
+{
+	return false;
+}
+#endif
+
+/**
+ * blk_mq_complete_request - end a request from the driver's completion path
+ * @rq: the request
+ *
+ * Claims @rq against the timeout handler, then finishes it through
+ * ->complete (blk_mq_end_io() by default) on the CPU that submitted it
+ * if the queue asks for that.  Meant for hard or soft interrupt context.
+ */
+void blk_mq_complete_request(struct request *rq)
+{
+	if (blk_mark_rq_complete(rq))
+		return;
+
+	if (!blk_mq_complete_remote(rq))
+		__blk_mq_complete_request(rq);
+}
+EXPORT_SYMBOL(blk_mq_complete_request);
+
+/*
+ * Timeouts.  A timer is only armed if the driver has a ->timeout handler,
+ * since there is nothing else to do when a request expires.
+ */
+static void blk_mq_add_timer(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+	unsigned long expiry;
+
+	rq->deadline = jiffies + q->rq_timeout;
+	if (!q->mq_ops->timeout)
+		return;
+
+	/* racy, but an update lost here is made up for by the next scan */
+	expiry = round_jiffies_up(rq->deadline);
+	if (!timer_pending(&q->timeout) ||
+	    time_before(expiry, q->timeout.expires))
+		mod_timer(&q->timeout, expiry);
+}
+
+static void blk_mq_start_request(struct blk_mq_hw_ctx *hctx,
+				 struct request *rq)
+{
+	struct request_queue *q = hctx->queue;
+
+	trace_block_rq_issue(q, rq);
+
+	blk_mq_add_timer(rq);
+	set_bit(REQ_ATOM_STARTED, &rq->atomic_flags);
+}
+
+/* the driver bounced @rq, it is no longer in flight */
+static void blk_mq_requeue_request(struct request *rq)
+{
+	trace_block_rq_requeue(rq->q, rq);
+	clear_bit(REQ_ATOM_STARTED, &rq->atomic_flags);
+}
+
+struct blk_mq_timeout_data {
+	struct blk_mq_hw_ctx *hctx;
+	unsigned long next;
+	bool next_set;
+};
+
+static void blk_mq_rq_timed_out(struct request *rq)
+{
+	switch (rq->q->mq_ops->timeout(rq)) {
+	case BLK_EH_HANDLED:
+		__blk_mq_complete_request(rq);
+		break;
+	case BLK_EH_RESET_TIMER:
+		blk_mq_add_timer(rq);
+		blk_clear_rq_complete(rq);
+		break;
+	case BLK_EH_NOT_HANDLED:
+		/* the driver will end it with blk_mq_end_io() */
+		break;
+	default:
+		printk(KERN_ERR "block: bad eh return\n");
+		break;
+	}
+}
+
+static void blk_mq_check_expired(void *data, unsigned int tag)
+{
+	struct blk_mq_timeout_data *td = data;
+	struct request *rq = td->hctx->rqs[tag];
+
+	if (!test_bit(REQ_ATOM_STARTED, &rq->atomic_flags))
+		return;
+
+	if (time_after_eq(jiffies, rq->deadline)) {
+		if (!blk_mark_rq_complete(rq))
+			blk_mq_rq_timed_out(rq);
+	} else if (!td->next_set || time_after(td->next, rq->deadline)) {
+		td->next = rq->deadline;
+		td->next_set = true;
+	}
+}
+
+static void blk_mq_rq_timer(unsigned long data)
+{
+	struct request_queue *q = (struct request_queue *) data;
+	struct blk_mq_timeout_data td = { .next_set = false };
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		td.hctx = hctx;
+		blk_mq_tag_busy_iter(hctx->tags, blk_mq_check_expired, &td);
+	}
+
+	if (td.next_set)
+		mod_timer(&q->timeout, round_jiffies_up(td.next));
+}
+
+/*
+ * Submission
+ */
+static bool blk_mq_attempt_merge(struct request_queue *q,
+				 struct blk_mq_ctx *ctx, struct bio *bio)
+{
+	struct request *rq;
+	int checked = BLK_MQ_MERGE_DEPTH;
+
+	list_for_each_entry_reverse(rq, &ctx->rq_list, queuelist) {
+		int el_ret;
+
+		if (!checked--)
+			break;
+
+		if (!blk_rq_merge_ok(rq, bio))
+			continue;
+
+		el_ret = blk_try_merge(rq, bio);
+		if (el_ret == ELEVATOR_BACK_MERGE)
+			return bio_attempt_back_merge(q, rq, bio);
+		else if (el_ret == ELEVATOR_FRONT_MERGE)
+			return bio_attempt_front_merge(q, rq, bio);
+	}
+
+	return false;
+}
+
+static void __blk_mq_insert_request(struct blk_mq_hw_ctx *hctx,
+				    struct request *rq)
+{
+	struct blk_mq_ctx *ctx = rq->mq_ctx;
+
+	trace_block_rq_insert(hctx->queue, rq);
+
+	list_add_tail(&rq->queuelist, &ctx->rq_list);
+	blk_mq_hctx_mark_pending(hctx, ctx);
+}
+
+/**
+ * blk_mq_insert_request - queue a prepared request
+ * @rq: request from blk_mq_alloc_request()
+ * @run_queue: run the hardware queue afterwards
+ * @async: run it from kblockd rather than from the caller
+ *
+ * Must be called from process context.
+ */
+void blk_mq_insert_request(struct request *rq, bool run_queue, bool async)
+{
+	struct request_queue *q = rq->q;
+	struct blk_mq_ctx *ctx = rq->mq_ctx;
+	struct blk_mq_hw_ctx *hctx = q->mq_ops->map_queue(q, ctx->cpu);
+
+	spin_lock(&ctx->lock);
+	__blk_mq_insert_request(hctx, rq);
+	spin_unlock(&ctx->lock);
+
+	if (run_queue)
+		blk_mq_run_hw_queue(hctx, async);
+}
+EXPORT_SYMBOL(blk_mq_insert_request);
+
+static void blk_mq_make_request(struct request_queue *q, struct bio *bio)
+{
+	const int is_sync = rw_is_sync(bio->bi_rw);
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	struct request *rq;
+	int rw_flags;
+
+	blk_queue_bounce(q, &bio);
+
+	if (bio_integrity_enabled(bio) && bio_integrity_prep(bio)) {
+		bio_endio(bio, -EIO);
+		return;
+	}
+
+	if (unlikely(blk_queue_dying(q))) {
+		bio_endio(bio, -ENODEV);
+		return;
+	}
+
+	ctx = blk_mq_get_ctx(q);
+	hctx = q->mq_ops->map_queue(q, ctx->cpu);
+
+	if ((hctx->flags & BLK_MQ_F_SHOULD_MERGE) && !blk_queue_nomerges(q)) {
+		bool merged;
+
+		spin_lock(&ctx->lock);
+		merged = blk_mq_attempt_merge(q, ctx, bio);
+		spin_unlock(&ctx->lock);
+
+		if (merged) {
+			blk_mq_put_ctx(ctx);
+			return;
+		}
+	}
+	blk_mq_put_ctx(ctx);
+
+	rw_flags = bio_data_dir(bio);
+	if (is_sync)
+		rw_flags |= REQ_SYNC;
+
+	trace_block_getrq(q, bio, rw_flags);
+	rq = __blk_mq_alloc_request(q, rw_flags, GFP_NOIO, false);
+
+	init_request_from_bio(rq, bio);
+	drive_stat_acct(rq, 1);
+
+	/*
+	 * Flush and FUA are passed down as request flags for the driver to
+	 * honour, there is no flush sequencing on these queues.  Sync I/O
+	 * is dispatched right away from the submitting context, the rest
+	 * from kblockd, which leaves a window for more bios to merge.
+	 */
+	blk_mq_insert_request(rq, true, !is_sync);
+}
+
+/*
+ * Dispatch
+ */
+static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	struct request_queue *q = hctx->queue;
+	struct blk_mq_ctx *ctx;
+	struct request *rq;
+	LIST_HEAD(rq_list);
+	unsigned int bit;
+	int ret = BLK_MQ_RQ_QUEUE_OK;
+
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
+		return;
+
+	/* pull every software queue that has something pending */
+	for_each_set_bit(bit, hctx->ctx_map, hctx->nr_ctx) {
+		clear_bit(bit, hctx->ctx_map);
+		ctx = hctx->ctxs[bit];
+
+		spin_lock(&ctx->lock);
+		list_splice_tail_init(&ctx->rq_list, &rq_list);
+		spin_unlock(&ctx->lock);
+	}
+
+	/* requests the driver bounced last time go first */
+	if (!list_empty_careful(&hctx->dispatch)) {
+		spin_lock(&hctx->lock);
+		list_splice_init(&hctx->dispatch, &rq_list);
+		spin_unlock(&hctx->lock);
+	}
+
+	while (!list_empty(&rq_list)) {
+		rq = list_first_entry(&rq_list, struct request, queuelist);
+		list_del_init(&rq->queuelist);
+
+		blk_mq_start_request(hctx, rq);
+
+		ret = q->mq_ops->queue_rq(hctx, rq);
+		if (ret == BLK_MQ_RQ_QUEUE_OK)
+			continue;
+		if (ret == BLK_MQ_RQ_QUEUE_BUSY) {
+			blk_mq_requeue_request(rq);
+			list_add(&rq->queuelist, &rq_list);
+			break;
+		}
+
+		if (ret != BLK_MQ_RQ_QUEUE_ERROR)
+			pr_err("blk-mq: bad return on queue: %d\n", ret);
+		rq->errors = -EIO;
+		blk_mq_end_io(rq, rq->errors);
+	}
+
+	/* keep what the driver could not take for the next run */
+	if (!list_empty(&rq_list)) {
+		spin_lock(&hctx->lock);
+		list_splice(&rq_list, &hctx->dispatch);
+		spin_unlock(&hctx->lock);
+	}
+}
+
+static void blk_mq_work_fn(struct work_struct *work)
+{
+	struct blk_mq_hw_ctx *hctx;
+
+	hctx = container_of(work, struct blk_mq_hw_ctx, delayed_work.work);
+	__blk_mq_run_hw_queue(hctx);
+}
+
+/**
+ * blk_mq_run_hw_queue - hand pending requests to the driver
+ * @hctx: the hardware queue
+ * @async: run it from kblockd rather than from the caller
+ *
+ * A synchronous run calls ->queue_rq from the caller, which must then be
+ * in process context.  Runs of the same queue may overlap on different
+ * CPUs; each of them dispatches different requests.
+ */
+void blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx, bool async)
+{
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
+		return;
+
+	if (!async)
+		__blk_mq_run_hw_queue(hctx);
+	else
+		kblockd_schedule_delayed_work(hctx->queue,
+					      &hctx->delayed_work, 0);
+}
+EXPORT_SYMBOL(blk_mq_run_hw_queue);
+
+void blk_mq_run_queues(struct request_queue *q, bool async)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (!blk_mq_hctx_has_pending(hctx))
+			continue;
+		blk_mq_run_hw_queue(hctx, async);
+	}
+}
+EXPORT_SYMBOL(blk_mq_run_queues);
+
+/**
+ * blk_mq_stop_hw_queue - stop dispatching to the driver
+ * @hctx: the hardware queue
+ *
+ * For drivers that ran out of resources; requests keep being queued and
+ * are dispatched once the queue is started again.
+ */
+void blk_mq_stop_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	cancel_delayed_work(&hctx->delayed_work);
+	set_bit(BLK_MQ_S_STOPPED, &hctx->state);
+}
+EXPORT_SYMBOL(blk_mq_stop_hw_queue);
+
+/* must be called from process context, see blk_mq_run_hw_queue() */
+void blk_mq_start_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	clear_bit(BLK_MQ_S_STOPPED, &hctx->state);
+	__blk_mq_run_hw_queue(hctx);
+}
+EXPORT_SYMBOL(blk_mq_start_hw_queue);
+
+void blk_mq_stop_hw_queues(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i)
+		blk_mq_stop_hw_queue(hctx);
+}
+EXPORT_SYMBOL(blk_mq_stop_hw_queues);
+
+void blk_mq_start_stopped_hw_queues(struct request_queue *q, bool async)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (!test_bit(BLK_MQ_S_STOPPED, &hctx->state))
+			continue;
+
+		clear_bit(BLK_MQ_S_STOPPED, &hctx->state);
+		blk_mq_run_hw_queue(hctx, async);
+	}
+}
+EXPORT_SYMBOL(blk_mq_start_stopped_hw_queues);
+
+/*
+ * Queue setup and teardown
+ */
+static bool blk_mq_queue_busy(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i)
+		if (blk_mq_tags_busy(hctx->tags))
+			return true;
+	return false;
+}
+
+/* wait for every allocated request to be freed, @q must be dying */
+void blk_mq_drain_queue(struct request_queue *q)
+{
+	for (;;) {
+		blk_mq_run_queues(q, false);
+		if (!blk_mq_queue_busy(q))
+			break;
+		msleep(10);
+	}
+}
+
+void blk_mq_sync_queue(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i)
+		cancel_delayed_work_sync(&hctx->delayed_work);
+}
+
+/* give neighbouring CPUs, on ARM the CPUs of one cluster, one queue */
+static unsigned int *blk_mq_make_queue_map(struct blk_mq_reg *reg)
+{
+	unsigned int *map;
+	unsigned int cpu;
+
+	map = kzalloc_node(sizeof(*map) * nr_cpu_ids, GFP_KERNEL,
+			   reg->numa_node);
+	if (!map)
+		return NULL;
+
+	for_each_possible_cpu(cpu)
+		map[cpu] = cpu * reg->nr_hw_queues / nr_cpu_ids;
+
+	return map;
+}
+
+static void blk_mq_free_rq_map(struct blk_mq_hw_ctx *hctx)
+{
+	unsigned int i;
+
+	if (hctx->rqs)
+		for (i = 0; i < hctx->queue_depth; i++)
+			kfree(hctx->rqs[i]);
+	kfree(hctx->rqs);
+	blk_mq_free_tags(hctx->tags);
+}
+
+static int blk_mq_init_rq_map(struct blk_mq_hw_ctx *hctx,
+			      struct blk_mq_reg *reg)
+{
+	/* driver data follows the request, see blk_mq_rq_to_pdu() */
+	size_t rq_size = sizeof(struct request) + reg->cmd_size;
+	unsigned int i;
+
+	hctx->tags = blk_mq_init_tags(reg->queue_depth, reg->reserved_tags,
+				      reg->numa_node);
+	if (!hctx->tags)
+		return -ENOMEM;
+
+	hctx->rqs = kzalloc_node(reg->queue_depth * sizeof(struct request *),
+				 GFP_KERNEL, reg->numa_node);
+	if (!hctx->rqs)
+		return -ENOMEM;
+
+	for (i = 0; i < reg->queue_depth; i++) {
+		hctx->rqs[i] = kzalloc_node(rq_size, GFP_KERNEL,
+					    reg->numa_node);
+		if (!hctx->rqs[i])
+			return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static void blk_mq_free_hw_queues(struct request_queue *q,
+				  unsigned int nr_init)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (i < nr_init && q->mq_ops->exit_hctx)
+			q->mq_ops->exit_hctx(hctx, i);
+		blk_mq_free_rq_map(hctx);
+		kfree(hctx->ctx_map);
+		kfree(hctx->ctxs);
+	}
+}
+
+static int blk_mq_init_hw_queues(struct request_queue *q,
+				 struct blk_mq_reg *reg, void *driver_data)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		INIT_DELAYED_WORK(&hctx->delayed_work, blk_mq_work_fn);
+		spin_lock_init(&hctx->lock);
+		INIT_LIST_HEAD(&hctx->dispatch);
+		hctx->queue = q;
+		hctx->queue_num = i;
+		hctx->flags = reg->flags;
+		hctx->queue_depth = reg->queue_depth;
+		hctx->cmd_size = reg->cmd_size;
+
+		hctx->ctxs = kmalloc_node(nr_cpu_ids * sizeof(void *),
+					  GFP_KERNEL, reg->numa_node);
+		hctx->ctx_map = kzalloc_node(BITS_TO_LONGS(nr_cpu_ids) *
+					     sizeof(long), GFP_KERNEL,
+					     reg->numa_node);
+		if (!hctx->ctxs || !hctx->ctx_map)
+			goto err;
+
+		if (blk_mq_init_rq_map(hctx, reg))
+			goto err;
+
+		if (reg->ops->init_hctx &&
+		    reg->ops->init_hctx(hctx, driver_data, i))
+			goto err;
+	}
+
+	return 0;
+
+err:
+	blk_mq_free_hw_queues(q, i);
+	return -ENOMEM;
+}
+
+static void blk_mq_init_cpu_queues(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct blk_mq_ctx *ctx = __blk_mq_get_ctx(q, cpu);
+
+		memset(ctx, 0, sizeof(*ctx));
+		spin_lock_init(&ctx->lock);
+		INIT_LIST_HEAD(&ctx->rq_list);
+		ctx->cpu = cpu;
+		ctx->queue = q;
+
+		/*
+		 * The map is static: the software queue of a CPU that goes
+		 * offline keeps being served by its hardware queue, so the
+		 * requests left on it are not lost.
+		 */
+		hctx = q->mq_ops->map_queue(q, cpu);
+		ctx->index_hw = hctx->nr_ctx;
+		hctx->ctxs[hctx->nr_ctx++] = ctx;
+	}
+}
+
+/**
+ * blk_mq_init_queue - set up a multi-queue request queue
+ * @reg: queue geometry and driver operations
+ * @driver_data: passed to ->init_hctx
+ *
+ * Returns the queue or an ERR_PTR().  It is torn down like any other
+ * queue, with blk_cleanup_queue().
+ */
+struct request_queue *blk_mq_init_queue(struct blk_mq_reg *reg,
+					void *driver_data)
+{
+	struct blk_mq_hw_ctx **hctxs;
+	struct request_queue *q;
+	int i;
+
+	if (!reg->nr_hw_queues || !reg->ops->queue_rq ||
+	    !reg->ops->map_queue || !reg->queue_depth ||
+	    reg->queue_depth > BLK_MQ_MAX_DEPTH ||
+	    reg->reserved_tags >= reg->queue_depth)
+		return ERR_PTR(-EINVAL);
+
+	if (reg->nr_hw_queues > nr_cpu_ids)
+		reg->nr_hw_queues = nr_cpu_ids;
+
+	hctxs = kzalloc_node(reg->nr_hw_queues * sizeof(*hctxs), GFP_KERNEL,
+			     reg->numa_node);
+	if (!hctxs)
+		return ERR_PTR(-ENOMEM);
+
+	for (i = 0; i < reg->nr_hw_queues; i++) {
+		hctxs[i] = kzalloc_node(sizeof(struct blk_mq_hw_ctx),
+					GFP_KERNEL, reg->numa_node);
+		if (!hctxs[i])
+			goto err_hctxs;
+	}
+
+	q = blk_alloc_queue_node(GFP_KERNEL, reg->numa_node);
+	if (!q)
+		goto err_hctxs;
+
+	q->mq_map = blk_mq_make_queue_map(reg);
+	if (!q->mq_map)
+		goto err_queue;
+
+	q->queue_ctx = alloc_percpu(struct blk_mq_ctx);
+	if (!q->queue_ctx)
+		goto err_map;
+
+	q->mq_ops = reg->ops;
+	q->nr_queues = nr_cpu_ids;
+	q->queue_hw_ctx = hctxs;
+	q->nr_hw_queues = reg->nr_hw_queues;
+
+	blk_queue_make_request(q, blk_mq_make_request);
+	setup_timer(&q->timeout, blk_mq_rq_timer, (unsigned long) q);
+	blk_queue_rq_timeout(q, reg->timeout ? reg->timeout : 30 * HZ);
+
+	if (blk_mq_init_hw_queues(q, reg, driver_data))
+		goto err_ctx;
+
+	blk_mq_init_cpu_queues(q);
+
+	return q;
+
+err_ctx:
+	/* the hardware queues are torn down, don't let release find them */
+	q->mq_ops = NULL;
+	q->nr_hw_queues = 0;
+	free_percpu(q->queue_ctx);
+err_map:
+	kfree(q->mq_map);
+err_queue:
+	blk_cleanup_queue(q);
+err_hctxs:
+	for (i = 0; i < reg->nr_hw_queues; i++)
+		kfree(hctxs[i]);
+	kfree(hctxs);
+	return ERR_PTR(-ENOMEM);
+}
+EXPORT_SYMBOL(blk_mq_init_queue);
+
+/* called on the final put of the queue, from blk_release_queue() */
+void blk_mq_free_queue(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	blk_mq_free_hw_queues(q, q->nr_hw_queues);
+	queue_for_each_hw_ctx(q, hctx, i)
+		kfree(hctx);
+	free_percpu(q->queue_ctx);
+	kfree(q->queue_hw_ctx);
+	kfree(q->mq_map);
+
+	q->queue_ctx = NULL;
+	q->queue_hw_ctx = NULL;
+	q->mq_map = NULL;
+}
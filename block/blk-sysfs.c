@@ -9,6 +9,7 @@
 #include <linux/blktrace_api.h>
 
 #include "blk.h"
+#include "blk-mq.h"
 #include "blk-cgroup.h"
 
 struct queue_sysfs_entry {
@@ -537,6 +538,9 @@ static void blk_release_queue(struct kobject *kobj)
 		elevator_exit(q->elevator);
 	}
 
+	if (q->mq_ops)
+		blk_mq_free_queue(q);
+
 	blk_exit_rl(&q->root_rl);
 
 	if (q->queue_tags)
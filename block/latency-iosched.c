@@ -0,0 +1,585 @@
+/*
+ *  Latency-targeted i/o scheduler.
+ *
+ *  Reads, sync writes, async writes and background i/o are queued
+ *  separately and served in that order, each with a fifo deadline.  Async
+ *  writes and background i/o are throttled: the number of them at the
+ *  device is limited, and that limit is halved whenever foreground reads or
+ *  sync writes complete slower than their target and raised again while
+ *  they are on target.
+ */
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/blkdev.h>
+#include <linux/elevator.h>
+#include <linux/bio.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/init.h>
+#include <linux/compiler.h>
+#include <linux/rbtree.h>
+#include <linux/ioprio.h>
+#include <linux/iocontext.h>
+#include <linux/ktime.h>
+
+/*
+ * See Documentation/block/latency-iosched.txt
+ */
+static const int read_expire = HZ / 4;	/* max time before a read is submitted */
+static const int write_expire = HZ / 2;	/* ditto for sync writes */
+static const int async_expire = 5 * HZ;	/* ditto for async writes */
+static const int bg_expire = 2 * HZ;	/* ditto for background i/o */
+static const int target_read_lat = 5000;	/* usecs */
+static const int target_write_lat = 20000;	/* usecs */
+static const int async_depth_max = 16;	/* max async + background in flight */
+static const int bg_ioprio = 6;		/* BE level from which i/o is background */
+
+/* completion latencies are judged over windows of this many usecs */
+#define LATENCY_WINDOW		100000
+/* a window is over target if more than 1/LATENCY_MISS_FRAC of it missed */
+#define LATENCY_MISS_FRAC	10
+
+enum {
+	LATENCY_READ,		/* foreground reads */
+	LATENCY_SYNC_WRITE,	/* foreground sync writes */
+	LATENCY_ASYNC,		/* async writes (writeback), throttled */
+	LATENCY_BG,		/* anything from background tasks, throttled */
+	LATENCY_NR_CLASSES,
+};
+
+struct latency_data {
+	/*
+	 * run time data
+	 */
+
+	/*
+	 * requests are on the sort_list of their direction, for merging,
+	 * and on the fifo_list of their class, for dispatch
+	 */
+	struct rb_root sort_list[2];
+	struct list_head fifo_list[LATENCY_NR_CLASSES];
+
+	unsigned int throttled_in_flight; /* async + bg at the device */
+	unsigned int async_depth;	/* current limit on the above */
+	bool throttled;			/* dispatch held back by async_depth */
+
+	/* foreground completions in the current window, [READ] and [WRITE] */
+	u32 window_start;
+	unsigned int nr_samples[2];
+	unsigned int nr_missed[2];
+
+	/*
+	 * settings that change how the i/o scheduler behaves
+	 */
+	int fifo_expire[LATENCY_NR_CLASSES];
+	int target_lat[2];
+	int async_depth_max;
+	int bg_ioprio;
+	int front_merges;
+};
+
+static inline int latency_rq_class(struct request *rq)
+{
+	return (unsigned long) rq->elv.priv[1];
+}
+
+static inline bool latency_class_throttled(int class)
+{
+	return class == LATENCY_ASYNC || class == LATENCY_BG;
+}
+
+/*
+ * microseconds, truncated: only ever used for differences shorter than
+ * the ~71 minutes it takes to wrap
+ */
+static inline u32 latency_now(void)
+{
+	return (u32) ktime_to_us(ktime_get());
+}
+
+/*
+ * Background i/o is that of idle class tasks and of best effort tasks at
+ * or below bg_ioprio, which is where nice 10 and above ends up without an
+ * explicit i/o priority.  Called in the context of the submitting task.
+ */
+static bool latency_background(struct latency_data *ld, struct bio *bio)
+{
+	struct io_context *ioc = current->io_context;
+	int ioprio = bio ? bio_prio(bio) : 0;
+	int class, data;
+
+	if (!ioprio_valid(ioprio) && ioc)
+		ioprio = ioc->ioprio;
+
+	if (ioprio_valid(ioprio)) {
+		class = IOPRIO_PRIO_CLASS(ioprio);
+		data = IOPRIO_PRIO_DATA(ioprio);
+	} else {
+		class = task_nice_ioclass(current);
+		data = task_nice_ioprio(current);
+	}
+
+	if (class == IOPRIO_CLASS_IDLE)
+		return true;
+	return class == IOPRIO_CLASS_BE && data >= ld->bg_ioprio;
+}
+
+static int latency_class(struct latency_data *ld, struct bio *bio,
+			 int data_dir, bool sync)
+{
+	if (latency_background(ld, bio))
+		return LATENCY_BG;
+	if (data_dir == READ)
+		return LATENCY_READ;
+	return sync ? LATENCY_SYNC_WRITE : LATENCY_ASYNC;
+}
+
+static int
+latency_set_request(struct request_queue *q, struct request *rq,
+		    struct bio *bio, gfp_t gfp_mask)
+{
+	struct latency_data *ld = q->elevator->elevator_data;
+	int class = latency_class(ld, bio, rq_data_dir(rq), rq_is_sync(rq));
+
+	rq->elv.priv[0] = NULL;
+	rq->elv.priv[1] = (void *) (unsigned long) class;
+	return 0;
+}
+
+/*
+ * add rq to rbtree and fifo
+ */
+static void
+latency_add_request(struct request_queue *q, struct request *rq)
+{
+	struct latency_data *ld = q->elevator->elevator_data;
+	const int class = latency_rq_class(rq);
+
+	elv_rb_add(&ld->sort_list[rq_data_dir(rq)], rq);
+
+	/*
+	 * set expire time and add to fifo list
+	 */
+	rq_set_fifo_time(rq, jiffies + ld->fifo_expire[class]);
+	list_add_tail(&rq->queuelist, &ld->fifo_list[class]);
+}
+
+/*
+ * remove rq from rbtree and fifo.
+ */
+static void latency_remove_request(struct request_queue *q, struct request *rq)
+{
+	struct latency_data *ld = q->elevator->elevator_data;
+
+	rq_fifo_clear(rq);
+	elv_rb_del(&ld->sort_list[rq_data_dir(rq)], rq);
+}
+
+static int
+latency_merge(struct request_queue *q, struct request **req, struct bio *bio)
+{
+	struct latency_data *ld = q->elevator->elevator_data;
+	struct request *__rq;
+
+	/*
+	 * check for front merge
+	 */
+	if (ld->front_merges) {
+		sector_t sector = bio_end_sector(bio);
+
+		__rq = elv_rb_find(&ld->sort_list[bio_data_dir(bio)], sector);
+		if (__rq) {
+			BUG_ON(sector != blk_rq_pos(__rq));
+
+			if (elv_rq_merge_ok(__rq, bio)) {
+				*req = __rq;
+				return ELEVATOR_FRONT_MERGE;
+			}
+		}
+	}
+
+	return ELEVATOR_NO_MERGE;
+}
+
+/*
+ * a bio only joins a request of its own class, or background i/o would
+ * ride along with foreground requests and the other way round
+ */
+static int
+latency_allow_merge(struct request_queue *q, struct request *rq,
+		    struct bio *bio)
+{
+	struct latency_data *ld = q->elevator->elevator_data;
+	int class = latency_class(ld, bio, bio_data_dir(bio),
+				  rw_is_sync(bio->bi_rw));
+
+	return latency_rq_class(rq) == class;
+}
+
+static void latency_merged_request(struct request_queue *q,
+				   struct request *req, int type)
+{
+	struct latency_data *ld = q->elevator->elevator_data;
+
+	/*
+	 * if the merge was a front merge, we need to reposition request
+	 */
+	if (type == ELEVATOR_FRONT_MERGE) {
+		elv_rb_del(&ld->sort_list[rq_data_dir(req)], req);
+		elv_rb_add(&ld->sort_list[rq_data_dir(req)], req);
+	}
+}
+
+static void
+latency_merged_requests(struct request_queue *q, struct request *req,
+			struct request *next)
+{
+	/*
+	 * if next expires before rq, assign its expire time to rq
+	 * and move into next position (next will be deleted) in fifo,
+	 * provided that is the fifo of rq's class
+	 */
+	if (!list_empty(&req->queuelist) && !list_empty(&next->queuelist) &&
+	    latency_rq_class(req) == latency_rq_class(next)) {
+		if (time_before(rq_fifo_time(next), rq_fifo_time(req))) {
+			list_move(&req->queuelist, &next->queuelist);
+			rq_set_fifo_time(req, rq_fifo_time(next));
+		}
+	}
+
+	/*
+	 * kill knowledge of next, this one is a goner
+	 */
+	latency_remove_request(q, next);
+}
+
+/*
+ * latency_may_dispatch returns 1 if class has a request that may go to the
+ * device now, 0 otherwise
+ */
+static int latency_may_dispatch(struct latency_data *ld, int class, int force)
+{
+	if (list_empty(&ld->fifo_list[class]))
+		return 0;
+
+	if (force || !latency_class_throttled(class) ||
+	    ld->throttled_in_flight < ld->async_depth)
+		return 1;
+
+	ld->throttled = true;
+	return 0;
+}
+
+/*
+ * latency_check_fifo returns 0 if there are no expired requests on the fifo,
+ * 1 otherwise. Requires !list_empty(&ld->fifo_list[class])
+ */
+static inline int latency_check_fifo(struct latency_data *ld, int class)
+{
+	struct request *rq = rq_entry_fifo(ld->fifo_list[class].next);
+
+	return time_after_eq(jiffies, rq_fifo_time(rq));
+}
+
+/*
+ * Dispatch the oldest expired request, in class order, and if none has
+ * expired the oldest request of the first class that has one.  Throttled
+ * classes are skipped while async_depth of theirs are at the device,
+ * unless the queue is being drained.
+ */
+static int latency_dispatch_requests(struct request_queue *q, int force)
+{
+	struct latency_data *ld = q->elevator->elevator_data;
+	struct request *rq;
+	int class;
+
+	for (class = 0; class < LATENCY_NR_CLASSES; class++)
+		if (latency_may_dispatch(ld, class, force) &&
+		    latency_check_fifo(ld, class))
+			goto dispatch_request;
+
+	for (class = 0; class < LATENCY_NR_CLASSES; class++)
+		if (latency_may_dispatch(ld, class, force))
+			goto dispatch_request;
+
+	return 0;
+
+dispatch_request:
+	rq = rq_entry_fifo(ld->fifo_list[class].next);
+	if (latency_class_throttled(class))
+		ld->throttled_in_flight++;
+
+	latency_remove_request(q, rq);
+	elv_dispatch_add_tail(q, rq);
+
+	return 1;
+}
+
+static void
+latency_activate_request(struct request_queue *q, struct request *rq)
+{
+	rq->elv.priv[0] = (void *) (unsigned long) (latency_now() ?: 1);
+}
+
+static void
+latency_deactivate_request(struct request_queue *q, struct request *rq)
+{
+	rq->elv.priv[0] = NULL;
+}
+
+/*
+ * Close the window: halve async_depth if more than 1/LATENCY_MISS_FRAC of
+ * the reads or of the sync writes missed their target, otherwise raise it
+ * by one.  Without foreground i/o there is nothing to protect and the full
+ * depth is allowed at once.
+ */
+static void latency_end_window(struct latency_data *ld, u32 now)
+{
+	unsigned int depth = ld->async_depth;
+	int dir;
+
+	if (!ld->nr_samples[READ] && !ld->nr_samples[WRITE]) {
+		depth = ld->async_depth_max;
+		goto out;
+	}
+
+	for (dir = READ; dir <= WRITE; dir++) {
+		if (ld->nr_missed[dir] * LATENCY_MISS_FRAC >
+		    ld->nr_samples[dir]) {
+			depth /= 2;
+			goto out;
+		}
+	}
+	depth++;
+out:
+	ld->async_depth = clamp_t(unsigned int, depth, 1,
+				  ld->async_depth_max);
+	ld->nr_samples[READ] = ld->nr_samples[WRITE] = 0;
+	ld->nr_missed[READ] = ld->nr_missed[WRITE] = 0;
+	ld->window_start = now;
+}
+
+static void
+latency_completed_request(struct request_queue *q, struct request *rq)
+{
+	struct latency_data *ld = q->elevator->elevator_data;
+	const int class = latency_rq_class(rq);
+	u32 start = (unsigned long) rq->elv.priv[0];
+	u32 now = latency_now();
+
+	if (latency_class_throttled(class)) {
+		WARN_ON_ONCE(!ld->throttled_in_flight);
+		if (ld->throttled_in_flight)
+			ld->throttled_in_flight--;
+	} else if (start) {
+		const int dir = rq_data_dir(rq);
+
+		ld->nr_samples[dir]++;
+		if (now - start > ld->target_lat[dir])
+			ld->nr_missed[dir]++;
+	}
+
+	if (now - ld->window_start >= LATENCY_WINDOW)
+		latency_end_window(ld, now);
+
+	/*
+	 * nothing else runs the queue for requests held back by the
+	 * throttle, kick it once there is room for them
+	 */
+	if (ld->throttled && ld->throttled_in_flight < ld->async_depth) {
+		ld->throttled = false;
+		blk_run_queue_async(q);
+	}
+}
+
+static void latency_exit_queue(struct elevator_queue *e)
+{
+	struct latency_data *ld = e->elevator_data;
+	int class;
+
+	for (class = 0; class < LATENCY_NR_CLASSES; class++)
+		BUG_ON(!list_empty(&ld->fifo_list[class]));
+
+	kfree(ld);
+}
+
+/*
+ * initialize elevator private data (latency_data).
+ */
+static int latency_init_queue(struct request_queue *q, struct elevator_type *e)
+{
+	struct latency_data *ld;
+	struct elevator_queue *eq;
+	int class;
+
+	eq = elevator_alloc(q, e);
+	if (!eq)
+		return -ENOMEM;
+
+	ld = kmalloc_node(sizeof(*ld), GFP_KERNEL | __GFP_ZERO, q->node);
+	if (!ld) {
+		kobject_put(&eq->kobj);
+		return -ENOMEM;
+	}
+	eq->elevator_data = ld;
+
+	for (class = 0; class < LATENCY_NR_CLASSES; class++)
+		INIT_LIST_HEAD(&ld->fifo_list[class]);
+	ld->sort_list[READ] = RB_ROOT;
+	ld->sort_list[WRITE] = RB_ROOT;
+	ld->fifo_expire[LATENCY_READ] = read_expire;
+	ld->fifo_expire[LATENCY_SYNC_WRITE] = write_expire;
+	ld->fifo_expire[LATENCY_ASYNC] = async_expire;
+	ld->fifo_expire[LATENCY_BG] = bg_expire;
+	ld->target_lat[READ] = target_read_lat;
+	ld->target_lat[WRITE] = target_write_lat;
+	ld->async_depth_max = async_depth_max;
+	ld->async_depth = async_depth_max;
+	ld->bg_ioprio = bg_ioprio;
+	ld->front_merges = 1;
+	ld->window_start = latency_now();
+
+	spin_lock_irq(q->queue_lock);
+	q->elevator = eq;
+	spin_unlock_irq(q->queue_lock);
+	return 0;
+}
+
+/*
+ * sysfs parts below
+ */
+
+static ssize_t
+latency_var_show(int var, char *page)
+{
+	return sprintf(page, "%d\n", var);
+}
+
+static ssize_t
+latency_var_store(int *var, const char *page, size_t count)
+{
+	char *p = (char *) page;
+
+	*var = simple_strtol(p, &p, 10);
+	return count;
+}
+
+#define SHOW_FUNCTION(__FUNC, __VAR, __CONV)				\
+static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
+{									\
+	struct latency_data *ld = e->elevator_data;			\
+	int __data = __VAR;						\
+	if (__CONV)							\
+		__data = jiffies_to_msecs(__data);			\
+	return latency_var_show(__data, (page));			\
+}
+SHOW_FUNCTION(latency_read_expire_show, ld->fifo_expire[LATENCY_READ], 1);
+SHOW_FUNCTION(latency_write_expire_show, ld->fifo_expire[LATENCY_SYNC_WRITE], 1);
+SHOW_FUNCTION(latency_async_expire_show, ld->fifo_expire[LATENCY_ASYNC], 1);
+SHOW_FUNCTION(latency_bg_expire_show, ld->fifo_expire[LATENCY_BG], 1);
+SHOW_FUNCTION(latency_target_read_lat_show, ld->target_lat[READ], 0);
+SHOW_FUNCTION(latency_target_write_lat_show, ld->target_lat[WRITE], 0);
+SHOW_FUNCTION(latency_async_depth_max_show, ld->async_depth_max, 0);
+SHOW_FUNCTION(latency_async_depth_show, ld->async_depth, 0);
+SHOW_FUNCTION(latency_bg_ioprio_show, ld->bg_ioprio, 0);
+SHOW_FUNCTION(latency_front_merges_show, ld->front_merges, 0);
+#undef SHOW_FUNCTION
+
+#define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
+static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count)	\
+{									\
+	struct latency_data *ld = e->elevator_data;			\
+	int __data;							\
+	int ret = latency_var_store(&__data, (page), count);		\
+	if (__data < (MIN))						\
+		__data = (MIN);						\
+	else if (__data > (MAX))					\
+		__data = (MAX);						\
+	if (__CONV)							\
+		*(__PTR) = msecs_to_jiffies(__data);			\
+	else								\
+		*(__PTR) = __data;					\
+	return ret;							\
+}
+STORE_FUNCTION(latency_read_expire_store, &ld->fifo_expire[LATENCY_READ], 0, INT_MAX, 1);
+STORE_FUNCTION(latency_write_expire_store, &ld->fifo_expire[LATENCY_SYNC_WRITE], 0, INT_MAX, 1);
+STORE_FUNCTION(latency_async_expire_store, &ld->fifo_expire[LATENCY_ASYNC], 0, INT_MAX, 1);
+STORE_FUNCTION(latency_bg_expire_store, &ld->fifo_expire[LATENCY_BG], 0, INT_MAX, 1);
+STORE_FUNCTION(latency_target_read_lat_store, &ld->target_lat[READ], 1, INT_MAX, 0);
+STORE_FUNCTION(latency_target_write_lat_store, &ld->target_lat[WRITE], 1, INT_MAX, 0);
+STORE_FUNCTION(latency_bg_ioprio_store, &ld->bg_ioprio, 0, IOPRIO_BE_NR, 0);
+STORE_FUNCTION(latency_front_merges_store, &ld->front_merges, 0, 1, 0);
+#undef STORE_FUNCTION
+
+/* the current depth must not be left above a lowered maximum */
+static ssize_t
+latency_async_depth_max_store(struct elevator_queue *e, const char *page,
+			      size_t count)
+{
+	struct latency_data *ld = e->elevator_data;
+	int __data;
+	int ret = latency_var_store(&__data, page, count);
+
+	__data = clamp(__data, 1, INT_MAX);
+	ld->async_depth_max = __data;
+	if (ld->async_depth > __data)
+		ld->async_depth = __data;
+	return ret;
+}
+
+#define LD_ATTR(name) \
+	__ATTR(name, S_IRUGO|S_IWUSR, latency_##name##_show, \
+				      latency_##name##_store)
+
+static struct elv_fs_entry latency_attrs[] = {
+	LD_ATTR(read_expire),
+	LD_ATTR(write_expire),
+	LD_ATTR(async_expire),
+	LD_ATTR(bg_expire),
+	LD_ATTR(target_read_lat),
+	LD_ATTR(target_write_lat),
+	LD_ATTR(async_depth_max),
+	__ATTR(async_depth, S_IRUGO, latency_async_depth_show, NULL),
+	LD_ATTR(bg_ioprio),
+	LD_ATTR(front_merges),
+	__ATTR_NULL
+};
+
+static struct elevator_type iosched_latency = {
+	.ops = {
+		.elevator_merge_fn = 		latency_merge,
+		.elevator_merged_fn =		latency_merged_request,
+		.elevator_merge_req_fn =	latency_merged_requests,
+		.elevator_allow_merge_fn =	latency_allow_merge,
+		.elevator_dispatch_fn =		latency_dispatch_requests,
+		.elevator_add_req_fn =		latency_add_request,
+		.elevator_activate_req_fn =	latency_activate_request,
+		.elevator_deactivate_req_fn =	latency_deactivate_request,
+		.elevator_completed_req_fn =	latency_completed_request,
+		.elevator_former_req_fn =	elv_rb_former_request,
+		.elevator_latter_req_fn =	elv_rb_latter_request,
+		.elevator_set_req_fn =		latency_set_request,
+		.elevator_init_fn =		latency_init_queue,
+		.elevator_exit_fn =		latency_exit_queue,
+	},
+
+	.elevator_attrs = latency_attrs,
+	.elevator_name = "latency",
+	.elevator_owner = THIS_MODULE,
+};
+
+static int __init latency_init(void)
+{
+	return elv_register(&iosched_latency);
+}
+
+static void __exit latency_exit(void)
+{
+	elv_unregister(&iosched_latency);
+}
+
+module_init(latency_init);
+module_exit(latency_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("latency-targeted IO scheduler");
@@ -32,6 +32,14 @@
 #include <linux/swap.h>
 #include <linux/mm_types.h>
 #include <linux/dma-contiguous.h>
+#include <linux/workqueue.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+
+#define CREATE_TRACE_POINTS
+#include <trace/events/cma.h>
 
 struct cma {
 	unsigned long	base_pfn;
@@ -40,8 +48,20 @@ struct cma {
 	unsigned long	*bitmap;
 	unsigned long	carved_out_count;
 	bool isolated;
+
+	/* pre-drain request from dma_contiguous_prepare() */
+	struct work_struct	predrain_work;
+	struct delayed_work	predrain_expire;
+	int			predrain_count;
+	unsigned long		predrain_mask;
+	/* range migrated ahead of time, marked in the bitmap but not given out */
+	unsigned long		predrained_pageno;
+	int			predrained_count;
 };
 
+/* how long a pre-drained range is held for the allocation to arrive */
+#define CMA_PREDRAIN_HOLD_MS	2000
+
 struct cma *dma_contiguous_default_area;
 
 #ifdef CONFIG_CMA_SIZE_MBYTES
@@ -137,6 +157,163 @@ void __init dma_contiguous_reserve(phys_addr_t limit)
 
 static DEFINE_MUTEX(cma_mutex);
 
+/*
+ * Allocation latency histograms, bucket b counts allocations that took
+ * [2^b, 2^(b+1)) us.  Protected by cma_mutex.
+ */
+#define CMA_LATENCY_BUCKETS	24
+
+static struct cma_latency {
+	unsigned long	total[CMA_LATENCY_BUCKETS];
+	unsigned long	isolate[CMA_LATENCY_BUCKETS];
+	unsigned long	migrate[CMA_LATENCY_BUCKETS];
+	unsigned long	predrain_requested;
+	unsigned long	predrain_hit;
+	unsigned long	predrain_expired;
+} cma_latency;
+
+static inline int cma_latency_bucket(s64 us)
+{
+	if (us <= 0)
+		return 0;
+
+	return min_t(int, ilog2(us), CMA_LATENCY_BUCKETS - 1);
+}
+
+static void cma_account_latency(struct contig_range_stats *stats, s64 total)
+{
+	cma_latency.total[cma_latency_bucket(total)]++;
+	cma_latency.isolate[cma_latency_bucket(stats->isolate_us)]++;
+	cma_latency.migrate[cma_latency_bucket(stats->migrate_us)]++;
+}
+
+/*
+ * Find and take @count free pages aligned to @mask in @cma, migrating
+ * their current users away unless the area is isolated.  Returns the page
+ * number within the area, or a negative error code.  The time spent is
+ * added to @stats.  Must be called with cma_mutex held.
+ */
+static long cma_alloc_range(struct cma *cma, int count, unsigned long mask,
+			    struct contig_range_stats *stats)
+{
+	struct contig_range_stats range_stats;
+	unsigned long pfn, pageno, start = 0;
+	int ret;
+
+	for (;;) {
+		pageno = bitmap_find_next_zero_area(cma->bitmap, cma->count,
+						    start, count, mask);
+		if (pageno >= cma->count)
+			return -ENOMEM;
+
+		pfn = cma->base_pfn + pageno;
+		if (cma->isolated) {
+			ret = 0;
+		} else {
+			ret = alloc_contig_range_stats(pfn, pfn + count,
+						       MIGRATE_CMA,
+						       &range_stats);
+			stats->isolate_us += range_stats.isolate_us;
+			stats->migrate_us += range_stats.migrate_us;
+		}
+		if (ret == 0) {
+			bitmap_set(cma->bitmap, pageno, count);
+			return pageno;
+		} else if (ret != -EBUSY) {
+			return ret;
+		}
+		pr_debug("%s(): memory range at %p is busy, retrying\n",
+			 __func__, pfn_to_page(pfn));
+		/* try again with a bit different memory target */
+		start = pageno + mask + 1;
+	}
+}
+
+/* Give back pages taken by cma_alloc_range().  Called with cma_mutex held. */
+static void cma_release_range(struct cma *cma, unsigned long pageno, int count)
+{
+	if (!count)
+		return;
+
+	bitmap_clear(cma->bitmap, pageno, count);
+	if (!cma->isolated)
+		free_contig_range(cma->base_pfn + pageno, count);
+}
+
+/*
+ * Allocating from a migrating area has to move every page in the range
+ * that is in use, which can take hundreds of milliseconds for a camera or
+ * video buffer.  A client that knows an allocation is coming can call
+ * dma_contiguous_prepare() to have the range migrated in the background.
+ * The pages are then held, so that the page allocator cannot hand them out
+ * again, until the allocation takes them or the hold expires.
+ */
+static void cma_predrain_work(struct work_struct *work)
+{
+	struct cma *cma = container_of(work, struct cma, predrain_work);
+	struct contig_range_stats stats = { 0, 0 };
+	long pageno;
+
+	mutex_lock(&cma_mutex);
+
+	/* already satisfied, or already holding a range */
+	if (!cma->predrain_count || cma->predrained_count)
+		goto out;
+
+	pageno = cma_alloc_range(cma, cma->predrain_count,
+				 cma->predrain_mask, &stats);
+	if (pageno < 0)
+		goto out;
+
+	cma->predrained_pageno = pageno;
+	cma->predrained_count = cma->predrain_count;
+	trace_cma_predrain(cma->base_pfn + pageno, cma->predrained_count);
+	mod_delayed_work(system_wq, &cma->predrain_expire,
+			 msecs_to_jiffies(CMA_PREDRAIN_HOLD_MS));
+out:
+	cma->predrain_count = 0;
+	mutex_unlock(&cma_mutex);
+}
+
+static void cma_predrain_expire(struct work_struct *work)
+{
+	struct cma *cma = container_of(to_delayed_work(work), struct cma,
+				       predrain_expire);
+
+	mutex_lock(&cma_mutex);
+	if (cma->predrained_count) {
+		trace_cma_predrain_expire(cma->base_pfn + cma->predrained_pageno,
+					  cma->predrained_count);
+		cma_release_range(cma, cma->predrained_pageno,
+				  cma->predrained_count);
+		cma->predrained_count = 0;
+		cma_latency.predrain_expired++;
+	}
+	mutex_unlock(&cma_mutex);
+}
+
+/*
+ * Take @count pages aligned to @mask out of the pre-drained range, giving
+ * the rest of it back.  Returns the page number or -1 if the range does not
+ * fit the request.  Called with cma_mutex held.
+ */
+static long cma_take_predrained(struct cma *cma, int count, unsigned long mask)
+{
+	unsigned long start = cma->predrained_pageno;
+	unsigned long end = start + cma->predrained_count;
+	unsigned long pageno = ALIGN(start, mask + 1);
+
+	if (!cma->predrained_count || pageno + count > end)
+		return -1;
+
+	cma_release_range(cma, start, pageno - start);
+	cma_release_range(cma, pageno + count, end - pageno - count);
+	cma->predrained_count = 0;
+	cma_latency.predrain_hit++;
+
+	return pageno;
+}
+
 #ifndef CMA_NO_MIGRATION
 static __init int cma_activate_area(unsigned long base_pfn, unsigned long count)
 {
@@ -187,6 +364,8 @@ static __init struct cma *cma_create_area(unsigned long base_pfn,
 #ifdef CMA_NO_MIGRATION
 	cma->isolated = true;
 #endif
+	INIT_WORK(&cma->predrain_work, cma_predrain_work);
+	INIT_DELAYED_WORK(&cma->predrain_expire, cma_predrain_expire);
 
 	if (!cma->bitmap)
 		goto no_mem;
@@ -335,10 +514,14 @@ err:
 struct page *dma_alloc_from_contiguous(struct device *dev, int count,
 				       unsigned int align)
 {
-	unsigned long mask, pfn, pageno, start = 0;
+	struct contig_range_stats stats = { 0, 0 };
 	struct cma *cma = dev_get_cma_area(dev);
 	struct page *page = NULL;
-	int ret;
+	bool predrained = false;
+	unsigned long mask;
+	ktime_t start;
+	s64 total;
+	long pageno;
 
 	if (!cma || !cma->count)
 		return NULL;
@@ -354,32 +537,29 @@ struct page *dma_alloc_from_contiguous(struct device *dev, int count,
 
 	mask = (1 << align) - 1;
 
+	start = ktime_get();
 	mutex_lock(&cma_mutex);
 
-	for (;;) {
-		pageno = bitmap_find_next_zero_area(cma->bitmap, cma->count,
-						    start, count, mask);
-		if (pageno >= cma->count)
-			break;
+	/* a pending pre-drain is no longer needed */
+	cma->predrain_count = 0;
 
-		pfn = cma->base_pfn + pageno;
-		ret = cma->isolated ?
-			0 : alloc_contig_range(pfn, pfn + count, MIGRATE_CMA);
-		if (ret == 0) {
-			bitmap_set(cma->bitmap, pageno, count);
-			page = pfn_to_page(pfn);
-			cma->free_count -= count;
-			break;
-		} else if (ret != -EBUSY) {
-			break;
-		}
-		pr_debug("%s(): memory range at %p is busy, retrying\n",
-			 __func__, pfn_to_page(pfn));
-		/* try again with a bit different memory target */
-		start = pageno + mask + 1;
+	pageno = cma_take_predrained(cma, count, mask);
+	if (pageno >= 0)
+		predrained = true;
+	else
+		pageno = cma_alloc_range(cma, count, mask, &stats);
+
+	if (pageno >= 0) {
+		page = pfn_to_page(cma->base_pfn + pageno);
+		cma->free_count -= count;
 	}
 
+	total = ktime_us_delta(ktime_get(), start);
+	cma_account_latency(&stats, total);
 	mutex_unlock(&cma_mutex);
+
+	trace_cma_alloc(page ? page_to_pfn(page) : 0, count, align,
+			stats.isolate_us, stats.migrate_us, total, predrained);
 	pr_debug("%s(): returned %p\n", __func__, page);
 	return page;
 }
@@ -413,15 +593,55 @@ bool dma_release_from_contiguous(struct device *dev, struct page *pages,
 	VM_BUG_ON(pfn + count > cma->base_pfn + cma->count);
 
 	mutex_lock(&cma_mutex);
-	bitmap_clear(cma->bitmap, pfn - cma->base_pfn, count);
-	if (!cma->isolated)
-		free_contig_range(pfn, count);
+	cma_release_range(cma, pfn - cma->base_pfn, count);
 	cma->free_count += count;
 	mutex_unlock(&cma_mutex);
 
+	trace_cma_release(pfn, count);
+
 	return true;
 }
 
+/**
+ * dma_contiguous_prepare() - announce an upcoming contiguous allocation
+ * @dev:   Pointer to device for which the allocation will be performed.
+ * @count: Number of pages that will be requested.
+ * @align: Alignment of the pages (in PAGE_SIZE order).
+ *
+ * This function asks for a range fitting a following
+ * dma_alloc_from_contiguous() with the same arguments to be migrated out of
+ * the contiguous area in the background, so that the allocation itself
+ * does not have to wait for it.  The range is held for a short while and
+ * given back to the page allocator if no allocation arrives.  Nothing is
+ * done for areas that are isolated from the page allocator.
+ */
+int dma_contiguous_prepare(struct device *dev, int count, unsigned int align)
+{
+	struct cma *cma = dev_get_cma_area(dev);
+
+	if (!cma)
+		return -ENODEV;
+
+	if (count <= 0 || count > cma->count)
+		return -EINVAL;
+
+	if (align > CONFIG_CMA_ALIGNMENT)
+		align = CONFIG_CMA_ALIGNMENT;
+
+	mutex_lock(&cma_mutex);
+	if (cma->isolated) {
+		mutex_unlock(&cma_mutex);
+		return 0;
+	}
+	cma->predrain_count = count;
+	cma->predrain_mask = (1 << align) - 1;
+	cma_latency.predrain_requested++;
+	mutex_unlock(&cma_mutex);
+
+	queue_work(system_unbound_wq, &cma->predrain_work);
+	return 0;
+}
+
 /**
  * dma_contiguous_info() - retrieving contiguous memory information
  * @dev:  Pointer to device to get the information.
@@ -548,3 +768,64 @@ int dma_contiguous_isolate(struct device *dev)
 	return 0;
 }
 #endif /* CMA_NO_MIGRATION */
+
+#ifdef CONFIG_DEBUG_FS
+static void cma_latency_show_hist(struct seq_file *m, const char *name,
+				  unsigned long *hist)
+{
+	int b;
+
+	seq_printf(m, "%s:\n", name);
+	for (b = 0; b < CMA_LATENCY_BUCKETS; b++) {
+		if (!hist[b])
+			continue;
+		seq_printf(m, "  %8lu-%lu us: %lu\n", b ? 1UL << b : 0,
+			   (2UL << b) - 1, hist[b]);
+	}
+}
+
+static int cma_latency_show(struct seq_file *m, void *v)
+{
+	mutex_lock(&cma_mutex);
+	cma_latency_show_hist(m, "total", cma_latency.total);
+	cma_latency_show_hist(m, "isolate", cma_latency.isolate);
+	cma_latency_show_hist(m, "migrate", cma_latency.migrate);
+	seq_printf(m, "predrain_requested: %lu\n",
+		   cma_latency.predrain_requested);
+	seq_printf(m, "predrain_hit: %lu\n", cma_latency.predrain_hit);
+	seq_printf(m, "predrain_expired: %lu\n",
+		   cma_latency.predrain_expired);
+	mutex_unlock(&cma_mutex);
+
+	return 0;
+}
+
+static int cma_latency_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, cma_latency_show, NULL);
+}
+
+static const struct file_operations cma_latency_fops = {
+	.open		= cma_latency_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init cma_debugfs_init(void)
+{
+	struct dentry *dir;
+
+	dir = debugfs_create_dir("cma", NULL);
+	if (!dir)
+		return -ENOMEM;
+
+	if (!debugfs_create_file("latency", S_IRUGO, dir, NULL,
+				 &cma_latency_fops)) {
+		debugfs_remove(dir);
+		return -ENOMEM;
+	}
+	return 0;
+}
+late_initcall(cma_debugfs_init);
+#endif /* CONFIG_DEBUG_FS */
@@ -59,6 +59,7 @@
 #include <linux/major.h>
 #include <linux/wait.h>
 #include <linux/blkdev.h>
+#include <linux/blk-mq.h>
 #include <linux/blkpg.h>
 #include <linux/init.h>
 #include <linux/swap.h>
@@ -466,50 +467,39 @@ out:
 }
 
 /*
- * Add bio to back of pending list
+ * Hand a request over to loop_thread.  Called by blk-mq with no locks
+ * held; the request is ended right away if the device cannot take it.
  */
-static void loop_add_bio(struct loop_device *lo, struct bio *bio)
+static int loop_queue_rq(struct blk_mq_hw_ctx *hctx, struct request *rq)
 {
-	lo->lo_bio_count++;
-	bio_list_add(&lo->lo_bio_list, bio);
-}
-
-/*
- * Grab first pending buffer
- */
-static struct bio *loop_get_bio(struct loop_device *lo)
-{
-	lo->lo_bio_count--;
-	return bio_list_pop(&lo->lo_bio_list);
-}
-
-static void loop_make_request(struct request_queue *q, struct bio *old_bio)
-{
-	struct loop_device *lo = q->queuedata;
-	int rw = bio_rw(old_bio);
-
-	if (rw == READA)
-		rw = READ;
-
-	BUG_ON(!lo || (rw != READ && rw != WRITE));
+	struct loop_device *lo = rq->q->queuedata;
 
 	spin_lock_irq(&lo->lo_lock);
 	if (lo->lo_state != Lo_bound)
 		goto out;
-	if (unlikely(rw == WRITE && (lo->lo_flags & LO_FLAGS_READ_ONLY)))
+	if (unlikely(rq->cmd_type == REQ_TYPE_FS && rq_data_dir(rq) == WRITE &&
+		     (lo->lo_flags & LO_FLAGS_READ_ONLY)))
 		goto out;
-	if (lo->lo_bio_count >= q->nr_congestion_on)
-		wait_event_lock_irq(lo->lo_req_wait,
-				    lo->lo_bio_count < q->nr_congestion_off,
-				    lo->lo_lock);
-	loop_add_bio(lo, old_bio);
+	list_add_tail(&rq->queuelist, &lo->lo_req_list);
 	wake_up(&lo->lo_event);
 	spin_unlock_irq(&lo->lo_lock);
-	return;
+	return BLK_MQ_RQ_QUEUE_OK;
 
 out:
 	spin_unlock_irq(&lo->lo_lock);
-	bio_io_error(old_bio);
+	return BLK_MQ_RQ_QUEUE_ERROR;
+}
+
+/*
+ * Grab first pending request
+ */
+static struct request *loop_get_request(struct loop_device *lo)
+{
+	struct request *rq;
+
+	rq = list_first_entry(&lo->lo_req_list, struct request, queuelist);
+	list_del_init(&rq->queuelist);
+	return rq;
 }
 
 struct switch_request {
@@ -519,52 +509,56 @@ struct switch_request {
 
 static void do_loop_switch(struct loop_device *, struct switch_request *);
 
-static inline void loop_handle_bio(struct loop_device *lo, struct bio *bio)
+static inline void loop_handle_request(struct loop_device *lo,
+				       struct request *rq)
 {
-	if (unlikely(!bio->bi_bdev)) {
-		do_loop_switch(lo, bio->bi_private);
-		bio_put(bio);
+	struct bio *bio;
+	int ret = 0;
+
+	if (unlikely(rq->cmd_type == REQ_TYPE_SPECIAL)) {
+		do_loop_switch(lo, rq->special);
 	} else {
-		int ret = do_bio_filebacked(lo, bio);
-		bio_endio(bio, ret);
+		__rq_for_each_bio(bio, rq) {
+			ret = do_bio_filebacked(lo, bio);
+			if (ret)
+				break;
+		}
 	}
+	blk_mq_end_io(rq, ret);
 }
 
 /*
  * worker thread that handles reads/writes to file backed loop devices,
- * to avoid blocking in our make_request_fn. it also does loop decrypting
+ * to avoid blocking in ->queue_rq. it also does loop decrypting
  * on reads for block backed loop, as that is too heavy to do from
  * b_end_io context where irqs may be disabled.
  *
  * Loop explanation:  loop_clr_fd() sets lo_state to Lo_rundown before
  * calling kthread_stop().  Therefore once kthread_should_stop() is
- * true, make_request will not place any more requests.  Therefore
- * once kthread_should_stop() is true and lo_bio is NULL, we are
+ * true, loop_queue_rq will not place any more requests.  Therefore
+ * once kthread_should_stop() is true and lo_req_list is empty, we are
  * done with the loop.
  */
 static int loop_thread(void *data)
 {
 	struct loop_device *lo = data;
-	struct bio *bio;
+	struct request *rq;
 
 	set_user_nice(current, -20);
 
-	while (!kthread_should_stop() || !bio_list_empty(&lo->lo_bio_list)) {
+	while (!kthread_should_stop() || !list_empty(&lo->lo_req_list)) {
 
 		wait_event_interruptible(lo->lo_event,
-				!bio_list_empty(&lo->lo_bio_list) ||
+				!list_empty(&lo->lo_req_list) ||
 				kthread_should_stop());
 
-		if (bio_list_empty(&lo->lo_bio_list))
+		if (list_empty(&lo->lo_req_list))
 			continue;
 		spin_lock_irq(&lo->lo_lock);
-		bio = loop_get_bio(lo);
-		if (lo->lo_bio_count < lo->lo_queue->nr_congestion_off)
-			wake_up(&lo->lo_req_wait);
+		rq = loop_get_request(lo);
 		spin_unlock_irq(&lo->lo_lock);
 
-		BUG_ON(!bio);
-		loop_handle_bio(lo, bio);
+		loop_handle_request(lo, rq);
 	}
 
 	return 0;
@@ -573,19 +567,23 @@ static int loop_thread(void *data)
 /*
  * loop_switch performs the hard work of switching a backing store.
  * First it needs to flush existing IO, it does this by sending a magic
- * BIO down the pipe. The completion of this BIO does the actual switch.
+ * request down the pipe. The handling of this request does the actual
+ * switch.  It uses the reserved tag, so it never waits behind regular I/O
+ * for a request to send.
  */
 static int loop_switch(struct loop_device *lo, struct file *file)
 {
 	struct switch_request w;
-	struct bio *bio = bio_alloc(GFP_KERNEL, 0);
-	if (!bio)
+	struct request *rq;
+
+	rq = blk_mq_alloc_request(lo->lo_queue, READ, GFP_KERNEL, true);
+	if (!rq)
 		return -ENOMEM;
 	init_completion(&w.wait);
 	w.file = file;
-	bio->bi_private = &w;
-	bio->bi_bdev = NULL;
-	loop_make_request(lo->lo_queue, bio);
+	rq->cmd_type = REQ_TYPE_SPECIAL;
+	rq->special = &w;
+	blk_mq_insert_request(rq, true, false);
 	wait_for_completion(&w.wait);
 	return 0;
 }
@@ -603,7 +601,7 @@ static int loop_flush(struct loop_device *lo)
 }
 
 /*
- * Do the actual switch; called from the BIO completion routine
+ * Do the actual switch; called from loop_thread
  */
 static void do_loop_switch(struct loop_device *lo, struct switch_request *p)
 {
@@ -611,7 +609,7 @@ static void do_loop_switch(struct loop_device *lo, struct switch_request *p)
 	struct file *old_file = lo->lo_backing_file;
 	struct address_space *mapping;
 
-	/* if no new file, only flush of queued bios requested */
+	/* if no new file, only flush of queued requests requested */
 	if (!file)
 		goto out;
 
@@ -888,19 +886,9 @@ static int loop_set_fd(struct loop_device *lo, fmode_t mode,
 	lo->transfer = transfer_none;
 	lo->ioctl = NULL;
 	lo->lo_sizelimit = 0;
-	lo->lo_bio_count = 0;
 	lo->old_gfp_mask = mapping_gfp_mask(mapping);
 	mapping_set_gfp_mask(mapping, lo->old_gfp_mask & ~(__GFP_IO|__GFP_FS));
 
-	bio_list_init(&lo->lo_bio_list);
-
-	/*
-	 * set queue make_request_fn, and add limits based on lower level
-	 * device
-	 */
-	blk_queue_make_request(lo->lo_queue, loop_make_request);
-	lo->lo_queue->queuedata = lo;
-
 	if (!(lo_flags & LO_FLAGS_READ_ONLY) && file->f_op->fsync)
 		blk_queue_flush(lo->lo_queue, REQ_FLUSH);
 
@@ -1607,6 +1595,25 @@ int loop_unregister_transfer(int number)
 EXPORT_SYMBOL(loop_register_transfer);
 EXPORT_SYMBOL(loop_unregister_transfer);
 
+static struct blk_mq_ops loop_mq_ops = {
+	.queue_rq	= loop_queue_rq,
+	.map_queue	= blk_mq_map_queue,
+};
+
+/*
+ * All I/O is done by one thread per device, so one hardware queue does.
+ * The queue depth bounds the requests waiting for it, as the congestion
+ * limits did for the bio list this replaced.
+ */
+static struct blk_mq_reg loop_mq_reg = {
+	.ops		= &loop_mq_ops,
+	.nr_hw_queues	= 1,
+	.queue_depth	= 128,
+	.reserved_tags	= 1,	/* loop_switch() */
+	.numa_node	= NUMA_NO_NODE,
+	.flags		= BLK_MQ_F_SHOULD_MERGE,
+};
+
 static int loop_add(struct loop_device **l, int i)
 {
 	struct loop_device *lo;
@@ -1630,11 +1637,14 @@ static int loop_add(struct loop_device **l, int i)
 		goto out_free_dev;
 	i = err;
 
-	err = -ENOMEM;
-	lo->lo_queue = blk_alloc_queue(GFP_KERNEL);
-	if (!lo->lo_queue)
+	lo->lo_queue = blk_mq_init_queue(&loop_mq_reg, lo);
+	if (IS_ERR(lo->lo_queue)) {
+		err = PTR_ERR(lo->lo_queue);
 		goto out_free_dev;
+	}
+	lo->lo_queue->queuedata = lo;
 
+	err = -ENOMEM;
 	disk = lo->lo_disk = alloc_disk(1 << part_shift);
 	if (!disk)
 		goto out_free_queue;
@@ -1664,7 +1674,7 @@ static int loop_add(struct loop_device **l, int i)
 	lo->lo_number		= i;
 	lo->lo_thread		= NULL;
 	init_waitqueue_head(&lo->lo_event);
-	init_waitqueue_head(&lo->lo_req_wait);
+	INIT_LIST_HEAD(&lo->lo_req_list);
 	spin_lock_init(&lo->lo_lock);
 	disk->major		= LOOP_MAJOR;
 	disk->first_minor	= i << part_shift;
@@ -0,0 +1,720 @@
+/*
+ * Null block device driver.
+ *
+ * Completes every request without transferring any data, either right
+ * away or after a delay drawn from a simple latency model: a base latency
+ * per direction, an optional uniform spread and a tail of slow requests,
+ * on top of the time the data would take at a given bandwidth.  This
+ * makes it possible to measure the block layer itself, and to emulate a
+ * flash device such as eMMC closely enough to compare I/O schedulers,
+ * on any machine.
+ *
+ * See Documentation/block/null_blk.txt
+ */
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+#include <linux/bio.h>
+#include <linux/fs.h>
+#include <linux/slab.h>
+#include <linux/hrtimer.h>
+#include <linux/interrupt.h>
+#include <linux/llist.h>
+#include <linux/log2.h>
+#include <linux/percpu.h>
+#include <linux/random.h>
+#include <linux/wait.h>
+#include <linux/sched.h>
+
+struct nullb_cmd {
+	struct llist_node ll_list;	/* softirq completion, bio mode */
+	struct hrtimer timer;		/* timer completion */
+	struct request *rq;
+	struct bio *bio;
+	unsigned int tag;
+	struct nullb_queue *nq;
+};
+
+/*
+ * Command slots, one per tag.  blk-mq hands out the tags itself, the bio
+ * and request modes take them from tag_map.
+ */
+struct nullb_queue {
+	unsigned long *tag_map;
+	wait_queue_head_t wait;
+	unsigned int queue_depth;
+	struct nullb_cmd *cmds;
+	struct nullb *dev;
+};
+
+struct nullb {
+	struct list_head list;
+	unsigned int index;
+	struct request_queue *q;
+	struct gendisk *disk;
+	struct nullb_queue *queues;
+	unsigned int nr_queues;
+	spinlock_t lock;		/* queue_lock of the request mode */
+
+	/* bandwidth model: the emulated medium is busy until media_free */
+	spinlock_t media_lock;
+	ktime_t media_free;
+};
+
+/* bio mode completions waiting for the softirq of their CPU */
+struct completion_queue {
+	struct llist_head list;
+	struct tasklet_struct tasklet;
+};
+
+static DEFINE_PER_CPU(struct completion_queue, completion_queues);
+
+static LIST_HEAD(nullb_list);
+static DEFINE_MUTEX(lock);
+static int null_major;
+static int nullb_indexes;
+
+enum {
+	NULL_IRQ_NONE		= 0,
+	NULL_IRQ_SOFTIRQ	= 1,
+	NULL_IRQ_TIMER		= 2,
+};
+
+enum {
+	NULL_Q_BIO		= 0,
+	NULL_Q_RQ		= 1,
+	NULL_Q_MQ		= 2,
+};
+
+enum {
+	NULL_LAT_FIXED		= 0,
+	NULL_LAT_UNIFORM	= 1,
+};
+
+static int submit_queues = 1;
+module_param(submit_queues, int, S_IRUGO);
+MODULE_PARM_DESC(submit_queues, "Number of hardware queues in mq mode");
+
+static int home_node = NUMA_NO_NODE;
+module_param(home_node, int, S_IRUGO);
+MODULE_PARM_DESC(home_node, "Home node for the device");
+
+static int queue_mode = NULL_Q_MQ;
+module_param(queue_mode, int, S_IRUGO);
+MODULE_PARM_DESC(queue_mode, "Block interface: 0=bio, 1=request (with an I/O scheduler), 2=multi-queue");
+
+static int gb = 250;
+module_param(gb, int, S_IRUGO);
+MODULE_PARM_DESC(gb, "Size in GB");
+
+static int bs = 512;
+module_param(bs, int, S_IRUGO);
+MODULE_PARM_DESC(bs, "Block size (in bytes)");
+
+static int nr_devices = 2;
+module_param(nr_devices, int, S_IRUGO);
+MODULE_PARM_DESC(nr_devices, "Number of devices to register");
+
+static int irqmode = NULL_IRQ_SOFTIRQ;
+module_param(irqmode, int, S_IRUGO);
+MODULE_PARM_DESC(irqmode, "Completion: 0=inline, 1=softirq, 2=timer (latency model)");
+
+static int hw_queue_depth = 64;
+module_param(hw_queue_depth, int, S_IRUGO);
+MODULE_PARM_DESC(hw_queue_depth, "Commands in flight per queue, default: 64");
+
+/*
+ * The latency model, timer mode only.  Parameters are read for every
+ * request, so they may be changed at run time.
+ */
+static ulong completion_nsec = 10000;
+module_param(completion_nsec, ulong, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(completion_nsec, "Base latency of reads in ns, default: 10000");
+
+static ulong write_nsec;
+module_param(write_nsec, ulong, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(write_nsec, "Base latency of writes in ns, default: completion_nsec");
+
+static int latency_dist = NULL_LAT_FIXED;
+module_param(latency_dist, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(latency_dist, "Base latency distribution: 0=fixed, 1=uniform between 0 and twice the base");
+
+static uint tail_pct;
+module_param(tail_pct, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(tail_pct, "Percentage of requests that also take tail_nsec, default: 0");
+
+static ulong tail_nsec;
+module_param(tail_nsec, ulong, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(tail_nsec, "Extra latency of tail requests in ns");
+
+static uint read_mbps;
+module_param(read_mbps, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(read_mbps, "Read bandwidth in MB/s, default: 0 (unlimited)");
+
+static uint write_mbps;
+module_param(write_mbps, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(write_mbps, "Write bandwidth in MB/s, default: 0 (unlimited)");
+
+static void put_tag(struct nullb_queue *nq, unsigned int tag)
+{
+	clear_bit_unlock(tag, nq->tag_map);
+
+	if (waitqueue_active(&nq->wait))
+		wake_up(&nq->wait);
+}
+
+static unsigned int get_tag(struct nullb_queue *nq)
+{
+	unsigned int tag;
+
+	do {
+		tag = find_first_zero_bit(nq->tag_map, nq->queue_depth);
+		if (tag >= nq->queue_depth)
+			return -1U;
+	} while (test_and_set_bit_lock(tag, nq->tag_map));
+
+	return tag;
+}
+
+static void free_cmd(struct nullb_cmd *cmd)
+{
+	put_tag(cmd->nq, cmd->tag);
+}
+
+static struct nullb_cmd *__alloc_cmd(struct nullb_queue *nq)
+{
+	unsigned int tag;
+
+	tag = get_tag(nq);
+	if (tag != -1U)
+		return &nq->cmds[tag];
+
+	return NULL;
+}
+
+static struct nullb_cmd *alloc_cmd(struct nullb_queue *nq, int can_wait)
+{
+	struct nullb_cmd *cmd;
+	DEFINE_WAIT(wait);
+
+	cmd = __alloc_cmd(nq);
+	if (cmd || !can_wait)
+		return cmd;
+
+	do {
+		prepare_to_wait(&nq->wait, &wait, TASK_UNINTERRUPTIBLE);
+		cmd = __alloc_cmd(nq);
+		if (cmd)
+			break;
+
+		io_schedule();
+	} while (1);
+
+	finish_wait(&nq->wait, &wait);
+	return cmd;
+}
+
+/*
+ * A request mode queue stopped for want of commands may go again.  The
+ * stopped flag is tested under queue_lock, which null_rq_prep_fn() holds
+ * from its failed alloc_cmd() to blk_stop_queue(), so that a command freed
+ * in between is not missed.
+ */
+static void null_restart_queue(struct request_queue *q)
+{
+	unsigned long flags;
+
+	if (queue_mode != NULL_Q_RQ)
+		return;
+
+	spin_lock_irqsave(q->queue_lock, flags);
+	if (blk_queue_stopped(q))
+		blk_start_queue(q);
+	spin_unlock_irqrestore(q->queue_lock, flags);
+}
+
+static void end_cmd(struct nullb_cmd *cmd)
+{
+	struct request_queue *q;
+
+	switch (queue_mode) {
+	case NULL_Q_MQ:
+		blk_mq_end_io(cmd->rq, 0);
+		return;
+	case NULL_Q_RQ:
+		q = cmd->rq->q;
+		INIT_LIST_HEAD(&cmd->rq->queuelist);
+		blk_end_request_all(cmd->rq, 0);
+		free_cmd(cmd);
+		null_restart_queue(q);
+		return;
+	case NULL_Q_BIO:
+		bio_endio(cmd->bio, 0);
+		free_cmd(cmd);
+		return;
+	}
+}
+
+static enum hrtimer_restart null_cmd_timer_expired(struct hrtimer *timer)
+{
+	end_cmd(container_of(timer, struct nullb_cmd, timer));
+
+	return HRTIMER_NORESTART;
+}
+
+/*
+ * When the command completes under the latency model.  The transfer
+ * time is serialised on the emulated medium, so that bandwidth is shared
+ * by everything in flight, while the base and tail latencies overlap.
+ */
+static ktime_t null_cmd_deadline(struct nullb *nullb, int rw,
+				 unsigned int bytes)
+{
+	u64 lat = completion_nsec;
+	unsigned int mbps = read_mbps;
+	unsigned long flags;
+	ktime_t now, start;
+
+	if (rw == WRITE) {
+		if (write_nsec)
+			lat = write_nsec;
+		mbps = write_mbps;
+	}
+
+	if (latency_dist == NULL_LAT_UNIFORM)
+		lat = (lat * 2 * (prandom_u32() & 0xffff)) >> 16;
+	if (tail_pct && prandom_u32() % 100 < tail_pct)
+		lat += tail_nsec;
+
+	now = ktime_get();
+	if (!mbps)
+		return ktime_add_ns(now, lat);
+
+	/* MB/s is bytes per us, so bytes * 1000 / mbps is ns */
+	spin_lock_irqsave(&nullb->media_lock, flags);
+	start = ktime_compare(now, nullb->media_free) > 0 ?
+		now : nullb->media_free;
+	nullb->media_free = ktime_add_ns(start,
+					 div_u64((u64) bytes * 1000, mbps));
+	now = nullb->media_free;
+	spin_unlock_irqrestore(&nullb->media_lock, flags);
+
+	return ktime_add_ns(now, lat);
+}
+
+static void null_cmd_end_timer(struct nullb_cmd *cmd)
+{
+	int rw;
+	unsigned int bytes;
+
+	if (cmd->bio) {
+		rw = bio_data_dir(cmd->bio);
+		bytes = cmd->bio->bi_size;
+	} else {
+		rw = rq_data_dir(cmd->rq);
+		bytes = blk_rq_bytes(cmd->rq);
+	}
+
+	hrtimer_start(&cmd->timer, null_cmd_deadline(cmd->nq->dev, rw, bytes),
+		      HRTIMER_MODE_ABS);
+}
+
+static void null_softirq_done_fn(struct request *rq)
+{
+	end_cmd(rq->special);
+}
+
+static void null_bio_tasklet_fn(unsigned long data)
+{
+	struct completion_queue *cq = (struct completion_queue *) data;
+	struct llist_node *entry;
+	struct nullb_cmd *cmd;
+
+	entry = llist_del_all(&cq->list);
+	while (entry) {
+		cmd = llist_entry(entry, struct nullb_cmd, ll_list);
+		entry = entry->next;
+		end_cmd(cmd);
+	}
+}
+
+static void null_cmd_end_softirq(struct nullb_cmd *cmd)
+{
+	struct completion_queue *cq = &get_cpu_var(completion_queues);
+
+	if (llist_add(&cmd->ll_list, &cq->list))
+		tasklet_schedule(&cq->tasklet);
+	put_cpu_var(completion_queues);
+}
+
+static void null_handle_cmd(struct nullb_cmd *cmd)
+{
+	switch (irqmode) {
+	case NULL_IRQ_SOFTIRQ:
+		switch (queue_mode) {
+		case NULL_Q_MQ:
+			blk_mq_complete_request(cmd->rq);
+			break;
+		case NULL_Q_RQ:
+			blk_complete_request(cmd->rq);
+			break;
+		case NULL_Q_BIO:
+			null_cmd_end_softirq(cmd);
+			break;
+		}
+		break;
+	case NULL_IRQ_NONE:
+		end_cmd(cmd);
+		break;
+	case NULL_IRQ_TIMER:
+		null_cmd_end_timer(cmd);
+		break;
+	}
+}
+
+static void null_queue_bio(struct request_queue *q, struct bio *bio)
+{
+	struct nullb *nullb = q->queuedata;
+	struct nullb_cmd *cmd;
+
+	cmd = alloc_cmd(&nullb->queues[0], 1);
+	cmd->bio = bio;
+	cmd->rq = NULL;
+
+	null_handle_cmd(cmd);
+}
+
+static int null_rq_prep_fn(struct request_queue *q, struct request *req)
+{
+	struct nullb *nullb = q->queuedata;
+	struct nullb_cmd *cmd;
+
+	cmd = alloc_cmd(&nullb->queues[0], 0);
+	if (cmd) {
+		cmd->rq = req;
+		cmd->bio = NULL;
+		req->special = cmd;
+		req->cmd_flags |= REQ_DONTPREP;
+		return BLKPREP_OK;
+	}
+
+	/* null_restart_queue() starts it again when a command is freed */
+	blk_stop_queue(q);
+	return BLKPREP_DEFER;
+}
+
+static void null_request_fn(struct request_queue *q)
+{
+	struct request *rq;
+
+	while ((rq = blk_fetch_request(q)) != NULL) {
+		struct nullb_cmd *cmd = rq->special;
+
+		spin_unlock_irq(q->queue_lock);
+		null_handle_cmd(cmd);
+		spin_lock_irq(q->queue_lock);
+	}
+}
+
+static int null_queue_rq(struct blk_mq_hw_ctx *hctx, struct request *rq)
+{
+	struct nullb_queue *nq = hctx->driver_data;
+	struct nullb_cmd *cmd = &nq->cmds[rq->tag];
+
+	cmd->rq = rq;
+	cmd->bio = NULL;
+	rq->special = cmd;
+
+	null_handle_cmd(cmd);
+	return BLK_MQ_RQ_QUEUE_OK;
+}
+
+static int null_init_hctx(struct blk_mq_hw_ctx *hctx, void *data,
+			  unsigned int index)
+{
+	struct nullb *nullb = data;
+
+	hctx->driver_data = &nullb->queues[index];
+	return 0;
+}
+
+static struct blk_mq_ops null_mq_ops = {
+	.queue_rq	= null_queue_rq,
+	.map_queue	= blk_mq_map_queue,
+	.complete	= null_softirq_done_fn,
+	.init_hctx	= null_init_hctx,
+};
+
+static struct blk_mq_reg null_mq_reg = {
+	.ops		= &null_mq_ops,
+	.flags		= BLK_MQ_F_SHOULD_MERGE,
+};
+
+static void cleanup_queue(struct nullb_queue *nq)
+{
+	kfree(nq->tag_map);
+	kfree(nq->cmds);
+}
+
+static void cleanup_queues(struct nullb *nullb)
+{
+	int i;
+
+	for (i = 0; i < nullb->nr_queues; i++)
+		cleanup_queue(&nullb->queues[i]);
+
+	kfree(nullb->queues);
+}
+
+/*
+ * In bio mode nothing else waits for the commands still on a timer, and
+ * they must not fire once the device is gone.
+ */
+static void null_wait_queues(struct nullb *nullb)
+{
+	struct nullb_queue *nq;
+	int i;
+
+	for (i = 0; i < nullb->nr_queues; i++) {
+		nq = &nullb->queues[i];
+		wait_event(nq->wait,
+			   find_first_bit(nq->tag_map, nq->queue_depth) >=
+			   nq->queue_depth);
+	}
+}
+
+static void null_del_dev(struct nullb *nullb)
+{
+	list_del_init(&nullb->list);
+
+	del_gendisk(nullb->disk);
+	if (queue_mode != NULL_Q_MQ)
+		null_wait_queues(nullb);
+	blk_cleanup_queue(nullb->q);
+	put_disk(nullb->disk);
+	cleanup_queues(nullb);
+	kfree(nullb);
+}
+
+static int null_open(struct block_device *bdev, fmode_t mode)
+{
+	return 0;
+}
+
+static void null_release(struct gendisk *disk, fmode_t mode)
+{
+}
+
+static const struct block_device_operations null_fops = {
+	.owner =	THIS_MODULE,
+	.open =		null_open,
+	.release =	null_release,
+};
+
+static int setup_commands(struct nullb_queue *nq)
+{
+	struct nullb_cmd *cmd;
+	int i, tag_size;
+
+	nq->cmds = kzalloc(nq->queue_depth * sizeof(*nq->cmds), GFP_KERNEL);
+	if (!nq->cmds)
+		return -ENOMEM;
+
+	for (i = 0; i < nq->queue_depth; i++) {
+		cmd = &nq->cmds[i];
+		cmd->tag = i;
+		cmd->nq = nq;
+		hrtimer_init(&cmd->timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+		cmd->timer.function = null_cmd_timer_expired;
+	}
+
+	tag_size = BITS_TO_LONGS(nq->queue_depth) * sizeof(unsigned long);
+	nq->tag_map = kzalloc(tag_size, GFP_KERNEL);
+	if (!nq->tag_map) {
+		kfree(nq->cmds);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+/* one queue per hardware queue in mq mode, a single one otherwise */
+static int init_driver_queues(struct nullb *nullb)
+{
+	unsigned int nr_queues = queue_mode == NULL_Q_MQ ? submit_queues : 1;
+	struct nullb_queue *nq;
+
+	nullb->queues = kzalloc(nr_queues * sizeof(*nullb->queues),
+				GFP_KERNEL);
+	if (!nullb->queues)
+		return -ENOMEM;
+
+	for (; nullb->nr_queues < nr_queues; nullb->nr_queues++) {
+		nq = &nullb->queues[nullb->nr_queues];
+		init_waitqueue_head(&nq->wait);
+		nq->queue_depth = hw_queue_depth;
+		nq->dev = nullb;
+		if (setup_commands(nq)) {
+			cleanup_queues(nullb);
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+static int null_add_dev(void)
+{
+	struct gendisk *disk;
+	struct nullb *nullb;
+	sector_t size;
+
+	nullb = kzalloc_node(sizeof(*nullb), GFP_KERNEL, home_node);
+	if (!nullb)
+		return -ENOMEM;
+
+	spin_lock_init(&nullb->lock);
+	spin_lock_init(&nullb->media_lock);
+	nullb->media_free = ktime_set(0, 0);
+
+	if (init_driver_queues(nullb))
+		goto out_free_nullb;
+
+	if (queue_mode == NULL_Q_MQ) {
+		nullb->q = blk_mq_init_queue(&null_mq_reg, nullb);
+		if (IS_ERR(nullb->q))
+			goto out_cleanup_queues;
+	} else if (queue_mode == NULL_Q_BIO) {
+		nullb->q = blk_alloc_queue_node(GFP_KERNEL, home_node);
+		if (!nullb->q)
+			goto out_cleanup_queues;
+		blk_queue_make_request(nullb->q, null_queue_bio);
+	} else {
+		nullb->q = blk_init_queue_node(null_request_fn, &nullb->lock,
+					       home_node);
+		if (!nullb->q)
+			goto out_cleanup_queues;
+		blk_queue_prep_rq(nullb->q, null_rq_prep_fn);
+		blk_queue_softirq_done(nullb->q, null_softirq_done_fn);
+	}
+
+	nullb->q->queuedata = nullb;
+	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, nullb->q);
+
+	disk = nullb->disk = alloc_disk_node(1, home_node);
+	if (!disk)
+		goto out_cleanup_blk_queue;
+
+	mutex_lock(&lock);
+	list_add_tail(&nullb->list, &nullb_list);
+	nullb->index = nullb_indexes++;
+	mutex_unlock(&lock);
+
+	blk_queue_logical_block_size(nullb->q, bs);
+	blk_queue_physical_block_size(nullb->q, bs);
+
+	size = gb * 1024 * 1024 * 1024ULL;
+	sector_div(size, bs);
+	set_capacity(disk, size * (bs >> 9));
+
+	disk->flags |= GENHD_FL_EXT_DEVT;
+	disk->major		= null_major;
+	disk->first_minor	= nullb->index;
+	disk->fops		= &null_fops;
+	disk->private_data	= nullb;
+	disk->queue		= nullb->q;
+	sprintf(disk->disk_name, "nullb%d", nullb->index);
+	add_disk(disk);
+	return 0;
+
+out_cleanup_blk_queue:
+	blk_cleanup_queue(nullb->q);
+out_cleanup_queues:
+	cleanup_queues(nullb);
+out_free_nullb:
+	kfree(nullb);
+	return -ENOMEM;
+}
+
+static int __init null_init(void)
+{
+	unsigned int i;
+
+	if (bs > PAGE_SIZE || bs < 512 || !is_power_of_2(bs)) {
+		pr_warn("null_blk: invalid block size %d, using 512\n", bs);
+		bs = 512;
+	}
+
+	if (queue_mode < NULL_Q_BIO || queue_mode > NULL_Q_MQ ||
+	    irqmode < NULL_IRQ_NONE || irqmode > NULL_IRQ_TIMER) {
+		pr_err("null_blk: invalid queue_mode %d or irqmode %d\n",
+		       queue_mode, irqmode);
+		return -EINVAL;
+	}
+
+	if (hw_queue_depth < 1)
+		hw_queue_depth = 1;
+	else if (hw_queue_depth > BLK_MQ_MAX_DEPTH)
+		hw_queue_depth = BLK_MQ_MAX_DEPTH;
+
+	if (submit_queues < 1)
+		submit_queues = 1;
+	else if (submit_queues > nr_cpu_ids)
+		submit_queues = nr_cpu_ids;
+
+	null_mq_reg.nr_hw_queues = submit_queues;
+	null_mq_reg.queue_depth = hw_queue_depth;
+	null_mq_reg.numa_node = home_node;
+
+	for_each_possible_cpu(i) {
+		struct completion_queue *cq = &per_cpu(completion_queues, i);
+
+		init_llist_head(&cq->list);
+		tasklet_init(&cq->tasklet, null_bio_tasklet_fn,
+			     (unsigned long) cq);
+	}
+
+	null_major = register_blkdev(0, "nullb");
+	if (null_major < 0)
+		return null_major;
+
+	for (i = 0; i < nr_devices; i++) {
+		if (null_add_dev()) {
+			while (!list_empty(&nullb_list))
+				null_del_dev(list_first_entry(&nullb_list,
+							      struct nullb,
+							      list));
+			unregister_blkdev(null_major, "nullb");
+			return -EINVAL;
+		}
+	}
+
+	pr_info("null_blk: module loaded\n");
+	return 0;
+}
+
+static void __exit null_exit(void)
+{
+	struct nullb *nullb;
+	unsigned int i;
+
+	unregister_blkdev(null_major, "nullb");
+
+	mutex_lock(&lock);
+	while (!list_empty(&nullb_list)) {
+		nullb = list_entry(nullb_list.next, struct nullb, list);
+		null_del_dev(nullb);
+	}
+	mutex_unlock(&lock);
+
+	for_each_possible_cpu(i)
+		tasklet_kill(&per_cpu(completion_queues, i).tasklet);
+}
+
+module_init(null_init);
+module_exit(null_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("null block device with a latency model");
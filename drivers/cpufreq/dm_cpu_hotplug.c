@@ -26,6 +26,9 @@
 #include <mach/cpufreq.h>
 #include <linux/suspend.h>
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/dm_hotplug.h>
+
 #define MEIZU_SPECIFIC
 #if defined(CONFIG_SOC_EXYNOS5430)
 #define NORMALMIN_FREQ	1000000
@@ -122,6 +125,46 @@ static struct workqueue_struct *force_hotplug_wq;
 
 static int dm_hotplug_disable = 0;
 
+#ifdef CONFIG_DM_HOTPLUG_PREDICTIVE
+/*
+ * Predictive hotplug-in.  The history of sched_get_nr_running_avg() samples
+ * (runnable tasks * 100) and the heavy task count from rq_stats are used to
+ * extrapolate the demand 'horizon' polling periods ahead, so that the big
+ * cluster is brought online before the frequency based reactive path asks
+ * for it.  Every predictive decision is validated against the reactive
+ * decision of the following 'window' samples and accounted as a hit or a
+ * misprediction; reactive hotplug-ins that were not predicted are misses.
+ */
+#define PRED_HIST_SIZE		8
+#define DEFAULT_PRED_THRESHD	350
+#define DEFAULT_PRED_HORIZON	2
+#define DEFAULT_PRED_WINDOW	5
+#define DEFAULT_PRED_HEAVY_WEIGHT	100
+
+struct dm_predictor {
+	int nr_hist[PRED_HIST_SIZE];
+	unsigned int head;
+	unsigned int count;
+	int ewma;
+	int predicted;
+	bool pending;
+	unsigned int pending_age;
+	enum hotplug_cmd reactive;	/* last reactive decision */
+	bool forced;			/* last command overrode it */
+	unsigned long decisions;
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long mispredicts;
+};
+
+static struct dm_predictor dm_pred;
+static unsigned int pred_enabled = 1;
+static unsigned int pred_threshold = DEFAULT_PRED_THRESHD;
+static unsigned int pred_horizon = DEFAULT_PRED_HORIZON;
+static unsigned int pred_window = DEFAULT_PRED_WINDOW;
+static unsigned int pred_heavy_weight = DEFAULT_PRED_HEAVY_WEIGHT;
+#endif
+
 #ifdef CONFIG_DEFERRABLE_DM_HOTPLUG
 static unsigned int NonDeferedTime = 40;
 struct timer_list	hotplug_timer;
@@ -382,6 +425,54 @@ static ssize_t store_dm_hotplug_delay(struct kobject *kobj, struct attribute *at
 	return count;
 }
 
+#ifdef CONFIG_DM_HOTPLUG_PREDICTIVE
+static ssize_t show_dm_hotplug_predictor(struct kobject *kobj,
+				struct attribute *attr, char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "enabled = %u, threshold = %u, "
+			"horizon = %u, window = %u, heavy_weight = %u\n"
+			"predicted = %d, decisions = %lu, hits = %lu, "
+			"misses = %lu, mispredicts = %lu\n",
+			pred_enabled, pred_threshold, pred_horizon,
+			pred_window, pred_heavy_weight, dm_pred.predicted,
+			dm_pred.decisions, dm_pred.hits, dm_pred.misses,
+			dm_pred.mispredicts);
+}
+
+static ssize_t store_dm_hotplug_predictor(struct kobject *kobj,
+				struct attribute *attr, const char *buf, size_t count)
+{
+	int input_enabled, input_threshold, input_horizon, input_window;
+	int input_heavy_weight;
+
+	if (sscanf(buf, "%d %d %d %d %d", &input_enabled, &input_threshold,
+			&input_horizon, &input_window,
+			&input_heavy_weight) != 5)
+		return -EINVAL;
+
+	if (input_enabled < 0 || input_threshold <= 0 ||
+		input_horizon < 0 || input_window <= 0 ||
+		input_heavy_weight < 0) {
+		pr_err("%s: invalid values (%d, %d, %d, %d, %d)\n", __func__,
+			input_enabled, input_threshold, input_horizon,
+			input_window, input_heavy_weight);
+		return -EINVAL;
+	}
+
+	mutex_lock(&dm_thread_lock);
+	pred_enabled = !!input_enabled;
+	pred_threshold = (unsigned int)input_threshold;
+	pred_horizon = (unsigned int)input_horizon;
+	pred_window = (unsigned int)input_window;
+	pred_heavy_weight = (unsigned int)input_heavy_weight;
+	dm_pred.pending = false;
+	dm_pred.forced = false;
+	mutex_unlock(&dm_thread_lock);
+
+	return count;
+}
+#endif
+
 static struct global_attr enable_dm_hotplug =
 		__ATTR(enable_dm_hotplug, S_IRUGO | S_IWUSR,
 			show_enable_dm_hotplug, store_enable_dm_hotplug);
@@ -408,6 +499,12 @@ static struct global_attr dm_hotplug_stay_threshold =
 static struct global_attr dm_hotplug_delay =
 		__ATTR(dm_hotplug_delay, S_IRUGO | S_IWUSR,
 			show_dm_hotplug_delay, store_dm_hotplug_delay);
+
+#ifdef CONFIG_DM_HOTPLUG_PREDICTIVE
+static struct global_attr dm_hotplug_predictor =
+		__ATTR(dm_hotplug_predictor, S_IRUGO | S_IWUSR,
+			show_dm_hotplug_predictor, store_dm_hotplug_predictor);
+#endif
 #endif
 
 static inline u64 get_cpu_idle_time_jiffy(unsigned int cpu, u64 *wall)
@@ -959,6 +1056,20 @@ extern bool cluster_on[CA_END];
 #endif
 static int low_stay = 0;
 
+/*
+ * The command diagnose_condition() carries over when nothing changes.  While
+ * the predictor holds the big cluster in, prev_cmd is its forced CMD_NORMAL,
+ * which would confirm itself, so continue from the last reactive decision.
+ */
+static inline enum hotplug_cmd dm_reactive_base(void)
+{
+#ifdef CONFIG_DM_HOTPLUG_PREDICTIVE
+	if (dm_pred.forced)
+		return dm_pred.reactive;
+#endif
+	return prev_cmd;
+}
+
 static enum hotplug_cmd diagnose_condition(void)
 {
 	enum hotplug_cmd ret;
@@ -1003,7 +1114,7 @@ static enum hotplug_cmd diagnose_condition(void)
 
 #if defined(CONFIG_ARM_EXYNOS_MP_CPUFREQ)
 #ifdef CONFIG_DEFERRABLE_DM_HOTPLUG
-	ret = prev_cmd;
+	ret = dm_reactive_base();
 #else
 	ret = CMD_LITTLE_IN;
 #endif // CONFIG_DEFERRABLE_DM_HOTPLUG
@@ -1093,6 +1204,104 @@ static void calc_load(void)
 	return;
 }
 
+#ifdef CONFIG_DM_HOTPLUG_PREDICTIVE
+static int dm_predict_demand(void)
+{
+	struct dm_predictor *p = &dm_pred;
+	int nr_avg, iowait_avg, oldest, newest, slope = 0;
+	unsigned int nr_heavy, n;
+
+	sched_get_nr_running_avg(&nr_avg, &iowait_avg);
+	nr_heavy = sched_get_nr_heavy_task();
+
+	trace_dm_hotplug_sample(nr_avg, iowait_avg, nr_heavy, cur_load_freq,
+				num_online_cpus());
+
+	p->nr_hist[p->head] = nr_avg;
+	p->head = (p->head + 1) % PRED_HIST_SIZE;
+	if (p->count < PRED_HIST_SIZE)
+		p->count++;
+
+	if (p->count == 1)
+		p->ewma = nr_avg;
+	else
+		p->ewma = (p->ewma * 3 + nr_avg) / 4;
+
+	/* average slope over the recorded history, per polling period */
+	n = p->count;
+	if (n > 1) {
+		newest = p->nr_hist[(p->head + PRED_HIST_SIZE - 1) % PRED_HIST_SIZE];
+		oldest = p->nr_hist[(p->head + PRED_HIST_SIZE - n) % PRED_HIST_SIZE];
+		slope = (newest - oldest) / (int)(n - 1);
+	}
+
+	p->predicted = p->ewma + slope * (int)pred_horizon +
+			(int)(nr_heavy * pred_heavy_weight);
+	if (p->predicted < 0)
+		p->predicted = 0;
+
+	return p->predicted;
+}
+
+/*
+ * Returns the command to execute given the reactive decision of
+ * diagnose_condition().  The predictor may only bring the big cluster in
+ * earlier; hotplug-out stays under the control of the reactive path once a
+ * prediction has been resolved.
+ */
+static enum hotplug_cmd dm_predict_cmd(enum hotplug_cmd reactive)
+{
+	struct dm_predictor *p = &dm_pred;
+	enum hotplug_cmd cmd = reactive;
+	int predicted;
+
+	predicted = dm_predict_demand();
+
+	p->reactive = reactive;
+	p->forced = false;
+
+	if (!pred_enabled || !lcd_is_on || forced_hotplug ||
+		in_low_power_mode) {
+		p->pending = false;
+		trace_dm_hotplug_predict(predicted, reactive, reactive);
+		return reactive;
+	}
+
+	if (p->pending) {
+		if (reactive == CMD_NORMAL) {
+			p->hits++;
+			trace_dm_hotplug_hit(predicted, p->pending_age);
+			p->pending = false;
+		} else if (++p->pending_age > pred_window) {
+			p->mispredicts++;
+			trace_dm_hotplug_mispredict(predicted, p->pending_age);
+			p->pending = false;
+		} else {
+			cmd = CMD_NORMAL;
+		}
+	} else if (reactive == CMD_NORMAL && prev_cmd != CMD_NORMAL) {
+		p->misses++;
+		trace_dm_hotplug_miss(predicted, 0);
+	} else if (reactive != CMD_NORMAL && prev_cmd != CMD_NORMAL &&
+		predicted >= (int)pred_threshold) {
+		p->decisions++;
+		p->pending = true;
+		p->pending_age = 0;
+		cmd = CMD_NORMAL;
+	}
+
+	p->forced = cmd != reactive;
+	trace_dm_hotplug_predict(predicted, reactive, cmd);
+
+	return cmd;
+}
+#else
+static inline enum hotplug_cmd dm_predict_cmd(enum hotplug_cmd reactive)
+{
+	return reactive;
+}
+#endif
+
 static int on_run(void *data)
 {
 	int on_cpu = 0;
@@ -1129,7 +1338,7 @@ static int on_run(void *data)
 		}
 #endif // MEIZU_SPECIFIC
 		calc_load();
-		exe_cmd = diagnose_condition();
+		exe_cmd = dm_predict_cmd(diagnose_condition());
 #ifdef DM_HOTPLUG_DEBUG
 		pr_info("frequency info : %d, prev_cmd %d, exe_cmd %d\n",
 				cur_load_freq, prev_cmd, exe_cmd);
@@ -1470,6 +1679,15 @@ static int __init dm_cpu_hotplug_init(void)
 			__func__);
 		goto err_dm_hotplug_delay;
 	}
+
+#ifdef CONFIG_DM_HOTPLUG_PREDICTIVE
+	ret = sysfs_create_file(power_kobj, &dm_hotplug_predictor.attr);
+	if (ret) {
+		pr_err("%s: failed to create dm_hotplug_predictor sysfs interface\n",
+			__func__);
+		goto err_dm_hotplug_predictor;
+	}
+#endif
 #endif
 
 #ifdef CONFIG_ARM_EXYNOS_MP_CPUFREQ
@@ -1535,6 +1753,10 @@ err_wq:
 err_policy:
 #endif
 #ifdef CONFIG_PM
+#ifdef CONFIG_DM_HOTPLUG_PREDICTIVE
+	sysfs_remove_file(power_kobj, &dm_hotplug_predictor.attr);
+err_dm_hotplug_predictor:
+#endif
 	sysfs_remove_file(power_kobj, &dm_hotplug_delay.attr);
 err_dm_hotplug_delay:
 	sysfs_remove_file(power_kobj, &dm_hotplug_stay_threshold.attr);
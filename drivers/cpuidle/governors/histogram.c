@@ -0,0 +1,267 @@
+/*
+ * histogram.c - the wakeup history idle governor
+ *
+ * Keeps, for every CPU, a small decaying histogram of recent idle
+ * durations split by what ended them: the timer that was expected when
+ * the state was selected, or any other interrupt.  Timer wakeups are
+ * fully predictable from the next timer event, so only the distribution
+ * of non-timer wakeups has to be learned.  The deepest state whose target
+ * residency is met with the configured confidence is selected.
+ *
+ * This code is licenced under the GPL version 2 as described
+ * in the COPYING file that acompanies the Linux Kernel.
+ */
+
+#include <linux/kernel.h>
+#include <linux/cpuidle.h>
+#include <linux/pm_qos.h>
+#include <linux/time.h>
+#include <linux/ktime.h>
+#include <linux/hrtimer.h>
+#include <linux/tick.h>
+#include <linux/sched.h>
+#include <linux/module.h>
+#include <linux/log2.h>
+
+#define BUCKETS		16
+#define DECAY_PERIOD	64
+#define TIMER_SLACK_US	50
+
+/* percentage of the history that must outlast a state's target residency */
+static unsigned int confidence __read_mostly = 80;
+module_param(confidence, uint, 0644);
+
+enum hist_wakeup_type {
+	HIST_WAKEUP_TIMER,
+	HIST_WAKEUP_IRQ,
+	NR_HIST_WAKEUP,
+};
+
+struct hist_device {
+	int		last_state_idx;
+	int		needs_update;
+
+	unsigned int	next_timer_us;
+	unsigned int	shallower_us;
+
+	/* bucket b counts idle periods in [2^b, 2^(b+1)) us */
+	unsigned int	hist[NR_HIST_WAKEUP][BUCKETS];
+	unsigned int	total[NR_HIST_WAKEUP];
+	unsigned int	samples;
+
+	struct cpuidle_hist_stats stats;
+};
+
+static DEFINE_PER_CPU(struct hist_device, hist_devices);
+
+static inline int which_bucket(unsigned int duration)
+{
+	if (!duration)
+		return 0;
+
+	return min_t(int, ilog2(duration), BUCKETS - 1);
+}
+
+/*
+ * Number of recorded idle periods that would have lasted at least
+ * @residency us.  The caller has checked that the next timer is further
+ * away than @residency, so all timer driven periods qualify; the rest is
+ * estimated from the IRQ histogram, counting only buckets that lie
+ * entirely above @residency.
+ */
+static unsigned int hist_count_above(struct hist_device *data,
+				     unsigned int residency)
+{
+	unsigned int count = data->total[HIST_WAKEUP_TIMER];
+	int b;
+
+	for (b = which_bucket(residency) + 1; b < BUCKETS; b++)
+		count += data->hist[HIST_WAKEUP_IRQ][b];
+
+	return count;
+}
+
+static void hist_decay(struct hist_device *data)
+{
+	int t, b;
+
+	for (t = 0; t < NR_HIST_WAKEUP; t++) {
+		data->total[t] = 0;
+		for (b = 0; b < BUCKETS; b++) {
+			data->hist[t][b] >>= 1;
+			data->total[t] += data->hist[t][b];
+		}
+	}
+}
+
+/**
+ * hist_update - classify the last wakeup and account it
+ * @drv: cpuidle driver containing state data
+ * @dev: the CPU
+ */
+static void hist_update(struct cpuidle_driver *drv, struct cpuidle_device *dev)
+{
+	struct hist_device *data = &__get_cpu_var(hist_devices);
+	int last_idx = data->last_state_idx;
+	struct cpuidle_state *target = &drv->states[last_idx];
+	unsigned int measured_us = cpuidle_get_last_residency(dev);
+	enum hist_wakeup_type type;
+
+	/* no residency measurement, assume the timer woke us up */
+	if (unlikely(!(target->flags & CPUIDLE_FLAG_TIME_VALID)))
+		measured_us = data->next_timer_us;
+
+	if (measured_us + TIMER_SLACK_US >= data->next_timer_us) {
+		type = HIST_WAKEUP_TIMER;
+		data->stats.timer_wakeups++;
+	} else {
+		type = HIST_WAKEUP_IRQ;
+		data->stats.irq_wakeups++;
+	}
+
+	data->hist[type][which_bucket(measured_us)]++;
+	data->total[type]++;
+
+	if (last_idx > CPUIDLE_DRIVER_STATE_START &&
+	    measured_us < target->target_residency)
+		data->stats.too_deep++;
+	else if (data->shallower_us && measured_us >= data->shallower_us)
+		data->stats.too_shallow++;
+
+	if (++data->samples >= DECAY_PERIOD) {
+		hist_decay(data);
+		data->samples = 0;
+	}
+}
+
+/**
+ * hist_select - selects the next idle state to enter
+ * @drv: cpuidle driver containing state data
+ * @dev: the CPU
+ */
+static int hist_select(struct cpuidle_driver *drv, struct cpuidle_device *dev)
+{
+	struct hist_device *data = &__get_cpu_var(hist_devices);
+	int latency_req = pm_qos_request(PM_QOS_CPU_DMA_LATENCY);
+	unsigned int total;
+	int i;
+
+	if (data->needs_update) {
+		hist_update(drv, dev);
+		data->needs_update = 0;
+	}
+
+	data->last_state_idx = CPUIDLE_DRIVER_STATE_START;
+	data->shallower_us = 0;
+
+	/* Special case when user has set very strict latency requirement */
+	if (unlikely(latency_req == 0))
+		return 0;
+
+	data->next_timer_us = ktime_to_us(tick_nohz_get_sleep_length());
+
+	total = data->total[HIST_WAKEUP_TIMER] + data->total[HIST_WAKEUP_IRQ];
+
+	for (i = drv->state_count - 1; i > CPUIDLE_DRIVER_STATE_START; i--) {
+		struct cpuidle_state *s = &drv->states[i];
+		struct cpuidle_state_usage *su = &dev->states_usage[i];
+
+		if (s->disabled || su->disable)
+			continue;
+		if (s->exit_latency > latency_req)
+			continue;
+		if (s->target_residency > data->next_timer_us)
+			continue;
+
+		if (!total || hist_count_above(data, s->target_residency) * 100 >=
+		    confidence * total) {
+			data->last_state_idx = i;
+			break;
+		}
+
+		/* rejected on the history alone */
+		data->shallower_us = s->target_residency;
+	}
+
+	return data->last_state_idx;
+}
+
+/**
+ * hist_reflect - records that data structures need update
+ * @dev: the CPU
+ * @index: the index of actual entered state
+ */
+static void hist_reflect(struct cpuidle_device *dev, int index)
+{
+	struct hist_device *data = &__get_cpu_var(hist_devices);
+
+	data->last_state_idx = index;
+	if (index >= 0)
+		data->needs_update = 1;
+}
+
+/**
+ * hist_enable_device - scans a CPU's states and does setup
+ * @drv: cpuidle driver
+ * @dev: the CPU
+ */
+static int hist_enable_device(struct cpuidle_driver *drv,
+			      struct cpuidle_device *dev)
+{
+	struct hist_device *data = &per_cpu(hist_devices, dev->cpu);
+
+	memset(data, 0, sizeof(struct hist_device));
+
+	return 0;
+}
+
+/**
+ * cpuidle_hist_get_stats - read the prediction statistics of a CPU
+ * @cpu: the CPU
+ * @stats: filled with the counters accumulated since the last reset
+ */
+void cpuidle_hist_get_stats(int cpu, struct cpuidle_hist_stats *stats)
+{
+	*stats = per_cpu(hist_devices, cpu).stats;
+}
+
+/**
+ * cpuidle_hist_reset_stats - clear the prediction statistics
+ *
+ * Must be called on the CPU whose statistics are cleared.
+ */
+void cpuidle_hist_reset_stats(void)
+{
+	struct hist_device *data = &__get_cpu_var(hist_devices);
+
+	memset(&data->stats, 0, sizeof(data->stats));
+}
+
+static struct cpuidle_governor hist_governor = {
+	.name =		"histogram",
+	.rating =	30,
+	.enable =	hist_enable_device,
+	.select =	hist_select,
+	.reflect =	hist_reflect,
+	.owner =	THIS_MODULE,
+};
+
+/**
+ * init_hist - initializes the governor
+ */
+static int __init init_hist(void)
+{
+	return cpuidle_register_governor(&hist_governor);
+}
+
+/**
+ * exit_hist - exits the governor
+ */
+static void __exit exit_hist(void)
+{
+	cpuidle_unregister_governor(&hist_governor);
+}
+
+MODULE_LICENSE("GPL");
+module_init(init_hist);
+module_exit(exit_hist);
@@ -1551,9 +1551,35 @@ static ssize_t isolated_store(struct device *dev, struct device_attribute *attr,
 	return count;
 }
 
+/*
+ * Writing the size of an upcoming allocation in bytes, optionally followed
+ * by its alignment, lets a region that is not isolated migrate the pages in
+ * the way out in the background, e.g. before a camera starts.
+ */
+static ssize_t prepare_store(struct device *dev, struct device_attribute *attr,
+				const char *buf, size_t count)
+{
+	unsigned long size, align = PAGE_SIZE;
+	int ret;
+
+	if (sscanf(buf, "%lu %lu", &size, &align) < 1 || !size)
+		return -EINVAL;
+
+	if (!align)
+		align = PAGE_SIZE;
+
+	ret = dma_contiguous_prepare(dev, PAGE_ALIGN(size) >> PAGE_SHIFT,
+				     get_order(align));
+	if (ret)
+		return ret;
+
+	return count;
+}
+
 static struct device_attribute cma_regname_attr = __ATTR_RO(region_name);
 static struct device_attribute cma_regid_attr = __ATTR_RO(region_id);
 static DEVICE_ATTR(isolated, S_IRUSR | S_IWUSR, isolated_show, isolated_store);
+static DEVICE_ATTR(prepare, S_IWUSR, NULL, prepare_store);
 
 static int __init ion_exynos_contigheap_init(void)
 {
@@ -1618,6 +1644,11 @@ static int __init ion_exynos_contigheap_init(void)
 			dev_err(dev, "%s: Failed to create '%s' file. (%d)\n",
 				__func__, dev_attr_isolated.attr.name, ret);
 
+		ret = device_create_file(dev, &dev_attr_prepare);
+		if (ret)
+			dev_err(dev, "%s: Failed to create '%s' file. (%d)\n",
+				__func__, dev_attr_prepare.attr.name, ret);
+
 		mutex_init(&drvdata->lock);
 	}
 
@@ -2335,7 +2335,12 @@ static int mmc_blk_issue_rq(struct mmc_queue *mq, struct request *req)
 			atomic_set(&mq->mqrq_cur->index, index + 1);
 			atomic_inc(&card->host->areq_cnt);
 		}
-		if (!req && host->areq) {
+		/*
+		 * When the thread holds back a write to pack it, new
+		 * requests must not cut the wait short.
+		 */
+		if (!req && host->areq &&
+		    !(mq->flags & MMC_QUEUE_DEFER_PACKING)) {
 			spin_lock_irqsave(&host->context_info.lock, flags);
 			host->context_info.is_waiting_last_req = true;
 			spin_unlock_irqrestore(&host->context_info.lock, flags);
@@ -2824,6 +2829,17 @@ static int mmc_blk_probe(struct mmc_card *card)
 	mmc_set_drvdata(card, md);
 	mmc_fixup_device(card, blk_fixups);
 
+	/*
+	 * The user area is selected after init, so mmc_blk_part_switch()
+	 * would only enable command queueing after another partition has
+	 * been accessed.  Do it now.
+	 */
+	mmc_claim_host(card->host);
+	if (mmc_blk_cmdq_switch(card, 1))
+		pr_warn("%s: failed to enable cmdq mode\n",
+			md->disk->disk_name);
+	mmc_release_host(card->host);
+
 #ifdef CONFIG_MMC_BLOCK_DEFERRED_RESUME
 	mmc_set_bus_resume_policy(card->host, 1);
 #endif
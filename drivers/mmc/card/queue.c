@@ -90,6 +90,43 @@ int mmc_is_cmdq_full(struct mmc_host *host, int rt)
 	}
 }
 
+/*
+ * Without command queueing, the next request is prepared while the
+ * previous one transfers.  With packed writes, preparing a write behind
+ * another write would mostly send it alone.  Instead, let the transfer
+ * finish first, so that the writes queued meanwhile go out packed
+ * together.  This only pays when there is something to pack with: a
+ * lone write keeps the overlap of preparation and transfer.
+ */
+static bool mmc_queue_defer_packing(struct mmc_queue *mq, struct request *req)
+{
+	struct request_queue *q = mq->queue;
+	struct mmc_card *card = mq->card;
+	struct request *prev = mq->mqrq_prev->req;
+	struct request *next;
+
+	if (!mq->mqrq_cur->packed || !prev)
+		return false;
+
+	if (!card->ext_csd.max_packed_writes ||
+	    !mmc_host_packed_wr(card->host))
+		return false;
+
+	if (req->cmd_flags & MMC_REQ_SPECIAL_MASK)
+		return false;
+
+	if (rq_data_dir(req) != WRITE || rq_data_dir(prev) != WRITE)
+		return false;
+
+	/* another write must be queued behind req */
+	if (list_is_last(&req->queuelist, &q->queue_head))
+		return false;
+	next = list_entry(req->queuelist.next, struct request, queuelist);
+
+	return rq_data_dir(next) == WRITE &&
+		!(next->cmd_flags & MMC_REQ_SPECIAL_MASK);
+}
+
 static int mmc_queue_thread(void *d)
 {
 	struct mmc_queue *mq = d;
@@ -114,6 +151,12 @@ static int mmc_queue_thread(void *d)
 			req = NULL;
 			goto fetch_done;
 		}
+		if (!mq->card->ext_csd.cmdq_mode_en &&
+		    mmc_queue_defer_packing(mq, req)) {
+			mq->flags |= MMC_QUEUE_DEFER_PACKING;
+			req = NULL;
+			goto fetch_done;
+		}
 		req = blk_fetch_request(q);
 fetch_done:
 		if (!mq->card->ext_csd.cmdq_mode_en)
@@ -136,6 +179,7 @@ fetch_done:
 			set_current_state(TASK_RUNNING);
 			cmd_flags = req ? req->cmd_flags : 0;
 			mq->issue_fn(mq, req);
+			mq->flags &= ~MMC_QUEUE_DEFER_PACKING;
 			if (mq->flags & MMC_QUEUE_NEW_REQUEST) {
 				mq->flags &= ~MMC_QUEUE_NEW_REQUEST;
 				continue; /* fetch again */
@@ -345,6 +345,65 @@ void mmc_handle_queued_request(struct mmc_host *host)
 	mmc_run_queue(host, 1);
 }
 
+/**
+ *	mmc_cmdq_task_done - finish a task of a command queue engine
+ *	@host: MMC host which completed the task
+ *	@mrq: data request of the task
+ *
+ *	Hosts implementing ->cmdq_request() call this instead of
+ *	mmc_request_done() once the data of a task has been transferred,
+ *	or the task has failed.  It ends the block request, so it must not
+ *	be called from hard interrupt context.
+ */
+void mmc_cmdq_task_done(struct mmc_host *host, struct mmc_request *mrq)
+{
+	struct mmc_command *cmd = mrq->cmd;
+	int err;
+
+	led_trigger_event(host->led, LED_OFF);
+	trace_mmc_blk_rw_end(cmd->opcode, cmd->arg, mrq->data);
+
+	err = mrq->areq->err_check(host->card, mrq->areq);
+	mmc_post_req(host, mrq, 0);
+	mmc_blk_end_queued_req(host, mrq->areq, cmd->arg >> 16, err);
+
+	mmc_host_clk_release(host);
+
+	wake_up_interruptible(&host->cmp_que);
+}
+EXPORT_SYMBOL(mmc_cmdq_task_done);
+
+/*
+ * Hand a task over to the command queue engine of the host.  The data
+ * request is set up here, as mmc_wait_cmdq_done() does for the CMD46/47
+ * it queues itself.
+ */
+static void mmc_cmdq_start_task(struct mmc_host *host, struct mmc_request *mrq)
+{
+	struct mmc_request *dat_mrq = mrq->areq->mrq;
+	int err;
+
+	dat_mrq->host = host;
+	dat_mrq->cmd->error = 0;
+	dat_mrq->cmd->mrq = dat_mrq;
+	dat_mrq->cmd->data = dat_mrq->data;
+	dat_mrq->data->error = 0;
+	dat_mrq->data->bytes_xfered = 0;
+	dat_mrq->data->mrq = dat_mrq;
+	if (dat_mrq->stop) {
+		dat_mrq->data->stop = dat_mrq->stop;
+		dat_mrq->stop->error = 0;
+		dat_mrq->stop->mrq = dat_mrq;
+	}
+
+	err = host->ops->cmdq_request(host, mrq);
+	if (err) {
+		dat_mrq->cmd->error = err;
+		dat_mrq->data->error = err;
+		mmc_cmdq_task_done(host, dat_mrq);
+	}
+}
+
 static void
 mmc_start_request(struct mmc_host *host, struct mmc_request *mrq)
 {
@@ -407,10 +466,14 @@ mmc_start_request(struct mmc_host *host, struct mmc_request *mrq)
 
 	if (host->card && host->card->ext_csd.cmdq_mode_en &&
 	    mrq->done == mmc_wait_cmdq_done) {
-		mmc_enqueue_queue(host, mrq);
 		mmc_host_clk_hold(host);
 		led_trigger_event(host->led, LED_FULL);
-		mmc_run_queue(host, 0);
+		if (host->ops->cmdq_request) {
+			mmc_cmdq_start_task(host, mrq);
+		} else {
+			mmc_enqueue_queue(host, mrq);
+			mmc_run_queue(host, 0);
+		}
 	} else {
 		mmc_host_clk_hold(host);
 		led_trigger_event(host->led, LED_FULL);
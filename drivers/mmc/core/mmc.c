@@ -1482,6 +1482,27 @@ static int mmc_init_card(struct mmc_host *host, u32 ocr,
 			 */
 			mmc_bkops_enable(oldcard->host, oldcard->bkops_enable);
 		}
+
+		/*
+		 * The card left command queue mode with the reset,
+		 * put it back the way the block driver left it.
+		 */
+		if (oldcard->ext_csd.cmdq_mode_en) {
+			err = mmc_switch(card, EXT_CSD_CMD_SET_NORMAL,
+					 EXT_CSD_CMDQ_MODE_EN, 1,
+					 card->ext_csd.generic_cmd6_time);
+			if (!err && card->ext_csd.qrdy_function)
+				err = mmc_switch(card, EXT_CSD_CMD_SET_NORMAL,
+						 EXT_CSD_CMDQ_QRDY_FUNCTION, 1,
+						 card->ext_csd.generic_cmd6_time);
+			if (err) {
+				pr_warn("%s: restoring cmdq mode failed (%d)\n",
+					mmc_hostname(card->host), err);
+				card->ext_csd.cmdq_mode_en = 0;
+				card->ext_csd.qrdy_function = 0;
+				err = 0;
+			}
+		}
 	}
 
 	if (!oldcard)
@@ -0,0 +1,897 @@
+/*
+ * Emulated eMMC host controller.
+ *
+ * Registers an MMC host with an eMMC device behind it that keeps its data
+ * in memory.  The device supports packed writes and command queueing,
+ * either through CMD44 to CMD47 sequenced by the MMC core, or through a
+ * command queue engine in the host.  Every command completes after a
+ * configurable latency, so that the block driver and the core can be
+ * exercised and measured without hardware.
+ *
+ * See Documentation/mmc/mmc-mock.txt
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/platform_device.h>
+#include <linux/interrupt.h>
+#include <linux/hrtimer.h>
+#include <linux/scatterlist.h>
+#include <linux/spinlock.h>
+#include <linux/vmalloc.h>
+#include <linux/mmc/host.h>
+#include <linux/mmc/card.h>
+#include <linux/mmc/mmc.h>
+#include <linux/mmc/core.h>
+
+#define DRIVER_NAME		"mmc_mock"
+
+#define MOCK_MAX_REQ_SIZE	(512 * 1024)
+#define MOCK_OCR		0x00ff8080	/* 1.7-1.95V and 2.7-3.6V */
+#define MOCK_OCR_SECTOR_MODE	(1 << 30)
+
+/* Packed command header, as built by the block driver */
+#define MOCK_PACKED_VER		0x01
+#define MOCK_PACKED_WR		0x02
+#define MOCK_PACKED_MAX		63
+
+/* Fields of the CMD44 argument */
+#define MOCK_QC_TAG(arg)	(((arg) >> 16) & 0x1f)
+#define MOCK_QC_PRIO		(1 << 23)
+
+static unsigned int size_mb = 128;
+module_param(size_mb, uint, S_IRUGO);
+MODULE_PARM_DESC(size_mb, "Size of the device in MB");
+
+static bool cmdq = true;
+module_param(cmdq, bool, S_IRUGO);
+MODULE_PARM_DESC(cmdq, "Support command queueing");
+
+static unsigned int cmdq_depth = 16;
+module_param(cmdq_depth, uint, S_IRUGO);
+MODULE_PARM_DESC(cmdq_depth, "Number of command queue tasks (3-16)");
+
+static bool cmdq_engine;
+module_param(cmdq_engine, bool, S_IRUGO);
+MODULE_PARM_DESC(cmdq_engine, "Emulate a host command queue engine instead of queueing with CMD44-47");
+
+static bool packed = true;
+module_param(packed, bool, S_IRUGO);
+MODULE_PARM_DESC(packed, "Support packed writes");
+
+static unsigned long cmd_nsec = 10000;
+module_param(cmd_nsec, ulong, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(cmd_nsec, "Latency of commands without data, in ns");
+
+static unsigned long read_nsec = 100000;
+module_param(read_nsec, ulong, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(read_nsec, "Base latency of reads, in ns");
+
+static unsigned long write_nsec = 300000;
+module_param(write_nsec, ulong, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(write_nsec, "Base latency of writes, in ns");
+
+static unsigned int read_mbps = 200;
+module_param(read_mbps, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(read_mbps, "Read bandwidth in MB/s, 0 for unlimited");
+
+static unsigned int write_mbps = 80;
+module_param(write_mbps, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(write_mbps, "Write bandwidth in MB/s, 0 for unlimited");
+
+struct mmc_mock_host;
+
+/*
+ * The command and the data lines are busy independently: in command queue
+ * mode the core sends CMD13 and CMD44/45 while a CMD46/47 transfers.
+ */
+struct mmc_mock_slot {
+	struct mmc_mock_host	*host;
+	struct mmc_request	*mrq;
+	struct hrtimer		timer;
+	bool			expired;
+	bool			task;		/* run by the engine */
+};
+
+struct mmc_mock_task {
+	u32			qc_arg;		/* CMD44 argument */
+	u32			addr;		/* CMD45 argument */
+	u64			seq;
+	struct mmc_request	*mrq;		/* engine: CMD44/45 request */
+};
+
+struct mmc_mock_host {
+	struct mmc_host		*mmc;
+	spinlock_t		lock;
+	struct tasklet_struct	tasklet;
+
+	u8			*store;
+	u32			sectors;
+	u8			*bounce;	/* for packed writes */
+
+	u32			cid[4];
+	u32			csd[4];
+	u8			ext_csd[512];
+	unsigned int		state;		/* R1_STATE_* */
+	unsigned int		rca;
+	bool			switch_error;
+	u32			erase_start;
+	u32			erase_end;
+
+	struct mmc_mock_slot	cmd_slot;
+	struct mmc_mock_slot	dat_slot;
+
+	/* Command queue, protected by lock */
+	struct mmc_mock_task	task[EMMC_MAX_QUEUE_DEPTH];
+	unsigned long		queued;		/* tasks waiting to execute */
+	unsigned int		qc_tag;		/* tag of the last CMD44 */
+	int			selected;	/* task reported ready */
+	bool			qrdy;		/* queue ready signalled */
+	u64			seq;
+};
+
+static void mmc_mock_stuff_bits(u32 *resp, unsigned int start,
+				unsigned int size, u32 val)
+{
+	unsigned int off = 3 - start / 32;
+	unsigned int shft = start & 31;
+
+	resp[off] |= val << shft;
+	if (size + shft > 32)
+		resp[off - 1] |= val >> (32 - shft);
+}
+
+static void mmc_mock_init_regs(struct mmc_mock_host *host, int id)
+{
+	u32 *cid = host->cid, *csd = host->csd;
+	u8 *ext_csd = host->ext_csd;
+	static const char name[] = "MOCK01";
+	int i;
+
+	mmc_mock_stuff_bits(cid, 104, 16, 0x4d4b);		/* oemid */
+	for (i = 0; i < 6; i++)
+		mmc_mock_stuff_bits(cid, 96 - i * 8, 8, name[i]);
+	mmc_mock_stuff_bits(cid, 48, 8, 0x10);			/* prv */
+	mmc_mock_stuff_bits(cid, 16, 32, 0x4d00 + id);		/* serial */
+
+	mmc_mock_stuff_bits(csd, 126, 2, 3);	/* version in EXT_CSD */
+	mmc_mock_stuff_bits(csd, 122, 4, 4);	/* MMC v4 */
+	mmc_mock_stuff_bits(csd, 112, 8, 0x0e);	/* taac: 1ms */
+	mmc_mock_stuff_bits(csd, 96, 8, 0x32);	/* 26MHz */
+	mmc_mock_stuff_bits(csd, 84, 12, 0x0f5);
+	mmc_mock_stuff_bits(csd, 80, 4, 9);	/* 512 byte reads */
+	mmc_mock_stuff_bits(csd, 62, 12, 0xfff);	/* capacity in EXT_CSD */
+	mmc_mock_stuff_bits(csd, 47, 3, 7);
+	mmc_mock_stuff_bits(csd, 42, 5, 31);	/* erase group size */
+	mmc_mock_stuff_bits(csd, 37, 5, 31);
+	mmc_mock_stuff_bits(csd, 26, 3, 2);
+	mmc_mock_stuff_bits(csd, 22, 4, 9);	/* 512 byte writes */
+
+	ext_csd[EXT_CSD_REV] = 7;
+	ext_csd[EXT_CSD_STRUCTURE] = 2;
+	ext_csd[EXT_CSD_CARD_TYPE] = EXT_CSD_CARD_TYPE_26 |
+				     EXT_CSD_CARD_TYPE_52;
+	for (i = 0; i < 4; i++)
+		ext_csd[EXT_CSD_SEC_CNT + i] = host->sectors >> (i * 8);
+	ext_csd[EXT_CSD_S_A_TIMEOUT] = 0x10;
+	ext_csd[EXT_CSD_HC_WP_GRP_SIZE] = 1;
+	ext_csd[EXT_CSD_HC_ERASE_GRP_SIZE] = 1;
+	ext_csd[EXT_CSD_ERASE_TIMEOUT_MULT] = 1;
+	ext_csd[EXT_CSD_TRIM_MULT] = 1;
+	ext_csd[EXT_CSD_SEC_FEATURE_SUPPORT] = EXT_CSD_SEC_GB_CL_EN;
+	ext_csd[EXT_CSD_REL_WR_SEC_C] = 1;
+	ext_csd[EXT_CSD_WR_REL_PARAM] = EXT_CSD_WR_REL_PARAM_EN;
+	ext_csd[EXT_CSD_PART_SWITCH_TIME] = 1;
+	ext_csd[EXT_CSD_GENERIC_CMD6_TIME] = 1;
+	ext_csd[EXT_CSD_CACHE_SIZE + 1] = 4;	/* 1MB */
+	if (packed) {
+		ext_csd[EXT_CSD_MAX_PACKED_WRITES] = 32;
+		ext_csd[EXT_CSD_MAX_PACKED_READS] = 32;
+	}
+	if (cmdq) {
+		ext_csd[EXT_CSD_CMDQ_SUPPORT] = 1;
+		ext_csd[EXT_CSD_CMDQ_DEPTH] = cmdq_depth - 1;
+		ext_csd[EXT_CSD_QRDY_SUPPORT] = 1;
+	}
+}
+
+/* Power up or CMD0 */
+static void mmc_mock_reset(struct mmc_mock_host *host)
+{
+	u8 *ext_csd = host->ext_csd;
+	unsigned long flags;
+
+	host->state = R1_STATE_IDLE;
+	host->rca = 0;
+	host->switch_error = false;
+
+	ext_csd[EXT_CSD_CMDQ_MODE_EN] = 0;
+	ext_csd[EXT_CSD_CMDQ_QRDY_FUNCTION] = 0;
+	ext_csd[EXT_CSD_CACHE_CTRL] = 0;
+	ext_csd[EXT_CSD_PART_CONFIG] = 0;
+	ext_csd[EXT_CSD_BUS_WIDTH] = 0;
+	ext_csd[EXT_CSD_HS_TIMING] = 0;
+
+	spin_lock_irqsave(&host->lock, flags);
+	host->queued = 0;
+	host->selected = -1;
+	host->qrdy = false;
+	spin_unlock_irqrestore(&host->lock, flags);
+}
+
+static u32 mmc_mock_status(struct mmc_mock_host *host)
+{
+	u32 status = R1_READY_FOR_DATA | host->state << 9;
+
+	if (host->switch_error) {
+		status |= R1_SWITCH_ERROR;
+		host->switch_error = false;
+	}
+	return status;
+}
+
+static u64 mmc_mock_nsec(struct mmc_request *mrq)
+{
+	struct mmc_data *data = mrq->data;
+	unsigned int mbps;
+	u64 nsec;
+
+	if (!data)
+		return cmd_nsec;
+
+	if (data->flags & MMC_DATA_READ) {
+		nsec = read_nsec;
+		mbps = read_mbps;
+	} else {
+		nsec = write_nsec;
+		mbps = write_mbps;
+	}
+	if (mbps)
+		nsec += div_u64((u64)data->blocks * data->blksz * 1000, mbps);
+	return nsec;
+}
+
+/* Called with lock held, on an idle slot */
+static void mmc_mock_start(struct mmc_mock_host *host,
+			   struct mmc_mock_slot *slot,
+			   struct mmc_request *mrq, bool task)
+{
+	slot->mrq = mrq;
+	slot->task = task;
+	slot->expired = false;
+	hrtimer_start(&slot->timer, ns_to_ktime(mmc_mock_nsec(mrq)),
+		      HRTIMER_MODE_REL);
+}
+
+static bool mmc_mock_task_before(struct mmc_mock_task *a,
+				 struct mmc_mock_task *b)
+{
+	bool rt_a = a->qc_arg & MOCK_QC_PRIO;
+	bool rt_b = b->qc_arg & MOCK_QC_PRIO;
+
+	if (rt_a != rt_b)
+		return rt_a;
+	return a->seq < b->seq;
+}
+
+/*
+ * The task the device executes next: real time tasks first, the others
+ * in the order they were queued.  Called with lock held.
+ */
+static int mmc_mock_next_task(struct mmc_mock_host *host)
+{
+	int tag, next = -1;
+
+	for_each_set_bit(tag, &host->queued, EMMC_MAX_QUEUE_DEPTH) {
+		if (next < 0 ||
+		    mmc_mock_task_before(&host->task[tag], &host->task[next]))
+			next = tag;
+	}
+	return next;
+}
+
+/* Engine: start the next task if the data lines are free */
+static void mmc_mock_engine_next(struct mmc_mock_host *host)
+{
+	int tag;
+
+	if (host->dat_slot.mrq)
+		return;
+
+	tag = mmc_mock_next_task(host);
+	if (tag < 0)
+		return;
+
+	__clear_bit(tag, &host->queued);
+	mmc_mock_start(host, &host->dat_slot, host->task[tag].mrq->areq->mrq,
+		       true);
+}
+
+static void mmc_mock_packed_write(struct mmc_mock_host *host,
+				  struct mmc_data *data)
+{
+	unsigned int blocks = data->blocks, used = 1, nr, i;
+	u32 *hdr = (u32 *)host->bounce;
+	u8 *buf = host->bounce + 512;
+
+	if (blocks << 9 > MOCK_MAX_REQ_SIZE || !(data->flags & MMC_DATA_WRITE))
+		goto err;
+
+	sg_copy_to_buffer(data->sg, data->sg_len, host->bounce, blocks << 9);
+
+	nr = (hdr[0] >> 16) & 0xff;
+	if ((hdr[0] & 0xffff) != (MOCK_PACKED_WR << 8 | MOCK_PACKED_VER) ||
+	    !nr || nr > MOCK_PACKED_MAX)
+		goto err;
+
+	for (i = 1; i <= nr; i++) {
+		u32 cnt = hdr[i * 2] & 0xffff;
+		u32 addr = hdr[i * 2 + 1];
+
+		if (addr >= host->sectors || cnt > host->sectors - addr ||
+		    cnt > blocks - used)
+			goto err;
+		memcpy(host->store + ((size_t)addr << 9), buf, cnt << 9);
+		buf += cnt << 9;
+		used += cnt;
+	}
+
+	data->bytes_xfered = blocks << 9;
+	return;
+err:
+	data->error = -EIO;
+}
+
+static void mmc_mock_rw(struct mmc_mock_host *host, struct mmc_data *data,
+			u32 addr, bool packed_wr)
+{
+	unsigned int blocks = data->blocks;
+	void *buf = host->store + ((size_t)addr << 9);
+
+	if (data->blksz != 512) {
+		data->error = -EINVAL;
+		return;
+	}
+
+	if (packed_wr) {
+		mmc_mock_packed_write(host, data);
+		return;
+	}
+
+	if (addr >= host->sectors || blocks > host->sectors - addr) {
+		data->error = -EIO;
+		return;
+	}
+
+	if (data->flags & MMC_DATA_READ)
+		sg_copy_from_buffer(data->sg, data->sg_len, buf, blocks << 9);
+	else
+		sg_copy_to_buffer(data->sg, data->sg_len, buf, blocks << 9);
+	data->bytes_xfered = blocks << 9;
+}
+
+static void mmc_mock_switch(struct mmc_mock_host *host, u32 arg)
+{
+	unsigned int mode = (arg >> 24) & 0x3;
+	unsigned int index = (arg >> 16) & 0xff;
+	u8 value = (arg >> 8) & 0xff;
+	u8 *ext_csd = host->ext_csd;
+
+	if (index == EXT_CSD_FLUSH_CACHE)
+		return;
+
+	/* Only the modes segment is writable */
+	if (index >= EXT_CSD_REV || index == EXT_CSD_QRDY_SUPPORT)
+		goto err;
+
+	switch (mode) {
+	case MMC_SWITCH_MODE_SET_BITS:
+		value |= ext_csd[index];
+		break;
+	case MMC_SWITCH_MODE_CLEAR_BITS:
+		value = ext_csd[index] & ~value;
+		break;
+	case MMC_SWITCH_MODE_WRITE_BYTE:
+		break;
+	default:
+		goto err;
+	}
+
+	if (index == EXT_CSD_CMDQ_MODE_EN) {
+		if (value && !ext_csd[EXT_CSD_CMDQ_SUPPORT])
+			goto err;
+		spin_lock_irq(&host->lock);
+		host->queued = 0;
+		host->selected = -1;
+		spin_unlock_irq(&host->lock);
+	}
+	ext_csd[index] = value;
+	return;
+err:
+	host->switch_error = true;
+}
+
+static void mmc_mock_erase(struct mmc_mock_host *host, u32 arg)
+{
+	u32 start = host->erase_start, end = host->erase_end;
+
+	if (start > end || end >= host->sectors)
+		return;
+
+	/* Discarded data stays readable until the device reuses it */
+	if (arg == MMC_DISCARD_ARG)
+		return;
+
+	memset(host->store + ((size_t)start << 9), 0,
+	       (size_t)(end - start + 1) << 9);
+}
+
+static void mmc_mock_command(struct mmc_mock_host *host,
+			     struct mmc_command *cmd, struct mmc_data *data,
+			     u32 sbc_arg)
+{
+	u32 arg = cmd->arg;
+	unsigned int tag;
+
+	cmd->error = 0;
+	memset(cmd->resp, 0, sizeof(cmd->resp));
+
+	switch (cmd->opcode) {
+	case MMC_GO_IDLE_STATE:
+		mmc_mock_reset(host);
+		break;
+	case MMC_SEND_OP_COND:
+		cmd->resp[0] = MMC_CARD_BUSY | MOCK_OCR_SECTOR_MODE | MOCK_OCR;
+		if (arg)
+			host->state = R1_STATE_READY;
+		break;
+	case MMC_ALL_SEND_CID:
+		memcpy(cmd->resp, host->cid, sizeof(host->cid));
+		host->state = R1_STATE_IDENT;
+		break;
+	case MMC_SET_RELATIVE_ADDR:
+		host->rca = arg >> 16;
+		host->state = R1_STATE_STBY;
+		cmd->resp[0] = mmc_mock_status(host);
+		break;
+	case MMC_SEND_CSD:
+		memcpy(cmd->resp, host->csd, sizeof(host->csd));
+		break;
+	case MMC_SEND_CID:
+		memcpy(cmd->resp, host->cid, sizeof(host->cid));
+		break;
+	case MMC_SELECT_CARD:
+		cmd->resp[0] = mmc_mock_status(host);
+		if (host->rca && arg >> 16 == host->rca)
+			host->state = R1_STATE_TRAN;
+		else
+			host->state = R1_STATE_STBY;
+		break;
+	case MMC_SLEEP_AWAKE:
+		/* CMD5 is also the SDIO probe, with no RCA */
+		if (!host->rca || arg >> 16 != host->rca)
+			goto no_response;
+		cmd->resp[0] = mmc_mock_status(host);
+		break;
+	case MMC_SWITCH:
+		if (host->state != R1_STATE_TRAN)
+			goto no_response;
+		cmd->resp[0] = mmc_mock_status(host);
+		mmc_mock_switch(host, arg);
+		break;
+	case MMC_SEND_EXT_CSD:
+		/* Without data, this is the SD interface condition */
+		if (!data || host->state != R1_STATE_TRAN)
+			goto no_response;
+		cmd->resp[0] = mmc_mock_status(host);
+		sg_copy_from_buffer(data->sg, data->sg_len, host->ext_csd, 512);
+		data->bytes_xfered = 512;
+		break;
+	case MMC_SEND_STATUS:
+		if (arg & (1 << 15)) {
+			/* Queue status: report the task to execute next */
+			spin_lock_irq(&host->lock);
+			host->qrdy = false;
+			host->selected = mmc_mock_next_task(host);
+			if (host->selected >= 0)
+				cmd->resp[0] = 1 << host->selected;
+			spin_unlock_irq(&host->lock);
+		} else {
+			cmd->resp[0] = mmc_mock_status(host);
+		}
+		break;
+	case MMC_STOP_TRANSMISSION:
+	case MMC_SET_BLOCKLEN:
+	case MMC_SET_BLOCK_COUNT:
+		cmd->resp[0] = mmc_mock_status(host);
+		break;
+	case MMC_READ_SINGLE_BLOCK:
+	case MMC_READ_MULTIPLE_BLOCK:
+	case MMC_WRITE_BLOCK:
+	case MMC_WRITE_MULTIPLE_BLOCK:
+		if (!data || host->state != R1_STATE_TRAN)
+			goto no_response;
+		cmd->resp[0] = mmc_mock_status(host);
+		mmc_mock_rw(host, data, arg,
+			    cmd->opcode == MMC_WRITE_MULTIPLE_BLOCK &&
+			    (sbc_arg & MMC_CMD23_ARG_PACKED));
+		break;
+	case MMC_SET_QUEUE_CONTEXT:
+		tag = MOCK_QC_TAG(arg);
+		if (!host->ext_csd[EXT_CSD_CMDQ_MODE_EN] ||
+		    tag >= EMMC_MAX_QUEUE_DEPTH)
+			goto no_response;
+		cmd->resp[0] = mmc_mock_status(host);
+		host->qc_tag = tag;
+		host->task[tag].qc_arg = arg;
+		break;
+	case MMC_QUEUE_READ_ADDRESS:
+		if (!host->ext_csd[EXT_CSD_CMDQ_MODE_EN])
+			goto no_response;
+		cmd->resp[0] = mmc_mock_status(host);
+		spin_lock_irq(&host->lock);
+		host->task[host->qc_tag].addr = arg;
+		host->task[host->qc_tag].seq = host->seq++;
+		__set_bit(host->qc_tag, &host->queued);
+		spin_unlock_irq(&host->lock);
+		break;
+	case MMC_READ_REQUESTED_QUEUE:
+	case MMC_WRITE_REQUESTED_QUEUE:
+		tag = MOCK_QC_TAG(arg);
+		if (!data || tag >= EMMC_MAX_QUEUE_DEPTH)
+			goto no_response;
+		cmd->resp[0] = mmc_mock_status(host);
+		mmc_mock_rw(host, data, host->task[tag].addr, false);
+		break;
+	case MMC_ERASE_GROUP_START:
+		cmd->resp[0] = mmc_mock_status(host);
+		host->erase_start = arg;
+		break;
+	case MMC_ERASE_GROUP_END:
+		cmd->resp[0] = mmc_mock_status(host);
+		host->erase_end = arg;
+		break;
+	case MMC_ERASE:
+		cmd->resp[0] = mmc_mock_status(host);
+		mmc_mock_erase(host, arg);
+		break;
+	default:
+		goto no_response;
+	}
+	return;
+
+no_response:
+	cmd->error = -ETIMEDOUT;
+}
+
+static bool mmc_mock_queued_cmd(struct mmc_command *cmd)
+{
+	return cmd->opcode == MMC_READ_REQUESTED_QUEUE ||
+	       cmd->opcode == MMC_WRITE_REQUESTED_QUEUE;
+}
+
+static void mmc_mock_execute(struct mmc_mock_host *host,
+			     struct mmc_request *mrq)
+{
+	u32 sbc_arg = 0;
+
+	if (mrq->sbc) {
+		mmc_mock_command(host, mrq->sbc, NULL, 0);
+		if (mrq->sbc->error)
+			return;
+		sbc_arg = mrq->sbc->arg;
+	}
+
+	mmc_mock_command(host, mrq->cmd, mrq->data, sbc_arg);
+	if (mrq->cmd->error)
+		return;
+
+	/* Queued transfers end without CMD12 */
+	if (mrq->stop && !mmc_mock_queued_cmd(mrq->cmd))
+		mmc_mock_command(host, mrq->stop, NULL, 0);
+}
+
+static void mmc_mock_complete(struct mmc_mock_host *host,
+			      struct mmc_mock_slot *slot)
+{
+	struct mmc_request *mrq = NULL;
+	bool task;
+
+	spin_lock_irq(&host->lock);
+	if (slot->expired)
+		mrq = slot->mrq;
+	task = slot->task;
+	spin_unlock_irq(&host->lock);
+
+	if (!mrq)
+		return;
+
+	mmc_mock_execute(host, mrq);
+
+	/*
+	 * Free the slot first: completing a request in command queue mode
+	 * makes the core send the next one.
+	 */
+	spin_lock_irq(&host->lock);
+	slot->mrq = NULL;
+	slot->expired = false;
+	if (task)
+		mmc_mock_engine_next(host);
+	spin_unlock_irq(&host->lock);
+
+	if (task)
+		mmc_cmdq_task_done(host->mmc, mrq);
+	else
+		mmc_request_done(host->mmc, mrq);
+}
+
+/*
+ * Signal queue ready, as a card with the QRDY function does.  The core
+ * then reads the queue status and issues the CMD46/47 of the task
+ * reported.  It is signalled again once that task has started.
+ */
+static void mmc_mock_queue_ready(struct mmc_mock_host *host)
+{
+	bool ready;
+
+	spin_lock_irq(&host->lock);
+	ready = !cmdq_engine && host->ext_csd[EXT_CSD_CMDQ_MODE_EN] &&
+		host->queued && !host->qrdy && host->selected < 0;
+	if (ready)
+		host->qrdy = true;
+	spin_unlock_irq(&host->lock);
+
+	if (ready)
+		mmc_handle_queued_request(host->mmc);
+}
+
+static void mmc_mock_tasklet(unsigned long data)
+{
+	struct mmc_mock_host *host = (struct mmc_mock_host *)data;
+
+	mmc_mock_complete(host, &host->cmd_slot);
+	mmc_mock_complete(host, &host->dat_slot);
+	mmc_mock_queue_ready(host);
+}
+
+static enum hrtimer_restart mmc_mock_timer(struct hrtimer *timer)
+{
+	struct mmc_mock_slot *slot = container_of(timer, struct mmc_mock_slot,
+						  timer);
+	struct mmc_mock_host *host = slot->host;
+	unsigned long flags;
+
+	spin_lock_irqsave(&host->lock, flags);
+	slot->expired = true;
+	spin_unlock_irqrestore(&host->lock, flags);
+
+	tasklet_schedule(&host->tasklet);
+	return HRTIMER_NORESTART;
+}
+
+static void mmc_mock_request(struct mmc_host *mmc, struct mmc_request *mrq)
+{
+	struct mmc_mock_host *host = mmc_priv(mmc);
+	struct mmc_mock_slot *slot;
+	unsigned long flags;
+
+	slot = mrq->data ? &host->dat_slot : &host->cmd_slot;
+
+	spin_lock_irqsave(&host->lock, flags);
+	if (WARN_ON(slot->mrq)) {
+		spin_unlock_irqrestore(&host->lock, flags);
+		mrq->cmd->error = -EBUSY;
+		mmc_request_done(mmc, mrq);
+		return;
+	}
+
+	/* The reported task starts: the queue may signal the next one */
+	if (mmc_mock_queued_cmd(mrq->cmd)) {
+		unsigned int tag = MOCK_QC_TAG(mrq->cmd->arg);
+
+		if (tag < EMMC_MAX_QUEUE_DEPTH)
+			__clear_bit(tag, &host->queued);
+		if (host->selected == tag)
+			host->selected = -1;
+		tasklet_schedule(&host->tasklet);
+	}
+
+	mmc_mock_start(host, slot, mrq, false);
+	spin_unlock_irqrestore(&host->lock, flags);
+}
+
+static int mmc_mock_cmdq_request(struct mmc_host *mmc,
+				 struct mmc_request *mrq)
+{
+	struct mmc_mock_host *host = mmc_priv(mmc);
+	unsigned int tag = MOCK_QC_TAG(mrq->sbc->arg);
+	struct mmc_mock_task *task;
+	unsigned long flags;
+
+	if (tag >= EMMC_MAX_QUEUE_DEPTH || !host->ext_csd[EXT_CSD_CMDQ_MODE_EN])
+		return -EINVAL;
+
+	spin_lock_irqsave(&host->lock, flags);
+	task = &host->task[tag];
+	task->qc_arg = mrq->sbc->arg;
+	task->addr = mrq->cmd->arg;
+	task->seq = host->seq++;
+	task->mrq = mrq;
+	__set_bit(tag, &host->queued);
+	mmc_mock_engine_next(host);
+	spin_unlock_irqrestore(&host->lock, flags);
+
+	return 0;
+}
+
+static void mmc_mock_set_ios(struct mmc_host *mmc, struct mmc_ios *ios)
+{
+	struct mmc_mock_host *host = mmc_priv(mmc);
+
+	if (ios->power_mode == MMC_POWER_OFF)
+		mmc_mock_reset(host);
+}
+
+static int mmc_mock_get_ro(struct mmc_host *mmc)
+{
+	return 0;
+}
+
+static int mmc_mock_get_cd(struct mmc_host *mmc)
+{
+	return 1;
+}
+
+static const struct mmc_host_ops mmc_mock_ops = {
+	.request	= mmc_mock_request,
+	.set_ios	= mmc_mock_set_ios,
+	.get_ro		= mmc_mock_get_ro,
+	.get_cd		= mmc_mock_get_cd,
+};
+
+static const struct mmc_host_ops mmc_mock_cmdq_ops = {
+	.request	= mmc_mock_request,
+	.set_ios	= mmc_mock_set_ios,
+	.get_ro		= mmc_mock_get_ro,
+	.get_cd		= mmc_mock_get_cd,
+	.cmdq_request	= mmc_mock_cmdq_request,
+};
+
+static void mmc_mock_init_slot(struct mmc_mock_host *host,
+			       struct mmc_mock_slot *slot)
+{
+	slot->host = host;
+	hrtimer_init(&slot->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	slot->timer.function = mmc_mock_timer;
+}
+
+static int mmc_mock_probe(struct platform_device *pdev)
+{
+	struct mmc_mock_host *host;
+	struct mmc_host *mmc;
+	int ret;
+
+	mmc = mmc_alloc_host(sizeof(struct mmc_mock_host), &pdev->dev);
+	if (!mmc)
+		return -ENOMEM;
+
+	host = mmc_priv(mmc);
+	host->mmc = mmc;
+	spin_lock_init(&host->lock);
+	tasklet_init(&host->tasklet, mmc_mock_tasklet, (unsigned long)host);
+	mmc_mock_init_slot(host, &host->cmd_slot);
+	mmc_mock_init_slot(host, &host->dat_slot);
+
+	host->sectors = size_mb << 11;
+	host->store = vzalloc((size_t)host->sectors << 9);
+	host->bounce = vmalloc(MOCK_MAX_REQ_SIZE);
+	if (!host->store || !host->bounce) {
+		ret = -ENOMEM;
+		goto err_free;
+	}
+
+	mmc_mock_init_regs(host, pdev->id);
+	mmc_mock_reset(host);
+
+	mmc->ops = cmdq_engine ? &mmc_mock_cmdq_ops : &mmc_mock_ops;
+	mmc->f_min = 400000;
+	mmc->f_max = 52000000;
+	mmc->ocr_avail = MMC_VDD_32_33 | MMC_VDD_33_34;
+	mmc->caps = MMC_CAP_4_BIT_DATA | MMC_CAP_8_BIT_DATA |
+		    MMC_CAP_MMC_HIGHSPEED | MMC_CAP_NONREMOVABLE |
+		    MMC_CAP_CMD23 | MMC_CAP_ERASE;
+	mmc->caps2 = MMC_CAP2_CACHE_CTRL | MMC_CAP2_NO_SLEEP_CMD;
+	if (packed)
+		mmc->caps2 |= MMC_CAP2_PACKED_CMD;
+	if (cmdq)
+		mmc->caps2 |= MMC_CAP2_CMDQ;
+
+	mmc->max_segs = 128;
+	mmc->max_blk_size = 512;
+	mmc->max_blk_count = MOCK_MAX_REQ_SIZE >> 9;
+	mmc->max_req_size = MOCK_MAX_REQ_SIZE;
+	mmc->max_seg_size = mmc->max_req_size;
+
+	platform_set_drvdata(pdev, host);
+
+	ret = mmc_add_host(mmc);
+	if (ret)
+		goto err_free;
+
+	pr_info("%s: emulated eMMC, %u MB%s%s\n", mmc_hostname(mmc), size_mb,
+		packed ? ", packed writes" : "",
+		!cmdq ? "" : cmdq_engine ? ", cmdq engine" : ", cmdq");
+	return 0;
+
+err_free:
+	vfree(host->bounce);
+	vfree(host->store);
+	mmc_free_host(mmc);
+	return ret;
+}
+
+static int mmc_mock_remove(struct platform_device *pdev)
+{
+	struct mmc_mock_host *host = platform_get_drvdata(pdev);
+
+	mmc_remove_host(host->mmc);
+
+	hrtimer_cancel(&host->cmd_slot.timer);
+	hrtimer_cancel(&host->dat_slot.timer);
+	tasklet_kill(&host->tasklet);
+
+	vfree(host->bounce);
+	vfree(host->store);
+	mmc_free_host(host->mmc);
+	return 0;
+}
+
+static struct platform_driver mmc_mock_driver = {
+	.probe		= mmc_mock_probe,
+	.remove		= mmc_mock_remove,
+	.driver		= {
+		.name	= DRIVER_NAME,
+		.owner	= THIS_MODULE,
+	},
+};
+
+static struct platform_device *mmc_mock_device;
+
+static int __init mmc_mock_init(void)
+{
+	int ret;
+
+	if (!size_mb || size_mb > 2048 || cmdq_depth < 3 ||
+	    cmdq_depth > EMMC_MAX_QUEUE_DEPTH) {
+		pr_err(DRIVER_NAME ": invalid size_mb or cmdq_depth\n");
+		return -EINVAL;
+	}
+
+	ret = platform_driver_register(&mmc_mock_driver);
+	if (ret)
+		return ret;
+
+	mmc_mock_device = platform_device_register_simple(DRIVER_NAME, 0,
+							  NULL, 0);
+	if (IS_ERR(mmc_mock_device)) {
+		platform_driver_unregister(&mmc_mock_driver);
+		return PTR_ERR(mmc_mock_device);
+	}
+	return 0;
+}
+
+static void __exit mmc_mock_exit(void)
+{
+	platform_device_unregister(mmc_mock_device);
+	platform_driver_unregister(&mmc_mock_driver);
+}
+
+module_init(mmc_mock_init);
+module_exit(mmc_mock_exit);
+
+MODULE_DESCRIPTION("Emulated eMMC host controller");
+MODULE_LICENSE("GPL");
@@ -24,6 +24,7 @@
 #include <linux/bio.h>
 #include <linux/bitops.h>
 #include <linux/blkdev.h>
+#include <linux/blk-mq.h>
 #include <linux/buffer_head.h>
 #include <linux/device.h>
 #include <linux/genhd.h>
@@ -41,6 +42,7 @@ struct zram *zram_devices;
 
 /* Module params (documentation at end) */
 static unsigned int num_devices = 1;
+static bool use_mq;
 
 static void zram_stat64_add(struct zram *zram, u64 *v, u64 inc)
 {
@@ -360,7 +362,7 @@ static void update_position(u32 *index, int *offset, struct bio_vec *bvec)
 	*offset = (*offset + bvec->bv_len) % PAGE_SIZE;
 }
 
-static void __zram_make_request(struct zram *zram, struct bio *bio, int rw)
+static int __zram_make_request(struct zram *zram, struct bio *bio, int rw)
 {
 	int i, offset;
 	u32 index;
@@ -393,26 +395,21 @@ static void __zram_make_request(struct zram *zram, struct bio *bio, int rw)
 			bv.bv_offset = bvec->bv_offset;
 
 			if (zram_bvec_rw(zram, &bv, index, offset, bio, rw) < 0)
-				goto out;
+				return -EIO;
 
 			bv.bv_len = bvec->bv_len - max_transfer_size;
 			bv.bv_offset += max_transfer_size;
 			if (zram_bvec_rw(zram, &bv, index+1, 0, bio, rw) < 0)
-				goto out;
+				return -EIO;
 		} else
 			if (zram_bvec_rw(zram, bvec, index, offset, bio, rw)
 			    < 0)
-				goto out;
+				return -EIO;
 
 		update_position(&index, &offset, bvec);
 	}
 
-	set_bit(BIO_UPTODATE, &bio->bi_flags);
-	bio_endio(bio, 0);
-	return;
-
-out:
-	bio_io_error(bio);
+	return 0;
 }
 
 /*
@@ -455,9 +452,12 @@ static void zram_make_request(struct request_queue *queue, struct bio *bio)
 		goto error;
 	}
 
-	__zram_make_request(zram, bio, bio_data_dir(bio));
+	if (__zram_make_request(zram, bio, bio_data_dir(bio)))
+		goto error;
 	up_read(&zram->init_lock);
 
+	set_bit(BIO_UPTODATE, &bio->bi_flags);
+	bio_endio(bio, 0);
 	return;
 
 error:
@@ -465,6 +465,49 @@ error:
 	bio_io_error(bio);
 }
 
+/*
+ * Handler for requests of blk-mq queues (use_mq=1): the same work for
+ * every bio of the request, which is ended right away.
+ */
+static int zram_queue_rq(struct blk_mq_hw_ctx *hctx, struct request *rq)
+{
+	struct zram *zram = rq->q->queuedata;
+	struct bio *bio;
+	int ret = -EIO;
+
+	down_read(&zram->init_lock);
+	if (unlikely(!zram->init_done))
+		goto out;
+
+	__rq_for_each_bio(bio, rq) {
+		if (!valid_io_request(zram, bio)) {
+			zram_stat64_inc(zram, &zram->stats.invalid_io);
+			ret = -EIO;
+			goto out;
+		}
+		ret = __zram_make_request(zram, bio, bio_data_dir(bio));
+		if (ret)
+			goto out;
+	}
+
+out:
+	up_read(&zram->init_lock);
+	blk_mq_end_io(rq, ret);
+	return BLK_MQ_RQ_QUEUE_OK;
+}
+
+static struct blk_mq_ops zram_mq_ops = {
+	.queue_rq	= zram_queue_rq,
+	.map_queue	= blk_mq_map_queue,
+};
+
+static struct blk_mq_reg zram_mq_reg = {
+	.ops		= &zram_mq_ops,
+	.queue_depth	= 64,
+	.numa_node	= NUMA_NO_NODE,
+	.flags		= BLK_MQ_F_SHOULD_MERGE,
+};
+
 static void __zram_reset_device(struct zram *zram)
 {
 	size_t index;
@@ -606,14 +649,22 @@ static int create_device(struct zram *zram, int device_id)
 	init_rwsem(&zram->init_lock);
 	spin_lock_init(&zram->stat64_lock);
 
-	zram->queue = blk_alloc_queue(GFP_KERNEL);
+	if (use_mq) {
+		/* nothing to share behind the queues, give each CPU one */
+		zram_mq_reg.nr_hw_queues = nr_cpu_ids;
+		zram->queue = blk_mq_init_queue(&zram_mq_reg, zram);
+		if (IS_ERR(zram->queue))
+			zram->queue = NULL;
+	} else {
+		zram->queue = blk_alloc_queue(GFP_KERNEL);
+		if (zram->queue)
+			blk_queue_make_request(zram->queue, zram_make_request);
+	}
 	if (!zram->queue) {
 		pr_err("Error allocating disk queue for device %d\n",
 			device_id);
 		goto out;
 	}
-
-	blk_queue_make_request(zram->queue, zram_make_request);
 	zram->queue->queuedata = zram;
 
 	 /* gendisk structure */
@@ -751,6 +802,8 @@ static void __exit zram_exit(void)
 
 module_param(num_devices, uint, 0);
 MODULE_PARM_DESC(num_devices, "Number of zram devices");
+module_param(use_mq, bool, 0);
+MODULE_PARM_DESC(use_mq, "Use the multi-queue block layer (default: bio)");
 
 module_init(zram_init);
 module_exit(zram_exit);
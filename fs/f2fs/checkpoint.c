@@ -576,7 +576,7 @@ retry_flush_nodes:
 
 	if (get_pages(sbi, F2FS_DIRTY_NODES)) {
 		mutex_unlock(&sbi->node_write);
-		sync_node_pages(sbi, 0, &wbc);
+		sync_node_pages(sbi, 0, &wbc, false);
 		goto retry_flush_nodes;
 	}
 	blk_finish_plug(&plug);
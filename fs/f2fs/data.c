@@ -69,13 +69,16 @@ static int check_extent_cache(struct inode *inode, pgoff_t pgofs,
 {
 	struct f2fs_inode_info *fi = F2FS_I(inode);
 	struct f2fs_sb_info *sbi = F2FS_SB(inode->i_sb);
+	unsigned int blkbits = inode->i_sb->s_blocksize_bits;
 	pgoff_t start_fofs, end_fofs;
-	block_t start_blkaddr;
+	block_t start_blkaddr, blkaddr;
+	unsigned int len;
+	size_t count;
 
 	read_lock(&fi->ext.ext_lock);
 	if (fi->ext.len == 0) {
 		read_unlock(&fi->ext.ext_lock);
-		return 0;
+		goto lookup_tree;
 	}
 
 	sbi->total_hit_ext++;
@@ -84,24 +87,26 @@ static int check_extent_cache(struct inode *inode, pgoff_t pgofs,
 	start_blkaddr = fi->ext.blk_addr;
 
 	if (pgofs >= start_fofs && pgofs <= end_fofs) {
-		unsigned int blkbits = inode->i_sb->s_blocksize_bits;
-		size_t count;
-
-		clear_buffer_new(bh_result);
-		map_bh(bh_result, inode->i_sb,
-				start_blkaddr + pgofs - start_fofs);
-		count = end_fofs - pgofs + 1;
-		if (count < (UINT_MAX >> blkbits))
-			bh_result->b_size = (count << blkbits);
-		else
-			bh_result->b_size = UINT_MAX;
-
+		blkaddr = start_blkaddr + pgofs - start_fofs;
+		len = end_fofs - pgofs + 1;
 		sbi->read_hit_ext++;
 		read_unlock(&fi->ext.ext_lock);
-		return 1;
+		goto found;
 	}
 	read_unlock(&fi->ext.ext_lock);
-	return 0;
+
+lookup_tree:
+	if (!f2fs_lookup_extent_tree(inode, pgofs, &blkaddr, &len))
+		return 0;
+found:
+	clear_buffer_new(bh_result);
+	map_bh(bh_result, inode->i_sb, blkaddr);
+	count = len;
+	if (count < (UINT_MAX >> blkbits))
+		bh_result->b_size = (count << blkbits);
+	else
+		bh_result->b_size = UINT_MAX;
+	return 1;
 }
 
 void update_extent_cache(block_t blk_addr, struct dnode_of_data *dn)
@@ -115,6 +120,7 @@ void update_extent_cache(block_t blk_addr, struct dnode_of_data *dn)
 
 	/* Update the page address in the parent node */
 	__set_data_blkaddr(dn, blk_addr);
+	f2fs_update_extent_tree(dn->inode, fofs, blk_addr);
 
 	write_lock(&fi->ext.ext_lock);
 
@@ -187,9 +193,15 @@ struct page *find_data_page(struct inode *inode, pgoff_t index, bool sync)
 	f2fs_put_page(page, 0);
 
 	set_new_dnode(&dn, inode, NULL, NULL, 0);
+	if (f2fs_lookup_extent_tree(inode, index, &dn.data_blkaddr, NULL))
+		goto got_blkaddr;
+
 	err = get_dnode_of_data(&dn, index, LOOKUP_NODE);
 	if (err)
 		return ERR_PTR(err);
+	/* cache the address while the dnode keeps it from moving */
+	if (dn.data_blkaddr != NULL_ADDR && dn.data_blkaddr != NEW_ADDR)
+		f2fs_update_extent_tree(inode, index, dn.data_blkaddr);
 	f2fs_put_dnode(&dn);
 
 	if (dn.data_blkaddr == NULL_ADDR)
@@ -198,7 +210,7 @@ struct page *find_data_page(struct inode *inode, pgoff_t index, bool sync)
 	/* By fallocate(), there is no cached page, but with NEW_ADDR */
 	if (dn.data_blkaddr == NEW_ADDR)
 		return ERR_PTR(-EINVAL);
-
+got_blkaddr:
 	page = grab_cache_page(mapping, index);
 	if (!page)
 		return ERR_PTR(-ENOMEM);
@@ -234,9 +246,14 @@ struct page *get_lock_data_page(struct inode *inode, pgoff_t index)
 	int err;
 
 	set_new_dnode(&dn, inode, NULL, NULL, 0);
+	if (f2fs_lookup_extent_tree(inode, index, &dn.data_blkaddr, NULL))
+		goto repeat;
+
 	err = get_dnode_of_data(&dn, index, LOOKUP_NODE);
 	if (err)
 		return ERR_PTR(err);
+	if (dn.data_blkaddr != NULL_ADDR && dn.data_blkaddr != NEW_ADDR)
+		f2fs_update_extent_tree(inode, index, dn.data_blkaddr);
 	f2fs_put_dnode(&dn);
 
 	if (dn.data_blkaddr == NULL_ADDR)
@@ -439,6 +456,11 @@ static int get_data_block_ro(struct inode *inode, sector_t iblock,
 				break;
 		map_bh(bh_result, inode->i_sb, dn.data_blkaddr);
 		bh_result->b_size = (i << blkbits);
+
+		/* The pages being read are locked, so the mapping is stable */
+		while (i--)
+			f2fs_update_extent_tree(inode, pgofs + i,
+						dn.data_blkaddr + i);
 	}
 	f2fs_put_dnode(&dn);
 	trace_f2fs_get_data_block(inode, iblock, bh_result, 0);
@@ -447,6 +469,14 @@ static int get_data_block_ro(struct inode *inode, sector_t iblock,
 
 static int f2fs_read_data_page(struct file *file, struct page *page)
 {
+	struct inode *inode = page->mapping->host;
+	int ret;
+
+	if (f2fs_has_inline_data(inode)) {
+		ret = f2fs_read_inline_data(inode, page);
+		unlock_page(page);
+		return ret;
+	}
 	return mpage_readpage(page, get_data_block_ro);
 }
 
@@ -454,6 +484,12 @@ static int f2fs_read_data_pages(struct file *file,
 			struct address_space *mapping,
 			struct list_head *pages, unsigned nr_pages)
 {
+	struct inode *inode = mapping->host;
+
+	/* If the file has inline data, skip readpages */
+	if (f2fs_has_inline_data(inode))
+		return 0;
+
 	return mpage_readpages(mapping, pages, nr_pages, get_data_block_ro);
 }
 
@@ -525,6 +561,10 @@ static int f2fs_write_data_page(struct page *page,
 
 	zero_user_segment(page, offset, PAGE_CACHE_SIZE);
 write:
+	/* The page is written when its atomic write is committed */
+	if (IS_ATOMIC_WRITTEN_PAGE(page))
+		goto out;
+
 	if (sbi->por_doing) {
 		err = AOP_WRITEPAGE_ACTIVATE;
 		goto redirty_out;
@@ -537,7 +577,10 @@ write:
 		err = do_write_data_page(page);
 	} else {
 		int ilock = mutex_lock_op(sbi);
-		err = do_write_data_page(page);
+		if (f2fs_has_inline_data(inode))
+			err = f2fs_write_inline_data(inode, page);
+		else
+			err = do_write_data_page(page);
 		mutex_unlock_op(sbi, ilock);
 		need_balance_fs = true;
 	}
@@ -623,12 +666,20 @@ static int f2fs_write_begin(struct file *file, struct address_space *mapping,
 	*fsdata = NULL;
 
 	f2fs_balance_fs(sbi);
+
+	err = f2fs_convert_inline_data(inode, pos + len);
+	if (err)
+		return err;
 repeat:
 	page = grab_cache_page_write_begin(mapping, index, flags);
 	if (!page)
 		return -ENOMEM;
 	*pagep = page;
 
+	/* small writes to an inline file need no block */
+	if (f2fs_has_inline_data(inode) && (pos + len) <= MAX_INLINE_DATA)
+		goto inline_data;
+
 	ilock = mutex_lock_op(sbi);
 
 	set_new_dnode(&dn, inode, NULL, NULL, 0);
@@ -645,6 +696,7 @@ repeat:
 
 	mutex_unlock_op(sbi, ilock);
 
+inline_data:
 	if ((len == PAGE_CACHE_SIZE) || PageUptodate(page))
 		return 0;
 
@@ -657,7 +709,13 @@ repeat:
 		goto out;
 	}
 
-	if (dn.data_blkaddr == NEW_ADDR) {
+	if (f2fs_has_inline_data(inode)) {
+		err = f2fs_read_inline_data(inode, page);
+		if (err) {
+			f2fs_put_page(page, 1);
+			return err;
+		}
+	} else if (dn.data_blkaddr == NEW_ADDR) {
 		zero_user_segment(page, 0, PAGE_CACHE_SIZE);
 	} else {
 		err = f2fs_readpage(sbi, page, dn.data_blkaddr, READ_SYNC);
@@ -693,6 +751,10 @@ static ssize_t f2fs_direct_IO(int rw, struct kiocb *iocb,
 	if (rw == WRITE)
 		return 0;
 
+	/* Let buffered read handle inline data */
+	if (f2fs_has_inline_data(inode))
+		return 0;
+
 	/* Needs synchronization with the cleaner */
 	return blockdev_direct_IO(rw, iocb, inode, iov, offset, nr_segs,
 						  get_data_block_ro);
@@ -706,11 +768,18 @@ static void f2fs_invalidate_data_page(struct page *page, unsigned long offset)
 		dec_page_count(sbi, F2FS_DIRTY_DENTS);
 		inode_dec_dirty_dents(inode);
 	}
+
+	/* An atomic written page is released by commit_inmem_pages() */
+	if (IS_ATOMIC_WRITTEN_PAGE(page))
+		return;
 	ClearPagePrivate(page);
 }
 
 static int f2fs_release_data_page(struct page *page, gfp_t wait)
 {
+	/* The atomic write holds the page until it is committed */
+	if (IS_ATOMIC_WRITTEN_PAGE(page))
+		return 0;
 	ClearPagePrivate(page);
 	return 1;
 }
@@ -721,6 +790,11 @@ static int f2fs_set_data_page_dirty(struct page *page)
 	struct inode *inode = mapping->host;
 
 	SetPageUptodate(page);
+	if (f2fs_is_atomic_file(inode)) {
+		register_inmem_page(inode, page);
+		return 1;
+	}
+
 	if (!PageDirty(page)) {
 		__set_page_dirty_nobuffers(page);
 		set_dirty_dir_page(inode, page);
@@ -731,6 +805,11 @@ static int f2fs_set_data_page_dirty(struct page *page)
 
 static sector_t f2fs_bmap(struct address_space *mapping, sector_t block)
 {
+	struct inode *inode = mapping->host;
+
+	if (f2fs_has_inline_data(inode))
+		return 0;
+
 	return generic_block_bmap(mapping, block, get_data_block_ro);
 }
 
@@ -35,6 +35,9 @@ static void update_general_status(struct f2fs_sb_info *sbi)
 	/* valid check of the segment numbers */
 	si->hit_ext = sbi->read_hit_ext;
 	si->total_ext = sbi->total_hit_ext;
+	si->hit_tree = sbi->read_hit_tree;
+	si->total_tree = sbi->total_lookup_tree;
+	si->ext_node = atomic_read(&sbi->total_ext_node);
 	si->ndirty_node = get_pages(sbi, F2FS_DIRTY_NODES);
 	si->ndirty_dent = get_pages(sbi, F2FS_DIRTY_DENTS);
 	si->ndirty_dirs = sbi->n_dirty_dirs;
@@ -57,6 +60,11 @@ static void update_general_status(struct f2fs_sb_info *sbi)
 	si->sits = SIT_I(sbi)->dirty_sentries;
 	si->fnids = NM_I(sbi)->fcnt;
 	si->bg_gc = sbi->bg_gc;
+	si->fg_gc_stall = sbi->fg_gc_stall;
+	si->fg_gc_stall_ms = jiffies_to_msecs(sbi->fg_gc_stall_time);
+	si->fsync_roll_forward = sbi->fsync_roll_forward;
+	for (i = 0; i < NR_CP_REASONS; i++)
+		si->fsync_cp[i] = sbi->fsync_cp[i];
 	si->util_free = (int)(free_user_blocks(sbi) >> sbi->log_blocks_per_seg)
 		* 100 / (int)(sbi->user_block_count >> sbi->log_blocks_per_seg)
 		/ 2;
@@ -171,6 +179,8 @@ get_cache:
 	si->cache_mem += npages << PAGE_CACHE_SHIFT;
 	si->cache_mem += sbi->n_orphans * sizeof(struct orphan_inode_entry);
 	si->cache_mem += sbi->n_dirty_dirs * sizeof(struct dir_inode_entry);
+	si->cache_mem += atomic_read(&sbi->total_ext_node) *
+						sizeof(struct extent_node);
 }
 
 static int stat_show(struct seq_file *s, void *v)
@@ -235,6 +245,8 @@ static int stat_show(struct seq_file *s, void *v)
 			   si->prefree_count, si->free_segs, si->free_secs);
 		seq_printf(s, "GC calls: %d (BG: %d)\n",
 			   si->call_count, si->bg_gc);
+		seq_printf(s, "  - FG stalls : %d (%u ms)\n",
+			   si->fg_gc_stall, si->fg_gc_stall_ms);
 		seq_printf(s, "  - data segments : %d\n", si->data_segs);
 		seq_printf(s, "  - node segments : %d\n", si->node_segs);
 		seq_printf(s, "Try to move %d blocks\n", si->tot_blks);
@@ -242,6 +254,17 @@ static int stat_show(struct seq_file *s, void *v)
 		seq_printf(s, "  - node blocks : %d\n", si->node_blks);
 		seq_printf(s, "\nExtent Hit Ratio: %d / %d\n",
 			   si->hit_ext, si->total_ext);
+		seq_printf(s, "Extent Tree Hit Ratio: %d / %d (%d nodes)\n",
+			   si->hit_tree, si->total_tree, si->ext_node);
+		seq_printf(s, "\nFsync: roll-forward %d\n",
+			   si->fsync_roll_forward);
+		seq_printf(s, "  - checkpoint : non-regular %d, hardlink %d, "
+			   "lost pino %d, no space %d, parent %d\n",
+			   si->fsync_cp[CP_NON_REGULAR],
+			   si->fsync_cp[CP_HARDLINK],
+			   si->fsync_cp[CP_LOST_PINO],
+			   si->fsync_cp[CP_NO_SPC_ROLL],
+			   si->fsync_cp[CP_NODE_NEED_CP]);
 		seq_printf(s, "\nBalancing F2FS Async:\n");
 		seq_printf(s, "  - nodes %4d in %4d\n",
 			   si->ndirty_node, si->node_pages);
@@ -172,6 +172,42 @@ static struct f2fs_dir_entry *find_in_level(struct inode *dir,
 	return de;
 }
 
+static struct f2fs_dir_entry *find_in_inline_dir(struct inode *dir,
+			const char *name, size_t namelen,
+			f2fs_hash_t namehash, struct page **res_page)
+{
+	struct f2fs_sb_info *sbi = F2FS_SB(dir->i_sb);
+	struct f2fs_inline_dentry *dentry_blk;
+	struct f2fs_dir_entry *de;
+	unsigned long bit_pos;
+	struct page *ipage;
+
+	ipage = get_node_page(sbi, dir->i_ino);
+	if (IS_ERR(ipage))
+		return NULL;
+
+	kmap(ipage);
+	dentry_blk = inline_data_addr(ipage);
+	bit_pos = find_next_bit_le(&dentry_blk->dentry_bitmap,
+					NR_INLINE_DENTRY, 0);
+	while (bit_pos < NR_INLINE_DENTRY) {
+		de = &dentry_blk->dentry[bit_pos];
+		if (early_match_name(name, namelen, namehash, de) &&
+				!memcmp(dentry_blk->filename[bit_pos],
+							name, namelen)) {
+			*res_page = ipage;
+			unlock_page(ipage);
+			return de;
+		}
+		bit_pos = find_next_bit_le(&dentry_blk->dentry_bitmap,
+			NR_INLINE_DENTRY,
+			bit_pos + GET_DENTRY_SLOTS(le16_to_cpu(de->name_len)));
+	}
+	kunmap(ipage);
+	f2fs_put_page(ipage, 1);
+	return NULL;
+}
+
 /*
  * Find an entry in the specified directory with the wanted name.
  * It returns the page where the entry was found (as a parameter - res_page),
@@ -192,12 +228,17 @@ struct f2fs_dir_entry *f2fs_find_entry(struct inode *dir,
 	if (namelen > F2FS_NAME_LEN)
 		return NULL;
 
-	if (npages == 0)
-		return NULL;
-
 	*res_page = NULL;
 
 	name_hash = f2fs_dentry_hash(name, namelen);
+
+	if (f2fs_has_inline_dentry(dir))
+		return find_in_inline_dir(dir, name, namelen, name_hash,
+								res_page);
+
+	if (npages == 0)
+		return NULL;
+
 	max_depth = F2FS_I(dir)->i_current_depth;
 
 	for (level = 0; level < max_depth; level++) {
@@ -219,6 +260,21 @@ struct f2fs_dir_entry *f2fs_parent_dir(struct inode *dir, struct page **p)
 	struct f2fs_dir_entry *de = NULL;
 	struct f2fs_dentry_block *dentry_blk = NULL;
 
+	if (f2fs_has_inline_dentry(dir)) {
+		struct f2fs_inline_dentry *inline_dentry;
+
+		page = get_node_page(F2FS_SB(dir->i_sb), dir->i_ino);
+		if (IS_ERR(page))
+			return NULL;
+
+		kmap(page);
+		inline_dentry = inline_data_addr(page);
+		de = &inline_dentry->dentry[1];
+		*p = page;
+		unlock_page(page);
+		return de;
+	}
+
 	page = get_lock_data_page(dir, 0);
 	if (IS_ERR(page))
 		return NULL;
@@ -280,36 +336,69 @@ void init_dent_inode(const struct qstr *name, struct page *ipage)
 	set_page_dirty(ipage);
 }
 
-static int make_empty_dir(struct inode *inode, struct inode *parent)
+static void fill_empty_dir(struct inode *inode, struct inode *parent,
+			struct f2fs_dir_entry *dentry,
+			__u8 (*filename)[F2FS_SLOT_LEN], void *bitmap)
 {
-	struct page *dentry_page;
-	struct f2fs_dentry_block *dentry_blk;
 	struct f2fs_dir_entry *de;
-	void *kaddr;
 
-	dentry_page = get_new_data_page(inode, 0, true);
-	if (IS_ERR(dentry_page))
-		return PTR_ERR(dentry_page);
-
-	kaddr = kmap_atomic(dentry_page);
-	dentry_blk = (struct f2fs_dentry_block *)kaddr;
-
-	de = &dentry_blk->dentry[0];
+	de = &dentry[0];
 	de->name_len = cpu_to_le16(1);
 	de->hash_code = 0;
 	de->ino = cpu_to_le32(inode->i_ino);
-	memcpy(dentry_blk->filename[0], ".", 1);
+	memcpy(filename[0], ".", 1);
 	set_de_type(de, inode);
 
-	de = &dentry_blk->dentry[1];
+	de = &dentry[1];
 	de->hash_code = 0;
 	de->name_len = cpu_to_le16(2);
 	de->ino = cpu_to_le32(parent->i_ino);
-	memcpy(dentry_blk->filename[1], "..", 2);
+	memcpy(filename[1], "..", 2);
 	set_de_type(de, inode);
 
-	test_and_set_bit_le(0, &dentry_blk->dentry_bitmap);
-	test_and_set_bit_le(1, &dentry_blk->dentry_bitmap);
+	test_and_set_bit_le(0, bitmap);
+	test_and_set_bit_le(1, bitmap);
+}
+
+static int make_empty_inline_dir(struct inode *inode, struct inode *parent)
+{
+	struct f2fs_inline_dentry *dentry_blk;
+	struct page *ipage;
+
+	ipage = get_node_page(F2FS_SB(inode->i_sb), inode->i_ino);
+	if (IS_ERR(ipage))
+		return PTR_ERR(ipage);
+
+	wait_on_page_writeback(ipage);
+
+	dentry_blk = inline_data_addr(ipage);
+	fill_empty_dir(inode, parent, dentry_blk->dentry,
+			dentry_blk->filename, &dentry_blk->dentry_bitmap);
+
+	/* the inline area is all the directory has */
+	i_size_write(inode, MAX_INLINE_DATA);
+	update_inode(inode, ipage);
+	f2fs_put_page(ipage, 1);
+	return 0;
+}
+
+static int make_empty_dir(struct inode *inode, struct inode *parent)
+{
+	struct page *dentry_page;
+	struct f2fs_dentry_block *dentry_blk;
+	void *kaddr;
+
+	if (f2fs_has_inline_dentry(inode))
+		return make_empty_inline_dir(inode, parent);
+
+	dentry_page = get_new_data_page(inode, 0, true);
+	if (IS_ERR(dentry_page))
+		return PTR_ERR(dentry_page);
+
+	kaddr = kmap_atomic(dentry_page);
+	dentry_blk = (struct f2fs_dentry_block *)kaddr;
+	fill_empty_dir(inode, parent, dentry_blk->dentry,
+			dentry_blk->filename, &dentry_blk->dentry_bitmap);
 	kunmap_atomic(kaddr);
 
 	set_page_dirty(dentry_page);
@@ -382,30 +471,136 @@ static void update_parent_metadata(struct inode *dir, struct inode *inode,
 		clear_inode_flag(F2FS_I(inode), FI_INC_LINK);
 }
 
-static int room_for_filename(struct f2fs_dentry_block *dentry_blk, int slots)
+static int room_for_filename(const void *bitmap, int slots, int max_slots)
 {
 	int bit_start = 0;
 	int zero_start, zero_end;
 next:
-	zero_start = find_next_zero_bit_le(&dentry_blk->dentry_bitmap,
-						NR_DENTRY_IN_BLOCK,
-						bit_start);
-	if (zero_start >= NR_DENTRY_IN_BLOCK)
-		return NR_DENTRY_IN_BLOCK;
+	zero_start = find_next_zero_bit_le(bitmap, max_slots, bit_start);
+	if (zero_start >= max_slots)
+		return max_slots;
 
-	zero_end = find_next_bit_le(&dentry_blk->dentry_bitmap,
-						NR_DENTRY_IN_BLOCK,
-						zero_start);
+	zero_end = find_next_bit_le(bitmap, max_slots, zero_start);
 	if (zero_end - zero_start >= slots)
 		return zero_start;
 
 	bit_start = zero_end + 1;
 
-	if (zero_end + 1 >= NR_DENTRY_IN_BLOCK)
-		return NR_DENTRY_IN_BLOCK;
+	if (zero_end + 1 >= max_slots)
+		return max_slots;
 	goto next;
 }
 
+/*
+ * Add the entry to the inode block of an inline directory.
+ * Return -EAGAIN if there is no room for it.
+ */
+static int add_inline_entry(struct inode *dir, const struct qstr *name,
+						struct inode *inode)
+{
+	struct f2fs_sb_info *sbi = F2FS_SB(dir->i_sb);
+	struct f2fs_inline_dentry *dentry_blk;
+	struct f2fs_dir_entry *de;
+	struct page *ipage;
+	unsigned int bit_pos;
+	f2fs_hash_t dentry_hash;
+	size_t namelen = name->len;
+	int slots = GET_DENTRY_SLOTS(namelen);
+	int err, i;
+
+	ipage = get_node_page(sbi, dir->i_ino);
+	if (IS_ERR(ipage))
+		return PTR_ERR(ipage);
+
+	dentry_blk = inline_data_addr(ipage);
+	bit_pos = room_for_filename(&dentry_blk->dentry_bitmap,
+						slots, NR_INLINE_DENTRY);
+	if (bit_pos >= NR_INLINE_DENTRY) {
+		err = -EAGAIN;
+		goto out;
+	}
+
+	err = init_inode_metadata(inode, dir, name);
+	if (err)
+		goto out;
+
+	wait_on_page_writeback(ipage);
+
+	dentry_hash = f2fs_dentry_hash(name->name, name->len);
+	de = &dentry_blk->dentry[bit_pos];
+	de->hash_code = dentry_hash;
+	de->name_len = cpu_to_le16(namelen);
+	memcpy(dentry_blk->filename[bit_pos], name->name, name->len);
+	de->ino = cpu_to_le32(inode->i_ino);
+	set_de_type(de, inode);
+	for (i = 0; i < slots; i++)
+		test_and_set_bit_le(bit_pos + i, &dentry_blk->dentry_bitmap);
+	set_page_dirty(ipage);
+
+	/* update_parent_metadata() may write the inode page of dir */
+	f2fs_put_page(ipage, 1);
+	update_parent_metadata(dir, inode, F2FS_I(dir)->i_current_depth);
+
+	F2FS_I(inode)->i_pino = dir->i_ino;
+	return 0;
+out:
+	f2fs_put_page(ipage, 1);
+	return err;
+}
+
+/*
+ * Move the entries of a full inline directory to its first dentry block.
+ * They keep their slots, so the readdir positions stay valid.
+ */
+static int convert_inline_dir(struct inode *dir)
+{
+	struct f2fs_sb_info *sbi = F2FS_SB(dir->i_sb);
+	struct f2fs_inline_dentry *inline_dentry;
+	struct f2fs_dentry_block *dentry_blk;
+	struct dnode_of_data dn;
+	struct page *ipage, *page;
+	int err;
+
+	page = grab_cache_page(dir->i_mapping, 0);
+	if (!page)
+		return -ENOMEM;
+
+	ipage = get_node_page(sbi, dir->i_ino);
+	if (IS_ERR(ipage)) {
+		err = PTR_ERR(ipage);
+		goto out;
+	}
+
+	set_new_dnode(&dn, dir, ipage, ipage, dir->i_ino);
+	err = reserve_new_block(&dn);
+	if (err)
+		goto out_ipage;
+
+	inline_dentry = inline_data_addr(ipage);
+
+	zero_user_segment(page, 0, PAGE_CACHE_SIZE);
+	dentry_blk = kmap(page);
+	memcpy(dentry_blk->dentry_bitmap, inline_dentry->dentry_bitmap,
+					INLINE_DENTRY_BITMAP_SIZE);
+	memcpy(dentry_blk->dentry, inline_dentry->dentry,
+			sizeof(struct f2fs_dir_entry) * NR_INLINE_DENTRY);
+	memcpy(dentry_blk->filename, inline_dentry->filename,
+					NR_INLINE_DENTRY * F2FS_SLOT_LEN);
+	kunmap(page);
+	SetPageUptodate(page);
+	set_page_dirty(page);
+
+	memset(inline_dentry, 0, MAX_INLINE_DATA);
+	clear_inode_flag(F2FS_I(dir), FI_INLINE_DENTRY);
+	i_size_write(dir, PAGE_CACHE_SIZE);
+	sync_inode_page(&dn);
+out_ipage:
+	f2fs_put_page(ipage, 1);
+out:
+	f2fs_put_page(page, 1);
+	return err;
+}
+
 /*
  * Caller should grab and release a mutex by calling mutex_lock_op() and
  * mutex_unlock_op().
@@ -426,6 +621,16 @@ int __f2fs_add_link(struct inode *dir, const struct qstr *name, struct inode *in
 	int err = 0;
 	int i;
 
+	if (f2fs_has_inline_dentry(dir)) {
+		err = add_inline_entry(dir, name, inode);
+		if (err != -EAGAIN)
+			return err;
+
+		err = convert_inline_dir(dir);
+		if (err)
+			return err;
+	}
+
 	dentry_hash = f2fs_dentry_hash(name->name, name->len);
 	level = 0;
 	current_depth = F2FS_I(dir)->i_current_depth;
@@ -453,7 +658,8 @@ start:
 			return PTR_ERR(dentry_page);
 
 		dentry_blk = kmap(dentry_page);
-		bit_pos = room_for_filename(dentry_blk, slots);
+		bit_pos = room_for_filename(&dentry_blk->dentry_bitmap,
+						slots, NR_DENTRY_IN_BLOCK);
 		if (bit_pos < NR_DENTRY_IN_BLOCK)
 			goto add_dentry;
 
@@ -496,12 +702,10 @@ fail:
  * entry in name page does not need to be touched during deletion.
  */
 void f2fs_delete_entry(struct f2fs_dir_entry *dentry, struct page *page,
-						struct inode *inode)
+					struct inode *dir, struct inode *inode)
 {
 	struct	f2fs_dentry_block *dentry_blk;
 	unsigned int bit_pos;
-	struct address_space *mapping = page->mapping;
-	struct inode *dir = mapping->host;
 	struct f2fs_sb_info *sbi = F2FS_SB(dir->i_sb);
 	int slots = GET_DENTRY_SLOTS(le16_to_cpu(dentry->name_len));
 	void *kaddr = page_address(page);
@@ -510,17 +714,35 @@ void f2fs_delete_entry(struct f2fs_dir_entry *dentry, struct page *page,
 	lock_page(page);
 	wait_on_page_writeback(page);
 
-	dentry_blk = (struct f2fs_dentry_block *)kaddr;
-	bit_pos = dentry - (struct f2fs_dir_entry *)dentry_blk->dentry;
-	for (i = 0; i < slots; i++)
-		test_and_clear_bit_le(bit_pos + i, &dentry_blk->dentry_bitmap);
+	if (f2fs_has_inline_dentry(dir)) {
+		struct f2fs_inline_dentry *inline_dentry;
 
-	/* Let's check and deallocate this dentry page */
-	bit_pos = find_next_bit_le(&dentry_blk->dentry_bitmap,
-			NR_DENTRY_IN_BLOCK,
-			0);
-	kunmap(page); /* kunmap - pair of f2fs_find_entry */
-	set_page_dirty(page);
+		inline_dentry = inline_data_addr(page);
+		bit_pos = dentry - inline_dentry->dentry;
+		for (i = 0; i < slots; i++)
+			test_and_clear_bit_le(bit_pos + i,
+					&inline_dentry->dentry_bitmap);
+		kunmap(page);
+		set_page_dirty(page);
+
+		/* page is the inode page of dir, which is updated below */
+		f2fs_put_page(page, 1);
+		page = NULL;
+		bit_pos = 0;
+	} else {
+		dentry_blk = (struct f2fs_dentry_block *)kaddr;
+		bit_pos = dentry - (struct f2fs_dir_entry *)dentry_blk->dentry;
+		for (i = 0; i < slots; i++)
+			test_and_clear_bit_le(bit_pos + i,
+					&dentry_blk->dentry_bitmap);
+
+		/* Let's check and deallocate this dentry page */
+		bit_pos = find_next_bit_le(&dentry_blk->dentry_bitmap,
+				NR_DENTRY_IN_BLOCK,
+				0);
+		kunmap(page); /* kunmap - pair of f2fs_find_entry */
+		set_page_dirty(page);
+	}
 
 	dir->i_ctime = dir->i_mtime = CURRENT_TIME;
 
@@ -562,6 +784,22 @@ bool f2fs_empty_dir(struct inode *dir)
 	struct	f2fs_dentry_block *dentry_blk;
 	unsigned long nblock = dir_blocks(dir);
 
+	if (f2fs_has_inline_dentry(dir)) {
+		struct f2fs_inline_dentry *inline_dentry;
+		struct page *ipage;
+
+		ipage = get_node_page(F2FS_SB(dir->i_sb), dir->i_ino);
+		if (IS_ERR(ipage))
+			return false;
+
+		inline_dentry = inline_data_addr(ipage);
+		bit_pos = find_next_bit_le(&inline_dentry->dentry_bitmap,
+						NR_INLINE_DENTRY, 2);
+		f2fs_put_page(ipage, 1);
+
+		return bit_pos >= NR_INLINE_DENTRY;
+	}
+
 	for (bidx = 0; bidx < nblock; bidx++) {
 		void *kaddr;
 		dentry_page = get_lock_data_page(dir, bidx);
@@ -591,6 +829,52 @@ bool f2fs_empty_dir(struct inode *dir)
 	return true;
 }
 
+static int f2fs_read_inline_dir(struct file *file, void *dirent,
+							filldir_t filldir)
+{
+	struct inode *inode = file_inode(file);
+	struct f2fs_inline_dentry *inline_dentry;
+	unsigned int bit_pos = file->f_pos;
+	struct f2fs_dir_entry *de;
+	unsigned char d_type;
+	struct page *ipage;
+	int over;
+
+	if (bit_pos >= NR_INLINE_DENTRY)
+		return 0;
+
+	ipage = get_node_page(F2FS_SB(inode->i_sb), inode->i_ino);
+	if (IS_ERR(ipage))
+		return PTR_ERR(ipage);
+
+	inline_dentry = inline_data_addr(ipage);
+	while (bit_pos < NR_INLINE_DENTRY) {
+		bit_pos = find_next_bit_le(&inline_dentry->dentry_bitmap,
+						NR_INLINE_DENTRY,
+						bit_pos);
+		if (bit_pos >= NR_INLINE_DENTRY)
+			break;
+
+		de = &inline_dentry->dentry[bit_pos];
+		d_type = DT_UNKNOWN;
+		if (de->file_type < F2FS_FT_MAX)
+			d_type = f2fs_filetype_table[de->file_type];
+
+		over = filldir(dirent, inline_dentry->filename[bit_pos],
+				le16_to_cpu(de->name_len), bit_pos,
+				le32_to_cpu(de->ino), d_type);
+		if (over) {
+			file->f_pos = bit_pos;
+			goto out;
+		}
+		bit_pos += GET_DENTRY_SLOTS(le16_to_cpu(de->name_len));
+	}
+	file->f_pos = NR_INLINE_DENTRY;
+out:
+	f2fs_put_page(ipage, 1);
+	return 0;
+}
+
 static int f2fs_readdir(struct file *file, void *dirent, filldir_t filldir)
 {
 	unsigned long pos = file->f_pos;
@@ -606,6 +890,9 @@ static int f2fs_readdir(struct file *file, void *dirent, filldir_t filldir)
 	unsigned char d_type = DT_UNKNOWN;
 	int slots;
 
+	if (f2fs_has_inline_dentry(inode))
+		return f2fs_read_inline_dir(file, dirent, filldir);
+
 	types = f2fs_filetype_table;
 	bit_pos = (pos % NR_DENTRY_IN_BLOCK);
 	n = (pos / NR_DENTRY_IN_BLOCK);
@@ -0,0 +1,317 @@
+/*
+ * fs/f2fs/extent_cache.c
+ *
+ * Copyright (c) 2013 Samsung Electronics Co., Ltd.
+ *             http://www.samsung.com/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/fs.h>
+#include <linux/f2fs_fs.h>
+
+#include "f2fs.h"
+#include "node.h"
+
+/*
+ * Each inode keeps the ranges of contiguous data blocks it has looked up or
+ * written in an rb-tree, so that reading a block of a large file does not
+ * need its direct node page once the mapping was seen.  The tree only caches
+ * valid block addresses, and it follows every change of a block address
+ * through update_extent_cache().
+ *
+ * The inodes with a non-empty tree are kept in an LRU list per superblock,
+ * and a shrinker drops the trees of the least recently used inodes.
+ */
+
+static struct kmem_cache *extent_node_slab;
+
+static struct extent_node *__lookup_extent_tree(struct rb_root *root,
+							unsigned int fofs)
+{
+	struct rb_node *node = root->rb_node;
+	struct extent_node *en;
+
+	while (node) {
+		en = rb_entry(node, struct extent_node, rb_node);
+
+		if (fofs < en->fofs)
+			node = node->rb_left;
+		else if (fofs >= en->fofs + en->len)
+			node = node->rb_right;
+		else
+			return en;
+	}
+	return NULL;
+}
+
+static void __insert_extent_tree(struct rb_root *root, struct extent_node *new)
+{
+	struct rb_node **p = &root->rb_node;
+	struct rb_node *parent = NULL;
+	struct extent_node *en;
+
+	while (*p) {
+		parent = *p;
+		en = rb_entry(parent, struct extent_node, rb_node);
+
+		if (new->fofs < en->fofs)
+			p = &(*p)->rb_left;
+		else
+			p = &(*p)->rb_right;
+	}
+
+	rb_link_node(&new->rb_node, parent, p);
+	rb_insert_color(&new->rb_node, root);
+}
+
+static struct extent_node *__attach_extent_node(struct f2fs_sb_info *sbi,
+		struct f2fs_inode_info *fi, unsigned int fofs, u32 blk_addr,
+		unsigned int len)
+{
+	struct extent_node *en;
+
+	/* we are under a spinning rwlock */
+	en = kmem_cache_alloc(extent_node_slab, GFP_ATOMIC);
+	if (!en)
+		return NULL;
+
+	en->fofs = fofs;
+	en->blk_addr = blk_addr;
+	en->len = len;
+	__insert_extent_tree(&fi->ext_tree, en);
+	fi->ext_tree_cnt++;
+	atomic_inc(&sbi->total_ext_node);
+	return en;
+}
+
+static void __detach_extent_node(struct f2fs_sb_info *sbi,
+		struct f2fs_inode_info *fi, struct extent_node *en)
+{
+	rb_erase(&en->rb_node, &fi->ext_tree);
+	fi->ext_tree_cnt--;
+	atomic_dec(&sbi->total_ext_node);
+	kmem_cache_free(extent_node_slab, en);
+}
+
+static unsigned int __free_extent_tree(struct f2fs_sb_info *sbi,
+				struct f2fs_inode_info *fi, unsigned int nr)
+{
+	struct rb_node *node, *next;
+	unsigned int freed = 0;
+
+	node = rb_first(&fi->ext_tree);
+	while (node && freed < nr) {
+		next = rb_next(node);
+		__detach_extent_node(sbi, fi,
+				rb_entry(node, struct extent_node, rb_node));
+		freed++;
+		node = next;
+	}
+	return freed;
+}
+
+static void extent_lru_add(struct f2fs_sb_info *sbi, struct f2fs_inode_info *fi)
+{
+	spin_lock(&sbi->ext_lru_lock);
+	fi->ext_lru_time = jiffies;
+	if (list_empty(&fi->ext_lru))
+		list_add_tail(&fi->ext_lru, &sbi->ext_lru);
+	else
+		list_move_tail(&fi->ext_lru, &sbi->ext_lru);
+	spin_unlock(&sbi->ext_lru_lock);
+}
+
+/*
+ * Find the cached extent that covers pgofs.  Returns the block address of
+ * pgofs and, if len is given, the number of blocks mapped from there on.
+ */
+bool f2fs_lookup_extent_tree(struct inode *inode, pgoff_t pgofs,
+					block_t *blk_addr, unsigned int *len)
+{
+	struct f2fs_sb_info *sbi = F2FS_SB(inode->i_sb);
+	struct f2fs_inode_info *fi = F2FS_I(inode);
+	struct extent_node *en;
+
+	if (!test_opt(sbi, EXTENT_CACHE))
+		return false;
+
+	read_lock(&fi->ext_tree_lock);
+	sbi->total_lookup_tree++;
+	en = __lookup_extent_tree(&fi->ext_tree, pgofs);
+	if (!en) {
+		read_unlock(&fi->ext_tree_lock);
+		return false;
+	}
+
+	*blk_addr = en->blk_addr + pgofs - en->fofs;
+	if (len)
+		*len = en->fofs + en->len - pgofs;
+	sbi->read_hit_tree++;
+	read_unlock(&fi->ext_tree_lock);
+
+	/* a hit moves the inode in the LRU list at most once a second */
+	if (list_empty(&fi->ext_lru) ||
+			time_after(jiffies, fi->ext_lru_time + HZ))
+		extent_lru_add(sbi, fi);
+	return true;
+}
+
+/*
+ * Record that the block at fofs moved to blk_addr.  NULL_ADDR and NEW_ADDR
+ * remove the block from the cache.
+ */
+void f2fs_update_extent_tree(struct inode *inode, pgoff_t fofs,
+							block_t blk_addr)
+{
+	struct f2fs_sb_info *sbi = F2FS_SB(inode->i_sb);
+	struct f2fs_inode_info *fi = F2FS_I(inode);
+	struct extent_node *en, *prev, *next;
+	bool cached;
+
+	if (!test_opt(sbi, EXTENT_CACHE))
+		return;
+
+	write_lock(&fi->ext_tree_lock);
+
+	/* Split the extent that holds the old address */
+	en = __lookup_extent_tree(&fi->ext_tree, fofs);
+	if (en) {
+		unsigned int end = en->fofs + en->len;
+
+		if (en->blk_addr + fofs - en->fofs == blk_addr)
+			goto out;
+
+		if (fofs > en->fofs) {
+			en->len = fofs - en->fofs;
+			if (end > fofs + 1)
+				__attach_extent_node(sbi, fi, fofs + 1,
+					en->blk_addr + fofs + 1 - en->fofs,
+					end - fofs - 1);
+		} else if (end > fofs + 1) {
+			en->fofs++;
+			en->blk_addr++;
+			en->len--;
+		} else {
+			__detach_extent_node(sbi, fi, en);
+		}
+	}
+
+	if (blk_addr == NULL_ADDR || blk_addr == NEW_ADDR)
+		goto out;
+
+	/* Merge the new block with its neighbours if they are contiguous */
+	prev = fofs ? __lookup_extent_tree(&fi->ext_tree, fofs - 1) : NULL;
+	next = __lookup_extent_tree(&fi->ext_tree, fofs + 1);
+
+	if (prev && prev->blk_addr + prev->len != blk_addr)
+		prev = NULL;
+	if (next && (next->fofs != fofs + 1 || next->blk_addr != blk_addr + 1))
+		next = NULL;
+
+	if (prev) {
+		prev->len++;
+		if (next) {
+			prev->len += next->len;
+			__detach_extent_node(sbi, fi, next);
+		}
+	} else if (next) {
+		next->fofs--;
+		next->blk_addr--;
+		next->len++;
+	} else {
+		__attach_extent_node(sbi, fi, fofs, blk_addr, 1);
+	}
+out:
+	cached = fi->ext_tree_cnt != 0;
+	write_unlock(&fi->ext_tree_lock);
+
+	if (cached)
+		extent_lru_add(sbi, fi);
+}
+
+/*
+ * Called when the inode is evicted, after its data blocks are settled.
+ */
+void f2fs_destroy_extent_tree(struct inode *inode)
+{
+	struct f2fs_sb_info *sbi = F2FS_SB(inode->i_sb);
+	struct f2fs_inode_info *fi = F2FS_I(inode);
+
+	spin_lock(&sbi->ext_lru_lock);
+	if (!list_empty(&fi->ext_lru))
+		list_del_init(&fi->ext_lru);
+	spin_unlock(&sbi->ext_lru_lock);
+
+	write_lock(&fi->ext_tree_lock);
+	__free_extent_tree(sbi, fi, UINT_MAX);
+	write_unlock(&fi->ext_tree_lock);
+}
+
+static int f2fs_shrink_extent_tree(struct shrinker *shrink,
+					struct shrink_control *sc)
+{
+	struct f2fs_sb_info *sbi = container_of(shrink,
+					struct f2fs_sb_info, ext_shrinker);
+	struct f2fs_inode_info *fi;
+	struct list_head *cur, *tmp, scanned;
+	unsigned int nr_to_scan = sc->nr_to_scan;
+	unsigned int freed;
+
+	if (!nr_to_scan)
+		return atomic_read(&sbi->total_ext_node);
+
+	INIT_LIST_HEAD(&scanned);
+
+	spin_lock(&sbi->ext_lru_lock);
+	list_for_each_safe(cur, tmp, &sbi->ext_lru) {
+		fi = list_entry(cur, struct f2fs_inode_info, ext_lru);
+
+		write_lock(&fi->ext_tree_lock);
+		freed = __free_extent_tree(sbi, fi, nr_to_scan);
+		if (fi->ext_tree_cnt)
+			list_move_tail(cur, &scanned);
+		else
+			list_del_init(cur);
+		write_unlock(&fi->ext_tree_lock);
+
+		nr_to_scan -= freed;
+		if (!nr_to_scan)
+			break;
+	}
+	list_splice_tail(&scanned, &sbi->ext_lru);
+	spin_unlock(&sbi->ext_lru_lock);
+
+	return atomic_read(&sbi->total_ext_node);
+}
+
+void f2fs_init_extent_cache(struct f2fs_sb_info *sbi)
+{
+	INIT_LIST_HEAD(&sbi->ext_lru);
+	spin_lock_init(&sbi->ext_lru_lock);
+	atomic_set(&sbi->total_ext_node, 0);
+
+	sbi->ext_shrinker.shrink = f2fs_shrink_extent_tree;
+	sbi->ext_shrinker.seeks = DEFAULT_SEEKS;
+	register_shrinker(&sbi->ext_shrinker);
+}
+
+void f2fs_destroy_extent_cache(struct f2fs_sb_info *sbi)
+{
+	unregister_shrinker(&sbi->ext_shrinker);
+}
+
+int __init create_extent_cache(void)
+{
+	extent_node_slab = f2fs_kmem_cache_create("f2fs_extent_node",
+					sizeof(struct extent_node), NULL);
+	if (!extent_node_slab)
+		return -ENOMEM;
+	return 0;
+}
+
+void destroy_extent_cache(void)
+{
+	kmem_cache_destroy(extent_node_slab);
+}
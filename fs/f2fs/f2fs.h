@@ -17,6 +17,7 @@
 #include <linux/slab.h>
 #include <linux/crc32.h>
 #include <linux/magic.h>
+#include <linux/rbtree.h>
 
 /*
  * For mount options
@@ -28,6 +29,9 @@
 #define F2FS_MOUNT_XATTR_USER		0x00000010
 #define F2FS_MOUNT_POSIX_ACL		0x00000020
 #define F2FS_MOUNT_DISABLE_EXT_IDENTIFY	0x00000040
+#define F2FS_MOUNT_INLINE_DATA		0x00000080
+#define F2FS_MOUNT_INLINE_DENTRY	0x00000100
+#define F2FS_MOUNT_EXTENT_CACHE		0x00000200
 
 #define clear_opt(sbi, option)	(sbi->mount_opt.opt &= ~F2FS_MOUNT_##option)
 #define set_opt(sbi, option)	(sbi->mount_opt.opt |= F2FS_MOUNT_##option)
@@ -81,6 +85,16 @@ struct fsync_inode_entry {
 	block_t blkaddr;	/* block address locating the last inode */
 };
 
+/* why f2fs_sync_file() had to write a checkpoint instead of roll-forward */
+enum {
+	CP_NON_REGULAR,		/* not a regular file */
+	CP_HARDLINK,		/* the inode has more than one link */
+	CP_LOST_PINO,		/* a hard link was made, i_pino is stale */
+	CP_NO_SPC_ROLL,		/* no space for roll-forward recovery */
+	CP_NODE_NEED_CP,	/* the parent dir is not checkpointed yet */
+	NR_CP_REASONS,
+};
+
 #define nats_in_cursum(sum)		(le16_to_cpu(sum->n_nats))
 #define sits_in_cursum(sum)		(le16_to_cpu(sum->n_sits))
 
@@ -109,6 +123,11 @@ static inline int update_sits_in_cursum(struct f2fs_summary_block *rs, int i)
 #define F2FS_IOC_GETFLAGS               FS_IOC_GETFLAGS
 #define F2FS_IOC_SETFLAGS               FS_IOC_SETFLAGS
 
+#define F2FS_IOCTL_MAGIC		0xf5
+#define F2FS_IOC_START_ATOMIC_WRITE	_IO(F2FS_IOCTL_MAGIC, 1)
+#define F2FS_IOC_COMMIT_ATOMIC_WRITE	_IO(F2FS_IOCTL_MAGIC, 2)
+#define F2FS_IOC_ABORT_ATOMIC_WRITE	_IO(F2FS_IOCTL_MAGIC, 5)
+
 #if defined(__KERNEL__) && defined(CONFIG_COMPAT)
 /*
  * ioctl commands in 32 bit emulation
@@ -144,6 +163,14 @@ struct extent_info {
 	unsigned int len;	/* length of the extent */
 };
 
+/* for the per-inode rb-tree of extents, see extent_cache.c */
+struct extent_node {
+	struct rb_node rb_node;	/* rb node located in rb-tree */
+	unsigned int fofs;	/* start offset in a file */
+	u32 blk_addr;		/* start block address of the extent */
+	unsigned int len;	/* length of the extent */
+};
+
 /*
  * i_advise uses FADVISE_XXX_BIT. We can add additional hints later.
  */
@@ -165,6 +192,17 @@ struct f2fs_inode_info {
 	unsigned int clevel;		/* maximum level of given file name */
 	nid_t i_xattr_nid;		/* node id that contains xattrs */
 	struct extent_info ext;		/* in-memory extent cache entry */
+	struct rb_root ext_tree;	/* rb-tree of cached extents */
+	rwlock_t ext_tree_lock;		/* lock for ext_tree */
+	unsigned int ext_tree_cnt;	/* # of extent nodes in ext_tree */
+	struct list_head ext_lru;	/* entry in sbi->ext_lru */
+	unsigned long ext_lru_time;	/* jiffies of the last LRU move */
+
+	/* for atomic writes */
+	struct list_head inmem_pages;	/* pages written since the start */
+	struct mutex inmem_lock;	/* lock for inmem_pages */
+	loff_t i_atomic_size;		/* i_size at the start */
+	struct file *i_atomic_file;	/* file that started the write */
 };
 
 static inline void get_extent_info(struct extent_info *ext,
@@ -371,6 +409,12 @@ struct f2fs_sb_info {
 	spinlock_t dir_inode_lock;		/* for dir inode list lock */
 	unsigned int n_dirty_dirs;		/* # of dir inodes */
 
+	/* for extent tree cache */
+	struct list_head ext_lru;		/* inodes with extent trees */
+	spinlock_t ext_lru_lock;		/* for ext_lru lock */
+	atomic_t total_ext_node;		/* # of cached extent nodes */
+	struct shrinker ext_shrinker;		/* shrinker for extent trees */
+
 	/* basic file system units */
 	unsigned int log_sectors_per_block;	/* log2 sectors per block */
 	unsigned int log_blocksize;		/* log2 block size */
@@ -411,7 +455,12 @@ struct f2fs_sb_info {
 	unsigned int block_count[2];		/* # of allocated blocks */
 	unsigned int last_victim[2];		/* last victim segment # */
 	int total_hit_ext, read_hit_ext;	/* extent cache hit ratio */
+	int total_lookup_tree, read_hit_tree;	/* extent tree hit ratio */
 	int bg_gc;				/* background gc calls */
+	int fg_gc_stall;			/* writers stalled by fg gc */
+	unsigned long fg_gc_stall_time;		/* jiffies spent in the stalls */
+	int fsync_roll_forward;			/* fsyncs done by roll-forward */
+	int fsync_cp[NR_CP_REASONS];		/* fsyncs done by checkpoint */
 	spinlock_t stat_lock;			/* lock for stat operations */
 };
 
@@ -846,6 +895,9 @@ enum {
 	FI_INC_LINK,		/* need to increment i_nlink */
 	FI_ACL_MODE,		/* indicate acl mode */
 	FI_NO_ALLOC,		/* should not allocate any blocks */
+	FI_INLINE_DATA,		/* data is stored in the inode block */
+	FI_INLINE_DENTRY,	/* dentries are stored in the inode block */
+	FI_ATOMIC_FILE,		/* an atomic write is in progress */
 };
 
 static inline void set_inode_flag(struct f2fs_inode_info *fi, int flag)
@@ -878,11 +930,59 @@ static inline int cond_clear_inode_flag(struct f2fs_inode_info *fi, int flag)
 	return 0;
 }
 
+static inline void get_inline_info(struct f2fs_inode_info *fi,
+					struct f2fs_inode *ri)
+{
+	if (ri->i_inline & F2FS_INLINE_DATA)
+		set_inode_flag(fi, FI_INLINE_DATA);
+	if (ri->i_inline & F2FS_INLINE_DENTRY)
+		set_inode_flag(fi, FI_INLINE_DENTRY);
+}
+
+static inline void set_raw_inline(struct f2fs_inode_info *fi,
+					struct f2fs_inode *ri)
+{
+	ri->i_inline = 0;
+
+	if (is_inode_flag_set(fi, FI_INLINE_DATA))
+		ri->i_inline |= F2FS_INLINE_DATA;
+	if (is_inode_flag_set(fi, FI_INLINE_DENTRY))
+		ri->i_inline |= F2FS_INLINE_DENTRY;
+}
+
+static inline int f2fs_has_inline_data(struct inode *inode)
+{
+	return is_inode_flag_set(F2FS_I(inode), FI_INLINE_DATA);
+}
+
+static inline int f2fs_has_inline_dentry(struct inode *inode)
+{
+	return is_inode_flag_set(F2FS_I(inode), FI_INLINE_DENTRY);
+}
+
+static inline int f2fs_is_atomic_file(struct inode *inode)
+{
+	return is_inode_flag_set(F2FS_I(inode), FI_ATOMIC_FILE);
+}
+
+/* page_private of the data pages held back by an atomic write */
+#define ATOMIC_WRITTEN_PAGE		0x0000ffff
+
+#define IS_ATOMIC_WRITTEN_PAGE(page)			\
+		(page_private(page) == (unsigned long)ATOMIC_WRITTEN_PAGE)
+
+static inline void *inline_data_addr(struct page *page)
+{
+	struct f2fs_node *raw_node = (struct f2fs_node *)page_address(page);
+	return (void *)&(raw_node->i.i_addr[1]);
+}
+
 /*
  * file.c
  */
 int f2fs_sync_file(struct file *, loff_t, loff_t, int);
 void truncate_data_blocks(struct dnode_of_data *);
+int truncate_blocks(struct inode *, u64);
 void f2fs_truncate(struct inode *);
 int f2fs_setattr(struct dentry *, struct iattr *);
 int truncate_hole(struct inode *, pgoff_t, pgoff_t);
@@ -915,7 +1015,8 @@ void f2fs_set_link(struct inode *, struct f2fs_dir_entry *,
 				struct page *, struct inode *);
 void init_dent_inode(const struct qstr *, struct page *);
 int __f2fs_add_link(struct inode *, const struct qstr *, struct inode *);
-void f2fs_delete_entry(struct f2fs_dir_entry *, struct page *, struct inode *);
+void f2fs_delete_entry(struct f2fs_dir_entry *, struct page *,
+				struct inode *, struct inode *);
 int f2fs_make_empty(struct inode *, struct inode *);
 bool f2fs_empty_dir(struct inode *);
 
@@ -954,13 +1055,15 @@ void ra_node_page(struct f2fs_sb_info *, nid_t);
 struct page *get_node_page(struct f2fs_sb_info *, pgoff_t);
 struct page *get_node_page_ra(struct page *, int);
 void sync_inode_page(struct dnode_of_data *);
-int sync_node_pages(struct f2fs_sb_info *, nid_t, struct writeback_control *);
+int sync_node_pages(struct f2fs_sb_info *, nid_t,
+			struct writeback_control *, bool);
 bool alloc_nid(struct f2fs_sb_info *, nid_t *);
 void alloc_nid_done(struct f2fs_sb_info *, nid_t);
 void alloc_nid_failed(struct f2fs_sb_info *, nid_t);
 void recover_node_page(struct f2fs_sb_info *, struct page *,
 		struct f2fs_summary *, struct node_info *, block_t);
 int recover_inode_page(struct f2fs_sb_info *, struct page *);
+int recover_xattr_data(struct inode *, struct page *, block_t);
 int restore_node_summary(struct f2fs_sb_info *, unsigned int,
 				struct f2fs_summary_block *);
 void flush_nat_entries(struct f2fs_sb_info *);
@@ -973,6 +1076,8 @@ void destroy_node_manager_caches(void);
  * segment.c
  */
 void f2fs_balance_fs(struct f2fs_sb_info *);
+void register_inmem_page(struct inode *, struct page *);
+int commit_inmem_pages(struct inode *, bool);
 void invalidate_blocks(struct f2fs_sb_info *, block_t);
 void locate_dirty_segment(struct f2fs_sb_info *, unsigned int);
 void clear_prefree_segments(struct f2fs_sb_info *);
@@ -998,6 +1103,8 @@ int lookup_journal_in_cursum(struct f2fs_summary_block *,
 void flush_sit_entries(struct f2fs_sb_info *);
 int build_segment_manager(struct f2fs_sb_info *);
 void destroy_segment_manager(struct f2fs_sb_info *);
+int __init create_segment_manager_caches(void);
+void destroy_segment_manager_caches(void);
 
 /*
  * checkpoint.c
@@ -1046,6 +1153,27 @@ void destroy_gc_caches(void);
 int recover_fsync_data(struct f2fs_sb_info *);
 bool space_for_roll_forward(struct f2fs_sb_info *);
 
+/*
+ * inline.c
+ */
+int f2fs_read_inline_data(struct inode *, struct page *);
+int f2fs_write_inline_data(struct inode *, struct page *);
+int f2fs_convert_inline_data(struct inode *, loff_t);
+void truncate_inline_data(struct inode *, u64);
+bool recover_inline_data(struct inode *, struct page *);
+
+/*
+ * extent_cache.c
+ */
+bool f2fs_lookup_extent_tree(struct inode *, pgoff_t, block_t *,
+							unsigned int *);
+void f2fs_update_extent_tree(struct inode *, pgoff_t, block_t);
+void f2fs_destroy_extent_tree(struct inode *);
+void f2fs_init_extent_cache(struct f2fs_sb_info *);
+void f2fs_destroy_extent_cache(struct f2fs_sb_info *);
+int __init create_extent_cache(void);
+void destroy_extent_cache(void);
+
 /*
  * debug.c
  */
@@ -1057,10 +1185,14 @@ struct f2fs_stat_info {
 	int all_area_segs, sit_area_segs, nat_area_segs, ssa_area_segs;
 	int main_area_segs, main_area_sections, main_area_zones;
 	int hit_ext, total_ext;
+	int hit_tree, total_tree, ext_node;
 	int ndirty_node, ndirty_dent, ndirty_dirs, ndirty_meta;
 	int nats, sits, fnids;
 	int total_count, utilization;
 	int bg_gc;
+	int fg_gc_stall;
+	unsigned int fg_gc_stall_ms;
+	int fsync_roll_forward, fsync_cp[NR_CP_REASONS];
 	unsigned int valid_count, valid_node_count, valid_inode_count;
 	unsigned int bimodal, avg_vblocks;
 	int util_free, util_valid, util_invalid;
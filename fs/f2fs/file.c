@@ -41,6 +41,11 @@ static int f2fs_vm_page_mkwrite(struct vm_area_struct *vma,
 
 	sb_start_pagefault(inode->i_sb);
 
+	/* force to convert with normal data indices */
+	err = f2fs_convert_inline_data(inode, MAX_INLINE_DATA + 1);
+	if (err)
+		goto out;
+
 	/* block allocation */
 	ilock = mutex_lock_op(sbi);
 	set_new_dnode(&dn, inode, NULL, NULL, 0);
@@ -102,11 +107,32 @@ static const struct vm_operations_struct f2fs_file_vm_ops = {
 	.remap_pages	= generic_file_remap_pages,
 };
 
-int f2fs_sync_file(struct file *file, loff_t start, loff_t end, int datasync)
+/*
+ * The hard link that made a file lose its i_pino may be gone.  Take the
+ * parent of the only dentry left, so that the file can go back to the
+ * roll-forward path once the checkpoint for this fsync is written.
+ */
+static void fix_lost_pino(struct inode *inode)
+{
+	struct dentry *dentry;
+
+	dentry = d_find_any_alias(inode);
+	if (!dentry)
+		return;
+
+	F2FS_I(inode)->i_pino = parent_ino(dentry);
+	clear_cp_file(inode);
+	dput(dentry);
+	update_inode_page(inode);
+}
+
+static int __f2fs_sync_file(struct file *file, loff_t start, loff_t end,
+						int datasync, bool atomic)
 {
 	struct inode *inode = file->f_mapping->host;
 	struct f2fs_sb_info *sbi = F2FS_SB(inode->i_sb);
 	int ret = 0;
+	int cp_reason = NR_CP_REASONS;
 	bool need_cp = false;
 	struct writeback_control wbc = {
 		.sync_mode = WB_SYNC_ALL,
@@ -132,21 +158,30 @@ int f2fs_sync_file(struct file *file, loff_t start, loff_t end, int datasync)
 	if (datasync && !(inode->i_state & I_DIRTY_DATASYNC))
 		goto out;
 
-	if (!S_ISREG(inode->i_mode) || inode->i_nlink != 1)
-		need_cp = true;
+	if (!S_ISREG(inode->i_mode))
+		cp_reason = CP_NON_REGULAR;
+	else if (inode->i_nlink != 1)
+		cp_reason = CP_HARDLINK;
 	else if (is_cp_file(inode))
-		need_cp = true;
+		cp_reason = CP_LOST_PINO;
 	else if (!space_for_roll_forward(sbi))
-		need_cp = true;
+		cp_reason = CP_NO_SPC_ROLL;
 	else if (!is_checkpointed_node(sbi, F2FS_I(inode)->i_pino))
-		need_cp = true;
+		cp_reason = CP_NODE_NEED_CP;
 
+	need_cp = cp_reason != NR_CP_REASONS;
 	if (need_cp) {
+		sbi->fsync_cp[cp_reason]++;
+		if (cp_reason == CP_LOST_PINO)
+			fix_lost_pino(inode);
+
 		/* all the dirty node pages should be flushed for POR */
 		ret = f2fs_sync_fs(inode->i_sb, 1);
 	} else {
+		sbi->fsync_roll_forward++;
+
 		/* if there is no written node page, write its inode page */
-		while (!sync_node_pages(sbi, inode->i_ino, &wbc)) {
+		while (!sync_node_pages(sbi, inode->i_ino, &wbc, atomic)) {
 			ret = f2fs_write_inode(inode, NULL);
 			if (ret)
 				goto out;
@@ -161,6 +196,11 @@ out:
 	return ret;
 }
 
+int f2fs_sync_file(struct file *file, loff_t start, loff_t end, int datasync)
+{
+	return __f2fs_sync_file(file, start, end, datasync, false);
+}
+
 static int f2fs_file_mmap(struct file *file, struct vm_area_struct *vma)
 {
 	file_accessed(file);
@@ -227,7 +267,7 @@ static void truncate_partial_data_page(struct inode *inode, u64 from)
 	f2fs_put_page(page, 1);
 }
 
-static int truncate_blocks(struct inode *inode, u64 from)
+int truncate_blocks(struct inode *inode, u64 from)
 {
 	struct f2fs_sb_info *sbi = F2FS_SB(inode->i_sb);
 	unsigned int blocksize = inode->i_sb->s_blocksize;
@@ -242,6 +282,14 @@ static int truncate_blocks(struct inode *inode, u64 from)
 			((from + blocksize - 1) >> (sbi->log_blocksize));
 
 	ilock = mutex_lock_op(sbi);
+
+	if (f2fs_has_inline_data(inode) || f2fs_has_inline_dentry(inode)) {
+		truncate_inline_data(inode, from);
+		mutex_unlock_op(sbi, ilock);
+		trace_f2fs_truncate_blocks_exit(inode, 0);
+		return 0;
+	}
+
 	set_new_dnode(&dn, inode, NULL, NULL, 0);
 	err = get_dnode_of_data(&dn, free_from, LOOKUP_NODE);
 	if (err) {
@@ -343,6 +391,10 @@ int f2fs_setattr(struct dentry *dentry, struct iattr *attr)
 
 	if ((attr->ia_valid & ATTR_SIZE) &&
 			attr->ia_size != i_size_read(inode)) {
+		err = f2fs_convert_inline_data(inode, attr->ia_size);
+		if (err)
+			return err;
+
 		truncate_setsize(inode, attr->ia_size);
 		f2fs_truncate(inode);
 		f2fs_balance_fs(F2FS_SB(inode->i_sb));
@@ -541,6 +593,10 @@ static long f2fs_fallocate(struct file *file, int mode,
 	if (mode & ~(FALLOC_FL_KEEP_SIZE | FALLOC_FL_PUNCH_HOLE))
 		return -EOPNOTSUPP;
 
+	ret = f2fs_convert_inline_data(inode, MAX_INLINE_DATA + 1);
+	if (ret)
+		return ret;
+
 	if (mode & FALLOC_FL_PUNCH_HOLE)
 		ret = punch_hole(inode, offset, len, mode);
 	else
@@ -567,6 +623,138 @@ static inline __u32 f2fs_mask_flags(umode_t mode, __u32 flags)
 		return flags & F2FS_OTHER_FLMASK;
 }
 
+/*
+ * Atomic writes let an application such as SQLite update a file without a
+ * rollback journal.  The pages written between the start and the commit are
+ * held in memory, and the commit writes them and the node blocks with one
+ * fsync, which roll-forward recovery replays as a whole.
+ */
+static int f2fs_ioc_start_atomic_write(struct file *filp)
+{
+	struct inode *inode = file_inode(filp);
+	struct f2fs_inode_info *fi = F2FS_I(inode);
+	int ret;
+
+	if (!inode_owner_or_capable(inode))
+		return -EACCES;
+	if (!S_ISREG(inode->i_mode))
+		return -EINVAL;
+
+	ret = mnt_want_write_file(filp);
+	if (ret)
+		return ret;
+
+	mutex_lock(&inode->i_mutex);
+	if (f2fs_is_atomic_file(inode)) {
+		if (fi->i_atomic_file != filp)
+			ret = -EBUSY;
+		goto out;
+	}
+
+	ret = f2fs_convert_inline_data(inode, MAX_INLINE_DATA + 1);
+	if (ret)
+		goto out;
+
+	fi->i_atomic_size = i_size_read(inode);
+	fi->i_atomic_file = filp;
+	set_inode_flag(fi, FI_ATOMIC_FILE);
+
+	/* the pages dirtied before the start are not part of the write */
+	ret = filemap_write_and_wait(inode->i_mapping);
+	if (ret) {
+		clear_inode_flag(fi, FI_ATOMIC_FILE);
+		fi->i_atomic_file = NULL;
+		commit_inmem_pages(inode, true);
+	}
+out:
+	mutex_unlock(&inode->i_mutex);
+	mnt_drop_write_file(filp);
+	return ret;
+}
+
+static int f2fs_ioc_commit_atomic_write(struct file *filp)
+{
+	struct inode *inode = file_inode(filp);
+	int ret;
+
+	if (!inode_owner_or_capable(inode))
+		return -EACCES;
+
+	ret = mnt_want_write_file(filp);
+	if (ret)
+		return ret;
+
+	mutex_lock(&inode->i_mutex);
+	if (f2fs_is_atomic_file(inode)) {
+		clear_inode_flag(F2FS_I(inode), FI_ATOMIC_FILE);
+		F2FS_I(inode)->i_atomic_file = NULL;
+		ret = commit_inmem_pages(inode, false);
+	} else {
+		ret = -EINVAL;
+	}
+	mutex_unlock(&inode->i_mutex);
+
+	if (!ret)
+		ret = __f2fs_sync_file(filp, 0, LLONG_MAX, 0, true);
+
+	mnt_drop_write_file(filp);
+	return ret;
+}
+
+/*
+ * Caller should hold i_mutex.
+ */
+static void drop_atomic_write(struct inode *inode)
+{
+	struct f2fs_inode_info *fi = F2FS_I(inode);
+
+	if (!f2fs_is_atomic_file(inode))
+		return;
+
+	clear_inode_flag(fi, FI_ATOMIC_FILE);
+	fi->i_atomic_file = NULL;
+	commit_inmem_pages(inode, true);
+
+	/* the blocks reserved beyond the old size are not needed anymore */
+	if (i_size_read(inode) > fi->i_atomic_size) {
+		truncate_setsize(inode, fi->i_atomic_size);
+		f2fs_truncate(inode);
+		f2fs_balance_fs(F2FS_SB(inode->i_sb));
+	}
+}
+
+static int f2fs_ioc_abort_atomic_write(struct file *filp)
+{
+	struct inode *inode = file_inode(filp);
+	int ret;
+
+	if (!inode_owner_or_capable(inode))
+		return -EACCES;
+
+	ret = mnt_want_write_file(filp);
+	if (ret)
+		return ret;
+
+	mutex_lock(&inode->i_mutex);
+	drop_atomic_write(inode);
+	mutex_unlock(&inode->i_mutex);
+
+	mnt_drop_write_file(filp);
+	return 0;
+}
+
+static int f2fs_release_file(struct inode *inode, struct file *filp)
+{
+	/* an atomic write left open by this file is aborted */
+	if (f2fs_is_atomic_file(inode)) {
+		mutex_lock(&inode->i_mutex);
+		if (F2FS_I(inode)->i_atomic_file == filp)
+			drop_atomic_write(inode);
+		mutex_unlock(&inode->i_mutex);
+	}
+	return 0;
+}
+
 long f2fs_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 {
 	struct inode *inode = file_inode(filp);
@@ -622,6 +810,12 @@ out:
 		mnt_drop_write_file(filp);
 		return ret;
 	}
+	case F2FS_IOC_START_ATOMIC_WRITE:
+		return f2fs_ioc_start_atomic_write(filp);
+	case F2FS_IOC_COMMIT_ATOMIC_WRITE:
+		return f2fs_ioc_commit_atomic_write(filp);
+	case F2FS_IOC_ABORT_ATOMIC_WRITE:
+		return f2fs_ioc_abort_atomic_write(filp);
 	default:
 		return -ENOTTY;
 	}
@@ -637,6 +831,10 @@ long f2fs_compat_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	case F2FS_IOC32_SETFLAGS:
 		cmd = F2FS_IOC_SETFLAGS;
 		break;
+	case F2FS_IOC_START_ATOMIC_WRITE:
+	case F2FS_IOC_COMMIT_ATOMIC_WRITE:
+	case F2FS_IOC_ABORT_ATOMIC_WRITE:
+		break;
 	default:
 		return -ENOIOCTLCMD;
 	}
@@ -651,6 +849,7 @@ const struct file_operations f2fs_file_operations = {
 	.aio_read	= generic_file_aio_read,
 	.aio_write	= generic_file_aio_write,
 	.open		= generic_file_open,
+	.release	= f2fs_release_file,
 	.mmap		= f2fs_file_mmap,
 	.fsync		= f2fs_sync_file,
 	.fallocate	= f2fs_fallocate,
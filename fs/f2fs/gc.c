@@ -30,9 +30,10 @@ static int gc_thread_func(void *data)
 {
 	struct f2fs_sb_info *sbi = data;
 	wait_queue_head_t *wq = &sbi->gc_thread->gc_wait_queue_head;
-	long wait_ms;
+	long wait_ms, sleep_ms;
 
 	wait_ms = GC_THREAD_MIN_SLEEP_TIME;
+	sleep_ms = wait_ms;
 
 	do {
 		if (try_to_freeze())
@@ -40,12 +41,12 @@ static int gc_thread_func(void *data)
 		else
 			wait_event_interruptible_timeout(*wq,
 						kthread_should_stop(),
-						msecs_to_jiffies(wait_ms));
+						msecs_to_jiffies(sleep_ms));
 		if (kthread_should_stop())
 			break;
 
 		if (sbi->sb->s_writers.frozen >= SB_FREEZE_WRITE) {
-			wait_ms = GC_THREAD_MAX_SLEEP_TIME;
+			sleep_ms = GC_THREAD_MAX_SLEEP_TIME;
 			continue;
 		}
 
@@ -53,9 +54,8 @@ static int gc_thread_func(void *data)
 		 * [GC triggering condition]
 		 * 0. GC is not conducted currently.
 		 * 1. There are enough dirty segments.
-		 * 2. IO subsystem is idle by checking the # of writeback pages.
-		 * 3. IO subsystem is idle by checking the # of requests in
-		 *    bdev's request list.
+		 * 2. IO subsystem is idle: no request is in flight and no I/O
+		 *    was done during GC_THREAD_IDLE_WINDOW.
 		 *
 		 * Note) We have to avoid triggering GCs too much frequently.
 		 * Because it is possible that some segments can be
@@ -65,8 +65,12 @@ static int gc_thread_func(void *data)
 		if (!mutex_trylock(&sbi->gc_mutex))
 			continue;
 
+		/*
+		 * While the device is busy, look again once an idle window
+		 * has passed, instead of sleeping for another wait_ms.
+		 */
 		if (!is_idle(sbi)) {
-			wait_ms = increase_sleep_time(wait_ms);
+			sleep_ms = GC_THREAD_IDLE_WINDOW;
 			mutex_unlock(&sbi->gc_mutex);
 			continue;
 		}
@@ -81,6 +85,7 @@ static int gc_thread_func(void *data)
 		/* if return value is not zero, no victim was selected */
 		if (f2fs_gc(sbi))
 			wait_ms = GC_THREAD_NOGC_SLEEP_TIME;
+		sleep_ms = wait_ms;
 	} while (!kthread_should_stop());
 	return 0;
 }
@@ -98,6 +103,8 @@ int start_gc_thread(struct f2fs_sb_info *sbi)
 
 	sbi->gc_thread = gc_th;
 	init_waitqueue_head(&sbi->gc_thread->gc_wait_queue_head);
+	gc_th->last_ios = 0;
+	gc_th->busy_stamp = jiffies;
 	sbi->gc_thread->f2fs_gc_task = kthread_run(gc_thread_func, sbi,
 			"f2fs_gc-%u:%u", MAJOR(dev), MINOR(dev));
 	if (IS_ERR(gc_th->f2fs_gc_task)) {
@@ -181,6 +188,7 @@ static unsigned int get_cb_cost(struct f2fs_sb_info *sbi, unsigned int segno)
 	struct sit_info *sit_i = SIT_I(sbi);
 	unsigned int secno = GET_SECNO(sbi, segno);
 	unsigned int start = secno * sbi->segs_per_sec;
+	unsigned char type = get_seg_entry(sbi, start)->type;
 	unsigned long long mtime = 0;
 	unsigned int vblocks;
 	unsigned char age = 0;
@@ -205,6 +213,14 @@ static unsigned int get_cb_cost(struct f2fs_sb_info *sbi, unsigned int segno)
 		age = 100 - div64_u64(100 * (mtime - sit_i->min_mtime),
 				sit_i->max_mtime - sit_i->min_mtime);
 
+	/*
+	 * Blocks in hot segments are likely to be updated again soon, so leave
+	 * them to age, and clean cold sections first.  The moved blocks go to
+	 * the cold logs, which keeps the temperatures separated.
+	 */
+	if (type == CURSEG_HOT_DATA || type == CURSEG_HOT_NODE)
+		age >>= 1;
+
 	return UINT_MAX - ((100 * (100 - u) * age) / (100 + u));
 }
 
@@ -429,7 +445,7 @@ next_step:
 			.nr_to_write = LONG_MAX,
 			.for_reclaim = 0,
 		};
-		sync_node_pages(sbi, 0, &wbc);
+		sync_node_pages(sbi, 0, &wbc, false);
 
 		/*
 		 * In the case of FG_GC, it'd be better to reclaim this victim
@@ -526,6 +542,57 @@ out:
 	f2fs_put_page(page, 1);
 }
 
+/*
+ * The page of an atomic write holds data that is not committed yet, while
+ * the victim block keeps the committed data.  Put the committed data in the
+ * page while it is written to the new block, and restore the page after.
+ * The page is locked and not uptodate meanwhile, so readers wait for it.
+ */
+static void move_atomic_data_page(struct inode *inode, struct page *page,
+							block_t blkaddr)
+{
+	struct f2fs_sb_info *sbi = F2FS_SB(inode->i_sb);
+	struct page *tmp;
+	unsigned long *src, *dst;
+	int i;
+
+	tmp = alloc_page(GFP_NOFS);
+	if (!tmp)
+		goto out;
+	lock_page(tmp);
+	/* on failure, f2fs_readpage() has unlocked and released tmp */
+	if (f2fs_readpage(sbi, tmp, blkaddr, READ_SYNC))
+		goto out;
+	lock_page(tmp);
+	if (!PageUptodate(tmp))
+		goto free_tmp;
+
+	wait_on_page_writeback(page);
+	ClearPageUptodate(page);
+
+	src = kmap(tmp);
+	dst = kmap(page);
+	for (i = 0; i < PAGE_CACHE_SIZE / sizeof(unsigned long); i++)
+		swap(src[i], dst[i]);
+
+	set_cold_data(page);
+	do_write_data_page(page);
+	clear_cold_data(page);
+	f2fs_submit_bio(sbi, DATA, true);
+	wait_on_page_writeback(page);
+
+	for (i = 0; i < PAGE_CACHE_SIZE / sizeof(unsigned long); i++)
+		swap(src[i], dst[i]);
+	kunmap(page);
+	kunmap(tmp);
+
+	SetPageUptodate(page);
+free_tmp:
+	f2fs_put_page(tmp, 1);
+out:
+	f2fs_put_page(page, 1);
+}
+
 /*
  * This function tries to get parent node of victim data block, and identifies
  * data block validity. If the block is valid, copy that with cold status and
@@ -597,7 +664,13 @@ next_step:
 						start_bidx + ofs_in_node);
 				if (IS_ERR(data_page))
 					continue;
-				move_data_page(inode, data_page, gc_type);
+				if (gc_type == FG_GC &&
+					IS_ATOMIC_WRITTEN_PAGE(data_page))
+					move_atomic_data_page(inode, data_page,
+							start_addr + off);
+				else
+					move_data_page(inode, data_page,
+							gc_type);
 				stat_inc_data_blk_count(sbi, 1);
 			}
 		}
@@ -16,6 +16,11 @@
 #define GC_THREAD_MIN_SLEEP_TIME	30000	/* milliseconds */
 #define GC_THREAD_MAX_SLEEP_TIME	60000
 #define GC_THREAD_NOGC_SLEEP_TIME	300000	/* wait 5 min */
+#define GC_THREAD_IDLE_WINDOW		2000	/*
+						 * the device is idle when it
+						 * has done no I/O for this
+						 * long
+						 */
 #define LIMIT_INVALID_BLOCK	40 /* percentage over total user space */
 #define LIMIT_FREE_BLOCK	40 /* percentage over invalid + free space */
 
@@ -25,6 +30,10 @@
 struct f2fs_gc_kthread {
 	struct task_struct *f2fs_gc_task;
 	wait_queue_head_t gc_wait_queue_head;
+
+	/* for idle detection */
+	unsigned long last_ios;		/* # of I/Os seen at the last check */
+	unsigned long busy_stamp;	/* jiffies when I/O was last seen */
 };
 
 struct inode_entry {
@@ -93,10 +102,27 @@ static inline bool has_enough_invalid_blocks(struct f2fs_sb_info *sbi)
 	return false;
 }
 
+/*
+ * The device is idle when no request is in flight and no I/O completed
+ * within GC_THREAD_IDLE_WINDOW.  The partition statistics cover both
+ * request_fn and multi-queue devices.
+ */
 static inline int is_idle(struct f2fs_sb_info *sbi)
 {
+	struct f2fs_gc_kthread *gc_th = sbi->gc_thread;
 	struct block_device *bdev = sbi->sb->s_bdev;
+	struct hd_struct *part = bdev->bd_part;
 	struct request_queue *q = bdev_get_queue(bdev);
 	struct request_list *rl = &q->root_rl;
-	return !(rl->count[BLK_RW_SYNC]) && !(rl->count[BLK_RW_ASYNC]);
+	unsigned long ios;
+
+	ios = part_stat_read(part, ios[READ]) + part_stat_read(part, ios[WRITE]);
+	if (ios != gc_th->last_ios || part_in_flight(part) ||
+			rl->count[BLK_RW_SYNC] || rl->count[BLK_RW_ASYNC]) {
+		gc_th->last_ios = ios;
+		gc_th->busy_stamp = jiffies;
+		return 0;
+	}
+	return time_after_eq(jiffies, gc_th->busy_stamp +
+				msecs_to_jiffies(GC_THREAD_IDLE_WINDOW));
 }
@@ -0,0 +1,223 @@
+/*
+ * fs/f2fs/inline.c
+ *
+ * Copyright (c) 2013 Samsung Electronics Co., Ltd.
+ *             http://www.samsung.com/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/fs.h>
+#include <linux/f2fs_fs.h>
+
+#include "f2fs.h"
+#include "node.h"
+
+/*
+ * Fill the locked page with the inline data of the inode.
+ * The page is left locked.
+ */
+int f2fs_read_inline_data(struct inode *inode, struct page *page)
+{
+	struct f2fs_sb_info *sbi = F2FS_SB(inode->i_sb);
+	struct page *ipage;
+	void *src_addr, *dst_addr;
+
+	if (page->index) {
+		zero_user_segment(page, 0, PAGE_CACHE_SIZE);
+		goto out;
+	}
+
+	ipage = get_node_page(sbi, inode->i_ino);
+	if (IS_ERR(ipage))
+		return PTR_ERR(ipage);
+
+	zero_user_segment(page, MAX_INLINE_DATA, PAGE_CACHE_SIZE);
+
+	/* Copy the whole inline data block */
+	src_addr = inline_data_addr(ipage);
+	dst_addr = kmap(page);
+	memcpy(dst_addr, src_addr, MAX_INLINE_DATA);
+	kunmap(page);
+	f2fs_put_page(ipage, 1);
+out:
+	SetPageUptodate(page);
+	return 0;
+}
+
+/*
+ * Caller should grab and release a mutex by calling mutex_lock_op() and
+ * mutex_unlock_op().
+ */
+int f2fs_write_inline_data(struct inode *inode, struct page *page)
+{
+	struct f2fs_sb_info *sbi = F2FS_SB(inode->i_sb);
+	unsigned int size = min_t(loff_t, i_size_read(inode), MAX_INLINE_DATA);
+	struct page *ipage;
+	void *src_addr, *dst_addr;
+
+	ipage = get_node_page(sbi, inode->i_ino);
+	if (IS_ERR(ipage))
+		return PTR_ERR(ipage);
+
+	wait_on_page_writeback(ipage);
+
+	src_addr = kmap(page);
+	dst_addr = inline_data_addr(ipage);
+	memcpy(dst_addr, src_addr, size);
+	memset(dst_addr + size, 0, MAX_INLINE_DATA - size);
+	kunmap(page);
+
+	/* i_size goes to disk together with the data */
+	update_inode(inode, ipage);
+	f2fs_put_page(ipage, 1);
+	return 0;
+}
+
+/*
+ * Move the inline data to the first data block once the file grows beyond
+ * MAX_INLINE_DATA.  The block is written synchronously before the inline
+ * data is dropped, so that the data survives a sudden power-off.
+ *
+ * The caller must not hold the lock of the first page or the op lock.
+ */
+int f2fs_convert_inline_data(struct inode *inode, loff_t to_size)
+{
+	struct f2fs_sb_info *sbi = F2FS_SB(inode->i_sb);
+	struct dnode_of_data dn;
+	struct page *ipage, *page;
+	block_t new_blk_addr;
+	void *src_addr, *dst_addr;
+	int err, ilock;
+
+	if (!f2fs_has_inline_data(inode) || to_size <= MAX_INLINE_DATA)
+		return 0;
+
+	page = grab_cache_page(inode->i_mapping, 0);
+	if (!page)
+		return -ENOMEM;
+
+	ilock = mutex_lock_op(sbi);
+	ipage = get_node_page(sbi, inode->i_ino);
+	if (IS_ERR(ipage)) {
+		err = PTR_ERR(ipage);
+		goto out;
+	}
+
+	/* converted by someone else while we were waiting */
+	err = 0;
+	if (!f2fs_has_inline_data(inode))
+		goto out_ipage;
+
+	set_new_dnode(&dn, inode, ipage, ipage, inode->i_ino);
+	err = reserve_new_block(&dn);
+	if (err)
+		goto out_ipage;
+
+	/* an uptodate page is at least as new as the inline data */
+	if (!PageUptodate(page)) {
+		zero_user_segment(page, MAX_INLINE_DATA, PAGE_CACHE_SIZE);
+		src_addr = inline_data_addr(ipage);
+		dst_addr = kmap(page);
+		memcpy(dst_addr, src_addr, MAX_INLINE_DATA);
+		kunmap(page);
+		SetPageUptodate(page);
+	}
+
+	clear_page_dirty_for_io(page);
+	set_page_writeback(page);
+	write_data_page(inode, page, &dn, NEW_ADDR, &new_blk_addr);
+	update_extent_cache(new_blk_addr, &dn);
+	f2fs_submit_bio(sbi, DATA, true);
+	wait_on_page_writeback(page);
+
+	/* i_addr[0] keeps the new block address */
+	memset(inline_data_addr(ipage), 0, MAX_INLINE_DATA);
+	clear_inode_flag(F2FS_I(inode), FI_INLINE_DATA);
+	sync_inode_page(&dn);
+out_ipage:
+	f2fs_put_page(ipage, 1);
+out:
+	mutex_unlock_op(sbi, ilock);
+	f2fs_put_page(page, 1);
+	return err;
+}
+
+/*
+ * Caller should grab and release a mutex by calling mutex_lock_op() and
+ * mutex_unlock_op().
+ */
+void truncate_inline_data(struct inode *inode, u64 from)
+{
+	struct f2fs_sb_info *sbi = F2FS_SB(inode->i_sb);
+	struct page *ipage;
+
+	if (from >= MAX_INLINE_DATA)
+		return;
+
+	ipage = get_node_page(sbi, inode->i_ino);
+	if (IS_ERR(ipage))
+		return;
+
+	wait_on_page_writeback(ipage);
+	memset(inline_data_addr(ipage) + from, 0, MAX_INLINE_DATA - from);
+	set_page_dirty(ipage);
+	f2fs_put_page(ipage, 1);
+}
+
+/*
+ * Roll forward the inline data of a fsynced inode.
+ * Return true when the node page needs no further data recovery.
+ */
+bool recover_inline_data(struct inode *inode, struct page *npage)
+{
+	struct f2fs_sb_info *sbi = F2FS_SB(inode->i_sb);
+	struct f2fs_inode *ri = NULL;
+	void *src_addr, *dst_addr;
+	struct page *ipage;
+
+	/*
+	 * The inline_data recovery policy is as follows.
+	 * [prev.] [next] of inline_data flag
+	 *    o       o  -> recover inline_data
+	 *    o       x  -> remove inline_data, and then recover data blocks
+	 *    x       o  -> remove data blocks, and then recover inline_data
+	 *    x       x  -> recover data blocks
+	 */
+	if (IS_INODE(npage))
+		ri = &((struct f2fs_node *)page_address(npage))->i;
+
+	if (f2fs_has_inline_data(inode) &&
+			ri && (ri->i_inline & F2FS_INLINE_DATA)) {
+process_inline:
+		ipage = get_node_page(sbi, inode->i_ino);
+		BUG_ON(IS_ERR(ipage));
+
+		wait_on_page_writeback(ipage);
+
+		src_addr = inline_data_addr(npage);
+		dst_addr = inline_data_addr(ipage);
+		memcpy(dst_addr, src_addr, MAX_INLINE_DATA);
+		update_inode(inode, ipage);
+		f2fs_put_page(ipage, 1);
+		return true;
+	}
+
+	if (f2fs_has_inline_data(inode)) {
+		ipage = get_node_page(sbi, inode->i_ino);
+		BUG_ON(IS_ERR(ipage));
+
+		wait_on_page_writeback(ipage);
+
+		memset(inline_data_addr(ipage), 0, MAX_INLINE_DATA);
+		clear_inode_flag(F2FS_I(inode), FI_INLINE_DATA);
+		update_inode(inode, ipage);
+		f2fs_put_page(ipage, 1);
+	} else if (ri && (ri->i_inline & F2FS_INLINE_DATA)) {
+		truncate_blocks(inode, 0);
+		set_inode_flag(F2FS_I(inode), FI_INLINE_DATA);
+		goto process_inline;
+	}
+	return false;
+}
@@ -1018,8 +1018,12 @@ void sync_inode_page(struct dnode_of_data *dn)
 	}
 }
 
+/*
+ * An atomic commit writes the dnodes of ino without the fsync mark, and the
+ * inode page last with it, so that recovery skips a commit cut in the middle.
+ */
 int sync_node_pages(struct f2fs_sb_info *sbi, nid_t ino,
-					struct writeback_control *wbc)
+				struct writeback_control *wbc, bool atomic)
 {
 	struct address_space *mapping = sbi->node_inode->i_mapping;
 	pgoff_t index, end;
@@ -1081,11 +1085,15 @@ continue_unlock:
 				goto continue_unlock;
 			}
 
+			/* the inode page goes last with the fsync mark */
+			if (atomic && IS_INODE(page))
+				goto continue_unlock;
+
 			if (!clear_page_dirty_for_io(page))
 				goto continue_unlock;
 
 			/* called by fsync() */
-			if (ino && IS_DNODE(page)) {
+			if (ino && IS_DNODE(page) && !atomic) {
 				int mark = !is_checkpointed_node(sbi, ino);
 				set_fsync_mark(page, 1);
 				if (IS_INODE(page))
@@ -1115,6 +1123,21 @@ continue_unlock:
 		goto next_step;
 	}
 
+	if (atomic) {
+		struct page *page = get_node_page(sbi, ino);
+
+		if (!IS_ERR(page)) {
+			set_page_dirty(page);
+			clear_page_dirty_for_io(page);
+			set_fsync_mark(page, 1);
+			set_dentry_mark(page, !is_checkpointed_node(sbi, ino));
+			mapping->a_ops->writepage(page, wbc);
+			f2fs_put_page(page, 0);
+			nwritten++;
+			wrote++;
+		}
+	}
+
 	if (wrote)
 		f2fs_submit_bio(sbi, NODE, wbc->sync_mode == WB_SYNC_ALL);
 
@@ -1185,7 +1208,7 @@ static int f2fs_write_node_pages(struct address_space *mapping,
 
 	/* if mounting is failed, skip writing node pages */
 	wbc->nr_to_write = max_hw_blocks(sbi);
-	sync_node_pages(sbi, 0, wbc);
+	sync_node_pages(sbi, 0, wbc, false);
 	wbc->nr_to_write = nr_to_write - (max_hw_blocks(sbi) - wbc->nr_to_write);
 	return 0;
 }
@@ -1499,6 +1522,60 @@ int recover_inode_page(struct f2fs_sb_info *sbi, struct page *page)
 	return 0;
 }
 
+/*
+ * Point the xattr nid of the inode to the fsynced xattr node block at
+ * blkaddr.  If setxattr allocated a new xattr node, the checkpointed one
+ * is freed.
+ */
+int recover_xattr_data(struct inode *inode, struct page *page,
+						block_t blkaddr)
+{
+	struct f2fs_sb_info *sbi = F2FS_SB(inode->i_sb);
+	struct address_space *mapping = sbi->node_inode->i_mapping;
+	nid_t prev_xnid = F2FS_I(inode)->i_xattr_nid;
+	nid_t new_xnid = nid_of_node(page);
+	struct f2fs_summary sum;
+	struct node_info ni;
+	struct page *xpage;
+
+	xpage = grab_cache_page(mapping, new_xnid);
+	if (!xpage)
+		return -ENOMEM;
+
+	if (prev_xnid != new_xnid) {
+		if (prev_xnid) {
+			get_node_info(sbi, prev_xnid, &ni);
+			BUG_ON(ni.blk_addr == NULL_ADDR);
+			invalidate_blocks(sbi, ni.blk_addr);
+			dec_valid_node_count(sbi, inode, 1);
+			set_node_addr(sbi, &ni, NULL_ADDR);
+		}
+
+		/* Should not use this nid from free nid list */
+		remove_free_nid(NM_I(sbi), new_xnid);
+
+		get_node_info(sbi, new_xnid, &ni);
+		ni.ino = inode->i_ino;
+		if (!inc_valid_node_count(sbi, inode, 1))
+			BUG();
+		set_node_addr(sbi, &ni, NEW_ADDR);
+		ni.blk_addr = NEW_ADDR;
+
+		F2FS_I(inode)->i_xattr_nid = new_xnid;
+		update_inode_page(inode);
+	} else {
+		get_node_info(sbi, new_xnid, &ni);
+	}
+
+	memcpy(page_address(xpage), page_address(page), PAGE_CACHE_SIZE);
+	SetPageUptodate(xpage);
+
+	set_summary(&sum, new_xnid, 0, 0);
+	recover_node_page(sbi, xpage, &sum, &ni, blkaddr);
+	f2fs_put_page(xpage, 1);
+	return 0;
+}
+
 int restore_node_summary(struct f2fs_sb_info *sbi,
 			unsigned int segno, struct f2fs_summary_block *sum)
 {
@@ -233,10 +233,21 @@ static inline block_t next_blkaddr_of_node(struct page *node_page)
  *    `- double indirect node (5 + 2N)
  *                 `- indirect node (6 + 2N)
  *                       `- direct node (x(N + 1))
+ *
+ * The xattr node of a file is written with its direct nodes by fsync, and
+ * it is recovered together with them.
  */
+static inline bool IS_XATTR_NODE(struct page *node_page)
+{
+	unsigned int ofs = ofs_of_node(node_page);
+	return ofs == ((unsigned int)XATTR_NODE_OFFSET >> OFFSET_BIT_SHIFT);
+}
+
 static inline bool IS_DNODE(struct page *node_page)
 {
 	unsigned int ofs = ofs_of_node(node_page);
+	if (IS_XATTR_NODE(node_page))
+		return true;
 	if (ofs == 3 || ofs == 4 + NIDS_PER_BLOCK ||
 			ofs == 5 + 2 * NIDS_PER_BLOCK)
 		return false;
@@ -295,6 +306,11 @@ static inline void set_cp_file(struct inode *inode)
 	F2FS_I(inode)->i_advise |= FADVISE_CP_BIT;
 }
 
+static inline void clear_cp_file(struct inode *inode)
+{
+	F2FS_I(inode)->i_advise &= ~FADVISE_CP_BIT;
+}
+
 static inline int is_cold_data(struct page *page)
 {
 	return PageChecked(page);
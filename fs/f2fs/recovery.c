@@ -248,6 +248,16 @@ static int do_recover_data(struct f2fs_sb_info *sbi, struct inode *inode,
 	int err = 0;
 	int ilock;
 
+	if (IS_XATTR_NODE(page)) {
+		ilock = mutex_lock_op(sbi);
+		err = recover_xattr_data(inode, page, blkaddr);
+		mutex_unlock_op(sbi, ilock);
+		return err;
+	}
+
+	if (recover_inline_data(inode, page))
+		return 0;
+
 	start = start_bidx_of_node(ofs_of_node(page));
 	if (IS_INODE(page))
 		end = start + ADDRS_PER_INODE;
@@ -20,6 +20,8 @@
 #include "node.h"
 #include <trace/events/f2fs.h>
 
+static struct kmem_cache *inmem_entry_slab;
+
 /*
  * This function balances dirty node and dentry pages.
  * In addition, it controls garbage collection.
@@ -31,9 +33,112 @@ void f2fs_balance_fs(struct f2fs_sb_info *sbi)
 	 * dir/node pages without enough free segments.
 	 */
 	if (has_not_enough_free_secs(sbi, 0)) {
+		unsigned long start = jiffies;
+
 		mutex_lock(&sbi->gc_mutex);
 		f2fs_gc(sbi);
+
+		/*
+		 * writers were stalled by the foreground GC; f2fs_gc() has
+		 * dropped gc_mutex, so count under stat_lock
+		 */
+		spin_lock(&sbi->stat_lock);
+		sbi->fg_gc_stall++;
+		sbi->fg_gc_stall_time += jiffies - start;
+		spin_unlock(&sbi->stat_lock);
+	}
+}
+
+/*
+ * While an atomic write is in progress, a data page is not set dirty when it
+ * is written, but kept with a reference in the inode's list until the write
+ * is committed or aborted.  The page cannot be reclaimed meanwhile.
+ */
+void register_inmem_page(struct inode *inode, struct page *page)
+{
+	struct f2fs_inode_info *fi = F2FS_I(inode);
+	struct inmem_pages *new;
+
+	if (IS_ATOMIC_WRITTEN_PAGE(page))
+		return;
+retry:
+	new = kmem_cache_alloc(inmem_entry_slab, GFP_NOFS);
+	if (!new) {
+		cond_resched();
+		goto retry;
+	}
+	new->page = page;
+
+	mutex_lock(&fi->inmem_lock);
+	if (IS_ATOMIC_WRITTEN_PAGE(page)) {
+		mutex_unlock(&fi->inmem_lock);
+		kmem_cache_free(inmem_entry_slab, new);
+		return;
+	}
+	get_page(page);
+	set_page_private(page, (unsigned long)ATOMIC_WRITTEN_PAGE);
+	SetPagePrivate(page);
+	list_add_tail(&new->list, &fi->inmem_pages);
+	mutex_unlock(&fi->inmem_lock);
+}
+
+/*
+ * Write the pages of an atomic write, or drop them if abort is set, in which
+ * case they are read again from the disk.  The caller clears FI_ATOMIC_FILE
+ * first, and makes the data durable with f2fs_sync_file() after a commit.
+ */
+int commit_inmem_pages(struct inode *inode, bool abort)
+{
+	struct f2fs_sb_info *sbi = F2FS_SB(inode->i_sb);
+	struct f2fs_inode_info *fi = F2FS_I(inode);
+	struct inmem_pages *cur, *tmp;
+	bool submit = false;
+	int ilock = 0;
+	int err = 0, ret;
+
+	if (!abort) {
+		f2fs_balance_fs(sbi);
+		ilock = mutex_lock_op(sbi);
+	}
+
+	mutex_lock(&fi->inmem_lock);
+	list_for_each_entry_safe(cur, tmp, &fi->inmem_pages, list) {
+		struct page *page = cur->page;
+
+		lock_page(page);
+		set_page_private(page, 0);
+		ClearPagePrivate(page);
+
+		/* skip the pages truncated meanwhile */
+		if (page->mapping == inode->i_mapping) {
+			if (abort) {
+				ClearPageUptodate(page);
+			} else {
+				wait_on_page_writeback(page);
+				ret = do_write_data_page(page);
+				if (ret) {
+					/* leave it to the writeback */
+					set_page_dirty(page);
+					if (!err)
+						err = ret;
+				} else {
+					submit = true;
+				}
+			}
+		}
+		f2fs_put_page(page, 1);
+
+		list_del(&cur->list);
+		kmem_cache_free(inmem_entry_slab, cur);
 	}
+	mutex_unlock(&fi->inmem_lock);
+
+	if (!abort) {
+		mutex_unlock_op(sbi, ilock);
+		if (submit)
+			f2fs_submit_bio(sbi, DATA, true);
+	}
+	return err;
 }
 
 static void __locate_dirty_segment(struct f2fs_sb_info *sbi, unsigned int segno,
@@ -1797,3 +1902,17 @@ void destroy_segment_manager(struct f2fs_sb_info *sbi)
 	sbi->sm_info = NULL;
 	kfree(sm_info);
 }
+
+int __init create_segment_manager_caches(void)
+{
+	inmem_entry_slab = f2fs_kmem_cache_create("f2fs_inmem_page_entry",
+			sizeof(struct inmem_pages), NULL);
+	if (!inmem_entry_slab)
+		return -ENOMEM;
+	return 0;
+}
+
+void destroy_segment_manager_caches(void)
+{
+	kmem_cache_destroy(inmem_entry_slab);
+}
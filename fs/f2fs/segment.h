@@ -98,6 +98,12 @@ struct bio_private {
 	void *wait;
 };
 
+/* for the data pages held back by an atomic write */
+struct inmem_pages {
+	struct list_head list;
+	struct page *page;
+};
+
 /*
  * indicate a block allocation direction: RIGHT and LEFT.
  * RIGHT means allocating new sections towards the end of volume.
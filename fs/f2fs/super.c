@@ -42,6 +42,9 @@ enum {
 	Opt_noacl,
 	Opt_active_logs,
 	Opt_disable_ext_identify,
+	Opt_inline_data,
+	Opt_inline_dentry,
+	Opt_extent_cache,
 	Opt_err,
 };
 
@@ -54,6 +57,9 @@ static match_table_t f2fs_tokens = {
 	{Opt_noacl, "noacl"},
 	{Opt_active_logs, "active_logs=%u"},
 	{Opt_disable_ext_identify, "disable_ext_identify"},
+	{Opt_inline_data, "inline_data"},
+	{Opt_inline_dentry, "inline_dentry"},
+	{Opt_extent_cache, "extent_cache"},
 	{Opt_err, NULL},
 };
 
@@ -92,6 +98,14 @@ static struct inode *f2fs_alloc_inode(struct super_block *sb)
 	fi->i_current_depth = 1;
 	fi->i_advise = 0;
 	rwlock_init(&fi->ext.ext_lock);
+	fi->ext_tree = RB_ROOT;
+	rwlock_init(&fi->ext_tree_lock);
+	fi->ext_tree_cnt = 0;
+	INIT_LIST_HEAD(&fi->ext_lru);
+	fi->ext_lru_time = jiffies;
+	INIT_LIST_HEAD(&fi->inmem_pages);
+	mutex_init(&fi->inmem_lock);
+	fi->i_atomic_file = NULL;
 
 	set_inode_flag(fi, FI_NEW_INODE);
 
@@ -136,6 +150,7 @@ static void f2fs_put_super(struct super_block *sb)
 	iput(sbi->meta_inode);
 
 	/* destroy f2fs internal modules */
+	f2fs_destroy_extent_cache(sbi);
 	destroy_node_manager(sbi);
 	destroy_segment_manager(sbi);
 
@@ -238,6 +253,12 @@ static int f2fs_show_options(struct seq_file *seq, struct dentry *root)
 #endif
 	if (test_opt(sbi, DISABLE_EXT_IDENTIFY))
 		seq_puts(seq, ",disable_ext_identify");
+	if (test_opt(sbi, INLINE_DATA))
+		seq_puts(seq, ",inline_data");
+	if (test_opt(sbi, INLINE_DENTRY))
+		seq_puts(seq, ",inline_dentry");
+	if (test_opt(sbi, EXTENT_CACHE))
+		seq_puts(seq, ",extent_cache");
 
 	seq_printf(seq, ",active_logs=%u", sbi->active_logs);
 
@@ -366,6 +387,15 @@ static int parse_options(struct super_block *sb, struct f2fs_sb_info *sbi,
 		case Opt_disable_ext_identify:
 			set_opt(sbi, DISABLE_EXT_IDENTIFY);
 			break;
+		case Opt_inline_data:
+			set_opt(sbi, INLINE_DATA);
+			break;
+		case Opt_inline_dentry:
+			set_opt(sbi, INLINE_DENTRY);
+			break;
+		case Opt_extent_cache:
+			set_opt(sbi, EXTENT_CACHE);
+			break;
 		default:
 			f2fs_msg(sb, KERN_ERR,
 				"Unrecognized mount option \"%s\" or missing value",
@@ -636,13 +666,14 @@ static int f2fs_fill_super(struct super_block *sb, void *data, int silent)
 	}
 
 	build_gc_manager(sbi);
+	f2fs_init_extent_cache(sbi);
 
 	/* get an inode for node space */
 	sbi->node_inode = f2fs_iget(sb, F2FS_NODE_INO(sbi));
 	if (IS_ERR(sbi->node_inode)) {
 		f2fs_msg(sb, KERN_ERR, "Failed to read node inode");
 		err = PTR_ERR(sbi->node_inode);
-		goto free_nm;
+		goto free_extent_cache;
 	}
 
 	/* if there are nt orphan nodes free them */
@@ -699,6 +730,8 @@ free_root_inode:
 	sb->s_root = NULL;
 free_node_inode:
 	iput(sbi->node_inode);
+free_extent_cache:
+	f2fs_destroy_extent_cache(sbi);
 free_nm:
 	destroy_node_manager(sbi);
 free_sm:
@@ -757,9 +790,15 @@ static int __init init_f2fs_fs(void)
 	if (err)
 		goto fail;
 	err = create_node_manager_caches();
+	if (err)
+		goto fail;
+	err = create_segment_manager_caches();
 	if (err)
 		goto fail;
 	err = create_gc_caches();
+	if (err)
+		goto fail;
+	err = create_extent_cache();
 	if (err)
 		goto fail;
 	err = create_checkpoint_caches();
@@ -778,7 +817,9 @@ static void __exit exit_f2fs_fs(void)
 	f2fs_destroy_root_stats();
 	unregister_filesystem(&f2fs_fs_type);
 	destroy_checkpoint_caches();
+	destroy_extent_cache();
 	destroy_gc_caches();
+	destroy_segment_manager_caches();
 	destroy_node_manager_caches();
 	destroy_inodecache();
 }
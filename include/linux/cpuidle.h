@@ -207,6 +207,23 @@ static inline void cpuidle_unregister_governor(struct cpuidle_governor *gov) { }
 
 #endif
 
+struct cpuidle_hist_stats {
+	unsigned int	timer_wakeups;
+	unsigned int	irq_wakeups;
+	unsigned int	too_deep;
+	unsigned int	too_shallow;
+};
+
+#ifdef CONFIG_CPU_IDLE_GOV_HISTOGRAM
+extern void cpuidle_hist_get_stats(int cpu, struct cpuidle_hist_stats *stats);
+extern void cpuidle_hist_reset_stats(void);
+#else
+static inline void cpuidle_hist_get_stats(int cpu,
+		struct cpuidle_hist_stats *stats)
+{ memset(stats, 0, sizeof(*stats)); }
+static inline void cpuidle_hist_reset_stats(void) { }
+#endif
+
 #ifdef CONFIG_ARCH_HAS_CPU_RELAX
 #define CPUIDLE_DRIVER_STATE_START	1
 #else
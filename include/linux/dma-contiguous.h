@@ -67,7 +67,9 @@ struct cma_info {
 #ifdef CONFIG_CMA
 
 /* Not to allow CMA migration */
+#ifdef CONFIG_CMA_NO_MIGRATION
 #define CMA_NO_MIGRATION
+#endif
 
 /*
  * There is always at least global CMA area and a few optional device
@@ -86,6 +88,8 @@ struct page *dma_alloc_from_contiguous(struct device *dev, int count,
 bool dma_release_from_contiguous(struct device *dev, struct page *pages,
 				 int count);
 
+int dma_contiguous_prepare(struct device *dev, int count, unsigned int align);
+
 int dma_contiguous_info(struct device *dev, struct cma_info *info);
 
 #ifndef CMA_NO_MIGRATION
@@ -127,6 +131,12 @@ bool dma_release_from_contiguous(struct device *dev, struct page *pages,
 	return false;
 }
 
+static inline
+int dma_contiguous_prepare(struct device *dev, int count, unsigned int align)
+{
+	return -ENOSYS;
+}
+
 static inline
 int dma_contiguous_info(struct device *dev, struct cma_info *info)
 {
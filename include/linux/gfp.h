@@ -404,9 +404,18 @@ static inline bool pm_suspended_storage(void)
 
 #ifdef CONFIG_CMA
 
+/* Time spent in the phases of alloc_contig_range(), in microseconds */
+struct contig_range_stats {
+	s64 isolate_us;		/* isolating the range, taking free pages */
+	s64 migrate_us;		/* migrating used pages out of the range */
+};
+
 /* The below functions must be run on a range from a single zone. */
 extern int alloc_contig_range(unsigned long start, unsigned long end,
 			      unsigned migratetype);
+extern int alloc_contig_range_stats(unsigned long start, unsigned long end,
+				    unsigned migratetype,
+				    struct contig_range_stats *stats);
 extern void free_contig_range(unsigned long pfn, unsigned nr_pages);
 
 /* CMA stuff */
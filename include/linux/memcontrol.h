@@ -191,6 +191,11 @@ static inline void mem_cgroup_count_vm_event(struct mm_struct *mm,
 		return;
 	__mem_cgroup_count_vm_event(mm, idx);
 }
+
+void mem_cgroup_count_refault(struct page *page);
+bool mem_cgroup_low(struct mem_cgroup *root, struct mem_cgroup *memcg);
+void mem_cgroup_low_breached(struct mem_cgroup *memcg);
+int mem_cgroup_reclaim_priority(struct mem_cgroup *memcg);
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
 void mem_cgroup_split_huge_fixup(struct page *head);
 #endif
@@ -373,6 +378,25 @@ static inline
 void mem_cgroup_count_vm_event(struct mm_struct *mm, enum vm_event_item idx)
 {
 }
+
+static inline void mem_cgroup_count_refault(struct page *page)
+{
+}
+
+static inline bool mem_cgroup_low(struct mem_cgroup *root,
+				  struct mem_cgroup *memcg)
+{
+	return false;
+}
+
+static inline void mem_cgroup_low_breached(struct mem_cgroup *memcg)
+{
+}
+
+static inline int mem_cgroup_reclaim_priority(struct mem_cgroup *memcg)
+{
+	return 0;
+}
 static inline void mem_cgroup_replace_page_cache(struct page *oldpage,
 				struct page *newpage)
 {
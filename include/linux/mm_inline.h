@@ -21,10 +21,214 @@ static inline int page_is_file_cache(struct page *page)
 	return !PageSwapBacked(page);
 }
 
+static __always_inline void update_lru_size(struct lruvec *lruvec,
+				enum lru_list lru, int nr_pages)
+{
+	mem_cgroup_update_lru_size(lruvec, lru, nr_pages);
+	__mod_zone_page_state(lruvec_zone(lruvec), NR_LRU_BASE + lru, nr_pages);
+}
+
+#ifdef CONFIG_LRU_GEN
+
+static inline int lru_gen_from_seq(unsigned long seq)
+{
+	return seq % MAX_NR_GENS;
+}
+
+/* the generation @page is on, or -1 if it is not on a generation list */
+static inline int page_lru_gen(struct page *page)
+{
+	return (int)((page->flags >> LRU_GEN_PGSHIFT) & LRU_GEN_MASK) - 1;
+}
+
+static inline void page_set_lru_gen(struct page *page, int gen)
+{
+	unsigned long old_flags, flags;
+
+	do {
+		old_flags = flags = page->flags;
+
+		flags &= ~(LRU_GEN_MASK << LRU_GEN_PGSHIFT);
+		flags |= (unsigned long)(gen + 1) << LRU_GEN_PGSHIFT;
+	} while (unlikely(cmpxchg(&page->flags, old_flags, flags) !=
+			  old_flags));
+}
+
+static inline bool lru_gen_is_active(struct lruvec *lruvec, int gen)
+{
+	unsigned long max_seq = lruvec->lrugen.max_seq;
+
+	return gen == lru_gen_from_seq(max_seq) ||
+	       gen == lru_gen_from_seq(max_seq - 1);
+}
+
+/*
+ * Move the accounting of @page from generation @old_gen to @new_gen,
+ * either of which may be -1.  The zone and memcg LRU counters see the
+ * two youngest generations as active and the rest as inactive.
+ */
+static __always_inline void lru_gen_update_size(struct lruvec *lruvec,
+				struct page *page, int old_gen, int new_gen)
+{
+	int type = page_is_file_cache(page);
+	enum lru_list lru = type ? LRU_INACTIVE_FILE : LRU_INACTIVE_ANON;
+	int nr_pages = hpage_nr_pages(page);
+	struct lru_gen *lrugen = &lruvec->lrugen;
+
+	if (old_gen >= 0) {
+		lrugen->nr_pages[old_gen][type] -= nr_pages;
+		update_lru_size(lruvec, lru_gen_is_active(lruvec, old_gen) ?
+				lru + LRU_ACTIVE : lru, -nr_pages);
+	}
+	if (new_gen >= 0) {
+		lrugen->nr_pages[new_gen][type] += nr_pages;
+		update_lru_size(lruvec, lru_gen_is_active(lruvec, new_gen) ?
+				lru + LRU_ACTIVE : lru, nr_pages);
+	}
+}
+
+static __always_inline void lru_gen_move_page(struct lruvec *lruvec,
+				struct page *page, int gen, bool tail)
+{
+	struct list_head *head;
+
+	lru_gen_update_size(lruvec, page, page_lru_gen(page), gen);
+	page_set_lru_gen(page, gen);
+
+	head = &lruvec->lrugen.lists[gen][page_is_file_cache(page)];
+	if (tail)
+		list_move_tail(&page->lru, head);
+	else
+		list_move(&page->lru, head);
+}
+
+/*
+ * Pages that were found active go to the youngest generation.  Fresh anon
+ * pages, and pages put back by reclaim while still dirty or under
+ * writeback, get one generation of grace; everything else starts out in
+ * the oldest generation.  PG_active is not kept on generation lists.
+ */
+static __always_inline bool lru_gen_add_page(struct lruvec *lruvec,
+				struct page *page, enum lru_list lru)
+{
+	struct lru_gen *lrugen = &lruvec->lrugen;
+	int type = page_is_file_cache(page);
+	unsigned long seq;
+	int gen;
+
+	if (lru == LRU_UNEVICTABLE)
+		return false;
+
+	if (PageActive(page))
+		seq = lrugen->max_seq;
+	else if ((!type && !PageSwapCache(page)) ||
+		 (PageReclaim(page) &&
+		  (PageDirty(page) || PageWriteback(page))))
+		seq = lrugen->min_seq[type] + 1;
+	else
+		seq = lrugen->min_seq[type];
+
+	gen = lru_gen_from_seq(seq);
+	if (PageActive(page))
+		ClearPageActive(page);
+	page_set_lru_gen(page, gen);
+	lru_gen_update_size(lruvec, page, -1, gen);
+	list_add(&page->lru, &lrugen->lists[gen][type]);
+
+	return true;
+}
+
+static __always_inline bool lru_gen_del_page(struct lruvec *lruvec,
+				struct page *page)
+{
+	int gen = page_lru_gen(page);
+
+	if (gen < 0)
+		return false;
+
+	lru_gen_update_size(lruvec, page, gen, -1);
+	page_set_lru_gen(page, -1);
+	list_del(&page->lru);
+
+	return true;
+}
+
+/* move @page to the tail of the oldest generation of its type */
+static __always_inline bool lru_gen_rotate_page(struct lruvec *lruvec,
+				struct page *page)
+{
+	int type = page_is_file_cache(page);
+
+	if (page_lru_gen(page) < 0)
+		return false;
+
+	lru_gen_move_page(lruvec, page,
+			  lru_gen_from_seq(lruvec->lrugen.min_seq[type]), true);
+	return true;
+}
+
+/* a tail page split off a huge page inherits its generation */
+static inline void lru_gen_add_page_tail(struct page *page,
+					 struct page *page_tail)
+{
+	int gen = page_lru_gen(page);
+
+	if (gen >= 0)
+		page_set_lru_gen(page_tail, gen);
+}
+
+/*
+ * The generation of @page, as seen by a caller that takes it off the LRU
+ * and will put it back: the youngest two are reported as PG_active.
+ */
+static inline bool lru_gen_page_active(struct lruvec *lruvec,
+				       struct page *page)
+{
+	int gen = page_lru_gen(page);
+
+	return gen >= 0 && lru_gen_is_active(lruvec, gen);
+}
+
+#else /* !CONFIG_LRU_GEN */
+
+static inline bool lru_gen_add_page(struct lruvec *lruvec,
+				    struct page *page, enum lru_list lru)
+{
+	return false;
+}
+
+static inline bool lru_gen_del_page(struct lruvec *lruvec, struct page *page)
+{
+	return false;
+}
+
+static inline bool lru_gen_rotate_page(struct lruvec *lruvec,
+				       struct page *page)
+{
+	return false;
+}
+
+static inline void lru_gen_add_page_tail(struct page *page,
+					 struct page *page_tail)
+{
+}
+
+static inline bool lru_gen_page_active(struct lruvec *lruvec,
+				       struct page *page)
+{
+	return false;
+}
+
+#endif /* CONFIG_LRU_GEN */
+
 static __always_inline void add_page_to_lru_list(struct page *page,
 				struct lruvec *lruvec, enum lru_list lru)
 {
 	int nr_pages = hpage_nr_pages(page);
+
+	if (lru_gen_add_page(lruvec, page, lru))
+		return;
+
 	mem_cgroup_update_lru_size(lruvec, lru, nr_pages);
 	list_add(&page->lru, &lruvec->lists[lru]);
 	__mod_zone_page_state(lruvec_zone(lruvec), NR_LRU_BASE + lru, nr_pages);
@@ -34,11 +238,27 @@ static __always_inline void del_page_from_lru_list(struct page *page,
 				struct lruvec *lruvec, enum lru_list lru)
 {
 	int nr_pages = hpage_nr_pages(page);
+
+	if (lru_gen_del_page(lruvec, page))
+		return;
+
 	mem_cgroup_update_lru_size(lruvec, lru, -nr_pages);
 	list_del(&page->lru);
 	__mod_zone_page_state(lruvec_zone(lruvec), NR_LRU_BASE + lru, -nr_pages);
 }
 
+/*
+ * Take @page off its LRU list for a caller that puts it back later, such as
+ * migration: the age of its generation is carried over as PG_active.
+ */
+static __always_inline void isolate_page_from_lru_list(struct page *page,
+				struct lruvec *lruvec, enum lru_list lru)
+{
+	if (lru_gen_page_active(lruvec, page))
+		SetPageActive(page);
+	del_page_from_lru_list(page, lruvec, lru);
+}
+
 /**
  * page_lru_base_type - which LRU list type should a page be on?
  * @page: the page to test
@@ -294,6 +294,12 @@ struct vm_area_struct {
 #ifdef CONFIG_NUMA
 	struct mempolicy *vm_policy;	/* NUMA policy for the VMA */
 #endif
+#ifdef CONFIG_SWAP
+	atomic_long_t swap_readahead_info;	/* See mm/swap_state.c */
+#endif
+#ifdef CONFIG_KSM
+	unsigned char ksm_backoff;	/* See mm/ksm.c */
+#endif
 };
 
 struct core_thread {
@@ -143,6 +143,16 @@ struct mmc_host_ops {
 	int	(*select_drive_strength)(unsigned int max_dtr, int host_drv, int card_drv);
 	void	(*hw_reset)(struct mmc_host *host);
 	void	(*card_event)(struct mmc_host *host);
+
+	/*
+	 * Optional, for controllers with a command queue engine.  When the
+	 * card is in command queue mode, each task is handed over here
+	 * instead of being sequenced by the core with CMD44 to CMD47.
+	 * mrq carries CMD44 in sbc and CMD45 in cmd; mrq->areq->mrq is the
+	 * data request, with the task tag in bits 20:16 of its cmd->arg.
+	 * The host reports each finished task with mmc_cmdq_task_done().
+	 */
+	int	(*cmdq_request)(struct mmc_host *host, struct mmc_request *mrq);
 };
 
 struct mmc_card;
@@ -475,6 +485,7 @@ int mmc_power_restore_host(struct mmc_host *host);
 void mmc_detect_change(struct mmc_host *, unsigned long delay);
 void mmc_request_done(struct mmc_host *, struct mmc_request *);
 void mmc_handle_queued_request(struct mmc_host *host);
+void mmc_cmdq_task_done(struct mmc_host *host, struct mmc_request *mrq);
 int mmc_blk_end_queued_req(struct mmc_host *host,
 		struct mmc_async_req *areq, int index, int status);
 
@@ -141,6 +141,8 @@ enum zone_stat_item {
 	NUMA_LOCAL,		/* allocation from local node */
 	NUMA_OTHER,		/* allocation from other node */
 #endif
+	WORKINGSET_REFAULT,
+	WORKINGSET_ACTIVATE,
 	NR_ANON_TRANSPARENT_HUGEPAGES,
 	NR_FREE_CMA_PAGES,
 	NR_VM_ZONE_STAT_ITEMS };
@@ -199,9 +201,39 @@ struct zone_reclaim_stat {
 	unsigned long		recent_scanned[2];
 };
 
+#ifdef CONFIG_LRU_GEN
+/*
+ * The multi-generational LRU sorts evictable pages by age instead of by
+ * active/inactive.  A generation is identified by a sequence number:
+ * max_seq is the youngest generation and min_seq[] the oldest one still
+ * holding pages of each type, anon (0) or file (1).  Sequence numbers
+ * only grow; the lists are indexed by seq % MAX_NR_GENS.
+ *
+ * Between MIN_NR_GENS and MAX_NR_GENS generations are in use per type.
+ * The two youngest are accounted as active in the zone and memcg LRU
+ * counters, the others as inactive.
+ */
+#define MIN_NR_GENS		2
+#define MAX_NR_GENS		4
+
+#if MAX_NR_GENS + 1 > (1 << LRU_GEN_WIDTH)
+#error "LRU_GEN_WIDTH is too small for MAX_NR_GENS"
+#endif
+
+struct lru_gen {
+	unsigned long max_seq;
+	unsigned long min_seq[2];
+	struct list_head lists[MAX_NR_GENS][2];
+	unsigned long nr_pages[MAX_NR_GENS][2];
+};
+#endif
+
 struct lruvec {
 	struct list_head lists[NR_LRU_LISTS];
 	struct zone_reclaim_stat reclaim_stat;
+#ifdef CONFIG_LRU_GEN
+	struct lru_gen lrugen;
+#endif
 #ifdef CONFIG_MEMCG
 	struct zone *zone;
 #endif
@@ -235,6 +267,12 @@ enum zone_watermarks {
 #define low_wmark_pages(z) (z->watermark[WMARK_LOW])
 #define high_wmark_pages(z) (z->watermark[WMARK_HIGH])
 
+/*
+ * Orders 1 to PAGE_ALLOC_COSTLY_ORDER are also cached per cpu, on lists of
+ * their own so that the order-0 fast path is left alone.
+ */
+#define NR_PCP_HIGH_ORDERS	PAGE_ALLOC_COSTLY_ORDER
+
 struct per_cpu_pages {
 	int count;		/* number of pages in the list */
 	int high;		/* high watermark, emptying needed */
@@ -242,6 +280,11 @@ struct per_cpu_pages {
 
 	/* Lists of pages, one per migrate type stored on the pcp-lists */
 	struct list_head lists[MIGRATE_PCPTYPES];
+
+	/* base pages held on the high order lists */
+	int high_order_count;
+	/* high_lists[order - 1][migratetype] */
+	struct list_head high_lists[NR_PCP_HIGH_ORDERS][MIGRATE_PCPTYPES];
 };
 
 struct per_cpu_pageset {
@@ -398,6 +441,9 @@ struct zone {
 	/* Zone statistics */
 	atomic_long_t		vm_stat[NR_VM_ZONE_STAT_ITEMS];
 
+	/* Evictions & activations on the inactive file list */
+	atomic_long_t		inactive_age;
+
 	/*
 	 * The target ratio of ACTIVE_ANON to INACTIVE_ANON pages on
 	 * this zone's LRU.  Maintained by the pageout code.
@@ -731,6 +777,11 @@ typedef struct pglist_data {
 	struct task_struct *kswapd;	/* Protected by lock_memory_hotplug() */
 	int kswapd_max_order;
 	enum zone_type classzone_idx;
+#ifdef CONFIG_COMPACTION
+	wait_queue_head_t kcompactd_wait;
+	struct task_struct *kcompactd;
+	int kcompactd_max_order;
+#endif
 #ifdef CONFIG_NUMA_BALANCING
 	/*
 	 * Lock serializing the per destination node AutoNUMA memory
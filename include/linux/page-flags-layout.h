@@ -73,6 +73,21 @@
 #define LAST_NID_WIDTH 0
 #endif
 
+/*
+ * With the multi-generational LRU, page->flags also hold the generation
+ * a page is on, plus one so that zero means "not on a generation list".
+ * Three bits cover MAX_NR_GENS (see mmzone.h).
+ */
+#ifdef CONFIG_LRU_GEN
+#define LRU_GEN_WIDTH		3
+#else
+#define LRU_GEN_WIDTH		0
+#endif
+
+#if SECTIONS_WIDTH+ZONES_WIDTH+NODES_WIDTH+LAST_NID_WIDTH+LRU_GEN_WIDTH > BITS_PER_LONG - NR_PAGEFLAGS
+#error "No space for the LRU generation in page flags"
+#endif
+
 /*
  * We are going to use the flags for the page to node mapping if its in
  * there.  This includes the case where there is no node, so it is implicit.
@@ -43,11 +43,24 @@ enum stat_item {
 	CPU_PARTIAL_DRAIN,	/* Drain cpu partial to node partial */
 	NR_SLUB_STAT_ITEMS };
 
+/*
+ * Fast and slow path counters that can be switched on per cache at runtime
+ * through the path_stats sysfs file, without building in SLUB_STATS.
+ */
+enum lstat_item {
+	LSTAT_ALLOC_FASTPATH,
+	LSTAT_ALLOC_SLOWPATH,
+	LSTAT_FREE_FASTPATH,
+	LSTAT_FREE_SLOWPATH,
+	NR_SLUB_LSTAT_ITEMS };
+
 struct kmem_cache_cpu {
 	void **freelist;	/* Pointer to next available object */
 	unsigned long tid;	/* Globally unique transaction id */
 	struct page *page;	/* The slab from which we are allocating */
 	struct page *partial;	/* Partially allocated frozen slabs */
+	unsigned partial_misses;	/* Cpu partial list empty or full */
+	unsigned lstat[NR_SLUB_LSTAT_ITEMS];
 #ifdef CONFIG_SLUB_STATS
 	unsigned stat[NR_SLUB_STAT_ITEMS];
 #endif
@@ -74,6 +87,10 @@ struct kmem_cache {
 	int object_size;	/* The size of an object without meta data */
 	int offset;		/* Free pointer offset. */
 	int cpu_partial;	/* Number of per cpu partial objects to keep around */
+	int cpu_partial_base;	/* cpu_partial as configured, before auto tuning */
+	bool cpu_partial_auto;	/* Grow cpu_partial when it runs out often */
+	bool lstat_enabled;	/* Count fast and slow paths in lstat */
+	unsigned long partial_misses;	/* Sum of partial_misses at last tuning */
 	struct kmem_cache_order_objects oo;
 
 	/* Allocation and freeing of slabs */
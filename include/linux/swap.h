@@ -159,6 +159,27 @@ enum {
 #define SWAP_CLUSTER_MAX 32UL
 #define COMPACT_CLUSTER_MAX SWAP_CLUSTER_MAX
 
+/*
+ * Swap slots allocated ahead for the anonymous pages of one reclaim
+ * batch, handed out in order by add_to_swap().
+ */
+struct swap_slot_batch {
+	int want;		/* pages that may still need a slot */
+	int nr;
+	int cur;
+	swp_entry_t entries[SWAP_CLUSTER_MAX];
+};
+
+/*
+ * Swap-out of one reclaim batch: pages going to consecutive slots of a
+ * block device are collected into a single bio, submitted when the run
+ * breaks or by swap_write_batch_flush().
+ */
+struct swap_write_batch {
+	struct bio *bio;
+	int rw;
+};
+
 /*
  * Ratio between the present memory in the zone and the "gap" that
  * we're allowing kswapd to shrink in addition to the per-zone high
@@ -232,6 +253,11 @@ extern unsigned long nr_free_pagecache_pages(void);
 #define nr_free_pages() global_page_state(NR_FREE_PAGES)
 
 
+/* linux/mm/workingset.c */
+void *workingset_eviction(struct address_space *mapping, struct page *page);
+bool workingset_refault(void *shadow);
+void workingset_activation(struct page *page);
+
 /* linux/mm/swap.c */
 extern void __lru_cache_add(struct page *, enum lru_list lru);
 extern void lru_cache_add_lru(struct page *, enum lru_list lru);
@@ -330,6 +356,9 @@ static inline void mem_cgroup_uncharge_swap(swp_entry_t ent)
 /* linux/mm/page_io.c */
 extern int swap_readpage(struct page *);
 extern int swap_writepage(struct page *page, struct writeback_control *wbc);
+extern int swap_writepage_batch(struct page *page,
+	struct writeback_control *wbc, struct swap_write_batch *batch);
+extern void swap_write_batch_flush(struct swap_write_batch *batch);
 extern void end_swap_bio_write(struct bio *bio, int err);
 extern int __swap_writepage(struct page *page, struct writeback_control *wbc,
 	void (*end_write_func)(struct bio *, int));
@@ -346,18 +375,24 @@ extern struct address_space swapper_spaces[];
 #define swap_address_space(entry) (&swapper_spaces[swp_type(entry)])
 extern unsigned long total_swapcache_pages(void);
 extern void show_swap_cache_info(void);
-extern int add_to_swap(struct page *, struct list_head *list);
+extern int add_to_swap(struct page *, struct list_head *list,
+			struct swap_slot_batch *batch);
+extern void swap_slot_batch_release(struct swap_slot_batch *batch);
 extern int add_to_swap_cache(struct page *, swp_entry_t, gfp_t);
 extern int __add_to_swap_cache(struct page *page, swp_entry_t entry);
 extern void __delete_from_swap_cache(struct page *);
 extern void delete_from_swap_cache(struct page *);
 extern void free_page_and_swap_cache(struct page *);
 extern void free_pages_and_swap_cache(struct page **, int);
-extern struct page *lookup_swap_cache(swp_entry_t);
+extern struct page *lookup_swap_cache(swp_entry_t,
+			struct vm_area_struct *vma, unsigned long addr);
 extern struct page *read_swap_cache_async(swp_entry_t, gfp_t,
 			struct vm_area_struct *vma, unsigned long addr);
 extern struct page *swapin_readahead(swp_entry_t, gfp_t,
 			struct vm_area_struct *vma, unsigned long addr);
+extern struct page *swapin_vma_readahead(swp_entry_t, gfp_t,
+			struct vm_area_struct *vma, unsigned long addr);
+extern int swap_vma_readahead;
 
 /* linux/mm/swapfile.c */
 extern atomic_long_t nr_swap_pages;
@@ -375,6 +410,7 @@ static inline long get_nr_swap_pages(void)
 }
 
 extern void si_swapinfo(struct sysinfo *);
+extern int get_swap_pages(int n, swp_entry_t entries[]);
 extern swp_entry_t get_swap_page(void);
 extern swp_entry_t get_swap_page_of_type(int);
 extern int add_swap_count_continuation(swp_entry_t, gfp_t);
@@ -455,21 +491,44 @@ static inline struct page *swapin_readahead(swp_entry_t swp, gfp_t gfp_mask,
 	return NULL;
 }
 
+static inline struct page *swapin_vma_readahead(swp_entry_t swp,
+			gfp_t gfp_mask, struct vm_area_struct *vma,
+			unsigned long addr)
+{
+	return NULL;
+}
+
 static inline int swap_writepage(struct page *p, struct writeback_control *wbc)
 {
 	return 0;
 }
 
-static inline struct page *lookup_swap_cache(swp_entry_t swp)
+static inline int swap_writepage_batch(struct page *p,
+	struct writeback_control *wbc, struct swap_write_batch *batch)
+{
+	return 0;
+}
+
+static inline void swap_write_batch_flush(struct swap_write_batch *batch)
+{
+}
+
+static inline struct page *lookup_swap_cache(swp_entry_t swp,
+			struct vm_area_struct *vma, unsigned long addr)
 {
 	return NULL;
 }
 
-static inline int add_to_swap(struct page *page, struct list_head *list)
+static inline int add_to_swap(struct page *page, struct list_head *list,
+			struct swap_slot_batch *batch)
 {
 	return 0;
 }
 
+static inline void swap_slot_batch_release(struct swap_slot_batch *batch)
+{
+}
+
 static inline int add_to_swap_cache(struct page *page, swp_entry_t entry,
 							gfp_t gfp_mask)
 {
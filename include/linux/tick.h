@@ -41,6 +41,7 @@ enum tick_nohz_mode {
  * @idle_jiffies:	jiffies at the entry to idle for idle time accounting
  * @idle_calls:		Total number of idle calls
  * @idle_sleeps:	Number of idle calls, where the sched tick was stopped
+ * @idle_wakeups:	Number of interrupts that ended an idle sleep
  * @idle_entrytime:	Time when the idle call was entered
  * @idle_waketime:	Time when the idle was interrupted
  * @idle_exittime:	Time when the idle state was left
@@ -59,6 +60,7 @@ struct tick_sched {
 	unsigned long			idle_jiffies;
 	unsigned long			idle_calls;
 	unsigned long			idle_sleeps;
+	unsigned long			idle_wakeups;
 	int				idle_active;
 	ktime_t				idle_entrytime;
 	ktime_t				idle_waketime;
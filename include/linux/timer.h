@@ -252,6 +252,19 @@ extern int try_to_del_timer_sync(struct timer_list *timer);
 
 extern void init_timers(void);
 extern void run_local_timers(void);
+
+extern unsigned int sysctl_timer_coalesce_slot;
+
+#if defined(CONFIG_NO_HZ_COMMON) && defined(CONFIG_SMP)
+struct cpumask;
+extern unsigned int sysctl_timer_housekeeping;
+extern void timer_set_housekeeping_cpus(const struct cpumask *mask);
+#else
+static inline void timer_set_housekeeping_cpus(const struct cpumask *mask)
+{
+}
+#endif
+
 struct hrtimer;
 extern enum hrtimer_restart it_real_fn(struct hrtimer *);
 
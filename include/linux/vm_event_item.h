@@ -50,6 +50,9 @@ enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 		COMPACTMIGRATE_SCANNED, COMPACTFREE_SCANNED,
 		COMPACTISOLATED,
 		COMPACTSTALL, COMPACTFAIL, COMPACTSUCCESS,
+		COMPACTSTALL_US,	/* time spent in direct compaction */
+		KCOMPACTD_WAKE, KCOMPACTD_SUCCESS, KCOMPACTD_BACKOFF,
+		KCOMPACTD_US,		/* time spent in background compaction */
 #endif
 #ifdef CONFIG_HUGETLB_PAGE
 		HTLB_BUDDY_PGALLOC, HTLB_BUDDY_PGALLOC_FAIL,
@@ -61,6 +64,14 @@ enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 		UNEVICTABLE_PGMUNLOCKED,
 		UNEVICTABLE_PGCLEARED,	/* on COW, page truncate */
 		UNEVICTABLE_PGSTRANDED,	/* unable to isolate on unlock */
+#ifdef CONFIG_SWAP
+		SWAP_RA_CLUSTER,	/* pages read ahead by swap cluster */
+		SWAP_RA_CLUSTER_HIT,
+		SWAP_RA_CLUSTER_MISS,
+		SWAP_RA_VMA,		/* pages read ahead around the fault */
+		SWAP_RA_VMA_HIT,
+		SWAP_RA_VMA_MISS,
+#endif
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
 		THP_FAULT_ALLOC,
 		THP_FAULT_FALLBACK,
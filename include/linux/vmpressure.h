@@ -20,6 +20,10 @@ struct vmpressure {
 	struct mutex events_lock;
 
 	struct work_struct work;
+
+	/* Last level computed, and when, for vmpressure_under_pressure() */
+	int level;
+	unsigned long level_stamp;
 };
 
 struct mem_cgroup;
@@ -38,10 +42,15 @@ extern int vmpressure_register_event(struct cgroup *cg, struct cftype *cft,
 				     const char *args);
 extern void vmpressure_unregister_event(struct cgroup *cg, struct cftype *cft,
 					struct eventfd_ctx *eventfd);
+extern bool vmpressure_under_pressure(void);
 #else
 static inline void vmpressure(gfp_t gfp, struct mem_cgroup *memcg,
 			      unsigned long scanned, unsigned long reclaimed) {}
 static inline void vmpressure_prio(gfp_t gfp, struct mem_cgroup *memcg,
 				   int prio) {}
+static inline bool vmpressure_under_pressure(void)
+{
+	return false;
+}
 #endif /* CONFIG_MEMCG */
 #endif /* __LINUX_VMPRESSURE_H */
@@ -0,0 +1,88 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM cma
+
+#if !defined(_TRACE_CMA_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_CMA_H
+
+#include <linux/types.h>
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(cma_alloc,
+	TP_PROTO(unsigned long pfn, int count, unsigned int align,
+		 s64 isolate_us, s64 migrate_us, s64 total_us, bool predrained),
+	TP_ARGS(pfn, count, align, isolate_us, migrate_us, total_us, predrained),
+
+	TP_STRUCT__entry(
+		__field(unsigned long,	pfn		)
+		__field(int,		count		)
+		__field(unsigned int,	align		)
+		__field(s64,		isolate_us	)
+		__field(s64,		migrate_us	)
+		__field(s64,		total_us	)
+		__field(bool,		predrained	)
+	),
+
+	TP_fast_assign(
+		__entry->pfn = pfn;
+		__entry->count = count;
+		__entry->align = align;
+		__entry->isolate_us = isolate_us;
+		__entry->migrate_us = migrate_us;
+		__entry->total_us = total_us;
+		__entry->predrained = predrained;
+	),
+
+	TP_printk("pfn=%lx count=%d align=%u isolate_us=%lld migrate_us=%lld total_us=%lld predrained=%d",
+		  __entry->pfn, __entry->count, __entry->align,
+		  __entry->isolate_us, __entry->migrate_us, __entry->total_us,
+		  __entry->predrained)
+);
+
+TRACE_EVENT(cma_release,
+	TP_PROTO(unsigned long pfn, int count),
+	TP_ARGS(pfn, count),
+
+	TP_STRUCT__entry(
+		__field(unsigned long,	pfn	)
+		__field(int,		count	)
+	),
+
+	TP_fast_assign(
+		__entry->pfn = pfn;
+		__entry->count = count;
+	),
+
+	TP_printk("pfn=%lx count=%d", __entry->pfn, __entry->count)
+);
+
+DECLARE_EVENT_CLASS(cma_predrain_class,
+	TP_PROTO(unsigned long pfn, int count),
+	TP_ARGS(pfn, count),
+
+	TP_STRUCT__entry(
+		__field(unsigned long,	pfn	)
+		__field(int,		count	)
+	),
+
+	TP_fast_assign(
+		__entry->pfn = pfn;
+		__entry->count = count;
+	),
+
+	TP_printk("pfn=%lx count=%d", __entry->pfn, __entry->count)
+);
+
+DEFINE_EVENT(cma_predrain_class, cma_predrain,
+	TP_PROTO(unsigned long pfn, int count),
+	TP_ARGS(pfn, count)
+);
+
+DEFINE_EVENT(cma_predrain_class, cma_predrain_expire,
+	TP_PROTO(unsigned long pfn, int count),
+	TP_ARGS(pfn, count)
+);
+
+#endif /* _TRACE_CMA_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -0,0 +1,90 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM dm_hotplug
+
+#if !defined(_TRACE_DM_HOTPLUG_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_DM_HOTPLUG_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(dm_hotplug_sample,
+	TP_PROTO(int nr_avg, int iowait_avg, unsigned int nr_heavy,
+		 unsigned int load_freq, int online),
+	TP_ARGS(nr_avg, iowait_avg, nr_heavy, load_freq, online),
+
+	TP_STRUCT__entry(
+		__field(int,		nr_avg		)
+		__field(int,		iowait_avg	)
+		__field(unsigned int,	nr_heavy	)
+		__field(unsigned int,	load_freq	)
+		__field(int,		online		)
+	),
+
+	TP_fast_assign(
+		__entry->nr_avg = nr_avg;
+		__entry->iowait_avg = iowait_avg;
+		__entry->nr_heavy = nr_heavy;
+		__entry->load_freq = load_freq;
+		__entry->online = online;
+	),
+
+	TP_printk("nr_avg=%d iowait_avg=%d nr_heavy=%u load_freq=%u online=%d",
+		  __entry->nr_avg, __entry->iowait_avg, __entry->nr_heavy,
+		  __entry->load_freq, __entry->online)
+);
+
+TRACE_EVENT(dm_hotplug_predict,
+	TP_PROTO(int predicted, int reactive_cmd, int cmd),
+	TP_ARGS(predicted, reactive_cmd, cmd),
+
+	TP_STRUCT__entry(
+		__field(int,	predicted	)
+		__field(int,	reactive_cmd	)
+		__field(int,	cmd		)
+	),
+
+	TP_fast_assign(
+		__entry->predicted = predicted;
+		__entry->reactive_cmd = reactive_cmd;
+		__entry->cmd = cmd;
+	),
+
+	TP_printk("predicted=%d reactive_cmd=%d cmd=%d",
+		  __entry->predicted, __entry->reactive_cmd, __entry->cmd)
+);
+
+DECLARE_EVENT_CLASS(dm_hotplug_outcome,
+	TP_PROTO(int predicted, unsigned int age),
+	TP_ARGS(predicted, age),
+
+	TP_STRUCT__entry(
+		__field(int,		predicted	)
+		__field(unsigned int,	age		)
+	),
+
+	TP_fast_assign(
+		__entry->predicted = predicted;
+		__entry->age = age;
+	),
+
+	TP_printk("predicted=%d age=%u", __entry->predicted, __entry->age)
+);
+
+DEFINE_EVENT(dm_hotplug_outcome, dm_hotplug_hit,
+	TP_PROTO(int predicted, unsigned int age),
+	TP_ARGS(predicted, age)
+);
+
+DEFINE_EVENT(dm_hotplug_outcome, dm_hotplug_miss,
+	TP_PROTO(int predicted, unsigned int age),
+	TP_ARGS(predicted, age)
+);
+
+DEFINE_EVENT(dm_hotplug_outcome, dm_hotplug_mispredict,
+	TP_PROTO(int predicted, unsigned int age),
+	TP_ARGS(predicted, age)
+);
+
+#endif /* _TRACE_DM_HOTPLUG_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -18,12 +18,31 @@
 #include <linux/hrtimer.h>
 #include <linux/sched.h>
 #include <linux/math64.h>
+#include <linux/seqlock.h>
 
-static DEFINE_PER_CPU(u64, nr_prod_sum);
-static DEFINE_PER_CPU(u64, last_time);
-static DEFINE_PER_CPU(u64, nr);
-static DEFINE_PER_CPU(unsigned long, iowait_prod_sum);
-static DEFINE_PER_CPU(spinlock_t, nr_lock) = __SPIN_LOCK_UNLOCKED(nr_lock);
+/*
+ * Per-CPU accumulated nr_running * time and nr_iowait * time products.
+ * The sums only ever grow; the reader keeps its own snapshot of the values
+ * seen at the previous poll and works on the difference, so the scheduler
+ * side never has to be reset by the reader.
+ *
+ * Updates for a given CPU are serialized by that CPU's rq->lock, which the
+ * enqueue/dequeue paths already hold, so the writer only needs the seqcount
+ * to let lockless readers detect a torn snapshot and retry.
+ */
+struct nr_stats_s {
+	seqcount_t seq;
+	u64 nr_prod_sum;
+	u64 iowait_prod_sum;
+	u64 last_time;
+	unsigned long nr;
+};
+
+static DEFINE_PER_CPU(struct nr_stats_s, nr_stats);
+
+/* Only accessed by sched_get_nr_running_avg(), which is not reentrant */
+static DEFINE_PER_CPU(u64, nr_prod_snap);
+static DEFINE_PER_CPU(u64, iowait_prod_snap);
 static u64 last_get_time;
 
 /**
@@ -41,8 +60,6 @@ void sched_get_nr_running_avg(int *avg, int *iowait_avg)
 	u64 curr_time = sched_clock();
 	s64 diff = (s64) (curr_time - last_get_time);
 	u64 tmp_avg = 0, tmp_iowait = 0, old_lgt;
-	bool clk_faulty = 0;
-	u32 cpumask = 0;
 
 	*avg = 0;
 	*iowait_avg = 0;
@@ -54,36 +71,36 @@ void sched_get_nr_running_avg(int *avg, int *iowait_avg)
 
 	old_lgt = last_get_time;
 	last_get_time = curr_time;
-	/* read and reset nr_running counts */
+	/* snapshot the accumulated products without stopping the writers */
 	for_each_possible_cpu(cpu) {
-		unsigned long flags;
-
-		spin_lock_irqsave(&per_cpu(nr_lock, cpu), flags);
-		/* error handling for problematic clock violation */
-		if ((s64) (curr_time - per_cpu(last_time, cpu) < 0)) {
-			clk_faulty = 1;
-			cpumask |= 1 << cpu;
-		}
-
-		tmp_avg += per_cpu(nr_prod_sum, cpu);
-		tmp_avg += per_cpu(nr, cpu) *
-		    (curr_time - per_cpu(last_time, cpu));
-		tmp_iowait = per_cpu(iowait_prod_sum, cpu);
-		tmp_iowait += nr_iowait_cpu(cpu) *
-		    (curr_time - per_cpu(last_time, cpu));
-		per_cpu(last_time, cpu) = curr_time;
-		per_cpu(nr_prod_sum, cpu) = 0;
-		per_cpu(iowait_prod_sum, cpu) = 0;
-		spin_unlock_irqrestore(&per_cpu(nr_lock, cpu), flags);
-	}
-
-	/* error handling for problematic clock violation */
-	if (clk_faulty) {
-		*avg = 0;
-		*iowait_avg = 0;
-		pr_warn("[%s] **** CPU (0x%08x)clock may unstable !!\n",
-			__func__, cpumask);
-		return;
+		struct nr_stats_s *stats = &per_cpu(nr_stats, cpu);
+		u64 nr_prod_sum, iowait_prod_sum, last_time;
+		unsigned long nr;
+		unsigned int seq;
+
+		do {
+			seq = read_seqcount_begin(&stats->seq);
+			nr_prod_sum = stats->nr_prod_sum;
+			iowait_prod_sum = stats->iowait_prod_sum;
+			last_time = stats->last_time;
+			nr = stats->nr;
+		} while (read_seqcount_retry(&stats->seq, seq));
+
+		/*
+		 * The writer may have run on another CPU after curr_time was
+		 * sampled; there is no pending time to account in that case.
+		 */
+		if ((s64) (curr_time - last_time) < 0)
+			last_time = curr_time;
+
+		nr_prod_sum += (u64)nr * (curr_time - last_time);
+		iowait_prod_sum += (u64)nr_iowait_cpu(cpu) *
+		    (curr_time - last_time);
+
+		tmp_avg += nr_prod_sum - per_cpu(nr_prod_snap, cpu);
+		tmp_iowait += iowait_prod_sum - per_cpu(iowait_prod_snap, cpu);
+		per_cpu(nr_prod_snap, cpu) = nr_prod_sum;
+		per_cpu(iowait_prod_snap, cpu) = iowait_prod_sum;
 	}
 
 	*avg = (int)div64_u64(tmp_avg * 100, (u64) diff);
@@ -110,32 +127,28 @@ EXPORT_SYMBOL(sched_get_nr_running_avg);
  * @inc: Whether we are increasing or decreasing the count
  * @return: N/A
  *
- * Update average with latest nr_running value for CPU
+ * Update average with latest nr_running value for CPU.
+ * Must be called with cpu_rq(cpu)->lock held.
  */
 void sched_update_nr_prod(int cpu, unsigned long nr_running, bool inc)
 {
+	struct nr_stats_s *stats = &per_cpu(nr_stats, cpu);
 	s64 diff;
 	u64 curr_time;
-	unsigned long flags;
 
-	spin_lock_irqsave(&per_cpu(nr_lock, cpu), flags);
 	curr_time = sched_clock();
-	diff = (s64) (curr_time - per_cpu(last_time, cpu));
+	diff = (s64) (curr_time - stats->last_time);
 
 	/* skip this problematic clock violation */
-	if (diff < 0) {
-		spin_unlock_irqrestore(&per_cpu(nr_lock, cpu), flags);
+	if (diff < 0)
 		return;
-	}
-
-	per_cpu(last_time, cpu) = curr_time;
-	per_cpu(nr, cpu) = nr_running + (inc ? 1 : -1);
-
-	BUG_ON(per_cpu(nr, cpu) < 0);
 
-	per_cpu(nr_prod_sum, cpu) += nr_running * diff;
-	per_cpu(iowait_prod_sum, cpu) += nr_iowait_cpu(cpu) * diff;
-	spin_unlock_irqrestore(&per_cpu(nr_lock, cpu), flags);
+	write_seqcount_begin(&stats->seq);
+	stats->nr_prod_sum += nr_running * diff;
+	stats->iowait_prod_sum += nr_iowait_cpu(cpu) * diff;
+	stats->last_time = curr_time;
+	stats->nr = nr_running + (inc ? 1 : -1);
+	write_seqcount_end(&stats->seq);
 }
 
 EXPORT_SYMBOL(sched_update_nr_prod);
@@ -1055,8 +1055,10 @@ static inline void tick_check_nohz(int cpu)
 	if (!ts->idle_active && !ts->tick_stopped)
 		return;
 	now = ktime_get();
-	if (ts->idle_active)
+	if (ts->idle_active) {
+		ts->idle_wakeups++;
 		tick_nohz_stop_idle(cpu, now);
+	}
 	if (ts->tick_stopped) {
 		tick_nohz_update_jiffies(now);
 		tick_nohz_kick_tick(cpu, now);
@@ -178,6 +178,7 @@ static void print_cpu(struct seq_file *m, int cpu, u64 now)
 		P(idle_jiffies);
 		P(idle_calls);
 		P(idle_sleeps);
+		P(idle_wakeups);
 		P_ns(idle_entrytime);
 		P_ns(idle_waketime);
 		P_ns(idle_exittime);
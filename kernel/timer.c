@@ -108,6 +108,83 @@ static inline struct tvec_base *tbase_get_base(struct tvec_base *base)
 	return ((struct tvec_base *)((unsigned long)base & ~TIMER_FLAG_MASK));
 }
 
+/*
+ * Expiry slot, in jiffies, deferrable timers are rounded up to so that the
+ * periodic bookkeeping timers of a CPU fire together instead of waking it
+ * up one by one.  Zero disables the alignment.
+ */
+unsigned int sysctl_timer_coalesce_slot __read_mostly;
+
+static inline unsigned long
+coalesce_deferrable(struct timer_list *timer, unsigned long expires)
+{
+	unsigned long slot = sysctl_timer_coalesce_slot;
+	unsigned long rem;
+
+	if (!slot || !tbase_get_deferrable(timer->base))
+		return expires;
+
+	rem = expires % slot;
+	return rem ? expires + slot - rem : expires;
+}
+
+#if defined(CONFIG_NO_HZ_COMMON) && defined(CONFIG_SMP)
+/*
+ * Non pinned deferrable timers armed on a CPU outside this mask are queued
+ * on one of the housekeeping CPUs instead, so that e.g. the big cluster of
+ * a big.LITTLE system is not woken up only to run periodic bookkeeping.
+ * The mask stays empty, and the redirection off, unless the architecture
+ * or the "timer_housekeeping=" boot parameter provides one.
+ */
+static struct cpumask timer_housekeeping_mask;
+static bool timer_housekeeping_cmdline;
+unsigned int sysctl_timer_housekeeping __read_mostly = 1;
+
+void timer_set_housekeeping_cpus(const struct cpumask *mask)
+{
+	if (!timer_housekeeping_cmdline)
+		cpumask_copy(&timer_housekeeping_mask, mask);
+}
+
+static int __init timer_housekeeping_setup(char *str)
+{
+	if (cpulist_parse(str, &timer_housekeeping_mask) < 0) {
+		pr_warn("timer_housekeeping: incorrect CPU range\n");
+		cpumask_clear(&timer_housekeeping_mask);
+	}
+	timer_housekeeping_cmdline = true;
+	return 1;
+}
+__setup("timer_housekeeping=", timer_housekeeping_setup);
+
+/*
+ * Pick the CPU a deferrable timer armed on @cpu should be queued on:
+ * @cpu itself if it does housekeeping, else a busy housekeeping CPU, else
+ * any online one; deferrable timers do not need the target to be awake.
+ * Returns -1 when the redirection does not apply, so that the caller
+ * falls back to the usual nohz timer migration.
+ */
+static int get_housekeeping_timer_target(int cpu)
+{
+	int i, target = -1;
+
+	if (!sysctl_timer_housekeeping ||
+	    cpumask_empty(&timer_housekeeping_mask))
+		return -1;
+	if (cpumask_test_cpu(cpu, &timer_housekeeping_mask))
+		return cpu;
+
+	for_each_cpu_and(i, &timer_housekeeping_mask, cpu_online_mask) {
+		if (!idle_cpu(i))
+			return i;
+		if (target < 0)
+			target = i;
+	}
+
+	return target;
+}
+#endif
+
 static inline void
 timer_set_base(struct timer_list *timer, struct tvec_base *new_base)
 {
@@ -742,8 +819,16 @@ __mod_timer(struct timer_list *timer, unsigned long expires,
 	cpu = smp_processor_id();
 
 #if defined(CONFIG_NO_HZ_COMMON) && defined(CONFIG_SMP)
-	if (!pinned && get_sysctl_timer_migration() && idle_cpu(cpu))
-		cpu = get_nohz_timer_target();
+	if (!pinned) {
+		int target = -1;
+
+		if (tbase_get_deferrable(timer->base))
+			target = get_housekeeping_timer_target(cpu);
+		if (target >= 0)
+			cpu = target;
+		else if (get_sysctl_timer_migration() && idle_cpu(cpu))
+			cpu = get_nohz_timer_target();
+	}
 #endif
 	new_base = per_cpu(tvec_bases, cpu);
 
@@ -900,7 +985,7 @@ unsigned long apply_slack(struct timer_list *timer, unsigned long expires)
  */
 int mod_timer(struct timer_list *timer, unsigned long expires)
 {
-	expires = apply_slack(timer, expires);
+	expires = coalesce_deferrable(timer, apply_slack(timer, expires));
 
 	/*
 	 * This is a common optimization triggered by the
@@ -916,7 +1001,7 @@ EXPORT_SYMBOL(mod_timer);
 
 int mod_timer_on(struct timer_list *timer, int cpu, unsigned long expires)
 {
-	expires = apply_slack(timer, expires);
+	expires = coalesce_deferrable(timer, apply_slack(timer, expires));
 
 	/*
 	 * This is a common optimization triggered by the
@@ -951,6 +1036,8 @@ EXPORT_SYMBOL(mod_timer_on);
  */
 int mod_timer_pinned(struct timer_list *timer, unsigned long expires)
 {
+	expires = coalesce_deferrable(timer, expires);
+
 	if (timer->expires == expires && timer_pending(timer))
 		return 1;
 
@@ -993,6 +1080,7 @@ void add_timer_on(struct timer_list *timer, int cpu)
 
 	timer_stats_timer_set_start_info(timer);
 	BUG_ON(timer_pending(timer) || !timer->function);
+	timer->expires = coalesce_deferrable(timer, timer->expires);
 	spin_lock_irqsave(&base->lock, flags);
 	timer_set_base(timer, base);
 	debug_activate(timer, timer->expires);
@@ -16,6 +16,11 @@
 #include <linux/sysfs.h>
 #include <linux/balloon_compaction.h>
 #include <linux/page-isolation.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
+#include <linux/workqueue.h>
+#include <linux/vmpressure.h>
+#include <linux/ktime.h>
 #include "internal.h"
 
 #ifdef CONFIG_COMPACTION
@@ -600,7 +605,7 @@ isolate_migratepages_range(struct zone *zone, struct compact_control *cc,
 
 		/* Successfully isolated */
 		cc->finished_update_migrate = true;
-		del_page_from_lru_list(page, lruvec, page_lru(page));
+		isolate_page_from_lru_list(page, lruvec, page_lru(page));
 		list_add(&page->lru, migratelist);
 		cc->nr_migratepages++;
 		nr_isolated++;
@@ -825,6 +830,11 @@ static int compact_finished(struct zone *zone,
 	if (fatal_signal_pending(current))
 		return COMPACT_PARTIAL;
 
+	/* Background compaction yields as soon as reclaim is struggling */
+	if (cc->background &&
+	    (kthread_should_stop() || vmpressure_under_pressure()))
+		return COMPACT_PARTIAL;
+
 	/* Compaction run completes if the migrate and free scanner meet */
 	if (cc->free_pfn <= cc->migrate_pfn) {
 		/*
@@ -864,6 +874,10 @@ static int compact_finished(struct zone *zone,
 		/* Job done if allocation would set block type */
 		if (cc->order >= pageblock_order && area->nr_free)
 			return COMPACT_PARTIAL;
+
+		/* kcompactd: any free page of the order will do */
+		if (cc->background && area->nr_free)
+			return COMPACT_PARTIAL;
 	}
 
 	return COMPACT_CONTINUE;
@@ -1058,12 +1072,14 @@ unsigned long try_to_compact_pages(struct zonelist *zonelist,
 	struct zone *zone;
 	int rc = COMPACT_SKIPPED;
 	int alloc_flags = 0;
+	ktime_t start;
 
 	/* Check if the GFP flags allow compaction */
 	if (!order || !may_enter_fs || !may_perform_io)
 		return rc;
 
 	count_compact_event(COMPACTSTALL);
+	start = ktime_get();
 
 #ifdef CONFIG_CMA
 	if (allocflags_to_migratetype(gfp_mask) == MIGRATE_MOVABLE)
@@ -1084,6 +1100,9 @@ unsigned long try_to_compact_pages(struct zonelist *zonelist,
 			break;
 	}
 
+	count_compact_events(COMPACTSTALL_US,
+			     ktime_us_delta(ktime_get(), start));
+
 	return rc;
 }
 
@@ -1206,4 +1225,211 @@ void compaction_unregister_node(struct node *node)
 }
 #endif /* CONFIG_SYSFS && CONFIG_NUMA */
 
+/*
+ * kcompactd compacts a node in the background, ahead of the high-order
+ * allocations that would otherwise stall in direct compaction.  It is
+ * woken by direct compactors and by a periodic check of the fragmentation
+ * index, runs async migration only, and backs off as soon as the system
+ * is under memory pressure.
+ */
+int sysctl_kcompactd_order = PAGE_ALLOC_COSTLY_ORDER;
+int sysctl_kcompactd_interval_ms = 1000;
+
+static void kcompactd_check(struct work_struct *work);
+static DECLARE_DEFERRABLE_WORK(kcompactd_check_work, kcompactd_check);
+
+static bool kcompactd_node_suitable(pg_data_t *pgdat, int order)
+{
+	int zoneid;
+
+	for (zoneid = 0; zoneid < MAX_NR_ZONES; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+
+		if (!populated_zone(zone))
+			continue;
+
+		if (fragmentation_index(zone, order) > sysctl_extfrag_threshold)
+			return true;
+	}
+
+	return false;
+}
+
+static void kcompactd_do_work(pg_data_t *pgdat)
+{
+	int order = pgdat->kcompactd_max_order;
+	struct compact_control cc = {
+		.order = order,
+		.migratetype = MIGRATE_MOVABLE,
+		.sync = false,
+		.background = true,
+	};
+	int zoneid;
+
+	count_vm_event(KCOMPACTD_WAKE);
+
+	for (zoneid = 0; zoneid < MAX_NR_ZONES; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+		ktime_t start;
+		int status;
+
+		if (!populated_zone(zone))
+			continue;
+
+		if (compaction_deferred(zone, order))
+			continue;
+
+		/*
+		 * Leave zones that already meet the watermark, or that lack
+		 * the free pages to compact, so that a success below always
+		 * means compaction ran and got the zone there.
+		 */
+		if (zone_watermark_ok(zone, order, low_wmark_pages(zone), 0, 0))
+			continue;
+
+		if (compaction_suitable(zone, order) != COMPACT_CONTINUE)
+			continue;
+
+		if (vmpressure_under_pressure()) {
+			count_vm_event(KCOMPACTD_BACKOFF);
+			break;
+		}
+
+		cc.nr_freepages = 0;
+		cc.nr_migratepages = 0;
+		cc.zone = zone;
+		INIT_LIST_HEAD(&cc.freepages);
+		INIT_LIST_HEAD(&cc.migratepages);
+
+		start = ktime_get();
+		status = compact_zone(zone, &cc);
+		count_vm_events(KCOMPACTD_US,
+				ktime_us_delta(ktime_get(), start));
+
+		if (zone_watermark_ok(zone, order, low_wmark_pages(zone), 0, 0)) {
+			if (order >= zone->compact_order_failed)
+				zone->compact_order_failed = order + 1;
+			if (status != COMPACT_SKIPPED)
+				count_vm_event(KCOMPACTD_SUCCESS);
+		} else if (status == COMPACT_COMPLETE) {
+			/* Scanned the whole zone for nothing, leave it be */
+			defer_compaction(zone, order);
+		}
+
+		VM_BUG_ON(!list_empty(&cc.freepages));
+		VM_BUG_ON(!list_empty(&cc.migratepages));
+
+		if (kthread_should_stop())
+			break;
+	}
+
+	pgdat->kcompactd_max_order = 0;
+}
+
+static int kcompactd(void *p)
+{
+	pg_data_t *pgdat = (pg_data_t *)p;
+	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
+
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(current, cpumask);
+
+	set_user_nice(current, 19);
+	set_freezable();
+
+	while (!kthread_should_stop()) {
+		wait_event_freezable(pgdat->kcompactd_wait,
+				     kthread_should_stop() ||
+				     pgdat->kcompactd_max_order > 0);
+
+		if (kthread_should_stop())
+			break;
+
+		kcompactd_do_work(pgdat);
+	}
+
+	return 0;
+}
+
+/**
+ * wakeup_kcompactd - ask for background compaction of a node
+ * @pgdat: the node to compact
+ * @order: the order that should become available
+ */
+void wakeup_kcompactd(pg_data_t *pgdat, int order)
+{
+	if (!order || !pgdat->kcompactd)
+		return;
+
+	if (pgdat->kcompactd_max_order < order)
+		pgdat->kcompactd_max_order = order;
+
+	if (!waitqueue_active(&pgdat->kcompactd_wait))
+		return;
+
+	wake_up_interruptible(&pgdat->kcompactd_wait);
+}
+
+static void kcompactd_check(struct work_struct *work)
+{
+	int nid;
+
+	if (!sysctl_kcompactd_interval_ms || !sysctl_kcompactd_order)
+		return;
+
+	if (!vmpressure_under_pressure()) {
+		for_each_node_state(nid, N_MEMORY) {
+			pg_data_t *pgdat = NODE_DATA(nid);
+
+			if (kcompactd_node_suitable(pgdat,
+						    sysctl_kcompactd_order))
+				wakeup_kcompactd(pgdat, sysctl_kcompactd_order);
+		}
+	}
+
+	schedule_delayed_work(&kcompactd_check_work,
+			msecs_to_jiffies(sysctl_kcompactd_interval_ms));
+}
+
+int sysctl_kcompactd_handler(struct ctl_table *table, int write,
+			void __user *buffer, size_t *length, loff_t *ppos)
+{
+	int ret;
+
+	ret = proc_dointvec_minmax(table, write, buffer, length, ppos);
+	if (ret || !write)
+		return ret;
+
+	if (sysctl_kcompactd_interval_ms && sysctl_kcompactd_order)
+		mod_delayed_work(system_wq, &kcompactd_check_work,
+			msecs_to_jiffies(sysctl_kcompactd_interval_ms));
+	else
+		cancel_delayed_work(&kcompactd_check_work);
+
+	return 0;
+}
+
+static int __init kcompactd_init(void)
+{
+	int nid;
+
+	for_each_node_state(nid, N_MEMORY) {
+		pg_data_t *pgdat = NODE_DATA(nid);
+
+		pgdat->kcompactd = kthread_run(kcompactd, pgdat,
+					       "kcompactd%d", nid);
+		if (IS_ERR(pgdat->kcompactd)) {
+			pr_err("Failed to start kcompactd on node %d\n", nid);
+			pgdat->kcompactd = NULL;
+		}
+	}
+
+	if (sysctl_kcompactd_interval_ms)
+		schedule_delayed_work(&kcompactd_check_work,
+			msecs_to_jiffies(sysctl_kcompactd_interval_ms));
+
+	return 0;
+}
+module_init(kcompactd_init)
+
 #endif /* CONFIG_COMPACTION */
@@ -135,6 +135,7 @@ struct compact_control {
 	int migratetype;		/* MOVABLE, RECLAIMABLE etc */
 	struct zone *zone;
 	bool contended;			/* True if a lock was contended */
+	bool background;		/* Proactive compaction by kcompactd */
 };
 
 unsigned long
@@ -37,6 +37,7 @@
 #include <linux/freezer.h>
 #include <linux/oom.h>
 #include <linux/numa.h>
+#include <linux/list_sort.h>
 
 #include <asm/tlbflush.h>
 #include "internal.h"
@@ -98,12 +99,18 @@
  * @mm_list: link into the mm_slots list, rooted in ksm_mm_head
  * @rmap_list: head for this mm_slot's singly-linked list of rmap_items
  * @mm: the mm that this information is valid for
+ * @merged: pages merged in this mm during the current scan of it
+ * @score: decaying sum of @merged, full scans visit high scores first
+ * @backoff: number of consecutive scans of this mm that merged nothing
  */
 struct mm_slot {
 	struct hlist_node link;
 	struct list_head mm_list;
 	struct rmap_item *rmap_list;
 	struct mm_struct *mm;
+	unsigned long merged;
+	unsigned long score;
+	unsigned char backoff;
 };
 
 /**
@@ -112,6 +119,8 @@ struct mm_slot {
  * @address: the next address inside that to be scanned
  * @rmap_list: link to the next rmap to be scanned in the rmap_list
  * @seqnr: count of completed full scans (needed when removing unstable node)
+ * @vma_start: start of the vma being scanned, 0 if none
+ * @vma_merged: pages merged in that vma during this scan of it
  *
  * There is only the one ksm_scan instance of this cursor structure.
  */
@@ -120,6 +129,8 @@ struct ksm_scan {
 	unsigned long address;
 	struct rmap_item **rmap_list;
 	unsigned long seqnr;
+	unsigned long vma_start;
+	unsigned long vma_merged;
 };
 
 /**
@@ -223,6 +234,26 @@ static unsigned int ksm_thread_pages_to_scan = 100;
 /* Milliseconds ksmd should sleep between batches */
 static unsigned int ksm_thread_sleep_millisecs = 20;
 
+/*
+ * An mm or vma that merged nothing in a scan is only scanned again in the
+ * full scans whose number is a multiple of 2^(backoff - 1), backoff growing
+ * by one with every unproductive scan up to ksm_max_backoff.  The first
+ * unproductive scan costs nothing, pages need two scans to get into the
+ * unstable tree.  Taking the phase from the scan number, rather than from
+ * a countdown of each mm or vma, keeps those backed off to the same level
+ * in the same scans, so that their pages can still meet in the unstable
+ * tree.
+ */
+#define KSM_MAX_BACKOFF_LIMIT	8
+static unsigned int ksm_max_backoff = 6;
+
+/* Scanner effort, for judging the backoff */
+static unsigned long ksm_pages_scanned;
+static unsigned long ksm_pages_merged;
+static unsigned long ksm_mm_skipped;
+static unsigned long ksm_vma_skipped;
+static unsigned long ksm_pages_skipped;
+
 #ifdef CONFIG_NUMA
 /* Zeroed when merging across nodes is not allowed */
 static unsigned int ksm_merge_across_nodes = 1;
@@ -1402,6 +1433,14 @@ static void stable_tree_append(struct rmap_item *rmap_item,
 		ksm_pages_sharing++;
 	else
 		ksm_pages_shared++;
+	ksm_pages_merged++;
+}
+
+/* Credit a merge to the mm and vma being scanned. */
+static inline void ksm_note_merge(void)
+{
+	ksm_scan.mm_slot->merged++;
+	ksm_scan.vma_merged++;
 }
 
 /*
@@ -1455,6 +1494,7 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 			lock_page(kpage);
 			stable_tree_append(rmap_item, page_stable_node(kpage));
 			unlock_page(kpage);
+			ksm_note_merge();
 		}
 		put_page(kpage);
 		return;
@@ -1488,6 +1528,7 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 			if (stable_node) {
 				stable_tree_append(tree_rmap_item, stable_node);
 				stable_tree_append(rmap_item, stable_node);
+				ksm_note_merge();
 			}
 			unlock_page(kpage);
 
@@ -1533,6 +1574,77 @@ static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 	return rmap_item;
 }
 
+static void ksm_update_backoff(unsigned char *backoff, unsigned long merged)
+{
+	if (merged) {
+		*backoff = 0;
+		return;
+	}
+
+	if (*backoff < ksm_max_backoff)
+		(*backoff)++;
+	else
+		*backoff = ksm_max_backoff;
+}
+
+/* Whether an mm or vma at @backoff sits out the current full scan */
+static inline bool ksm_backoff_skip(unsigned char backoff)
+{
+	return backoff > 1 && ksm_scan.seqnr % (1UL << (backoff - 1));
+}
+
+/*
+ * Pass over the rmap_items below @end without scanning their pages.  Those
+ * left in the unstable tree by the previous scan must be taken off it, as
+ * if they had been scanned, or they would be found a scan too old later.
+ */
+static struct rmap_item **ksm_skip_rmap_items(struct rmap_item **rmap_list,
+					      unsigned long end)
+{
+	struct rmap_item *rmap_item;
+
+	while (*rmap_list) {
+		rmap_item = *rmap_list;
+		if ((rmap_item->address & PAGE_MASK) >= end)
+			break;
+		if (rmap_item->address & UNSTABLE_FLAG)
+			remove_rmap_item_from_tree(rmap_item);
+		rmap_list = &rmap_item->rmap_list;
+	}
+	return rmap_list;
+}
+
+/* Score the vma whose scan has just finished.  Called with mmap_sem held. */
+static void ksm_account_vma(struct mm_struct *mm)
+{
+	struct vm_area_struct *vma;
+
+	if (!ksm_scan.vma_start)
+		return;
+
+	vma = find_vma(mm, ksm_scan.vma_start);
+	if (vma && vma->vm_start == ksm_scan.vma_start)
+		ksm_update_backoff(&vma->ksm_backoff, ksm_scan.vma_merged);
+	ksm_scan.vma_start = 0;
+	ksm_scan.vma_merged = 0;
+}
+
+static void ksm_account_slot(struct mm_slot *slot)
+{
+	slot->score = slot->score / 2 + slot->merged;
+	ksm_update_backoff(&slot->backoff, slot->merged);
+	slot->merged = 0;
+}
+
+/* Most productive mm_slots first; list_sort() keeps ties in order. */
+static int ksm_slot_cmp(void *priv, struct list_head *a, struct list_head *b)
+{
+	struct mm_slot *slot_a = list_entry(a, struct mm_slot, mm_list);
+	struct mm_slot *slot_b = list_entry(b, struct mm_slot, mm_list);
+
+	return slot_a->score < slot_b->score;
+}
+
 static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 {
 	struct mm_struct *mm;
@@ -1583,6 +1695,7 @@ static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 			root_unstable_tree[nid] = RB_ROOT;
 
 		spin_lock(&ksm_mmlist_lock);
+		list_sort(NULL, &ksm_mm_head.mm_list, ksm_slot_cmp);
 		slot = list_entry(slot->mm_list.next, struct mm_slot, mm_list);
 		ksm_scan.mm_slot = slot;
 		spin_unlock(&ksm_mmlist_lock);
@@ -1595,6 +1708,27 @@ static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 next_mm:
 		ksm_scan.address = 0;
 		ksm_scan.rmap_list = &slot->rmap_list;
+		ksm_scan.vma_start = 0;
+		ksm_scan.vma_merged = 0;
+		slot->merged = 0;
+
+		/* an exiting mm must come round to be cleaned up */
+		if (ksm_backoff_skip(slot->backoff) &&
+		    !ksm_test_exit(slot->mm)) {
+			ksm_mm_skipped++;
+			ksm_skip_rmap_items(&slot->rmap_list, ULONG_MAX);
+
+			spin_lock(&ksm_mmlist_lock);
+			slot = list_entry(slot->mm_list.next,
+					  struct mm_slot, mm_list);
+			ksm_scan.mm_slot = slot;
+			spin_unlock(&ksm_mmlist_lock);
+
+			if (slot != &ksm_mm_head)
+				goto next_mm;
+			ksm_scan.seqnr++;
+			return NULL;
+		}
 	}
 
 	mm = slot->mm;
@@ -1612,6 +1746,21 @@ next_mm:
 		if (!vma->anon_vma)
 			ksm_scan.address = vma->vm_end;
 
+		if (ksm_scan.vma_start != vma->vm_start) {
+			ksm_account_vma(mm);
+			ksm_scan.vma_start = vma->vm_start;
+			if (ksm_backoff_skip(vma->ksm_backoff) &&
+			    ksm_scan.address < vma->vm_end) {
+				ksm_vma_skipped++;
+				ksm_pages_skipped += (vma->vm_end -
+						ksm_scan.address) >> PAGE_SHIFT;
+				ksm_scan.rmap_list = ksm_skip_rmap_items(
+					ksm_scan.rmap_list, vma->vm_end);
+				ksm_scan.address = vma->vm_end;
+				ksm_scan.vma_start = 0;
+			}
+		}
+
 		while (ksm_scan.address < vma->vm_end) {
 			if (ksm_test_exit(mm))
 				break;
@@ -1645,6 +1794,10 @@ next_mm:
 	if (ksm_test_exit(mm)) {
 		ksm_scan.address = 0;
 		ksm_scan.rmap_list = &slot->rmap_list;
+		ksm_scan.vma_start = 0;
+	} else {
+		ksm_account_vma(mm);
+		ksm_account_slot(slot);
 	}
 	/*
 	 * Nuke all the rmap_items that are above this current rmap:
@@ -1701,6 +1854,7 @@ static void ksm_do_scan(unsigned int scan_npages)
 		rmap_item = scan_get_next_rmap_item(&page);
 		if (!rmap_item)
 			return;
+		ksm_pages_scanned++;
 		cmp_and_merge_page(page, rmap_item);
 		put_page(page);
 	}
@@ -2378,6 +2532,75 @@ static ssize_t full_scans_show(struct kobject *kobj,
 }
 KSM_ATTR_RO(full_scans);
 
+static ssize_t max_backoff_show(struct kobject *kobj,
+				struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_max_backoff);
+}
+
+static ssize_t max_backoff_store(struct kobject *kobj,
+				 struct kobj_attribute *attr,
+				 const char *buf, size_t count)
+{
+	unsigned long backoff;
+	int err;
+
+	err = strict_strtoul(buf, 10, &backoff);
+	if (err || backoff > KSM_MAX_BACKOFF_LIMIT)
+		return -EINVAL;
+
+	ksm_max_backoff = backoff;
+
+	return count;
+}
+KSM_ATTR(max_backoff);
+
+static ssize_t pages_scanned_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_scanned);
+}
+KSM_ATTR_RO(pages_scanned);
+
+static ssize_t pages_merged_show(struct kobject *kobj,
+				 struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_merged);
+}
+KSM_ATTR_RO(pages_merged);
+
+static ssize_t scan_cost_show(struct kobject *kobj,
+			      struct kobj_attribute *attr, char *buf)
+{
+	unsigned long merged = ksm_pages_merged;
+
+	/* pages scanned per page merged */
+	return sprintf(buf, "%lu\n",
+		       merged ? ksm_pages_scanned / merged : ksm_pages_scanned);
+}
+KSM_ATTR_RO(scan_cost);
+
+static ssize_t mm_skipped_show(struct kobject *kobj,
+			       struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_mm_skipped);
+}
+KSM_ATTR_RO(mm_skipped);
+
+static ssize_t vma_skipped_show(struct kobject *kobj,
+				struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_vma_skipped);
+}
+KSM_ATTR_RO(vma_skipped);
+
+static ssize_t pages_skipped_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_skipped);
+}
+KSM_ATTR_RO(pages_skipped);
+
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
 	&pages_to_scan_attr.attr,
@@ -2387,6 +2610,13 @@ static struct attribute *ksm_attrs[] = {
 	&pages_unshared_attr.attr,
 	&pages_volatile_attr.attr,
 	&full_scans_attr.attr,
+	&max_backoff_attr.attr,
+	&pages_scanned_attr.attr,
+	&pages_merged_attr.attr,
+	&scan_cost_attr.attr,
+	&mm_skipped_attr.attr,
+	&vma_skipped_attr.attr,
+	&pages_skipped_attr.attr,
 #ifdef CONFIG_NUMA
 	&merge_across_nodes_attr.attr,
 #endif
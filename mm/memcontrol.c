@@ -43,6 +43,7 @@
 #include <linux/slab.h>
 #include <linux/swap.h>
 #include <linux/swapops.h>
+#include <linux/shmem_fs.h>
 #include <linux/spinlock.h>
 #include <linux/eventfd.h>
 #include <linux/sort.h>
@@ -113,6 +114,8 @@ enum mem_cgroup_events_index {
 	MEM_CGROUP_EVENTS_PGPGOUT,	/* # of pages paged out */
 	MEM_CGROUP_EVENTS_PGFAULT,	/* # of page-faults */
 	MEM_CGROUP_EVENTS_PGMAJFAULT,	/* # of major page-faults */
+	MEM_CGROUP_EVENTS_REFAULT,	/* # of evicted pages faulted back */
+	MEM_CGROUP_EVENTS_LOW,		/* # of reclaims below low limit */
 	MEM_CGROUP_EVENTS_NSTATS,
 };
 
@@ -121,6 +124,8 @@ static const char * const mem_cgroup_events_names[] = {
 	"pgpgout",
 	"pgfault",
 	"pgmajfault",
+	"refault",
+	"low",
 };
 
 static const char * const mem_cgroup_lru_names[] = {
@@ -306,6 +311,12 @@ struct mem_cgroup {
 	atomic_t	refcnt;
 
 	int	swappiness;
+
+	/* Global reclaim leaves the group alone below this usage */
+	unsigned long long low;
+	/* Priority levels added when global reclaim scans the group */
+	int	reclaim_priority;
+
 	/* OOM-Killer disable */
 	int		oom_kill_disable;
 
@@ -1307,6 +1318,65 @@ out:
 }
 EXPORT_SYMBOL(__mem_cgroup_count_vm_event);
 
+/**
+ * mem_cgroup_count_refault - account a refault to the page's memcg
+ * @page: the charged page that was faulted back in after eviction
+ */
+void mem_cgroup_count_refault(struct page *page)
+{
+	struct page_cgroup *pc = lookup_page_cgroup(page);
+
+	if (!PageCgroupUsed(pc))
+		return;
+
+	this_cpu_inc(pc->mem_cgroup->stat->events[MEM_CGROUP_EVENTS_REFAULT]);
+}
+
+/**
+ * mem_cgroup_low - check if memory consumption is below the low limit
+ * @root: the highest ancestor to consider
+ * @memcg: the memory cgroup to check
+ *
+ * Returns true if @memcg or any of its ancestors up to, but not including,
+ * @root uses less memory than its low limit.  An ancestor only covers its
+ * descendants with use_hierarchy set, as only then does its usage include
+ * theirs.  Global reclaim skips such groups as long as there is anything
+ * else left to reclaim.
+ */
+bool mem_cgroup_low(struct mem_cgroup *root, struct mem_cgroup *memcg)
+{
+	if (mem_cgroup_disabled())
+		return false;
+
+	if (!root)
+		root = root_mem_cgroup;
+
+	/* res.parent is only set while the parent uses hierarchy */
+	for (; memcg && memcg != root; memcg = parent_mem_cgroup(memcg)) {
+		if (res_counter_read_u64(&memcg->res, RES_USAGE) < memcg->low)
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * mem_cgroup_low_breached - account reclaim of a group below its low limit
+ * @memcg: the protected memory cgroup that is reclaimed anyway
+ */
+void mem_cgroup_low_breached(struct mem_cgroup *memcg)
+{
+	this_cpu_inc(memcg->stat->events[MEM_CGROUP_EVENTS_LOW]);
+}
+
+int mem_cgroup_reclaim_priority(struct mem_cgroup *memcg)
+{
+	if (mem_cgroup_disabled() || !memcg)
+		return 0;
+
+	return memcg->reclaim_priority;
+}
+
 /**
  * mem_cgroup_zone_lruvec - get the lru list vector for a zone and memcg
  * @zone: zone of the wanted lruvec
@@ -4798,26 +4868,18 @@ unsigned long mem_cgroup_soft_limit_reclaim(struct zone *zone, int order,
 /**
  * mem_cgroup_force_empty_list - clears LRU of a group
  * @memcg: group to clear
- * @node: NUMA node
- * @zid: zone id
- * @lru: lru to to clear
+ * @zone: zone the list belongs to
+ * @list: lru list to clear
  *
  * Traverse a specified page_cgroup list and try to drop them all.  This doesn't
  * reclaim the pages page themselves - pages are moved to the parent (or root)
  * group.
  */
 static void mem_cgroup_force_empty_list(struct mem_cgroup *memcg,
-				int node, int zid, enum lru_list lru)
+				struct zone *zone, struct list_head *list)
 {
-	struct lruvec *lruvec;
 	unsigned long flags;
-	struct list_head *list;
 	struct page *busy;
-	struct zone *zone;
-
-	zone = &NODE_DATA(node)->node_zones[zid];
-	lruvec = mem_cgroup_zone_lruvec(zone, memcg);
-	list = &lruvec->lists[lru];
 
 	busy = NULL;
 	do {
@@ -4849,6 +4911,24 @@ static void mem_cgroup_force_empty_list(struct mem_cgroup *memcg,
 	} while (!list_empty(list));
 }
 
+#ifdef CONFIG_LRU_GEN
+static void mem_cgroup_force_empty_gens(struct mem_cgroup *memcg,
+				struct zone *zone, struct lruvec *lruvec)
+{
+	int gen, type;
+
+	for (gen = 0; gen < MAX_NR_GENS; gen++)
+		for (type = 0; type < 2; type++)
+			mem_cgroup_force_empty_list(memcg, zone,
+					&lruvec->lrugen.lists[gen][type]);
+}
+#else
+static inline void mem_cgroup_force_empty_gens(struct mem_cgroup *memcg,
+				struct zone *zone, struct lruvec *lruvec)
+{
+}
+#endif
+
 /*
  * make mem_cgroup's charge to be 0 if there is no task by moving
  * all the charges and pages to the parent.
@@ -4868,11 +4948,18 @@ static void mem_cgroup_reparent_charges(struct mem_cgroup *memcg)
 		mem_cgroup_start_move(memcg);
 		for_each_node_state(node, N_MEMORY) {
 			for (zid = 0; zid < MAX_NR_ZONES; zid++) {
+				struct zone *zone;
+				struct lruvec *lruvec;
 				enum lru_list lru;
+
+				zone = &NODE_DATA(node)->node_zones[zid];
+				lruvec = mem_cgroup_zone_lruvec(zone, memcg);
 				for_each_lru(lru) {
-					mem_cgroup_force_empty_list(memcg,
-							node, zid, lru);
+					mem_cgroup_force_empty_list(memcg, zone,
+							&lruvec->lists[lru]);
 				}
+				mem_cgroup_force_empty_gens(memcg, zone,
+							    lruvec);
 			}
 		}
 		mem_cgroup_end_move(memcg);
@@ -5517,6 +5604,50 @@ static int mem_cgroup_swappiness_write(struct cgroup *cgrp, struct cftype *cft,
 	return 0;
 }
 
+static u64 mem_cgroup_low_read(struct cgroup *cgrp, struct cftype *cft)
+{
+	return mem_cgroup_from_cont(cgrp)->low;
+}
+
+static int mem_cgroup_low_write(struct cgroup *cgrp, struct cftype *cft,
+				const char *buffer)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_cont(cgrp);
+	unsigned long long val;
+	int ret;
+
+	if (mem_cgroup_is_root(memcg))
+		return -EINVAL;
+
+	ret = res_counter_memparse_write_strategy(buffer, &val);
+	if (ret)
+		return ret;
+
+	memcg->low = val;
+	return 0;
+}
+
+static u64 mem_cgroup_reclaim_priority_read(struct cgroup *cgrp,
+					    struct cftype *cft)
+{
+	return mem_cgroup_from_cont(cgrp)->reclaim_priority;
+}
+
+static int mem_cgroup_reclaim_priority_write(struct cgroup *cgrp,
+					     struct cftype *cft, u64 val)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_cont(cgrp);
+
+	if (val > DEF_PRIORITY)
+		return -EINVAL;
+
+	if (mem_cgroup_is_root(memcg))
+		return -EINVAL;
+
+	memcg->reclaim_priority = val;
+	return 0;
+}
+
 static void __mem_cgroup_threshold(struct mem_cgroup *memcg, bool swap)
 {
 	struct mem_cgroup_threshold_ary *t;
@@ -5919,6 +6050,16 @@ static struct cftype mem_cgroup_files[] = {
 		.write_string = mem_cgroup_write,
 		.read = mem_cgroup_read,
 	},
+	{
+		.name = "low_limit_in_bytes",
+		.write_string = mem_cgroup_low_write,
+		.read_u64 = mem_cgroup_low_read,
+	},
+	{
+		.name = "reclaim_priority",
+		.read_u64 = mem_cgroup_reclaim_priority_read,
+		.write_u64 = mem_cgroup_reclaim_priority_write,
+	},
 	{
 		.name = "failcnt",
 		.private = MEMFILE_PRIVATE(_MEM, RES_FAILCNT),
@@ -6484,16 +6625,21 @@ static struct page *mc_handle_file_pte(struct vm_area_struct *vma,
 		pgoff = pte_to_pgoff(ptent);
 
 	/* page is moved even if it's not RSS of this task(page-faulted). */
-	page = find_get_page(mapping, pgoff);
-
 #ifdef CONFIG_SWAP
 	/* shmem/tmpfs may report page out on swap: account for that too. */
-	if (radix_tree_exceptional_entry(page)) {
-		swp_entry_t swap = radix_to_swp_entry(page);
-		if (do_swap_account)
-			*entry = swap;
-		page = find_get_page(swap_address_space(swap), swap.val);
-	}
+	if (shmem_mapping(mapping)) {
+		page = find_get_entry(mapping, pgoff);
+		if (radix_tree_exceptional_entry(page)) {
+			swp_entry_t swap = radix_to_swp_entry(page);
+			if (do_swap_account)
+				*entry = swap;
+			page = find_get_page(swap_address_space(swap),
+					     swap.val);
+		}
+	} else
+		page = find_get_page(mapping, pgoff);
+#else
+	page = find_get_page(mapping, pgoff);
 #endif
 	return page;
 }
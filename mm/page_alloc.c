@@ -697,6 +697,63 @@ static void free_pcppages_bulk(struct zone *zone, int count,
 	spin_unlock(&zone->lock);
 }
 
+/*
+ * The high order per-cpu lists hold up to half as many base pages as the
+ * order-0 lists and are refilled and drained pcp->batch base pages at a
+ * time.
+ */
+static inline int pcp_high_order_high(struct per_cpu_pages *pcp)
+{
+	return pcp->high >> 1;
+}
+
+static inline int pcp_high_order_batch(struct per_cpu_pages *pcp, int order)
+{
+	return max(1, pcp->batch >> order);
+}
+
+/*
+ * Free at least count base pages worth of blocks from the high order pcp
+ * lists, taking one block from each non-empty list in turn.  Unlike
+ * free_pcppages_bulk(), pcp->high_order_count is updated here.
+ */
+static void free_pcppages_high_bulk(struct zone *zone, int count,
+				    struct per_cpu_pages *pcp)
+{
+	int order, migratetype;
+
+	spin_lock(&zone->lock);
+	zone->all_unreclaimable = 0;
+	zone->pages_scanned = 0;
+
+	while (count > 0 && pcp->high_order_count) {
+		for (order = 1; order <= NR_PCP_HIGH_ORDERS; order++) {
+			for (migratetype = 0; migratetype < MIGRATE_PCPTYPES;
+			     migratetype++) {
+				struct list_head *list;
+				struct page *page;
+				int mt;
+
+				list = &pcp->high_lists[order - 1][migratetype];
+				if (list_empty(list))
+					continue;
+
+				page = list_entry(list->prev, struct page, lru);
+				list_del(&page->lru);
+				mt = get_freepage_migratetype(page);
+				__free_one_page(page, zone, order, mt);
+				trace_mm_page_pcpu_drain(page, order, mt);
+				if (likely(!is_migrate_isolate_page(page)))
+					__mod_zone_freepage_state(zone,
+							1 << order, mt);
+				pcp->high_order_count -= 1 << order;
+				count -= 1 << order;
+			}
+		}
+	}
+	spin_unlock(&zone->lock);
+}
+
 static void free_one_page(struct zone *zone, struct page *page, int order,
 				int migratetype)
 {
@@ -710,6 +767,30 @@ static void free_one_page(struct zone *zone, struct page *page, int order,
 	spin_unlock(&zone->lock);
 }
 
+/*
+ * Put a block of order 1 to NR_PCP_HIGH_ORDERS on this cpu's high order
+ * lists.  Called with interrupts disabled.
+ */
+static void free_pcp_high_order(struct zone *zone, struct page *page,
+				int order, int migratetype)
+{
+	struct per_cpu_pages *pcp;
+
+	/* the buddy allocator would do this when merging */
+	if (PageCompound(page) && destroy_compound_page(page, order))
+		return;
+
+	/* RESERVE and CMA blocks go on the movable list, as for order-0 */
+	if (migratetype >= MIGRATE_PCPTYPES)
+		migratetype = MIGRATE_MOVABLE;
+
+	pcp = &this_cpu_ptr(zone->pageset)->pcp;
+	list_add(&page->lru, &pcp->high_lists[order - 1][migratetype]);
+	pcp->high_order_count += 1 << order;
+	if (pcp->high_order_count >= pcp_high_order_high(pcp))
+		free_pcppages_high_bulk(zone, pcp->batch, pcp);
+}
+
 static bool free_pages_prepare(struct page *page, unsigned int order)
 {
 	int i;
@@ -748,7 +829,10 @@ static void __free_pages_ok(struct page *page, unsigned int order)
 	__count_vm_events(PGFREE, 1 << order);
 	migratetype = get_pageblock_migratetype(page);
 	set_freepage_migratetype(page, migratetype);
-	free_one_page(page_zone(page), page, order, migratetype);
+	if (order <= NR_PCP_HIGH_ORDERS && !is_migrate_isolate(migratetype))
+		free_pcp_high_order(page_zone(page), page, order, migratetype);
+	else
+		free_one_page(page_zone(page), page, order, migratetype);
 	local_irq_restore(flags);
 }
 
@@ -1202,6 +1286,8 @@ void drain_zone_pages(struct zone *zone, struct per_cpu_pages *pcp)
 		free_pcppages_bulk(zone, to_drain, pcp);
 		pcp->count -= to_drain;
 	}
+	if (pcp->high_order_count)
+		free_pcppages_high_bulk(zone, pcp->batch, pcp);
 	local_irq_restore(flags);
 }
 #endif
@@ -1230,6 +1316,9 @@ static void drain_pages(unsigned int cpu)
 			free_pcppages_bulk(zone, pcp->count, pcp);
 			pcp->count = 0;
 		}
+		if (pcp->high_order_count)
+			free_pcppages_high_bulk(zone, pcp->high_order_count,
+						pcp);
 		local_irq_restore(flags);
 	}
 }
@@ -1273,7 +1362,7 @@ void drain_all_pages(void)
 		bool has_pcps = false;
 		for_each_populated_zone(zone) {
 			pcp = per_cpu_ptr(zone->pageset, cpu);
-			if (pcp->pcp.count) {
+			if (pcp->pcp.count || pcp->pcp.high_order_count) {
 				has_pcps = true;
 				break;
 			}
@@ -1493,6 +1582,20 @@ struct page *buffered_rmqueue(struct zone *preferred_zone,
 	struct page *page;
 	int cold = !!(gfp_flags & __GFP_COLD);
 
+	if (unlikely(order && (gfp_flags & __GFP_NOFAIL))) {
+		/*
+		 * __GFP_NOFAIL is not to be used in new code.
+		 *
+		 * All __GFP_NOFAIL callers should be fixed so that they
+		 * properly detect and handle allocation failures.
+		 *
+		 * We most definitely don't want callers attempting to
+		 * allocate greater than order-1 page units with
+		 * __GFP_NOFAIL.
+		 */
+		WARN_ON_ONCE(order > 1);
+	}
+
 again:
 	if (likely(order == 0)) {
 		struct per_cpu_pages *pcp;
@@ -1516,20 +1619,29 @@ again:
 
 		list_del(&page->lru);
 		pcp->count--;
-	} else {
-		if (unlikely(gfp_flags & __GFP_NOFAIL)) {
-			/*
-			 * __GFP_NOFAIL is not to be used in new code.
-			 *
-			 * All __GFP_NOFAIL callers should be fixed so that they
-			 * properly detect and handle allocation failures.
-			 *
-			 * We most definitely don't want callers attempting to
-			 * allocate greater than order-1 page units with
-			 * __GFP_NOFAIL.
-			 */
-			WARN_ON_ONCE(order > 1);
+	} else if (order <= NR_PCP_HIGH_ORDERS) {
+		struct per_cpu_pages *pcp;
+		struct list_head *list;
+
+		local_irq_save(flags);
+		pcp = &this_cpu_ptr(zone->pageset)->pcp;
+		list = &pcp->high_lists[order - 1][migratetype];
+		if (list_empty(list)) {
+			pcp->high_order_count += rmqueue_bulk(zone, order,
+					pcp_high_order_batch(pcp, order), list,
+					migratetype, cold) << order;
+			if (unlikely(list_empty(list)))
+				goto failed;
 		}
+
+		if (cold)
+			page = list_entry(list->prev, struct page, lru);
+		else
+			page = list_entry(list->next, struct page, lru);
+
+		list_del(&page->lru);
+		pcp->high_order_count -= 1 << order;
+	} else {
 		spin_lock_irqsave(&zone->lock, flags);
 		page = __rmqueue(zone, order, migratetype);
 		spin_unlock(&zone->lock);
@@ -2191,6 +2303,9 @@ __alloc_pages_direct_compact(gfp_t gfp_mask, unsigned int order,
 						contended_compaction);
 	current->flags &= ~PF_MEMALLOC;
 
+	/* Get ahead of the next allocation of this order */
+	wakeup_kcompactd(preferred_zone->zone_pgdat, order);
+
 	if (*did_some_progress != COMPACT_SKIPPED) {
 		struct page *page;
 
@@ -3007,9 +3122,10 @@ void show_free_areas(unsigned int filter)
 
 			pageset = per_cpu_ptr(zone->pageset, cpu);
 
-			printk("CPU %4d: hi:%5d, btch:%4d usd:%4d\n",
+			printk("CPU %4d: hi:%5d, btch:%4d usd:%4d hord:%4d\n",
 			       cpu, pageset->pcp.high,
-			       pageset->pcp.batch, pageset->pcp.count);
+			       pageset->pcp.batch, pageset->pcp.count,
+			       pageset->pcp.high_order_count);
 		}
 	}
 
@@ -4048,7 +4164,7 @@ static int __meminit zone_batchsize(struct zone *zone)
 static void setup_pageset(struct per_cpu_pageset *p, unsigned long batch)
 {
 	struct per_cpu_pages *pcp;
-	int migratetype;
+	int migratetype, order;
 
 	memset(p, 0, sizeof(*p));
 
@@ -4056,8 +4172,11 @@ static void setup_pageset(struct per_cpu_pageset *p, unsigned long batch)
 	pcp->count = 0;
 	pcp->high = 6 * batch;
 	pcp->batch = max(1UL, 1 * batch);
-	for (migratetype = 0; migratetype < MIGRATE_PCPTYPES; migratetype++)
+	for (migratetype = 0; migratetype < MIGRATE_PCPTYPES; migratetype++) {
 		INIT_LIST_HEAD(&pcp->lists[migratetype]);
+		for (order = 0; order < NR_PCP_HIGH_ORDERS; order++)
+			INIT_LIST_HEAD(&pcp->high_lists[order][migratetype]);
+	}
 }
 
 /*
@@ -4618,6 +4737,9 @@ static void __paginginit free_area_init_core(struct pglist_data *pgdat,
 #endif
 	init_waitqueue_head(&pgdat->kswapd_wait);
 	init_waitqueue_head(&pgdat->pfmemalloc_wait);
+#ifdef CONFIG_COMPACTION
+	init_waitqueue_head(&pgdat->kcompactd_wait);
+#endif
 	pgdat_page_cgroup_init(pgdat);
 
 	for (j = 0; j < MAX_NR_ZONES; j++) {
@@ -5946,9 +6068,25 @@ static int __alloc_contig_migrate_range(struct compact_control *cc,
  */
 int alloc_contig_range(unsigned long start, unsigned long end,
 		       unsigned migratetype)
+{
+	return alloc_contig_range_stats(start, end, migratetype, NULL);
+}
+
+/**
+ * alloc_contig_range_stats() -- alloc_contig_range() with phase timing
+ * @start:	start PFN to allocate
+ * @end:	one-past-the-last PFN to allocate
+ * @migratetype:	migratetype of the underlaying pageblocks
+ * @stats:	if not NULL, filled with the time spent migrating pages
+ *		out of the range and the time spent isolating it
+ */
+int alloc_contig_range_stats(unsigned long start, unsigned long end,
+			     unsigned migratetype,
+			     struct contig_range_stats *stats)
 {
 	unsigned long outer_start, outer_end;
 	int ret = 0, order;
+	ktime_t t0, t1, t2;
 
 	struct compact_control cc = {
 		.nr_migratepages = 0,
@@ -5983,13 +6121,19 @@ int alloc_contig_range(unsigned long start, unsigned long end,
 	 * put back to page allocator so that buddy can use them.
 	 */
 
+	if (stats)
+		stats->isolate_us = stats->migrate_us = 0;
+
+	t0 = ktime_get();
 	ret = start_isolate_page_range(pfn_max_align_down(start),
 				       pfn_max_align_up(end), migratetype,
 				       false);
 	if (ret)
 		return ret;
 
+	t1 = ktime_get();
 	ret = __alloc_contig_migrate_range(&cc, start, end);
+	t2 = ktime_get();
 	if (ret)
 		goto done;
 
@@ -6048,6 +6192,11 @@ int alloc_contig_range(unsigned long start, unsigned long end,
 done:
 	undo_isolate_page_range(pfn_max_align_down(start),
 				pfn_max_align_up(end), migratetype);
+	if (stats) {
+		stats->migrate_us = ktime_us_delta(t2, t1);
+		stats->isolate_us = ktime_us_delta(ktime_get(), t0) -
+				    stats->migrate_us;
+	}
 	return ret;
 }
 
@@ -6082,6 +6231,9 @@ static int __meminit __zone_pcp_update(void *data)
 		local_irq_save(flags);
 		if (pcp->count > 0)
 			free_pcppages_bulk(zone, pcp->count, pcp);
+		if (pcp->high_order_count > 0)
+			free_pcppages_high_bulk(zone, pcp->high_order_count,
+						pcp);
 		drain_zonestat(zone, pset);
 		setup_pageset(pset, batch);
 		local_irq_restore(flags);
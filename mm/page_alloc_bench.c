@@ -0,0 +1,177 @@
+/*
+ * page_alloc_bench.c - page allocator throughput benchmark
+ *
+ * Runs a thread on every online cpu that allocates a batch of pages of a
+ * given order and frees them again, for orders 0 to PAGE_ALLOC_COSTLY_ORDER.
+ * All cpus start together, so the zone->lock contention of the orders that
+ * are not cached per cpu shows up in the result.  The average cost of an
+ * alloc/free pair and the aggregate throughput are printed per order.
+ *
+ *	insmod page_alloc_bench.ko [loops=N] [batch=N] [orders=M]
+ *
+ * The module refuses to stay loaded once the results are printed.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/cpumask.h>
+#include <linux/gfp.h>
+#include <linux/mm.h>
+#include <linux/ktime.h>
+#include <linux/slab.h>
+
+static unsigned int loops = 10000;
+module_param(loops, uint, 0444);
+MODULE_PARM_DESC(loops, "alloc/free rounds per cpu and order");
+
+static unsigned int batch = 16;
+module_param(batch, uint, 0444);
+MODULE_PARM_DESC(batch, "pages held before they are freed");
+
+/* bitmask of the orders to measure */
+static unsigned int orders = (1 << (PAGE_ALLOC_COSTLY_ORDER + 1)) - 1;
+module_param(orders, uint, 0444);
+MODULE_PARM_DESC(orders, "bitmask of the orders to measure");
+
+struct bench_cpu {
+	struct task_struct	*task;
+	unsigned int		order;
+	u64			ns;
+	unsigned long		pairs;
+	unsigned long		failed;
+};
+
+static struct bench_cpu __percpu *bench_cpus;
+static atomic_t bench_ready;
+static DECLARE_COMPLETION(bench_start);
+static DECLARE_COMPLETION(bench_done);
+static atomic_t bench_running;
+
+static int bench_thread(void *data)
+{
+	struct bench_cpu *bc = data;
+	struct page **pages;
+	unsigned int i, j;
+	ktime_t start;
+
+	pages = kcalloc(batch, sizeof(*pages), GFP_KERNEL);
+
+	atomic_inc(&bench_ready);
+	wait_for_completion(&bench_start);
+	if (!pages)
+		goto out;
+
+	start = ktime_get();
+	for (i = 0; i < loops; i++) {
+		for (j = 0; j < batch; j++) {
+			pages[j] = alloc_pages(GFP_KERNEL | __GFP_NOWARN,
+					       bc->order);
+			if (!pages[j])
+				bc->failed++;
+		}
+		for (j = 0; j < batch; j++) {
+			if (pages[j]) {
+				__free_pages(pages[j], bc->order);
+				bc->pairs++;
+			}
+		}
+	}
+	bc->ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	kfree(pages);
+out:
+	if (atomic_dec_and_test(&bench_running))
+		complete(&bench_done);
+	return 0;
+}
+
+static void bench_order(unsigned int order)
+{
+	unsigned long pairs = 0, failed = 0;
+	u64 ns = 0, max_ns = 0;
+	int cpu, nr_cpus = 0;
+
+	atomic_set(&bench_ready, 0);
+	INIT_COMPLETION(bench_start);
+	INIT_COMPLETION(bench_done);
+
+	get_online_cpus();
+	atomic_set(&bench_running, num_online_cpus());
+	for_each_online_cpu(cpu) {
+		struct bench_cpu *bc = per_cpu_ptr(bench_cpus, cpu);
+
+		memset(bc, 0, sizeof(*bc));
+		bc->order = order;
+		bc->task = kthread_create(bench_thread, bc, "pa_bench/%d", cpu);
+		if (IS_ERR(bc->task)) {
+			bc->task = NULL;
+			if (atomic_dec_and_test(&bench_running))
+				complete(&bench_done);
+			continue;
+		}
+		kthread_bind(bc->task, cpu);
+		wake_up_process(bc->task);
+		nr_cpus++;
+	}
+
+	while (atomic_read(&bench_ready) < nr_cpus)
+		schedule_timeout_uninterruptible(1);
+	complete_all(&bench_start);
+	wait_for_completion(&bench_done);
+
+	for_each_online_cpu(cpu) {
+		struct bench_cpu *bc = per_cpu_ptr(bench_cpus, cpu);
+
+		if (!bc->task)
+			continue;
+		pairs += bc->pairs;
+		failed += bc->failed;
+		ns += bc->ns;
+		max_ns = max(max_ns, bc->ns);
+	}
+	put_online_cpus();
+
+	if (!pairs || !max_ns) {
+		pr_info("order %u: no pages allocated\n", order);
+		return;
+	}
+
+	pr_info("order %u: %d cpus, %lu pairs, %llu ns/pair, %llu pairs/s, %lu failed\n",
+		order, nr_cpus, pairs, div64_u64(ns, pairs),
+		div64_u64((u64)pairs * NSEC_PER_SEC, max_ns), failed);
+}
+
+static int __init page_alloc_bench_init(void)
+{
+	unsigned int order;
+
+	if (!batch)
+		return -EINVAL;
+
+	bench_cpus = alloc_percpu(struct bench_cpu);
+	if (!bench_cpus)
+		return -ENOMEM;
+
+	for (order = 0; order <= PAGE_ALLOC_COSTLY_ORDER; order++)
+		if (orders & (1 << order))
+			bench_order(order);
+
+	free_percpu(bench_cpus);
+
+	return -EAGAIN; /* Fail will directly unload the module */
+}
+
+static void __exit page_alloc_bench_exit(void)
+{
+}
+
+module_init(page_alloc_bench_init)
+module_exit(page_alloc_bench_exit)
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Page allocator throughput benchmark");
@@ -46,26 +46,33 @@ static struct bio *get_swap_bio(gfp_t gfp_flags,
 void end_swap_bio_write(struct bio *bio, int err)
 {
 	const int uptodate = test_bit(BIO_UPTODATE, &bio->bi_flags);
-	struct page *page = bio->bi_io_vec[0].bv_page;
+	struct bio_vec *bvec;
+	int i;
 
-	if (!uptodate) {
-		SetPageError(page);
-		/*
-		 * We failed to write the page out to swap-space.
-		 * Re-dirty the page in order to avoid it being reclaimed.
-		 * Also print a dire warning that things will go BAD (tm)
-		 * very quickly.
-		 *
-		 * Also clear PG_reclaim to avoid rotate_reclaimable_page()
-		 */
-		set_page_dirty(page);
-		printk(KERN_ALERT "Write-error on swap-device (%u:%u:%Lu)\n",
-				imajor(bio->bi_bdev->bd_inode),
-				iminor(bio->bi_bdev->bd_inode),
-				(unsigned long long)bio->bi_sector);
-		ClearPageReclaim(page);
+	/* batched swap-out writes several pages with one bio */
+	bio_for_each_segment_all(bvec, bio, i) {
+		struct page *page = bvec->bv_page;
+
+		if (!uptodate) {
+			SetPageError(page);
+			/*
+			 * We failed to write the page out to swap-space.
+			 * Re-dirty the page in order to avoid it being
+			 * reclaimed.  Also print a dire warning that things
+			 * will go BAD (tm) very quickly.
+			 *
+			 * Also clear PG_reclaim to avoid
+			 * rotate_reclaimable_page()
+			 */
+			set_page_dirty(page);
+			printk(KERN_ALERT "Write-error on swap-device (%u:%u:%Lu)\n",
+					imajor(bio->bi_bdev->bd_inode),
+					iminor(bio->bi_bdev->bd_inode),
+					(unsigned long long)bio->bi_sector);
+			ClearPageReclaim(page);
+		}
+		end_page_writeback(page);
 	}
-	end_page_writeback(page);
 	bio_put(bio);
 }
 
@@ -230,6 +237,81 @@ bad_bmap:
  * them here and get rid of the unnecessary final write.
  */
 int swap_writepage(struct page *page, struct writeback_control *wbc)
+{
+	return swap_writepage_batch(page, wbc, NULL);
+}
+
+/**
+ * swap_write_batch_flush - submit the pages collected in a swap-out batch
+ * @batch: the batch
+ */
+void swap_write_batch_flush(struct swap_write_batch *batch)
+{
+	if (batch->bio) {
+		submit_bio(batch->rw, batch->bio);
+		batch->bio = NULL;
+	}
+}
+
+/*
+ * Add @page to the bio of @batch if its slot follows the last one queued
+ * on the same device, else submit that bio and start a new one.
+ */
+static int swap_write_batch_add(struct page *page,
+				struct writeback_control *wbc,
+				struct swap_write_batch *batch)
+{
+	struct block_device *bdev;
+	struct bio *bio = batch->bio;
+	sector_t sector;
+
+	sector = map_swap_page(page, &bdev);
+	sector <<= PAGE_SHIFT - 9;
+
+	if (bio && (bio->bi_bdev != bdev ||
+		    bio->bi_sector + (bio->bi_size >> 9) != sector ||
+		    !bio_add_page(bio, page, PAGE_SIZE, 0))) {
+		swap_write_batch_flush(batch);
+		bio = NULL;
+	}
+
+	if (!bio) {
+		bio = bio_alloc(GFP_NOIO, SWAP_CLUSTER_MAX);
+		if (!bio)
+			return __swap_writepage(page, wbc, end_swap_bio_write);
+		bio->bi_sector = sector;
+		bio->bi_bdev = bdev;
+		bio->bi_end_io = end_swap_bio_write;
+		if (!bio_add_page(bio, page, PAGE_SIZE, 0)) {
+			bio_put(bio);
+			return __swap_writepage(page, wbc, end_swap_bio_write);
+		}
+		batch->bio = bio;
+		batch->rw = WRITE;
+		if (wbc->sync_mode == WB_SYNC_ALL)
+			batch->rw |= REQ_SYNC;
+	}
+
+	count_vm_event(PSWPOUT);
+	set_page_writeback(page);
+	unlock_page(page);
+
+	if (bio->bi_vcnt == bio->bi_max_vecs)
+		swap_write_batch_flush(batch);
+	return 0;
+}
+
+/**
+ * swap_writepage_batch - write a swap cache page as part of a batch
+ * @page: locked swap cache page
+ * @wbc: writeback control
+ * @batch: swap-out batch, or NULL to submit the page on its own
+ *
+ * The page is unlocked and under writeback on return, but with a @batch
+ * its I/O may only be issued by a later swap_write_batch_flush().
+ */
+int swap_writepage_batch(struct page *page, struct writeback_control *wbc,
+			 struct swap_write_batch *batch)
 {
 	int ret = 0;
 
@@ -243,7 +325,10 @@ int swap_writepage(struct page *page, struct writeback_control *wbc)
 		end_page_writeback(page);
 		goto out;
 	}
-	ret = __swap_writepage(page, wbc, end_swap_bio_write);
+	if (batch && !(page_swap_info(page)->flags & SWP_FILE))
+		ret = swap_write_batch_add(page, wbc, batch);
+	else
+		ret = __swap_writepage(page, wbc, end_swap_bio_write);
 out:
 	return ret;
 }
@@ -33,6 +33,8 @@
 #include <linux/stacktrace.h>
 #include <linux/prefetch.h>
 #include <linux/memcontrol.h>
+#include <linux/static_key.h>
+#include <linux/workqueue.h>
 
 #include <trace/events/kmem.h>
 
@@ -219,6 +221,15 @@ static inline void stat(const struct kmem_cache *s, enum stat_item si)
 #endif
 }
 
+/* Number of caches with lstat_enabled, patches lstat() in when non zero */
+static struct static_key slub_lstat_key = STATIC_KEY_INIT_FALSE;
+
+static inline void lstat(const struct kmem_cache *s, enum lstat_item si)
+{
+	if (static_key_false(&slub_lstat_key) && s->lstat_enabled)
+		__this_cpu_inc(s->cpu_slab->lstat[si]);
+}
+
 /********************************************************************
  * 			Core slab cache functions
  *******************************************************************/
@@ -1971,6 +1982,7 @@ static void put_cpu_partial(struct kmem_cache *s, struct page *page, int drain)
 				 */
 				local_irq_save(flags);
 				unfreeze_partials(s, this_cpu_ptr(s->cpu_slab));
+				__this_cpu_inc(s->cpu_slab->partial_misses);
 				local_irq_restore(flags);
 				oldpage = NULL;
 				pobjects = 0;
@@ -2220,6 +2232,7 @@ static void *__slab_alloc(struct kmem_cache *s, gfp_t gfpflags, int node,
 	 */
 	c = this_cpu_ptr(s->cpu_slab);
 #endif
+	lstat(s, LSTAT_ALLOC_SLOWPATH);
 
 	page = c->page;
 	if (!page)
@@ -2285,6 +2298,7 @@ new_slab:
 		goto redo;
 	}
 
+	c->partial_misses++;
 	freelist = new_slab_objects(s, gfpflags, node, &c);
 
 	if (unlikely(!freelist)) {
@@ -2386,6 +2400,7 @@ redo:
 		}
 		prefetch_freepointer(s, next_object);
 		stat(s, ALLOC_FASTPATH);
+		lstat(s, LSTAT_ALLOC_FASTPATH);
 	}
 
 	if (unlikely(gfpflags & __GFP_ZERO) && object)
@@ -2477,6 +2492,7 @@ static void __slab_free(struct kmem_cache *s, struct page *page,
 	unsigned long uninitialized_var(flags);
 
 	stat(s, FREE_SLOWPATH);
+	lstat(s, LSTAT_FREE_SLOWPATH);
 
 	if (kmem_cache_debug(s) &&
 		!(n = free_debug_processing(s, page, x, addr, &flags)))
@@ -2619,6 +2635,7 @@ redo:
 			goto redo;
 		}
 		stat(s, FREE_FASTPATH);
+		lstat(s, LSTAT_FREE_FASTPATH);
 	} else
 		__slab_free(s, page, x, addr);
 
@@ -2663,6 +2680,20 @@ static int slub_min_objects;
  */
 static int slub_nomerge;
 
+/*
+ * Let cpu_partial grow, up to SLUB_CPU_PARTIAL_MAX_SCALE times its
+ * configured value, in caches that keep running out of per cpu partial
+ * slabs.  Checked every SLUB_AUTOTUNE_INTERVAL; a cache that missed more
+ * than SLUB_AUTOTUNE_MISSES times per cpu has its capacity doubled, one
+ * that missed less than a quarter of that decays back.  Reclaim puts all
+ * caches back to their configured capacity.
+ */
+#define SLUB_CPU_PARTIAL_MAX_SCALE	4
+#define SLUB_AUTOTUNE_INTERVAL		HZ
+#define SLUB_AUTOTUNE_MISSES		64
+
+static bool slub_autotune = true;
+
 /*
  * Calculate the order of allocation given an slab object size.
  *
@@ -3069,6 +3100,8 @@ static int kmem_cache_open(struct kmem_cache *s, unsigned long flags)
 		s->cpu_partial = 13;
 	else
 		s->cpu_partial = 30;
+	s->cpu_partial_base = s->cpu_partial;
+	s->cpu_partial_auto = slub_autotune;
 
 #ifdef CONFIG_NUMA
 	s->remote_node_defrag_ratio = 1000;
@@ -3162,6 +3195,9 @@ int __kmem_cache_shutdown(struct kmem_cache *s)
 	int rc = kmem_cache_close(s);
 
 	if (!rc) {
+		if (s->lstat_enabled)
+			static_key_slow_dec(&slub_lstat_key);
+
 		/*
 		 * We do the same lock strategy around sysfs_slab_add, see
 		 * __kmem_cache_create. Because this is pretty much the last
@@ -3218,6 +3254,14 @@ static int __init setup_slub_nomerge(char *str)
 
 __setup("slub_nomerge", setup_slub_nomerge);
 
+static int __init setup_slub_noautotune(char *str)
+{
+	slub_autotune = false;
+	return 1;
+}
+
+__setup("slub_noautotune", setup_slub_noautotune);
+
 void *__kmalloc(size_t size, gfp_t flags)
 {
 	struct kmem_cache *s;
@@ -3638,6 +3682,84 @@ void __init kmem_cache_init_late(void)
 {
 }
 
+static void slub_autotune_cache(struct kmem_cache *s)
+{
+	unsigned long misses = 0, delta, threshold;
+	int limit;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		misses += per_cpu_ptr(s->cpu_slab, cpu)->partial_misses;
+	delta = misses - s->partial_misses;
+	s->partial_misses = misses;
+
+	if (!s->cpu_partial_auto || !s->cpu_partial_base)
+		return;
+
+	threshold = SLUB_AUTOTUNE_MISSES * num_online_cpus();
+	limit = s->cpu_partial_base * SLUB_CPU_PARTIAL_MAX_SCALE;
+
+	if (delta > threshold)
+		s->cpu_partial = min(s->cpu_partial * 2, limit);
+	else if (delta < threshold / 4 && s->cpu_partial > s->cpu_partial_base)
+		s->cpu_partial = (s->cpu_partial + s->cpu_partial_base) / 2;
+}
+
+static void slub_autotune_fn(struct work_struct *work);
+static DECLARE_DEFERRABLE_WORK(slub_autotune_work, slub_autotune_fn);
+
+static void slub_autotune_fn(struct work_struct *work)
+{
+	struct kmem_cache *s;
+
+	mutex_lock(&slab_mutex);
+	list_for_each_entry(s, &slab_caches, list)
+		slub_autotune_cache(s);
+	mutex_unlock(&slab_mutex);
+
+	schedule_delayed_work(&slub_autotune_work, SLUB_AUTOTUNE_INTERVAL);
+}
+
+/*
+ * Reports the objects the grown per cpu partial lists may hold beyond
+ * their configured capacity, and gives that capacity up when asked to
+ * scan.  The surplus slabs go back to the node lists on the next drain.
+ */
+static int slub_autotune_shrink(struct shrinker *shrink,
+				struct shrink_control *sc)
+{
+	struct kmem_cache *s;
+	int surplus = 0;
+
+	if (!mutex_trylock(&slab_mutex))
+		return -1;
+
+	list_for_each_entry(s, &slab_caches, list) {
+		if (s->cpu_partial <= s->cpu_partial_base)
+			continue;
+		if (sc->nr_to_scan)
+			s->cpu_partial = s->cpu_partial_base;
+		else
+			surplus += s->cpu_partial - s->cpu_partial_base;
+	}
+	mutex_unlock(&slab_mutex);
+
+	return surplus * num_online_cpus();
+}
+
+static struct shrinker slub_autotune_shrinker = {
+	.shrink = slub_autotune_shrink,
+	.seeks = DEFAULT_SEEKS,
+};
+
+static int __init slub_autotune_init(void)
+{
+	register_shrinker(&slub_autotune_shrinker);
+	schedule_delayed_work(&slub_autotune_work, SLUB_AUTOTUNE_INTERVAL);
+	return 0;
+}
+device_initcall(slub_autotune_init);
+
 /*
  * Find a mergeable slab cache
  */
@@ -4460,11 +4582,88 @@ static ssize_t cpu_partial_store(struct kmem_cache *s, const char *buf,
 		return -EINVAL;
 
 	s->cpu_partial = objects;
+	s->cpu_partial_base = objects;
 	flush_all(s);
 	return length;
 }
 SLAB_ATTR(cpu_partial);
 
+static ssize_t cpu_partial_auto_show(struct kmem_cache *s, char *buf)
+{
+	return sprintf(buf, "%d\n", s->cpu_partial_auto);
+}
+
+static ssize_t cpu_partial_auto_store(struct kmem_cache *s, const char *buf,
+				      size_t length)
+{
+	if (buf[0] == '1') {
+		s->cpu_partial_auto = true;
+	} else if (buf[0] == '0') {
+		s->cpu_partial_auto = false;
+		s->cpu_partial = s->cpu_partial_base;
+	} else {
+		return -EINVAL;
+	}
+	return length;
+}
+SLAB_ATTR(cpu_partial_auto);
+
+static ssize_t path_stats_show(struct kmem_cache *s, char *buf)
+{
+	unsigned long sum[NR_SLUB_LSTAT_ITEMS] = { 0 };
+	int cpu, i;
+
+	for_each_online_cpu(cpu) {
+		struct kmem_cache_cpu *c = per_cpu_ptr(s->cpu_slab, cpu);
+
+		for (i = 0; i < NR_SLUB_LSTAT_ITEMS; i++)
+			sum[i] += c->lstat[i];
+	}
+
+	return sprintf(buf, "enabled %d\n"
+		       "alloc_fastpath %lu\n"
+		       "alloc_slowpath %lu\n"
+		       "free_fastpath %lu\n"
+		       "free_slowpath %lu\n",
+		       s->lstat_enabled,
+		       sum[LSTAT_ALLOC_FASTPATH], sum[LSTAT_ALLOC_SLOWPATH],
+		       sum[LSTAT_FREE_FASTPATH], sum[LSTAT_FREE_SLOWPATH]);
+}
+
+/* Not slab_mutex, stores are propagated to memcg caches under it */
+static DEFINE_MUTEX(slub_lstat_mutex);
+
+static ssize_t path_stats_store(struct kmem_cache *s, const char *buf,
+				size_t length)
+{
+	bool enable;
+	int cpu;
+
+	if (buf[0] == '1')
+		enable = true;
+	else if (buf[0] == '0')
+		enable = false;
+	else
+		return -EINVAL;
+
+	mutex_lock(&slub_lstat_mutex);
+	if (enable && !s->lstat_enabled) {
+		/* start from zero every time counting is switched on */
+		for_each_online_cpu(cpu)
+			memset(per_cpu_ptr(s->cpu_slab, cpu)->lstat, 0,
+			       sizeof(per_cpu_ptr(s->cpu_slab, cpu)->lstat));
+		s->lstat_enabled = true;
+		static_key_slow_inc(&slub_lstat_key);
+	} else if (!enable && s->lstat_enabled) {
+		s->lstat_enabled = false;
+		static_key_slow_dec(&slub_lstat_key);
+	}
+	mutex_unlock(&slub_lstat_mutex);
+
+	return length;
+}
+SLAB_ATTR(path_stats);
+
 static ssize_t ctor_show(struct kmem_cache *s, char *buf)
 {
 	if (!s->ctor)
@@ -4869,6 +5068,8 @@ static struct attribute *slab_attrs[] = {
 	&order_attr.attr,
 	&min_partial_attr.attr,
 	&cpu_partial_attr.attr,
+	&cpu_partial_auto_attr.attr,
+	&path_stats_attr.attr,
 	&objects_attr.attr,
 	&objects_partial_attr.attr,
 	&partial_attr.attr,
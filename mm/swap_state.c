@@ -18,6 +18,7 @@
 #include <linux/pagevec.h>
 #include <linux/migrate.h>
 #include <linux/page_cgroup.h>
+#include <linux/pfn.h>
 
 #include <asm/pgtable.h>
 
@@ -46,6 +47,36 @@ struct address_space swapper_spaces[MAX_SWAPFILES] = {
 
 #define INC_CACHE_INFO(x)	do { swap_cache_info.x++; } while (0)
 
+/*
+ * Swap readahead mode: 0 reads an aligned cluster of swap slots around the
+ * faulting entry, 1 reads the swap entries found in the page table around
+ * the faulting address, with a window that adapts to the hit ratio.  Swap
+ * slots are allocated in reclaim order, so on devices without seek cost
+ * (zram) the virtual neighbours are far better candidates.
+ */
+int swap_vma_readahead __read_mostly = 1;
+
+/*
+ * vma->swap_readahead_info packs the last faulting address, the current
+ * window and the readahead hits seen since that fault.
+ */
+#define SWAP_RA_WIN_SHIFT	(PAGE_SHIFT / 2)
+#define SWAP_RA_HITS_MASK	((1UL << SWAP_RA_WIN_SHIFT) - 1)
+#define SWAP_RA_HITS_MAX	SWAP_RA_HITS_MASK
+#define SWAP_RA_WIN_MASK	(~PAGE_MASK & ~SWAP_RA_HITS_MASK)
+
+#define SWAP_RA_HITS(v)		((v) & SWAP_RA_HITS_MASK)
+#define SWAP_RA_WIN(v)		(((v) & SWAP_RA_WIN_MASK) >> SWAP_RA_WIN_SHIFT)
+#define SWAP_RA_ADDR(v)		((v) & PAGE_MASK)
+
+#define SWAP_RA_VAL(addr, win, hits)				\
+	(((addr) & PAGE_MASK) |					\
+	 (((win) << SWAP_RA_WIN_SHIFT) & SWAP_RA_WIN_MASK) |	\
+	 ((hits) & SWAP_RA_HITS_MASK))
+
+/* Upper bound of the VMA readahead window, in pages */
+#define SWAP_RA_ORDER_CEILING	5
+
 static struct {
 	unsigned long add_total;
 	unsigned long del_total;
@@ -138,6 +169,7 @@ void __delete_from_swap_cache(struct page *page)
 {
 	swp_entry_t entry;
 	struct address_space *address_space;
+	bool vma_ra;
 
 	VM_BUG_ON(!PageLocked(page));
 	VM_BUG_ON(!PageSwapCache(page));
@@ -151,16 +183,58 @@ void __delete_from_swap_cache(struct page *page)
 	address_space->nrpages--;
 	__dec_zone_page_state(page, NR_FILE_PAGES);
 	INC_CACHE_INFO(del_total);
+
+	/* read ahead but never looked up, count it against its mode */
+	vma_ra = TestClearPageVmaReadahead(page);
+	if (TestClearPageReadahead(page))
+		__count_vm_event(vma_ra ? SWAP_RA_VMA_MISS :
+					  SWAP_RA_CLUSTER_MISS);
+}
+
+/*
+ * Hand out the next slot of @batch, refilling it with as many slots as
+ * the batch still expects pages for.
+ */
+static swp_entry_t swap_slot_batch_get(struct swap_slot_batch *batch)
+{
+	if (!batch)
+		return get_swap_page();
+
+	if (batch->cur == batch->nr) {
+		batch->cur = 0;
+		batch->nr = get_swap_pages(clamp_t(int, batch->want, 1,
+						   SWAP_CLUSTER_MAX),
+					   batch->entries);
+		if (!batch->nr)
+			return (swp_entry_t) {0};
+	}
+	if (batch->want > 0)
+		batch->want--;
+	return batch->entries[batch->cur++];
+}
+
+/**
+ * swap_slot_batch_release - give back the slots a batch did not use
+ * @batch: the batch
+ */
+void swap_slot_batch_release(struct swap_slot_batch *batch)
+{
+	while (batch->cur < batch->nr)
+		swapcache_free(batch->entries[batch->cur++], NULL);
+	batch->cur = batch->nr = 0;
 }
 
 /**
  * add_to_swap - allocate swap space for a page
  * @page: page we want to move to swap
+ * @list: where to put the tail pages if @page is a huge page
+ * @batch: slots allocated ahead for this page's reclaim batch, or NULL
  *
  * Allocate swap space for the page and add the page to the
  * swap cache.  Caller needs to hold the page lock. 
  */
-int add_to_swap(struct page *page, struct list_head *list)
+int add_to_swap(struct page *page, struct list_head *list,
+		struct swap_slot_batch *batch)
 {
 	swp_entry_t entry;
 	int err;
@@ -168,7 +242,7 @@ int add_to_swap(struct page *page, struct list_head *list)
 	VM_BUG_ON(!PageLocked(page));
 	VM_BUG_ON(!PageUptodate(page));
 
-	entry = get_swap_page();
+	entry = swap_slot_batch_get(batch);
 	if (!entry.val)
 		return 0;
 
@@ -279,32 +353,56 @@ void free_pages_and_swap_cache(struct page **pages, int nr)
  * unlocked and with its refcount incremented - we rely on the kernel
  * lock getting page table operations atomic even if we drop the page
  * lock before returning.
+ *
+ * @vma and @addr, when given, identify the fault the lookup is done for;
+ * a hit on a page brought in by VMA readahead widens that VMA's window.
  */
-struct page * lookup_swap_cache(swp_entry_t entry)
+struct page *lookup_swap_cache(swp_entry_t entry, struct vm_area_struct *vma,
+			       unsigned long addr)
 {
 	struct page *page;
+	unsigned long ra_val;
+	unsigned int hits;
+	bool vma_ra;
 
 	page = find_get_page(swap_address_space(entry), entry.val);
 
-	if (page)
+	if (page) {
 		INC_CACHE_INFO(find_success);
+		vma_ra = TestClearPageVmaReadahead(page);
+		if (TestClearPageReadahead(page)) {
+			count_vm_event(vma_ra ? SWAP_RA_VMA_HIT :
+						SWAP_RA_CLUSTER_HIT);
+			if (vma_ra && vma) {
+				ra_val = atomic_long_read(&vma->swap_readahead_info);
+				hits = SWAP_RA_HITS(ra_val);
+				if (hits < SWAP_RA_HITS_MAX)
+					hits++;
+				atomic_long_set(&vma->swap_readahead_info,
+					SWAP_RA_VAL(addr, SWAP_RA_WIN(ra_val), hits));
+			}
+		}
+	}
 
 	INC_CACHE_INFO(find_total);
 	return page;
 }
 
-/* 
+/*
  * Locate a page of swap in physical memory, reserving swap cache space
- * and reading the disk if it is not already cached.
- * A failure return means that either the page allocation failed or that
- * the swap entry is no longer in use.
+ * if it is not already cached.  *@new_page_allocated tells whether the
+ * returned page was newly added to the swap cache, in which case it is
+ * locked and the caller must read it in with swap_readpage().
  */
-struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
-			struct vm_area_struct *vma, unsigned long addr)
+static struct page *__read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr,
+			bool *new_page_allocated)
 {
 	struct page *found_page, *new_page = NULL;
 	int err;
 
+	*new_page_allocated = false;
+
 	do {
 		/*
 		 * First check the swap cache.  Since this is normally
@@ -367,11 +465,8 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 		err = __add_to_swap_cache(new_page, entry);
 		if (likely(!err)) {
 			radix_tree_preload_end();
-			/*
-			 * Initiate read into locked page and return.
-			 */
 			lru_cache_add_anon(new_page);
-			swap_readpage(new_page);
+			*new_page_allocated = true;
 			return new_page;
 		}
 		radix_tree_preload_end();
@@ -389,6 +484,57 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 	return found_page;
 }
 
+/* 
+ * Locate a page of swap in physical memory, reserving swap cache space
+ * and reading the disk if it is not already cached.
+ * A failure return means that either the page allocation failed or that
+ * the swap entry is no longer in use.
+ */
+struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr)
+{
+	bool page_was_allocated;
+	struct page *page;
+
+	page = __read_swap_cache_async(entry, gfp_mask, vma, addr,
+				       &page_was_allocated);
+	/*
+	 * Initiate read into locked page and return.
+	 */
+	if (page_was_allocated)
+		swap_readpage(page);
+	return page;
+}
+
+/*
+ * Read one entry of a readahead window.  Pages other than the one being
+ * faulted in are tagged PG_readahead, so that lookup_swap_cache() and
+ * __delete_from_swap_cache() can tell whether reading them paid off, and
+ * PG_vma_readahead records which readahead mode to account that to.
+ */
+static void swap_ra_read_page(swp_entry_t entry, swp_entry_t fentry,
+			      gfp_t gfp_mask, struct vm_area_struct *vma,
+			      unsigned long addr, enum vm_event_item item)
+{
+	bool page_was_allocated;
+	struct page *page;
+
+	page = __read_swap_cache_async(entry, gfp_mask, vma, addr,
+				       &page_was_allocated);
+	if (!page)
+		return;
+	if (page_was_allocated) {
+		if (entry.val != fentry.val) {
+			if (item == SWAP_RA_VMA)
+				SetPageVmaReadahead(page);
+			SetPageReadahead(page);
+			count_vm_event(item);
+		}
+		swap_readpage(page);
+	}
+	page_cache_release(page);
+}
+
 /**
  * swapin_readahead - swap in pages in hope we need them soon
  * @entry: swap entry of this memory
@@ -411,7 +557,6 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
 			struct vm_area_struct *vma, unsigned long addr)
 {
-	struct page *page;
 	unsigned long offset = swp_offset(entry);
 	unsigned long start_offset, end_offset;
 	unsigned long mask = (1UL << page_cluster) - 1;
@@ -426,14 +571,137 @@ struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
 	blk_start_plug(&plug);
 	for (offset = start_offset; offset <= end_offset ; offset++) {
 		/* Ok, do the async read-ahead now */
-		page = read_swap_cache_async(swp_entry(swp_type(entry), offset),
-						gfp_mask, vma, addr);
-		if (!page)
+		swap_ra_read_page(swp_entry(swp_type(entry), offset), entry,
+				  gfp_mask, vma, addr, SWAP_RA_CLUSTER);
+	}
+	blk_finish_plug(&plug);
+
+	lru_add_drain();	/* Push any new pages onto the LRU now */
+	return read_swap_cache_async(entry, gfp_mask, vma, addr);
+}
+
+/*
+ * Size the next VMA readahead window.  Without hits since the previous
+ * fault only a sequential access keeps a minimal window open; otherwise
+ * the window follows the number of hits.  It never shrinks by more than
+ * half at a time, nor grows beyond @max_win.
+ */
+static unsigned int swap_ra_window(unsigned long prev_pfn, unsigned long pfn,
+				   unsigned int hits, unsigned int max_win,
+				   unsigned int prev_win)
+{
+	unsigned int win, roundup = 4;
+
+	win = hits + 2;
+	if (win == 2) {
+		if (pfn != prev_pfn + 1 && pfn != prev_pfn - 1)
+			win = 1;
+	} else {
+		while (roundup < win)
+			roundup <<= 1;
+		win = roundup;
+	}
+
+	if (win < prev_win / 2)
+		win = prev_win / 2;
+	if (win > max_win)
+		win = max_win;
+
+	return win;
+}
+
+/**
+ * swapin_vma_readahead - swap in the page table neighbours of a fault
+ * @entry: swap entry of this memory
+ * @gfp_mask: memory allocation flags
+ * @vma: user vma the faulting address belongs to
+ * @addr: faulting address
+ *
+ * Returns the struct page for entry and addr, after queueing swapin of
+ * the swap entries found in the ptes around @addr.  The window stays
+ * within @vma and the page table of @addr, grows with the readahead hits
+ * recorded by lookup_swap_cache() and follows the direction of sequential
+ * faults.  Falls back to swapin_readahead() in cluster mode.
+ *
+ * Caller must hold down_read on the vma->vm_mm.
+ */
+struct page *swapin_vma_readahead(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr)
+{
+	pte_t ptes[1 << SWAP_RA_ORDER_CEILING], *pte;
+	unsigned long ra_val, pfn, prev_pfn, start, end, lo, hi;
+	unsigned int max_win, win, prev_win, hits, i;
+	struct blk_plug plug;
+	swp_entry_t swap;
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+
+	if (!swap_vma_readahead)
+		return swapin_readahead(entry, gfp_mask, vma, addr);
+
+	max_win = 1 << min_t(unsigned int, ACCESS_ONCE(page_cluster),
+			     SWAP_RA_ORDER_CEILING);
+	if (max_win == 1)
+		goto skip;
+
+	pfn = PFN_DOWN(addr);
+	ra_val = atomic_long_read(&vma->swap_readahead_info);
+	prev_pfn = PFN_DOWN(SWAP_RA_ADDR(ra_val));
+	prev_win = SWAP_RA_WIN(ra_val);
+	hits = SWAP_RA_HITS(ra_val);
+	win = swap_ra_window(prev_pfn, pfn, hits, max_win, prev_win);
+	atomic_long_set(&vma->swap_readahead_info, SWAP_RA_VAL(addr, win, 0));
+
+	if (win == 1)
+		goto skip;
+
+	/* forward, backward or centered on the fault */
+	if (pfn == prev_pfn + 1) {
+		start = pfn;
+		end = pfn + win;
+	} else if (pfn == prev_pfn - 1) {
+		start = pfn + 1 > win ? pfn + 1 - win : 0;
+		end = pfn + 1;
+	} else {
+		start = pfn > (win - 1) / 2 ? pfn - (win - 1) / 2 : 0;
+		end = start + win;
+	}
+
+	lo = max(PFN_DOWN(vma->vm_start), PFN_DOWN(addr & PMD_MASK));
+	hi = min(PFN_DOWN(vma->vm_end), PFN_DOWN(addr & PMD_MASK) + PTRS_PER_PTE);
+	start = clamp(start, lo, hi);
+	end = clamp(end, lo, hi);
+
+	pgd = pgd_offset(vma->vm_mm, addr);
+	if (pgd_none_or_clear_bad(pgd))
+		goto skip;
+	pud = pud_offset(pgd, addr);
+	if (pud_none_or_clear_bad(pud))
+		goto skip;
+	pmd = pmd_offset(pud, addr);
+	if (pmd_none_or_trans_huge_or_clear_bad(pmd))
+		goto skip;
+
+	/* swapcache_prepare() revalidates every entry, no need for the ptl */
+	pte = pte_offset_map(pmd, start << PAGE_SHIFT);
+	for (i = 0; i < end - start; i++)
+		ptes[i] = pte[i];
+	pte_unmap(pte);
+
+	blk_start_plug(&plug);
+	for (i = 0; i < end - start; i++) {
+		if (!is_swap_pte(ptes[i]))
 			continue;
-		page_cache_release(page);
+		swap = pte_to_swp_entry(ptes[i]);
+		if (unlikely(non_swap_entry(swap)))
+			continue;
+		swap_ra_read_page(swap, entry, gfp_mask, vma,
+				  (start + i) << PAGE_SHIFT, SWAP_RA_VMA);
 	}
 	blk_finish_plug(&plug);
 
 	lru_add_drain();	/* Push any new pages onto the LRU now */
+skip:
 	return read_swap_cache_async(entry, gfp_mask, vma, addr);
 }
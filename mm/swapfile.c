@@ -413,18 +413,27 @@ no_page:
 	return 0;
 }
 
-swp_entry_t get_swap_page(void)
+/*
+ * Allocate up to @n swap slots for the swap cache, all from the same swap
+ * device and taking the swap locks only once, so that a reclaim batch gets
+ * consecutive slots.  Returns the number of entries stored in @entries.
+ */
+int get_swap_pages(int n, swp_entry_t entries[])
 {
 	struct swap_info_struct *si;
 	pgoff_t offset;
 	int type, next;
 	int wrapped = 0;
 	int hp_index;
+	long avail;
+	int nr = 0;
 
 	spin_lock(&swap_lock);
-	if (atomic_long_read(&nr_swap_pages) <= 0)
+	avail = atomic_long_read(&nr_swap_pages);
+	if (avail <= 0)
 		goto noswap;
-	atomic_long_dec(&nr_swap_pages);
+	n = min_t(long, n, avail);
+	atomic_long_sub(n, &nr_swap_pages);
 
 	for (type = swap_list.next; type >= 0 && wrapped < 2; type = next) {
 		hp_index = atomic_xchg(&highest_priority_index, -1);
@@ -469,17 +478,34 @@ swp_entry_t get_swap_page(void)
 
 		spin_unlock(&swap_lock);
 		/* This is called for allocating swap entry for cache */
-		offset = scan_swap_map(si, SWAP_HAS_CACHE);
+		while (nr < n) {
+			offset = scan_swap_map(si, SWAP_HAS_CACHE);
+			if (!offset)
+				break;
+			entries[nr++] = swp_entry(type, offset);
+		}
 		spin_unlock(&si->lock);
-		if (offset)
-			return swp_entry(type, offset);
+		if (nr) {
+			if (nr < n)
+				atomic_long_add(n - nr, &nr_swap_pages);
+			return nr;
+		}
 		spin_lock(&swap_lock);
 		next = swap_list.next;
 	}
 
-	atomic_long_inc(&nr_swap_pages);
+	atomic_long_add(n, &nr_swap_pages);
 noswap:
 	spin_unlock(&swap_lock);
+	return 0;
+}
+
+swp_entry_t get_swap_page(void)
+{
+	swp_entry_t entry;
+
+	if (get_swap_pages(1, &entry))
+		return entry;
 	return (swp_entry_t) {0};
 }
 
@@ -148,6 +148,8 @@ static bool vmpressure_event(struct vmpressure *vmpr,
 	bool signalled = false;
 
 	level = vmpressure_calc_level(scanned, reclaimed);
+	vmpr->level = level;
+	vmpr->level_stamp = jiffies;
 
 	mutex_lock(&vmpr->events_lock);
 
@@ -251,6 +253,26 @@ void vmpressure(gfp_t gfp, struct mem_cgroup *memcg,
 	schedule_work(&vmpr->work);
 }
 
+/**
+ * vmpressure_under_pressure() - Check for recent global memory pressure
+ *
+ * Returns true if the pressure level last computed for the root cgroup,
+ * less than a second ago, was medium or critical.  Background work that
+ * only trades CPU time and memory bandwidth for future allocation latency,
+ * like proactive compaction, should back off then.
+ */
+bool vmpressure_under_pressure(void)
+{
+	struct vmpressure *vmpr;
+
+	if (mem_cgroup_disabled())
+		return false;
+
+	vmpr = memcg_to_vmpressure(NULL);
+	return vmpr->level >= VMPRESSURE_MEDIUM &&
+	       time_before(jiffies, vmpr->level_stamp + HZ);
+}
+
 /**
  * vmpressure_prio() - Account memory pressure through reclaimer priority level
  * @gfp:	reclaimer's gfp mask
@@ -44,6 +44,9 @@
 #include <linux/oom.h>
 #include <linux/prefetch.h>
 #include <linux/debugfs.h>
+#include <linux/hugetlb.h>
+#include <linux/pagevec.h>
+#include <linux/slab.h>
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
@@ -83,6 +86,12 @@ struct scan_control {
 	/* Scan (total_size >> priority) pages at once */
 	int priority;
 
+	/* Groups below their low limit were skipped */
+	int memcg_low_skipped;
+
+	/* Reclaim groups below their low limit too */
+	int may_thrash;
+
 	/*
 	 * The memory cgroup that hit its limit and as a result is the
 	 * primary target of this reclaim invocation.
@@ -419,7 +428,8 @@ typedef enum {
  * Calls ->writepage().
  */
 static pageout_t pageout(struct page *page, struct address_space *mapping,
-			 struct scan_control *sc)
+			 struct scan_control *sc,
+			 struct swap_write_batch *swap_batch)
 {
 	/*
 	 * If the page is dirty, only perform writeback if that write
@@ -469,7 +479,10 @@ static pageout_t pageout(struct page *page, struct address_space *mapping,
 		};
 
 		SetPageReclaim(page);
-		res = mapping->a_ops->writepage(page, &wbc);
+		if (PageSwapCache(page))
+			res = swap_writepage_batch(page, &wbc, swap_batch);
+		else
+			res = mapping->a_ops->writepage(page, &wbc);
 		if (res < 0)
 			handle_write_error(mapping, page, res);
 		if (res == AOP_WRITEPAGE_ACTIVATE) {
@@ -493,7 +506,8 @@ static pageout_t pageout(struct page *page, struct address_space *mapping,
  * Same as remove_mapping, but if the page is removed from the mapping, it
  * gets returned with a refcount of 0.
  */
-static int __remove_mapping(struct address_space *mapping, struct page *page)
+static int __remove_mapping(struct address_space *mapping, struct page *page,
+			    bool reclaimed)
 {
 	BUG_ON(!PageLocked(page));
 	BUG_ON(mapping != page_mapping(page));
@@ -539,10 +553,23 @@ static int __remove_mapping(struct address_space *mapping, struct page *page)
 		swapcache_free(swap, page);
 	} else {
 		void (*freepage)(struct page *);
+		void *shadow = NULL;
 
 		freepage = mapping->a_ops->freepage;
-
-		__delete_from_page_cache(page);
+		/*
+		 * Remember a shadow entry for reclaimed file cache in
+		 * order to detect refaults, thus thrashing, later on.
+		 *
+		 * But don't store shadows in an address space that is
+		 * already exiting.  This is not just an optimization,
+		 * inode reclaim needs to empty out the radix tree or
+		 * the nodes are lost.  Don't plant shadows behind its
+		 * back.
+		 */
+		if (reclaimed && page_is_file_cache(page) &&
+		    !mapping_exiting(mapping))
+			shadow = workingset_eviction(mapping, page);
+		__delete_from_page_cache(page, shadow);
 		spin_unlock_irq(&mapping->tree_lock);
 		mem_cgroup_uncharge_cache_page(page);
 
@@ -565,7 +592,7 @@ cannot_free:
  */
 int remove_mapping(struct address_space *mapping, struct page *page)
 {
-	if (__remove_mapping(mapping, page)) {
+	if (__remove_mapping(mapping, page, false)) {
 		/*
 		 * Unfreezing the refcount with 1 rather than 2 effectively
 		 * drops the pagecache ref for us without requiring another
@@ -715,6 +742,45 @@ static enum page_references page_check_references(struct page *page,
 /*
  * shrink_page_list() returns the number of reclaimed pages
  */
+/*
+ * Swap cache pages whose write was batched by shrink_page_list() could
+ * not be freed right after pageout() even if the swap device completes
+ * writes synchronously (zram).  Now that the batch has been submitted,
+ * free those whose write is done; the rest goes back with @ret_pages.
+ */
+static unsigned long shrink_swap_pending(struct list_head *pending,
+					 struct list_head *free_pages,
+					 struct list_head *ret_pages)
+{
+	unsigned long nr_reclaimed = 0;
+	struct address_space *mapping;
+	struct page *page, *next;
+
+	list_for_each_entry_safe(page, next, pending, lru) {
+		if (!trylock_page(page))
+			goto keep;
+		if (PageDirty(page) || PageWriteback(page) ||
+		    page_has_private(page))
+			goto keep_locked;
+		mapping = page_mapping(page);
+		if (!mapping || !__remove_mapping(mapping, page, true))
+			goto keep_locked;
+
+		__clear_page_locked(page);
+		nr_reclaimed++;
+		list_move(&page->lru, free_pages);
+		continue;
+
+keep_locked:
+		unlock_page(page);
+keep:
+		list_move(&page->lru, ret_pages);
+		VM_BUG_ON(PageLRU(page) || PageUnevictable(page));
+	}
+
+	return nr_reclaimed;
+}
+
 static unsigned long shrink_page_list(struct list_head *page_list,
 				      struct zone *zone,
 				      struct scan_control *sc,
@@ -725,6 +791,10 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 {
 	LIST_HEAD(ret_pages);
 	LIST_HEAD(free_pages);
+	LIST_HEAD(swap_pending);
+	struct swap_slot_batch swap_slots = { .nr = 0 };
+	struct swap_write_batch swap_batch = { .bio = NULL };
+	struct page *page;
 	int pgactivate = 0;
 	unsigned long nr_dirty = 0;
 	unsigned long nr_congested = 0;
@@ -733,10 +803,17 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 
 	cond_resched();
 
+	/*
+	 * Anonymous pages of the batch get their swap slots in one
+	 * allocation, and consecutive slots are written with one bio.
+	 */
+	list_for_each_entry(page, page_list, lru)
+		if (PageAnon(page) && !PageSwapCache(page))
+			swap_slots.want++;
+
 	mem_cgroup_uncharge_start();
 	while (!list_empty(page_list)) {
 		struct address_space *mapping;
-		struct page *page;
 		int may_enter_fs;
 		enum page_references references = PAGEREF_RECLAIM_CLEAN;
 
@@ -824,7 +901,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 		if (PageAnon(page) && !PageSwapCache(page)) {
 			if (!(sc->gfp_mask & __GFP_IO))
 				goto keep_locked;
-			if (!add_to_swap(page, page_list))
+			if (!add_to_swap(page, page_list, &swap_slots))
 				goto activate_locked;
 			may_enter_fs = 1;
 		}
@@ -879,13 +956,17 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 				goto keep_locked;
 
 			/* Page is dirty, try to write it out here */
-			switch (pageout(page, mapping, sc)) {
+			switch (pageout(page, mapping, sc, &swap_batch)) {
 			case PAGE_KEEP:
 				nr_congested++;
 				goto keep_locked;
 			case PAGE_ACTIVATE:
 				goto activate_locked;
 			case PAGE_SUCCESS:
+				if (PageWriteback(page) && PageSwapCache(page)) {
+					list_add(&page->lru, &swap_pending);
+					continue;
+				}
 				if (PageWriteback(page))
 					goto keep;
 				if (PageDirty(page))
@@ -947,7 +1028,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			}
 		}
 
-		if (!mapping || !__remove_mapping(mapping, page))
+		if (!mapping || !__remove_mapping(mapping, page, true))
 			goto keep_locked;
 
 		/*
@@ -989,6 +1070,11 @@ keep:
 		VM_BUG_ON(PageLRU(page) || PageUnevictable(page));
 	}
 
+	swap_write_batch_flush(&swap_batch);
+	swap_slot_batch_release(&swap_slots);
+	nr_reclaimed += shrink_swap_pending(&swap_pending, &free_pages,
+					    &ret_pages);
+
 	/*
 	 * Tag a zone as congested if all the dirty pages encountered were
 	 * backed by a congested BDI. In this case, reclaimers should just
@@ -1212,7 +1298,7 @@ int isolate_lru_page(struct page *page)
 			int lru = page_lru(page);
 			get_page(page);
 			ClearPageLRU(page);
-			del_page_from_lru_list(page, lruvec, lru);
+			isolate_page_from_lru_list(page, lruvec, lru);
 			ret = 0;
 		}
 		spin_unlock_irq(&zone->lru_lock);
@@ -1859,10 +1945,481 @@ out:
 	}
 }
 
+#ifdef CONFIG_LRU_GEN
 /*
- * This is a basic per-zone page freer.  Used by both kswapd and direct reclaim.
+ * Multi-generational LRU
+ *
+ * Evictable pages are kept in up to MAX_NR_GENS generations per lruvec
+ * and type instead of on the active and inactive lists.  Reclaim evicts
+ * from the oldest generation of whichever type, anon or file, holds the
+ * older one; there is no active list to deactivate and no rotation on a
+ * single reference sample.
+ *
+ * A new generation is started (aging) when a type is down to
+ * MIN_NR_GENS.  Aging walks the page tables of all processes, clears the
+ * accessed bits it finds and moves the pages behind them to the youngest
+ * generation, so that everything left behind in older generations has
+ * not been referenced since.  Pages referenced through mappings the walk
+ * did not reach are still caught by page_referenced() in
+ * shrink_page_list() and go back to the youngest generation from there.
  */
-static void shrink_lruvec(struct lruvec *lruvec, struct scan_control *sc)
+
+/* minimum interval between two page table walks */
+#define LRU_GEN_WALK_INTERVAL	(HZ / 10)
+
+static DEFINE_MUTEX(lru_gen_walk_mutex);
+static unsigned long lru_gen_last_walk;
+
+struct lru_gen_walk {
+	struct vm_area_struct *vma;
+	unsigned long nr_young;
+	int nr;
+	struct page *pages[PAGEVEC_SIZE];
+};
+
+static int lru_gen_nr_gens(struct lru_gen *lrugen, int type)
+{
+	return lrugen->max_seq - lrugen->min_seq[type] + 1;
+}
+
+static unsigned long lru_gen_type_size(struct lruvec *lruvec, int type)
+{
+	enum lru_list lru = type ? LRU_INACTIVE_FILE : LRU_INACTIVE_ANON;
+
+	return get_lru_size(lruvec, lru) +
+	       get_lru_size(lruvec, lru + LRU_ACTIVE);
+}
+
+/*
+ * Retire the oldest generation of @type.  Pages still on it are moved,
+ * in order, to the tail of the next one so that they are evicted first.
+ */
+static void lru_gen_inc_min_seq(struct lruvec *lruvec, int type)
+{
+	struct lru_gen *lrugen = &lruvec->lrugen;
+	int gen = lru_gen_from_seq(lrugen->min_seq[type]);
+	int next = lru_gen_from_seq(lrugen->min_seq[type] + 1);
+	struct list_head *list = &lrugen->lists[gen][type];
+
+	VM_BUG_ON(lru_gen_nr_gens(lrugen, type) <= MIN_NR_GENS);
+
+	while (!list_empty(list)) {
+		struct page *page = list_entry(list->next, struct page, lru);
+
+		lru_gen_move_page(lruvec, page, next, true);
+	}
+
+	lrugen->min_seq[type]++;
+}
+
+static void lru_gen_inc_max_seq(struct lruvec *lruvec)
+{
+	struct lru_gen *lrugen = &lruvec->lrugen;
+	int prev = lru_gen_from_seq(lrugen->max_seq - 1);
+	int type;
+
+	for (type = 0; type < 2; type++) {
+		enum lru_list lru = type ? LRU_INACTIVE_FILE :
+					   LRU_INACTIVE_ANON;
+		long nr_pages;
+
+		/* make room for the new generation */
+		if (lru_gen_nr_gens(lrugen, type) >= MAX_NR_GENS)
+			lru_gen_inc_min_seq(lruvec, type);
+
+		/* the second youngest generation turns inactive */
+		nr_pages = lrugen->nr_pages[prev][type];
+		if (nr_pages) {
+			update_lru_size(lruvec, lru + LRU_ACTIVE, -nr_pages);
+			update_lru_size(lruvec, lru, nr_pages);
+		}
+	}
+
+	lrugen->max_seq++;
+	VM_BUG_ON(lrugen->nr_pages[lru_gen_from_seq(lrugen->max_seq)][0] ||
+		  lrugen->nr_pages[lru_gen_from_seq(lrugen->max_seq)][1]);
+}
+
+/* move the young pages batched by the walk to their youngest generation */
+static void lru_gen_promote_pages(struct lru_gen_walk *walk)
+{
+	struct zone *zone = NULL;
+	int i;
+
+	for (i = 0; i < walk->nr; i++) {
+		struct page *page = walk->pages[i];
+		struct zone *pagezone = page_zone(page);
+		struct lruvec *lruvec;
+		int gen;
+
+		if (pagezone != zone) {
+			if (zone)
+				spin_unlock_irq(&zone->lru_lock);
+			zone = pagezone;
+			spin_lock_irq(&zone->lru_lock);
+		}
+
+		if (!PageLRU(page) || page_lru_gen(page) < 0)
+			continue;
+
+		lruvec = mem_cgroup_page_lruvec(page, zone);
+		gen = lru_gen_from_seq(lruvec->lrugen.max_seq);
+		if (page_lru_gen(page) != gen)
+			lru_gen_move_page(lruvec, page, gen, false);
+	}
+	if (zone)
+		spin_unlock_irq(&zone->lru_lock);
+
+	walk->nr = 0;
+}
+
+static int lru_gen_walk_pmd(pmd_t *pmd, unsigned long addr,
+			    unsigned long end, struct mm_walk *mm_walk)
+{
+	struct lru_gen_walk *walk = mm_walk->private;
+	struct vm_area_struct *vma = walk->vma;
+	pte_t *pte, ptent;
+	spinlock_t *ptl;
+	struct page *page;
+
+	if (pmd_trans_unstable(pmd))
+		return 0;
+
+	/* the page table lock nests outside lru_lock, as in mlock_vma_page() */
+	pte = pte_offset_map_lock(vma->vm_mm, pmd, addr, &ptl);
+	for (; addr != end; pte++, addr += PAGE_SIZE) {
+		ptent = *pte;
+		if (!pte_present(ptent) || !pte_young(ptent))
+			continue;
+
+		page = vm_normal_page(vma, addr, ptent);
+		if (!page || !PageLRU(page))
+			continue;
+
+		if (!ptep_test_and_clear_young(vma, addr, pte))
+			continue;
+
+		walk->nr_young++;
+		walk->pages[walk->nr++] = page;
+		if (walk->nr == ARRAY_SIZE(walk->pages))
+			lru_gen_promote_pages(walk);
+	}
+	if (walk->nr)
+		lru_gen_promote_pages(walk);
+	pte_unmap_unlock(pte - 1, ptl);
+	cond_resched();
+	return 0;
+}
+
+static void lru_gen_walk_mm(struct mm_struct *mm, struct lru_gen_walk *walk)
+{
+	struct mm_walk mm_walk = {
+		.pmd_entry = lru_gen_walk_pmd,
+		.mm = mm,
+		.private = walk,
+	};
+	struct vm_area_struct *vma;
+
+	if (!down_read_trylock(&mm->mmap_sem))
+		return;
+
+	walk->nr_young = 0;
+	for (vma = mm->mmap; vma; vma = vma->vm_next) {
+		if (vma->vm_flags & (VM_IO | VM_PFNMAP | VM_LOCKED))
+			continue;
+		if (is_vm_hugetlb_page(vma))
+			continue;
+		walk->vma = vma;
+		walk_page_range(vma->vm_start, vma->vm_end, &mm_walk);
+	}
+	if (walk->nr_young)
+		flush_tlb_mm(mm);
+
+	up_read(&mm->mmap_sem);
+}
+
+/*
+ * Walk the page tables of every process.  Only one walk runs at a time
+ * and at most one per LRU_GEN_WALK_INTERVAL; aging simply goes without
+ * otherwise.
+ */
+static void lru_gen_walk_mms(void)
+{
+	struct lru_gen_walk walk = { .nr = 0 };
+	struct mm_struct **mms;
+	struct task_struct *p;
+	int nr_mms = 0, max_mms, i;
+
+	if (time_before(jiffies, lru_gen_last_walk + LRU_GEN_WALK_INTERVAL))
+		return;
+	if (!mutex_trylock(&lru_gen_walk_mutex))
+		return;
+	lru_gen_last_walk = jiffies;
+
+	max_mms = nr_processes();
+	mms = kmalloc(max_mms * sizeof(*mms), GFP_NOWAIT | __GFP_NOWARN);
+	if (!mms)
+		goto out;
+
+	rcu_read_lock();
+	for_each_process(p) {
+		struct mm_struct *mm;
+
+		if (nr_mms == max_mms)
+			break;
+		mm = get_task_mm(p);
+		if (mm)
+			mms[nr_mms++] = mm;
+	}
+	rcu_read_unlock();
+
+	for (i = 0; i < nr_mms; i++) {
+		lru_gen_walk_mm(mms[i], &walk);
+		mmput(mms[i]);
+	}
+	kfree(mms);
+out:
+	mutex_unlock(&lru_gen_walk_mutex);
+}
+
+static void lru_gen_age(struct lruvec *lruvec, struct scan_control *sc)
+{
+	struct zone *zone = lruvec_zone(lruvec);
+
+	/* mmput() may have to tear down an address space */
+	if (current_is_kswapd() ||
+	    (sc->gfp_mask & GFP_IOFS) == GFP_IOFS)
+		lru_gen_walk_mms();
+
+	spin_lock_irq(&zone->lru_lock);
+	if (lru_gen_nr_gens(&lruvec->lrugen, 0) <= MIN_NR_GENS ||
+	    lru_gen_nr_gens(&lruvec->lrugen, 1) <= MIN_NR_GENS)
+		lru_gen_inc_max_seq(lruvec);
+	spin_unlock_irq(&zone->lru_lock);
+}
+
+/*
+ * Get the oldest generation of @type ready for eviction: drop empty
+ * generations off the old end, and age once only the two youngest, the
+ * active ones, are left.
+ */
+static void lru_gen_prepare(struct lruvec *lruvec, struct scan_control *sc,
+			    int type)
+{
+	struct lru_gen *lrugen = &lruvec->lrugen;
+	struct zone *zone = lruvec_zone(lruvec);
+	bool need_aging;
+
+	spin_lock_irq(&zone->lru_lock);
+	while (lru_gen_nr_gens(lrugen, type) > MIN_NR_GENS &&
+	       list_empty(&lrugen->lists[lru_gen_from_seq(
+				lrugen->min_seq[type])][type]))
+		lru_gen_inc_min_seq(lruvec, type);
+	need_aging = lru_gen_nr_gens(lrugen, type) <= MIN_NR_GENS;
+	spin_unlock_irq(&zone->lru_lock);
+
+	if (need_aging)
+		lru_gen_age(lruvec, sc);
+}
+
+/*
+ * Take up to @nr_to_scan pages off the tail of the oldest generation of
+ * @type.  Pages that cannot be isolated in @mode move on to the next
+ * generation so that the oldest one drains in a single pass.
+ */
+static unsigned long lru_gen_isolate_pages(unsigned long nr_to_scan,
+		struct lruvec *lruvec, struct list_head *dst,
+		unsigned long *nr_scanned, struct scan_control *sc,
+		isolate_mode_t mode, int type)
+{
+	struct lru_gen *lrugen = &lruvec->lrugen;
+	unsigned long seq = lrugen->min_seq[type];
+	struct list_head *src = &lrugen->lists[lru_gen_from_seq(seq)][type];
+	unsigned long nr_taken = 0;
+	unsigned long scan;
+
+	for (scan = 0; scan < nr_to_scan && !list_empty(src); scan++) {
+		struct page *page;
+		int nr_pages;
+
+		page = lru_to_page(src);
+		prefetchw_prev_lru_page(page, src, flags);
+
+		VM_BUG_ON(!PageLRU(page));
+
+		switch (__isolate_lru_page(page, mode)) {
+		case 0:
+			nr_pages = hpage_nr_pages(page);
+			lru_gen_del_page(lruvec, page);
+			list_add(&page->lru, dst);
+			nr_taken += nr_pages;
+			break;
+
+		case -EBUSY:
+			lru_gen_move_page(lruvec, page,
+					  lru_gen_from_seq(seq + 1), false);
+			continue;
+
+		default:
+			BUG();
+		}
+	}
+
+	*nr_scanned = scan;
+	trace_mm_vmscan_lru_isolate(sc->order, nr_to_scan, scan,
+				    nr_taken, mode, type);
+	return nr_taken;
+}
+
+static unsigned long lru_gen_evict(unsigned long nr_to_scan,
+				   struct lruvec *lruvec,
+				   struct scan_control *sc, int type)
+{
+	LIST_HEAD(page_list);
+	unsigned long nr_scanned;
+	unsigned long nr_reclaimed;
+	unsigned long nr_taken;
+	unsigned long nr_dirty = 0;
+	unsigned long nr_writeback = 0;
+	isolate_mode_t isolate_mode = 0;
+	struct zone *zone = lruvec_zone(lruvec);
+	struct zone_reclaim_stat *reclaim_stat = &lruvec->reclaim_stat;
+
+	while (unlikely(too_many_isolated(zone, type, sc))) {
+		congestion_wait(BLK_RW_ASYNC, HZ/10);
+
+		/* We are about to die and free our memory. Return now. */
+		if (fatal_signal_pending(current))
+			return SWAP_CLUSTER_MAX;
+	}
+
+	lru_add_drain();
+
+	if (!sc->may_unmap)
+		isolate_mode |= ISOLATE_UNMAPPED;
+	if (!sc->may_writepage)
+		isolate_mode |= ISOLATE_CLEAN;
+
+	spin_lock_irq(&zone->lru_lock);
+
+	nr_taken = lru_gen_isolate_pages(nr_to_scan, lruvec, &page_list,
+					 &nr_scanned, sc, isolate_mode, type);
+
+	__mod_zone_page_state(zone, NR_ISOLATED_ANON + type, nr_taken);
+
+	if (global_reclaim(sc)) {
+		zone->pages_scanned += nr_scanned;
+		if (current_is_kswapd())
+			__count_zone_vm_events(PGSCAN_KSWAPD, zone, nr_scanned);
+		else
+			__count_zone_vm_events(PGSCAN_DIRECT, zone, nr_scanned);
+	}
+	spin_unlock_irq(&zone->lru_lock);
+
+	if (nr_taken == 0)
+		return 0;
+
+	nr_reclaimed = shrink_page_list(&page_list, zone, sc, TTU_UNMAP,
+					&nr_dirty, &nr_writeback, false);
+
+	spin_lock_irq(&zone->lru_lock);
+
+	reclaim_stat->recent_scanned[type] += nr_taken;
+
+	if (global_reclaim(sc)) {
+		if (current_is_kswapd())
+			__count_zone_vm_events(PGSTEAL_KSWAPD, zone,
+					       nr_reclaimed);
+		else
+			__count_zone_vm_events(PGSTEAL_DIRECT, zone,
+					       nr_reclaimed);
+	}
+
+	putback_inactive_pages(lruvec, &page_list);
+
+	__mod_zone_page_state(zone, NR_ISOLATED_ANON + type, -nr_taken);
+
+	spin_unlock_irq(&zone->lru_lock);
+
+	free_hot_cold_page_list(&page_list, 1);
+
+	trace_mm_vmscan_lru_shrink_inactive(zone->zone_pgdat->node_id,
+		zone_idx(zone),
+		nr_scanned, nr_reclaimed,
+		sc->priority,
+		trace_shrink_flags(type));
+	return nr_reclaimed;
+}
+
+/* evict from whichever type has the older generation, file on a tie */
+static int lru_gen_pick_type(struct lruvec *lruvec, bool can_swap)
+{
+	struct lru_gen *lrugen = &lruvec->lrugen;
+	bool anon = can_swap && lru_gen_type_size(lruvec, 0);
+	bool file = lru_gen_type_size(lruvec, 1);
+
+	if (anon && file)
+		return lrugen->min_seq[0] < lrugen->min_seq[1] ? 0 : 1;
+	if (anon)
+		return 0;
+	if (file)
+		return 1;
+	return -1;
+}
+
+static void lru_gen_shrink_lruvec(struct lruvec *lruvec,
+				  struct scan_control *sc)
+{
+	struct zone *zone = lruvec_zone(lruvec);
+	unsigned long nr_to_reclaim = sc->nr_to_reclaim;
+	unsigned long nr_reclaimed = 0;
+	unsigned long nr_to_scan, size;
+	struct blk_plug plug;
+	bool can_swap;
+
+	can_swap = sc->may_swap && get_nr_swap_pages() > 0 &&
+		   (global_reclaim(sc) || vmscan_swappiness(sc));
+
+	size = lru_gen_type_size(lruvec, 1);
+	if (can_swap)
+		size += lru_gen_type_size(lruvec, 0);
+
+	/* same minimum scan as get_scan_count() */
+	nr_to_scan = size >> sc->priority;
+	if (!nr_to_scan && (!global_reclaim(sc) ||
+			    (current_is_kswapd() && zone->all_unreclaimable)))
+		nr_to_scan = min(size, SWAP_CLUSTER_MAX);
+
+	blk_start_plug(&plug);
+	while (nr_to_scan) {
+		unsigned long batch = min(nr_to_scan, SWAP_CLUSTER_MAX);
+		int type = lru_gen_pick_type(lruvec, can_swap);
+
+		if (type < 0)
+			break;
+
+		lru_gen_prepare(lruvec, sc, type);
+		nr_reclaimed += lru_gen_evict(batch, lruvec, sc, type);
+		nr_to_scan -= batch;
+
+		if (nr_reclaimed >= nr_to_reclaim &&
+		    sc->priority < DEF_PRIORITY)
+			break;
+	}
+	blk_finish_plug(&plug);
+	sc->nr_reclaimed += nr_reclaimed;
+
+	throttle_vm_writeout(sc->gfp_mask);
+}
+#else /* !CONFIG_LRU_GEN */
+static inline void lru_gen_shrink_lruvec(struct lruvec *lruvec,
+					 struct scan_control *sc)
+{
+}
+#endif /* CONFIG_LRU_GEN */
+
+/* Reclaim from the active and inactive lists of @lruvec */
+static void shrink_lru_lists(struct lruvec *lruvec, struct scan_control *sc)
 {
 	unsigned long nr[NR_LRU_LISTS];
 	unsigned long nr_to_scan;
@@ -1911,6 +2468,17 @@ static void shrink_lruvec(struct lruvec *lruvec, struct scan_control *sc)
 	throttle_vm_writeout(sc->gfp_mask);
 }
 
+/*
+ * This is a basic per-zone page freer.  Used by both kswapd and direct reclaim.
+ */
+static void shrink_lruvec(struct lruvec *lruvec, struct scan_control *sc)
+{
+	if (IS_ENABLED(CONFIG_LRU_GEN))
+		lru_gen_shrink_lruvec(lruvec, sc);
+	else
+		shrink_lru_lists(lruvec, sc);
+}
+
 /* Use reclaim/compaction for costly allocs or under memory pressure */
 static bool in_reclaim_compaction(struct scan_control *sc)
 {
@@ -1986,6 +2554,41 @@ static inline bool should_continue_reclaim(struct zone *zone,
 	}
 }
 
+/*
+ * Global reclaim goes after the memory cgroups with a reclaim priority,
+ * e.g. cached background apps, in a first pass of their own.  It scans
+ * them as if reclaim were that many priority levels further along.
+ */
+static void shrink_zone_boosted(struct zone *zone, struct scan_control *sc)
+{
+	struct mem_cgroup *root = sc->target_mem_cgroup;
+	struct mem_cgroup *memcg;
+	int priority = sc->priority;
+
+	if (mem_cgroup_disabled())
+		return;
+
+	memcg = mem_cgroup_iter(root, NULL, NULL);
+	do {
+		int boost = mem_cgroup_reclaim_priority(memcg);
+
+		if (!boost)
+			continue;
+
+		if (mem_cgroup_low(root, memcg)) {
+			if (!sc->may_thrash) {
+				sc->memcg_low_skipped = 1;
+				continue;
+			}
+			mem_cgroup_low_breached(memcg);
+		}
+
+		sc->priority = max(priority - boost, 0);
+		shrink_lruvec(mem_cgroup_zone_lruvec(zone, memcg), sc);
+		sc->priority = priority;
+	} while ((memcg = mem_cgroup_iter(root, memcg, NULL)));
+}
+
 static void shrink_zone(struct zone *zone, struct scan_control *sc)
 {
 	unsigned long nr_reclaimed, nr_scanned;
@@ -2001,10 +2604,30 @@ static void shrink_zone(struct zone *zone, struct scan_control *sc)
 		nr_reclaimed = sc->nr_reclaimed;
 		nr_scanned = sc->nr_scanned;
 
+		if (global_reclaim(sc)) {
+			shrink_zone_boosted(zone, sc);
+			if (sc->nr_reclaimed >= sc->nr_to_reclaim)
+				goto done;
+		}
+
 		memcg = mem_cgroup_iter(root, NULL, &reclaim);
 		do {
 			struct lruvec *lruvec;
 
+			if (global_reclaim(sc)) {
+				/* Already done in the boosted pass */
+				if (mem_cgroup_reclaim_priority(memcg))
+					goto next;
+
+				if (mem_cgroup_low(root, memcg)) {
+					if (!sc->may_thrash) {
+						sc->memcg_low_skipped = 1;
+						goto next;
+					}
+					mem_cgroup_low_breached(memcg);
+				}
+			}
+
 			lruvec = mem_cgroup_zone_lruvec(zone, memcg);
 
 			shrink_lruvec(lruvec, sc);
@@ -2024,9 +2647,11 @@ static void shrink_zone(struct zone *zone, struct scan_control *sc)
 				mem_cgroup_iter_break(root, memcg);
 				break;
 			}
+next:
 			memcg = mem_cgroup_iter(root, memcg, &reclaim);
 		} while (memcg);
 
+done:
 		vmpressure(sc->gfp_mask, sc->target_mem_cgroup,
 			   sc->nr_scanned - nr_scanned,
 			   sc->nr_reclaimed - nr_reclaimed);
@@ -2209,12 +2834,14 @@ static unsigned long do_try_to_free_pages(struct zonelist *zonelist,
 	struct zone *zone;
 	unsigned long writeback_threshold;
 	bool aborted_reclaim;
+	int initial_priority = sc->priority;
 
 	delayacct_freepages_start();
 
 	if (global_reclaim(sc))
 		count_vm_event(ALLOCSTALL);
 
+retry:
 	do {
 		vmpressure_prio(sc->gfp_mask, sc->target_mem_cgroup,
 				sc->priority);
@@ -2278,6 +2905,16 @@ static unsigned long do_try_to_free_pages(struct zonelist *zonelist,
 		}
 	} while (--sc->priority >= 0);
 
+	/*
+	 * Nothing was left to reclaim outside the groups protected by
+	 * their low limit: go around again and reclaim those as well.
+	 */
+	if (!sc->nr_reclaimed && sc->memcg_low_skipped && !sc->may_thrash) {
+		sc->priority = initial_priority;
+		sc->may_thrash = 1;
+		goto retry;
+	}
+
 out:
 	delayacct_freepages_end();
 
@@ -2525,7 +3162,8 @@ static void age_active_anon(struct zone *zone, struct scan_control *sc)
 {
 	struct mem_cgroup *memcg;
 
-	if (!total_swap_pages)
+	/* generations age on their own, there is no active list to shrink */
+	if (!total_swap_pages || IS_ENABLED(CONFIG_LRU_GEN))
 		return;
 
 	memcg = mem_cgroup_iter(NULL, NULL, NULL);
@@ -2692,10 +3330,17 @@ loop_again:
 	sc.priority = DEF_PRIORITY;
 	sc.nr_reclaimed = 0;
 	sc.may_writepage = !laptop_mode;
+	sc.may_thrash = 0;
 	count_vm_event(PAGEOUTRUN);
 
 	do {
-		unsigned long lru_pages = 0;
+		unsigned long lru_pages;
+		unsigned long nr_reclaimed;
+
+rescan:
+		lru_pages = 0;
+		nr_reclaimed = sc.nr_reclaimed;
+		sc.memcg_low_skipped = 0;
 
 		/*
 		 * Scan in the highmem->dma direction for the highest
@@ -2842,6 +3487,18 @@ loop_again:
 				zone_clear_flag(zone, ZONE_CONGESTED);
 		}
 
+		/*
+		 * Everything this pass could have reclaimed sits in groups
+		 * protected by their low limit.  Repeat the pass with the
+		 * protection lifted, as direct reclaim does, rather than
+		 * spinning without ever marking the zones unreclaimable.
+		 */
+		if (sc.nr_reclaimed == nr_reclaimed && sc.memcg_low_skipped &&
+		    !sc.may_thrash) {
+			sc.may_thrash = 1;
+			goto rescan;
+		}
+
 		/*
 		 * If the low watermark is met there is no need for processes
 		 * to be throttled on pfmemalloc_wait as they should not be
@@ -0,0 +1,417 @@
+/*
+ * blk_replay.c - replay a blktrace against I/O schedulers, compare latency
+ *
+ * Reads the text output of blkparse, takes the Q (queued) events and
+ * replays them against a block device with their original timing, once
+ * per I/O scheduler given, switching the device's scheduler in between.
+ * Reads and sync writes are issued with O_DIRECT and timed; async writes
+ * go through the page cache so that they reach the device as writeback,
+ * the way they did when the trace was taken.  For each scheduler the
+ * read and sync write completion latency percentiles are printed.
+ *
+ *   blktrace -d /dev/mmcblk0 -o - | blkparse -i - > app-launch.txt
+ *   blk_replay -w -s cfq,deadline,latency app-launch.txt /dev/mmcblk0p20
+ *
+ * Write events overwrite the target, so they are only replayed with -w.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <linux/fs.h>
+
+#define SECTOR_SIZE	512
+#define MAX_IO_SIZE	(1 << 20)
+
+enum {
+	EV_READ,
+	EV_SYNC_WRITE,
+	EV_ASYNC_WRITE,
+	EV_NR_TYPES,
+};
+
+static const char * const ev_name[EV_NR_TYPES] = {
+	"read", "sync write", "async write",
+};
+
+struct event {
+	unsigned long long when;	/* nsecs from the first event */
+	unsigned long long offset;	/* bytes */
+	unsigned int len;		/* bytes */
+	int type;
+};
+
+static struct event *events;
+static unsigned int nr_events;
+
+/* samples of one run, usecs, [EV_READ] and [EV_SYNC_WRITE] */
+static unsigned int *lat[EV_ASYNC_WRITE];
+static unsigned int nr_lat[EV_ASYNC_WRITE];
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int next_event;
+static unsigned int nr_late;
+static struct timespec start;
+
+static int direct_fd, buffered_fd;
+static unsigned long long dev_size;
+static int allow_writes;
+static double speed = 1.0;
+static int nr_threads = 16;
+
+static unsigned long long ts_nsec(const struct timespec *ts)
+{
+	return ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
+
+static unsigned long long now_nsec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts_nsec(&ts);
+}
+
+/*
+ * blkparse default output:
+ *   8,0  1  42  0.001234567  1234  Q  WS 123456 + 8 [proc]
+ */
+static int load_trace(const char *path)
+{
+	unsigned long long first = 0, sector;
+	unsigned int cap = 0, nsect;
+	char line[512], action[8], rwbs[8];
+	double t;
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		perror(path);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), fp)) {
+		struct event *ev;
+
+		if (sscanf(line, "%*s %*u %*u %lf %*u %7s %7s %llu + %u",
+			   &t, action, rwbs, &sector, &nsect) != 5)
+			continue;
+		if (strcmp(action, "Q") || !nsect)
+			continue;
+		/* discards and flushes are not timed */
+		if (strchr(rwbs, 'D') || strchr(rwbs, 'F'))
+			continue;
+
+		if (nr_events == cap) {
+			cap = cap ? cap * 2 : 4096;
+			events = realloc(events, cap * sizeof(*events));
+			if (!events) {
+				perror("realloc");
+				fclose(fp);
+				return -1;
+			}
+		}
+
+		ev = &events[nr_events++];
+		if (nr_events == 1)
+			first = t * 1e9;
+		ev->when = t * 1e9 - first;
+		ev->offset = sector * SECTOR_SIZE;
+		ev->len = nsect * SECTOR_SIZE;
+		if (ev->len > MAX_IO_SIZE)
+			ev->len = MAX_IO_SIZE;
+		if (strchr(rwbs, 'R'))
+			ev->type = EV_READ;
+		else if (strchr(rwbs, 'S'))
+			ev->type = EV_SYNC_WRITE;
+		else
+			ev->type = EV_ASYNC_WRITE;
+	}
+	fclose(fp);
+
+	if (!nr_events) {
+		fprintf(stderr, "%s: no queue events found\n", path);
+		return -1;
+	}
+	return 0;
+}
+
+static void issue(struct event *ev, void *buf)
+{
+	unsigned long long offset = ev->offset % (dev_size - MAX_IO_SIZE);
+	unsigned long long t0, t1;
+	ssize_t ret;
+
+	/* keep O_DIRECT alignment whatever the trace says */
+	offset &= ~4095ULL;
+
+	t0 = now_nsec();
+	switch (ev->type) {
+	case EV_READ:
+		ret = pread(direct_fd, buf, ev->len, offset);
+		break;
+	case EV_SYNC_WRITE:
+		ret = pwrite(direct_fd, buf, ev->len, offset);
+		if (ret >= 0)
+			ret = fdatasync(direct_fd);
+		break;
+	default:
+		if (pwrite(buffered_fd, buf, ev->len, offset) < 0)
+			perror(ev_name[ev->type]);
+		return;
+	}
+	t1 = now_nsec();
+
+	if (ret < 0) {
+		perror(ev_name[ev->type]);
+		return;
+	}
+
+	pthread_mutex_lock(&lock);
+	lat[ev->type][nr_lat[ev->type]++] = (t1 - t0) / 1000;
+	pthread_mutex_unlock(&lock);
+}
+
+static void *worker(void *arg __attribute__((unused)))
+{
+	void *buf;
+
+	if (posix_memalign(&buf, 4096, MAX_IO_SIZE)) {
+		perror("posix_memalign");
+		return NULL;
+	}
+	memset(buf, 0x5a, MAX_IO_SIZE);
+
+	for (;;) {
+		unsigned long long due;
+		struct timespec ts;
+		struct event *ev;
+
+		pthread_mutex_lock(&lock);
+		if (next_event == nr_events) {
+			pthread_mutex_unlock(&lock);
+			break;
+		}
+		ev = &events[next_event++];
+		pthread_mutex_unlock(&lock);
+
+		if (ev->type != EV_READ && !allow_writes)
+			continue;
+
+		due = ts_nsec(&start) + ev->when / speed;
+		if (now_nsec() > due + 1000000) {
+			pthread_mutex_lock(&lock);
+			nr_late++;
+			pthread_mutex_unlock(&lock);
+		}
+		ts.tv_sec = due / 1000000000ULL;
+		ts.tv_nsec = due % 1000000000ULL;
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+				       &ts, NULL) == EINTR)
+			;
+
+		issue(ev, buf);
+	}
+
+	free(buf);
+	return NULL;
+}
+
+static int cmp_uint(const void *a, const void *b)
+{
+	unsigned int x = *(const unsigned int *)a;
+	unsigned int y = *(const unsigned int *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static unsigned int percentile(unsigned int *v, unsigned int n, double p)
+{
+	unsigned int i = n * p / 100;
+
+	return v[i < n ? i : n - 1];
+}
+
+static void report(const char *sched)
+{
+	int type;
+
+	for (type = EV_READ; type < EV_ASYNC_WRITE; type++) {
+		unsigned int n = nr_lat[type], *v = lat[type];
+
+		if (!n)
+			continue;
+		qsort(v, n, sizeof(*v), cmp_uint);
+		printf("%-10s %-10s %8u %8u %8u %8u %8u %8u\n",
+		       sched, ev_name[type], n,
+		       percentile(v, n, 50), percentile(v, n, 90),
+		       percentile(v, n, 99), percentile(v, n, 99.9), v[n - 1]);
+	}
+	if (nr_late)
+		printf("%-10s %u events issued more than 1ms late, "
+		       "try more threads (-t)\n", sched, nr_late);
+}
+
+/* the queue/ directory of the disk holding dev, partition or not */
+static int queue_dir(const char *dev, char *path, size_t size)
+{
+	struct stat st;
+
+	if (stat(dev, &st) || !S_ISBLK(st.st_mode)) {
+		fprintf(stderr, "%s: not a block device\n", dev);
+		return -1;
+	}
+	snprintf(path, size, "/sys/dev/block/%u:%u/partition",
+		 major(st.st_rdev), minor(st.st_rdev));
+	if (!access(path, F_OK))
+		snprintf(path, size, "/sys/dev/block/%u:%u/../queue",
+			 major(st.st_rdev), minor(st.st_rdev));
+	else
+		snprintf(path, size, "/sys/dev/block/%u:%u/queue",
+			 major(st.st_rdev), minor(st.st_rdev));
+	return 0;
+}
+
+static int write_file(const char *path, const char *val)
+{
+	int fd, ret = 0;
+
+	fd = open(path, O_WRONLY);
+	if (fd < 0 || write(fd, val, strlen(val)) < 0) {
+		perror(path);
+		ret = -1;
+	}
+	if (fd >= 0)
+		close(fd);
+	return ret;
+}
+
+static int run(const char *queue, const char *sched)
+{
+	pthread_t *threads;
+	char path[512];
+	int i, type;
+
+	if (sched) {
+		snprintf(path, sizeof(path), "%s/scheduler", queue);
+		if (write_file(path, sched))
+			return -1;
+	}
+
+	/* start each run with clean page cache and an idle device */
+	sync();
+	write_file("/proc/sys/vm/drop_caches", "3");
+
+	for (type = EV_READ; type < EV_ASYNC_WRITE; type++)
+		nr_lat[type] = 0;
+	next_event = 0;
+	nr_late = 0;
+
+	threads = calloc(nr_threads, sizeof(*threads));
+	if (!threads)
+		return -1;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < nr_threads; i++)
+		pthread_create(&threads[i], NULL, worker, NULL);
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+
+	if (allow_writes)
+		fsync(buffered_fd);
+
+	report(sched ? sched : "current");
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-w] [-s sched,...] [-t threads] [-x speed] "
+		"trace device\n"
+		"  -w   replay writes too, overwriting the device\n"
+		"  -s   schedulers to compare, e.g. cfq,deadline,latency\n"
+		"       (default: the current one)\n"
+		"  -t   concurrent I/Os at most (default 16)\n"
+		"  -x   replay speed factor (default 1.0)\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	char *scheds = NULL, *sched, queue[256];
+	int opt, type;
+
+	while ((opt = getopt(argc, argv, "ws:t:x:")) != -1) {
+		switch (opt) {
+		case 'w':
+			allow_writes = 1;
+			break;
+		case 's':
+			scheds = optarg;
+			break;
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 'x':
+			speed = atof(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (argc - optind != 2 || nr_threads < 1 || speed <= 0)
+		usage(argv[0]);
+
+	if (load_trace(argv[optind]) || queue_dir(argv[optind + 1], queue,
+						  sizeof(queue)))
+		return 1;
+
+	direct_fd = open(argv[optind + 1],
+			 (allow_writes ? O_RDWR : O_RDONLY) | O_DIRECT);
+	buffered_fd = open(argv[optind + 1], allow_writes ? O_RDWR : O_RDONLY);
+	if (direct_fd < 0 || buffered_fd < 0) {
+		perror(argv[optind + 1]);
+		return 1;
+	}
+	if (ioctl(direct_fd, BLKGETSIZE64, &dev_size) ||
+	    dev_size <= 2 * MAX_IO_SIZE) {
+		fprintf(stderr, "%s: too small\n", argv[optind + 1]);
+		return 1;
+	}
+
+	for (type = EV_READ; type < EV_ASYNC_WRITE; type++) {
+		lat[type] = calloc(nr_events, sizeof(**lat));
+		if (!lat[type]) {
+			perror("calloc");
+			return 1;
+		}
+	}
+
+	printf("%u events, writes %s\n", nr_events,
+	       allow_writes ? "replayed" : "skipped (no -w)");
+	printf("%-10s %-10s %8s %8s %8s %8s %8s %8s\n", "sched", "type",
+	       "count", "p50(us)", "p90", "p99", "p99.9", "max");
+
+	if (!scheds)
+		return run(queue, NULL) ? 1 : 0;
+
+	for (sched = strtok(scheds, ","); sched; sched = strtok(NULL, ","))
+		if (run(queue, sched))
+			return 1;
+	return 0;
+}
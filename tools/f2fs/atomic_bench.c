@@ -0,0 +1,344 @@
+/*
+ * atomic_bench.c - compare SQLite-like transactions with a rollback journal
+ * and with f2fs atomic writes
+ *
+ * Each transaction updates a few random pages of a database file, plus its
+ * first page, as SQLite does with its change counter.  In journal mode the
+ * original pages are first saved in a rollback journal, the way SQLite does
+ * with journal_mode=TRUNCATE and synchronous=FULL:
+ *
+ *   write the journal, fsync, write its header, fsync,
+ *   write the database, fsync, truncate the journal, fsync
+ *
+ * In atomic mode the pages are written between F2FS_IOC_START_ATOMIC_WRITE
+ * and F2FS_IOC_COMMIT_ATOMIC_WRITE, without a journal.
+ *
+ * Run it in a directory on f2fs, e.g. on a loop-mounted image:
+ *
+ *   dd if=/dev/zero of=f2fs.img bs=1M count=512
+ *   mkfs.f2fs f2fs.img
+ *   mount -o loop -t f2fs f2fs.img /mnt/f2fs
+ *   atomic_bench -d loop0 /mnt/f2fs
+ *
+ * With -d, the sectors written to the device are read from its statistics
+ * in /sys/block.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+#define F2FS_IOCTL_MAGIC		0xf5
+#define F2FS_IOC_START_ATOMIC_WRITE	_IO(F2FS_IOCTL_MAGIC, 1)
+#define F2FS_IOC_COMMIT_ATOMIC_WRITE	_IO(F2FS_IOCTL_MAGIC, 2)
+#define F2FS_IOC_ABORT_ATOMIC_WRITE	_IO(F2FS_IOCTL_MAGIC, 5)
+
+#define PAGE_SIZE	4096
+#define JOURNAL_HDR	512
+
+enum {
+	MODE_JOURNAL,
+	MODE_ATOMIC,
+	NR_MODES,
+};
+
+static const char * const mode_name[NR_MODES] = {
+	"journal", "atomic",
+};
+
+static unsigned int nr_txns = 1000;
+static unsigned int pages_per_txn = 4;
+static unsigned int db_pages = 1024;
+static const char *dev;
+
+static unsigned char page[PAGE_SIZE];
+static unsigned int *lat;	/* usecs per transaction */
+static unsigned int nr_fsync;
+
+static unsigned long long now_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/* sectors written to the device, 0 without -d */
+static unsigned long long dev_sectors_written(void)
+{
+	unsigned long long v[7];
+	char path[256];
+	FILE *fp;
+	int n;
+
+	if (!dev)
+		return 0;
+	snprintf(path, sizeof(path), "/sys/block/%s/stat", dev);
+	fp = fopen(path, "r");
+	if (!fp)
+		return 0;
+	n = fscanf(fp, "%llu %llu %llu %llu %llu %llu %llu",
+		   &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6]);
+	fclose(fp);
+	return n == 7 ? v[6] : 0;
+}
+
+static int xfsync(int fd)
+{
+	nr_fsync++;
+	if (fsync(fd)) {
+		perror("fsync");
+		return -1;
+	}
+	return 0;
+}
+
+static int xpwrite(int fd, const void *buf, size_t len, off_t off)
+{
+	if (pwrite(fd, buf, len, off) != (ssize_t)len) {
+		perror("pwrite");
+		return -1;
+	}
+	return 0;
+}
+
+static void pick_pages(unsigned int *pgno)
+{
+	unsigned int i;
+
+	pgno[0] = 0;
+	for (i = 1; i < pages_per_txn + 1; i++)
+		pgno[i] = 1 + rand() % (db_pages - 1);
+}
+
+static int txn_journal(int db, int jrnl, const unsigned int *pgno,
+		       unsigned int seq)
+{
+	unsigned char hdr[JOURNAL_HDR];
+	unsigned int i, n = pages_per_txn + 1;
+	off_t off = JOURNAL_HDR;
+
+	/* save the original pages */
+	for (i = 0; i < n; i++) {
+		if (pread(db, page, PAGE_SIZE, (off_t)pgno[i] * PAGE_SIZE) !=
+		    PAGE_SIZE) {
+			perror("pread");
+			return -1;
+		}
+		if (xpwrite(jrnl, &pgno[i], sizeof(pgno[i]), off) ||
+		    xpwrite(jrnl, page, PAGE_SIZE, off + sizeof(pgno[i])))
+			return -1;
+		off += sizeof(pgno[i]) + PAGE_SIZE;
+	}
+	if (xfsync(jrnl))
+		return -1;
+
+	/* the header with the record count makes the journal hot */
+	memset(hdr, 0, sizeof(hdr));
+	memcpy(hdr, "journal", 7);
+	memcpy(hdr + 8, &n, sizeof(n));
+	if (xpwrite(jrnl, hdr, sizeof(hdr), 0) || xfsync(jrnl))
+		return -1;
+
+	memset(page, seq, PAGE_SIZE);
+	for (i = 0; i < n; i++)
+		if (xpwrite(db, page, PAGE_SIZE, (off_t)pgno[i] * PAGE_SIZE))
+			return -1;
+	if (xfsync(db))
+		return -1;
+
+	if (ftruncate(jrnl, 0)) {
+		perror("ftruncate");
+		return -1;
+	}
+	return xfsync(jrnl);
+}
+
+static int txn_atomic(int db, const unsigned int *pgno, unsigned int seq)
+{
+	unsigned int i, n = pages_per_txn + 1;
+
+	if (ioctl(db, F2FS_IOC_START_ATOMIC_WRITE)) {
+		perror("F2FS_IOC_START_ATOMIC_WRITE");
+		return -1;
+	}
+
+	memset(page, seq, PAGE_SIZE);
+	for (i = 0; i < n; i++) {
+		if (xpwrite(db, page, PAGE_SIZE, (off_t)pgno[i] * PAGE_SIZE)) {
+			ioctl(db, F2FS_IOC_ABORT_ATOMIC_WRITE);
+			return -1;
+		}
+	}
+
+	nr_fsync++;
+	if (ioctl(db, F2FS_IOC_COMMIT_ATOMIC_WRITE)) {
+		perror("F2FS_IOC_COMMIT_ATOMIC_WRITE");
+		return -1;
+	}
+	return 0;
+}
+
+static int cmp_uint(const void *a, const void *b)
+{
+	unsigned int x = *(const unsigned int *)a, y = *(const unsigned int *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int run(const char *dir, int mode)
+{
+	unsigned long long start, t, total, sectors;
+	unsigned int *pgno, i;
+	char db_path[512], jrnl_path[512];
+	int db, jrnl = -1, ret = -1;
+
+	snprintf(db_path, sizeof(db_path), "%s/atomic_bench.db", dir);
+	snprintf(jrnl_path, sizeof(jrnl_path), "%s/atomic_bench.db-journal",
+		 dir);
+
+	db = open(db_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (db < 0) {
+		perror(db_path);
+		return -1;
+	}
+	if (mode == MODE_JOURNAL) {
+		jrnl = open(jrnl_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (jrnl < 0) {
+			perror(jrnl_path);
+			goto out;
+		}
+	}
+
+	/* populate the database */
+	memset(page, 0xff, PAGE_SIZE);
+	for (i = 0; i < db_pages; i++)
+		if (xpwrite(db, page, PAGE_SIZE, (off_t)i * PAGE_SIZE))
+			goto out;
+	if (fsync(db) || (jrnl >= 0 && fsync(jrnl))) {
+		perror("fsync");
+		goto out;
+	}
+	sync();
+
+	pgno = calloc(pages_per_txn + 1, sizeof(*pgno));
+	if (!pgno)
+		goto out;
+
+	srand(1);
+	nr_fsync = 0;
+	sectors = dev_sectors_written();
+	start = now_usec();
+	for (i = 0; i < nr_txns; i++) {
+		pick_pages(pgno);
+		t = now_usec();
+		if (mode == MODE_JOURNAL)
+			ret = txn_journal(db, jrnl, pgno, i);
+		else
+			ret = txn_atomic(db, pgno, i);
+		if (ret)
+			break;
+		lat[i] = now_usec() - t;
+	}
+	total = now_usec() - start;
+	sectors = dev_sectors_written() - sectors;
+	free(pgno);
+	if (ret)
+		goto out;
+
+	qsort(lat, nr_txns, sizeof(*lat), cmp_uint);
+	printf("%-8s %8u %10.1f %8u %8u %8u %8.1f",
+	       mode_name[mode], nr_txns, nr_txns * 1000000.0 / total,
+	       lat[nr_txns / 2], lat[nr_txns * 99 / 100], lat[nr_txns - 1],
+	       (double)nr_fsync / nr_txns);
+	if (dev)
+		printf(" %10.1f", sectors * 512.0 / 1024 / nr_txns);
+	printf("\n");
+out:
+	if (jrnl >= 0) {
+		close(jrnl);
+		unlink(jrnl_path);
+	}
+	close(db);
+	unlink(db_path);
+	return ret;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-m journal|atomic] [-n txns] [-p pages] [-s pages] "
+		"[-d dev] dir\n"
+		"  -m   run one mode only (default: both)\n"
+		"  -n   number of transactions (default 1000)\n"
+		"  -p   random pages updated per transaction (default 4)\n"
+		"  -s   database size in 4KB pages (default 1024)\n"
+		"  -d   block device holding dir, e.g. loop0, to report the\n"
+		"       KB written to it per transaction\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int opt, mode, only = -1;
+
+	while ((opt = getopt(argc, argv, "m:n:p:s:d:")) != -1) {
+		switch (opt) {
+		case 'm':
+			for (mode = 0; mode < NR_MODES; mode++)
+				if (!strcmp(optarg, mode_name[mode]))
+					only = mode;
+			if (only < 0)
+				usage(argv[0]);
+			break;
+		case 'n':
+			nr_txns = atoi(optarg);
+			break;
+		case 'p':
+			pages_per_txn = atoi(optarg);
+			break;
+		case 's':
+			db_pages = atoi(optarg);
+			break;
+		case 'd':
+			dev = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (argc - optind != 1 || !nr_txns || !pages_per_txn || db_pages < 2)
+		usage(argv[0]);
+
+	lat = calloc(nr_txns, sizeof(*lat));
+	if (!lat) {
+		perror("calloc");
+		return 1;
+	}
+
+	printf("%-8s %8s %10s %8s %8s %8s %8s", "mode", "txns", "txn/s",
+	       "p50(us)", "p99", "max", "fsyncs");
+	if (dev)
+		printf(" %10s", "KB/txn");
+	printf("\n");
+
+	for (mode = 0; mode < NR_MODES; mode++) {
+		if (only >= 0 && mode != only)
+			continue;
+		if (run(argv[optind], mode))
+			return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,556 @@
+/*
+ * fuse_wb_bench.c - measure small buffered writes through FUSE, with and
+ * without the writeback cache
+ *
+ * The program is its own FUSE filesystem: it mounts /dev/fuse on the given
+ * directory and serves a flat, in-memory filesystem from a child process,
+ * talking the kernel protocol directly, like a minimal libfuse example
+ * filesystem.  The parent writes files on the mount in small chunks, as
+ * apps do on the emulated sdcard, and closes them.
+ *
+ * In "sync" mode the daemon leaves FUSE_WRITEBACK_CACHE out of its INIT
+ * reply, so each write() is a WRITE request.  In "writeback" mode it sets
+ * the flag, and the kernel sends the dirty pages in large WRITE requests.
+ * The daemon counts the requests it gets.
+ *
+ * Must be run as root:
+ *
+ *   mkdir /mnt/fuse
+ *   fuse_wb_bench /mnt/fuse
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <linux/fuse.h>
+
+#ifndef FUSE_WRITEBACK_CACHE
+#define FUSE_WRITEBACK_CACHE	(1 << 16)
+#endif
+
+/* the INIT reply a 7.23 kernel expects, newer headers have a longer one */
+#define INIT_OUT_SIZE	(offsetof(struct fuse_init_out, max_write) + \
+			 sizeof(uint32_t))
+
+#define MAX_WRITE	(128 * 1024)
+#define MAX_FILES	64
+#define ROOT_ID		FUSE_ROOT_ID
+
+enum {
+	MODE_SYNC,
+	MODE_WRITEBACK,
+	NR_MODES,
+};
+
+static const char * const mode_name[NR_MODES] = {
+	"sync", "writeback",
+};
+
+struct bench_file {
+	char name[256];
+	int used;
+	char *data;
+	uint64_t size;
+	struct timespec mtime;
+};
+
+/* kept in shared memory, so that the parent sees the daemon's counts */
+struct daemon_stats {
+	unsigned long nr_reqs;
+	unsigned long nr_writes;
+	unsigned long long write_bytes;
+	unsigned long nr_setattr;
+};
+
+static unsigned int chunk = 4096;
+static unsigned int file_kb = 4096;
+static unsigned int nr_files = 4;
+
+static struct bench_file files[MAX_FILES];
+static struct daemon_stats *stats;
+static int fuse_fd;
+
+static unsigned long long now_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static struct bench_file *get_file(uint64_t nodeid)
+{
+	if (nodeid <= ROOT_ID || nodeid - ROOT_ID > MAX_FILES)
+		return NULL;
+	if (!files[nodeid - ROOT_ID - 1].used)
+		return NULL;
+	return &files[nodeid - ROOT_ID - 1];
+}
+
+static void fill_attr(uint64_t nodeid, struct fuse_attr *attr)
+{
+	struct bench_file *f = get_file(nodeid);
+
+	memset(attr, 0, sizeof(*attr));
+	attr->ino = nodeid;
+	attr->nlink = 1;
+	attr->blksize = 4096;
+	if (!f) {
+		attr->mode = S_IFDIR | 0755;
+		attr->nlink = 2;
+		return;
+	}
+	attr->mode = S_IFREG | 0644;
+	attr->size = f->size;
+	attr->blocks = (f->size + 511) / 512;
+	attr->mtime = attr->ctime = f->mtime.tv_sec;
+	attr->mtimensec = attr->ctimensec = f->mtime.tv_nsec;
+}
+
+static void fill_entry(uint64_t nodeid, struct fuse_entry_out *entry)
+{
+	memset(entry, 0, sizeof(*entry));
+	entry->nodeid = nodeid;
+	entry->entry_valid = 1;
+	entry->attr_valid = 1;
+	fill_attr(nodeid, &entry->attr);
+}
+
+static void reply(const struct fuse_in_header *in, int error,
+		  const void *arg, size_t argsize,
+		  const void *arg2, size_t argsize2)
+{
+	struct fuse_out_header out;
+	struct iovec iov[3];
+	int n = 1;
+
+	out.unique = in->unique;
+	out.error = error;
+	out.len = sizeof(out);
+	iov[0].iov_base = &out;
+	iov[0].iov_len = sizeof(out);
+	if (!error && argsize) {
+		iov[n].iov_base = (void *)arg;
+		iov[n++].iov_len = argsize;
+		out.len += argsize;
+	}
+	if (!error && argsize2) {
+		iov[n].iov_base = (void *)arg2;
+		iov[n++].iov_len = argsize2;
+		out.len += argsize2;
+	}
+	if (writev(fuse_fd, iov, n) < 0 && errno != ENOENT)
+		perror("fuse reply");
+}
+
+static int lookup_name(const char *name)
+{
+	int i;
+
+	for (i = 0; i < MAX_FILES; i++)
+		if (files[i].used && !strcmp(files[i].name, name))
+			return i;
+	return -1;
+}
+
+static int truncate_file(struct bench_file *f, uint64_t size)
+{
+	if (size > f->size) {
+		char *data = realloc(f->data, size);
+
+		if (!data)
+			return -ENOMEM;
+		memset(data + f->size, 0, size - f->size);
+		f->data = data;
+	}
+	f->size = size;
+	return 0;
+}
+
+static void do_init(const struct fuse_in_header *in, const void *arg,
+		    int mode)
+{
+	const struct fuse_init_in *init = arg;
+	struct fuse_init_out out;
+
+	memset(&out, 0, sizeof(out));
+	out.major = FUSE_KERNEL_VERSION;
+	out.minor = init->minor < 23 ? init->minor : 23;
+	out.max_readahead = init->max_readahead;
+	out.flags = init->flags & FUSE_BIG_WRITES;
+	if (mode == MODE_WRITEBACK) {
+		if (!(init->flags & FUSE_WRITEBACK_CACHE))
+			fprintf(stderr, "kernel lacks FUSE_WRITEBACK_CACHE\n");
+		out.flags |= init->flags & FUSE_WRITEBACK_CACHE;
+	}
+	out.max_background = 16;
+	out.congestion_threshold = 12;
+	out.max_write = MAX_WRITE;
+	reply(in, 0, &out, INIT_OUT_SIZE, NULL, 0);
+}
+
+static void do_create(const struct fuse_in_header *in, const void *arg)
+{
+	const struct fuse_create_in *create = arg;
+	const char *name = (const char *)(create + 1);
+	struct fuse_entry_out entry;
+	struct fuse_open_out open;
+	int i;
+
+	if (in->nodeid != ROOT_ID) {
+		reply(in, -ENOTDIR, NULL, 0, NULL, 0);
+		return;
+	}
+	i = lookup_name(name);
+	if (i < 0) {
+		for (i = 0; i < MAX_FILES && files[i].used; i++)
+			;
+		if (i == MAX_FILES) {
+			reply(in, -ENOSPC, NULL, 0, NULL, 0);
+			return;
+		}
+		memset(&files[i], 0, sizeof(files[i]));
+		snprintf(files[i].name, sizeof(files[i].name), "%s", name);
+		files[i].used = 1;
+		clock_gettime(CLOCK_REALTIME, &files[i].mtime);
+	}
+	fill_entry(ROOT_ID + 1 + i, &entry);
+	memset(&open, 0, sizeof(open));
+	open.fh = ROOT_ID + 1 + i;
+	reply(in, 0, &entry, sizeof(entry), &open, sizeof(open));
+}
+
+static void do_setattr(const struct fuse_in_header *in, const void *arg)
+{
+	const struct fuse_setattr_in *setattr = arg;
+	struct bench_file *f = get_file(in->nodeid);
+	struct fuse_attr_out out;
+	int err = 0;
+
+	stats->nr_setattr++;
+	if (f && (setattr->valid & FATTR_SIZE))
+		err = truncate_file(f, setattr->size);
+	if (f && (setattr->valid & FATTR_MTIME)) {
+		f->mtime.tv_sec = setattr->mtime;
+		f->mtime.tv_nsec = setattr->mtimensec;
+	}
+	memset(&out, 0, sizeof(out));
+	out.attr_valid = 1;
+	fill_attr(in->nodeid, &out.attr);
+	reply(in, err, &out, sizeof(out), NULL, 0);
+}
+
+static void do_read(const struct fuse_in_header *in, const void *arg)
+{
+	const struct fuse_read_in *read = arg;
+	struct bench_file *f = get_file(in->nodeid);
+	size_t size = 0;
+
+	if (!f) {
+		reply(in, -EISDIR, NULL, 0, NULL, 0);
+		return;
+	}
+	if (read->offset < f->size) {
+		size = f->size - read->offset;
+		if (size > read->size)
+			size = read->size;
+	}
+	reply(in, 0, f->data + read->offset, size, NULL, 0);
+}
+
+static void do_write(const struct fuse_in_header *in, const void *arg)
+{
+	const struct fuse_write_in *write = arg;
+	struct bench_file *f = get_file(in->nodeid);
+	struct fuse_write_out out;
+	int err;
+
+	if (!f) {
+		reply(in, -EISDIR, NULL, 0, NULL, 0);
+		return;
+	}
+	if (write->offset + write->size > f->size) {
+		err = truncate_file(f, write->offset + write->size);
+		if (err) {
+			reply(in, err, NULL, 0, NULL, 0);
+			return;
+		}
+	}
+	memcpy(f->data + write->offset, write + 1, write->size);
+	clock_gettime(CLOCK_REALTIME, &f->mtime);
+
+	stats->nr_writes++;
+	stats->write_bytes += write->size;
+
+	memset(&out, 0, sizeof(out));
+	out.size = write->size;
+	reply(in, 0, &out, sizeof(out), NULL, 0);
+}
+
+static void serve(int mode)
+{
+	size_t bufsize = MAX_WRITE + 4096;
+	char *buf = malloc(bufsize);
+	ssize_t res;
+
+	if (!buf)
+		exit(1);
+
+	for (;;) {
+		struct fuse_in_header *in = (struct fuse_in_header *)buf;
+		void *arg = in + 1;
+		struct fuse_entry_out entry;
+		struct fuse_attr_out attr;
+		struct fuse_open_out open;
+		int i;
+
+		res = read(fuse_fd, buf, bufsize);
+		if (res < 0) {
+			if (errno == EINTR || errno == ENOENT)
+				continue;
+			break;	/* ENODEV after umount */
+		}
+		stats->nr_reqs++;
+
+		switch (in->opcode) {
+		case FUSE_INIT:
+			do_init(in, arg, mode);
+			break;
+		case FUSE_LOOKUP:
+			i = lookup_name(arg);
+			if (in->nodeid != ROOT_ID || i < 0) {
+				reply(in, -ENOENT, NULL, 0, NULL, 0);
+				break;
+			}
+			fill_entry(ROOT_ID + 1 + i, &entry);
+			reply(in, 0, &entry, sizeof(entry), NULL, 0);
+			break;
+		case FUSE_FORGET:
+		case FUSE_BATCH_FORGET:
+		case FUSE_INTERRUPT:
+			break;
+		case FUSE_GETATTR:
+			memset(&attr, 0, sizeof(attr));
+			attr.attr_valid = 1;
+			fill_attr(in->nodeid, &attr.attr);
+			reply(in, 0, &attr, sizeof(attr), NULL, 0);
+			break;
+		case FUSE_SETATTR:
+			do_setattr(in, arg);
+			break;
+		case FUSE_CREATE:
+			do_create(in, arg);
+			break;
+		case FUSE_OPEN:
+		case FUSE_OPENDIR:
+			memset(&open, 0, sizeof(open));
+			open.fh = in->nodeid;
+			reply(in, 0, &open, sizeof(open), NULL, 0);
+			break;
+		case FUSE_READ:
+			do_read(in, arg);
+			break;
+		case FUSE_WRITE:
+			do_write(in, arg);
+			break;
+		case FUSE_UNLINK:
+			i = lookup_name(arg);
+			if (in->nodeid != ROOT_ID || i < 0) {
+				reply(in, -ENOENT, NULL, 0, NULL, 0);
+				break;
+			}
+			free(files[i].data);
+			memset(&files[i], 0, sizeof(files[i]));
+			reply(in, 0, NULL, 0, NULL, 0);
+			break;
+		case FUSE_READDIR:
+			reply(in, 0, NULL, 0, NULL, 0);
+			break;
+		case FUSE_FLUSH:
+		case FUSE_RELEASE:
+		case FUSE_RELEASEDIR:
+		case FUSE_FSYNC:
+		case FUSE_DESTROY:
+			reply(in, 0, NULL, 0, NULL, 0);
+			break;
+		default:
+			reply(in, -ENOSYS, NULL, 0, NULL, 0);
+		}
+	}
+	free(buf);
+}
+
+static int write_files(const char *dir)
+{
+	char path[512];
+	char *buf;
+	unsigned int i;
+	off_t off;
+	int fd;
+
+	buf = malloc(chunk);
+	if (!buf)
+		return -1;
+	memset(buf, 0x5a, chunk);
+
+	for (i = 0; i < nr_files; i++) {
+		snprintf(path, sizeof(path), "%s/file%u", dir, i);
+		fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0) {
+			perror(path);
+			goto err;
+		}
+		for (off = 0; off < (off_t)file_kb * 1024; off += chunk) {
+			if (write(fd, buf, chunk) != (ssize_t)chunk) {
+				perror("write");
+				close(fd);
+				goto err;
+			}
+		}
+		/* close() waits for the cached writes in writeback mode */
+		if (close(fd)) {
+			perror("close");
+			goto err;
+		}
+	}
+	free(buf);
+	return 0;
+err:
+	free(buf);
+	return -1;
+}
+
+static int run(const char *dir, int mode)
+{
+	unsigned long long t, total_kb;
+	char opts[128];
+	pid_t pid;
+	int status, ret;
+
+	memset(stats, 0, sizeof(*stats));
+
+	fuse_fd = open("/dev/fuse", O_RDWR);
+	if (fuse_fd < 0) {
+		perror("/dev/fuse");
+		return -1;
+	}
+	snprintf(opts, sizeof(opts),
+		 "fd=%d,rootmode=40000,user_id=0,group_id=0", fuse_fd);
+	if (mount("fuse_wb_bench", dir, "fuse", MS_NOSUID | MS_NODEV, opts)) {
+		perror("mount");
+		close(fuse_fd);
+		return -1;
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		umount2(dir, MNT_DETACH);
+		close(fuse_fd);
+		return -1;
+	}
+	if (!pid) {
+		serve(mode);
+		_exit(0);
+	}
+	close(fuse_fd);
+
+	t = now_usec();
+	ret = write_files(dir);
+	t = now_usec() - t;
+
+	if (umount2(dir, 0))
+		umount2(dir, MNT_DETACH);
+	waitpid(pid, &status, 0);
+	if (ret)
+		return ret;
+
+	total_kb = (unsigned long long)file_kb * nr_files;
+	printf("%-10s %8u %8llu %10.1f %10lu %10.1f %8lu %8lu\n",
+	       mode_name[mode], chunk, total_kb,
+	       total_kb * 1000000.0 / 1024 / t, stats->nr_writes,
+	       stats->nr_writes ?
+			stats->write_bytes / 1024.0 / stats->nr_writes : 0,
+	       stats->nr_setattr, stats->nr_reqs);
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-m sync|writeback] [-b bytes] [-s KB] [-n files] "
+		"dir\n"
+		"  -m   run one mode only (default: both)\n"
+		"  -b   bytes per write() (default 4096)\n"
+		"  -s   size of each file in KB (default 4096)\n"
+		"  -n   number of files (default 4)\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int opt, mode, only = -1;
+
+	while ((opt = getopt(argc, argv, "m:b:s:n:")) != -1) {
+		switch (opt) {
+		case 'm':
+			for (mode = 0; mode < NR_MODES; mode++)
+				if (!strcmp(optarg, mode_name[mode]))
+					only = mode;
+			if (only < 0)
+				usage(argv[0]);
+			break;
+		case 'b':
+			chunk = atoi(optarg);
+			break;
+		case 's':
+			file_kb = atoi(optarg);
+			break;
+		case 'n':
+			nr_files = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (argc - optind != 1 || !chunk || !file_kb || !nr_files ||
+	    nr_files > MAX_FILES)
+		usage(argv[0]);
+
+	stats = mmap(NULL, sizeof(*stats), PROT_READ | PROT_WRITE,
+		     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (stats == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	signal(SIGPIPE, SIG_IGN);
+
+	printf("%-10s %8s %8s %10s %10s %10s %8s %8s\n", "mode", "bytes/wr",
+	       "KB", "MB/s", "WRITEs", "KB/WRITE", "SETATTRs", "reqs");
+
+	for (mode = 0; mode < NR_MODES; mode++) {
+		if (only >= 0 && mode != only)
+			continue;
+		if (run(argv[optind], mode))
+			return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,249 @@
+/*
+ * dm_hotplug_replay.c - score a predictive hotplug policy against a trace
+ *
+ * Reads an ftrace text dump containing the dm_hotplug:dm_hotplug_sample and
+ * dm_hotplug:dm_hotplug_predict events and replays the run-queue history
+ * through the same extrapolating predictor as drivers/cpufreq/dm_cpu_hotplug.c
+ * with the parameters given on the command line.  The reactive decision
+ * recorded in the trace is used as ground truth for the demand; the kernel
+ * computes it from the previous reactive decision, not from a command the
+ * predictor forced, so a prediction cannot confirm itself.
+ *
+ * Record a trace with:
+ *	echo 1 > /sys/kernel/debug/tracing/events/dm_hotplug/enable
+ *	cat /sys/kernel/debug/tracing/trace_pipe > dm_hotplug.trace
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#define HIST_SIZE	8
+#define CMD_NORMAL	0
+
+struct sample {
+	int nr_avg;
+	unsigned int nr_heavy;
+	int reactive_cmd;
+};
+
+struct policy {
+	int threshold;
+	unsigned int horizon;
+	unsigned int window;
+	unsigned int heavy_weight;
+};
+
+struct score {
+	unsigned long decisions;
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long mispredicts;
+	unsigned long big_samples;
+	unsigned long reactive_big_samples;
+};
+
+static struct sample *samples;
+static unsigned long nr_samples;
+static unsigned long miss_cost = 4;
+static unsigned long mispredict_cost = 1;
+
+static int add_sample(const struct sample *s)
+{
+	static unsigned long alloc;
+
+	if (nr_samples == alloc) {
+		alloc = alloc ? alloc * 2 : 1024;
+		samples = realloc(samples, alloc * sizeof(*samples));
+		if (!samples)
+			return -1;
+	}
+	samples[nr_samples++] = *s;
+	return 0;
+}
+
+static int read_trace(FILE *fp)
+{
+	char line[512];
+	struct sample cur;
+	int have_sample = 0;
+	char *p;
+
+	while (fgets(line, sizeof(line), fp)) {
+		p = strstr(line, "dm_hotplug_sample: ");
+		if (p) {
+			if (sscanf(p, "dm_hotplug_sample: nr_avg=%d iowait_avg=%*d nr_heavy=%u",
+				   &cur.nr_avg, &cur.nr_heavy) == 2)
+				have_sample = 1;
+			continue;
+		}
+
+		p = strstr(line, "dm_hotplug_predict: ");
+		if (p && have_sample) {
+			if (sscanf(p, "dm_hotplug_predict: predicted=%*d reactive_cmd=%d",
+				   &cur.reactive_cmd) != 1)
+				continue;
+			if (add_sample(&cur))
+				return -1;
+			have_sample = 0;
+		}
+	}
+
+	return 0;
+}
+
+static void replay(const struct policy *pol, struct score *sc)
+{
+	int hist[HIST_SIZE];
+	unsigned int head = 0, count = 0, age = 0;
+	int ewma = 0, pending = 0, prev_big = 0;
+	unsigned long i;
+
+	memset(sc, 0, sizeof(*sc));
+
+	for (i = 0; i < nr_samples; i++) {
+		const struct sample *s = &samples[i];
+		int reactive_big = s->reactive_cmd == CMD_NORMAL;
+		int predicted, slope = 0, big = reactive_big;
+
+		hist[head] = s->nr_avg;
+		head = (head + 1) % HIST_SIZE;
+		if (count < HIST_SIZE)
+			count++;
+		ewma = count == 1 ? s->nr_avg : (ewma * 3 + s->nr_avg) / 4;
+		if (count > 1)
+			slope = (hist[(head + HIST_SIZE - 1) % HIST_SIZE] -
+				 hist[(head + HIST_SIZE - count) % HIST_SIZE]) /
+				(int)(count - 1);
+		predicted = ewma + slope * (int)pol->horizon +
+			    (int)(s->nr_heavy * pol->heavy_weight);
+
+		if (pending) {
+			if (reactive_big) {
+				sc->hits++;
+				pending = 0;
+			} else if (++age > pol->window) {
+				sc->mispredicts++;
+				pending = 0;
+			} else {
+				big = 1;
+			}
+		} else if (reactive_big && !prev_big) {
+			sc->misses++;
+		} else if (!reactive_big && !prev_big &&
+			   predicted >= pol->threshold) {
+			sc->decisions++;
+			pending = 1;
+			age = 0;
+			big = 1;
+		}
+
+		sc->big_samples += big;
+		sc->reactive_big_samples += reactive_big;
+		prev_big = big;
+	}
+}
+
+static void print_score(const struct policy *pol, const struct score *sc)
+{
+	unsigned long cost = sc->misses * miss_cost +
+			     sc->mispredicts * mispredict_cost;
+
+	printf("threshold=%d horizon=%u window=%u heavy_weight=%u: "
+	       "decisions=%lu hits=%lu misses=%lu mispredicts=%lu "
+	       "big_samples=%lu (reactive %lu) cost=%lu\n",
+	       pol->threshold, pol->horizon, pol->window, pol->heavy_weight,
+	       sc->decisions, sc->hits, sc->misses, sc->mispredicts,
+	       sc->big_samples, sc->reactive_big_samples, cost);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-t threshold] [-H horizon] [-w window] [-k heavy_weight]\n"
+		"          [-s step] [-m miss_cost] [-M mispredict_cost] [trace]\n"
+		"  -s step  sweep the threshold from step to 10 * step\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct policy pol = {
+		.threshold = 350,
+		.horizon = 2,
+		.window = 5,
+		.heavy_weight = 100,
+	};
+	struct score sc;
+	FILE *fp = stdin;
+	int step = 0, opt;
+
+	while ((opt = getopt(argc, argv, "t:H:w:k:s:m:M:h")) != -1) {
+		switch (opt) {
+		case 't':
+			pol.threshold = atoi(optarg);
+			break;
+		case 'H':
+			pol.horizon = atoi(optarg);
+			break;
+		case 'w':
+			pol.window = atoi(optarg);
+			break;
+		case 'k':
+			pol.heavy_weight = atoi(optarg);
+			break;
+		case 's':
+			step = atoi(optarg);
+			break;
+		case 'm':
+			miss_cost = strtoul(optarg, NULL, 0);
+			break;
+		case 'M':
+			mispredict_cost = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (optind < argc) {
+		fp = fopen(argv[optind], "r");
+		if (!fp) {
+			perror(argv[optind]);
+			return 1;
+		}
+	}
+
+	if (read_trace(fp)) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	if (fp != stdin)
+		fclose(fp);
+
+	if (!nr_samples) {
+		fprintf(stderr, "no dm_hotplug samples found\n");
+		return 1;
+	}
+
+	printf("%lu samples\n", nr_samples);
+
+	if (step > 0) {
+		for (pol.threshold = step; pol.threshold <= 10 * step;
+		     pol.threshold += step) {
+			replay(&pol, &sc);
+			print_score(&pol, &sc);
+		}
+	} else {
+		replay(&pol, &sc);
+		print_score(&pol, &sc);
+	}
+
+	free(samples);
+	return 0;
+}
@@ -0,0 +1,294 @@
+/*
+ * lru_gen_bench.c - compare reclaim cost and refaults of LRU implementations
+ *
+ * Maps an anonymous working set, and optionally a file, larger than the
+ * memory left to them (run it in a memory cgroup, or size it above free
+ * RAM).  Every pass touches the hot share of the anonymous set in full and
+ * a slice of the cold remainder and of the file, so that reclaim has to
+ * tell the hot pages from the cold ones.  Run it with the same arguments
+ * on kernels built with and without CONFIG_LRU_GEN and compare:
+ *
+ *  - reclaim CPU time: kswapd CPU time plus the system time of this
+ *    process, which includes its direct reclaim;
+ *  - scan efficiency: pages reclaimed per page scanned;
+ *  - refaults: swap-ins for anonymous pages, workingset_refault for file
+ *    pages, and the time spent touching the hot set.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+struct vm_counters {
+	unsigned long long steal;	/* pgsteal_kswapd_* + pgsteal_direct_* */
+	unsigned long long scan;	/* pgscan_kswapd_* + pgscan_direct_* */
+	unsigned long long pswpin;
+	unsigned long long pswpout;
+	unsigned long long refault;	/* workingset_refault */
+	unsigned long long activate;	/* workingset_activate */
+	unsigned long long majfault;
+	double kswapd_cpu;		/* seconds */
+};
+
+static int read_vmstat(struct vm_counters *c)
+{
+	char name[64];
+	unsigned long long val;
+	FILE *fp;
+
+	fp = fopen("/proc/vmstat", "r");
+	if (!fp) {
+		perror("/proc/vmstat");
+		return -1;
+	}
+	while (fscanf(fp, "%63s %llu", name, &val) == 2) {
+		if (!strncmp(name, "pgsteal_", 8))
+			c->steal += val;
+		else if (!strncmp(name, "pgscan_kswapd", 13) ||
+			 !strncmp(name, "pgscan_direct_", 14))
+			c->scan += val;
+		else if (!strcmp(name, "pswpin"))
+			c->pswpin = val;
+		else if (!strcmp(name, "pswpout"))
+			c->pswpout = val;
+		else if (!strcmp(name, "workingset_refault"))
+			c->refault = val;
+		else if (!strcmp(name, "workingset_activate"))
+			c->activate = val;
+		else if (!strcmp(name, "pgmajfault"))
+			c->majfault = val;
+	}
+	fclose(fp);
+	return 0;
+}
+
+/* utime + stime of all kswapd threads */
+static double kswapd_cpu(void)
+{
+	long ticks = sysconf(_SC_CLK_TCK);
+	unsigned long utime, stime;
+	double total = 0;
+	struct dirent *de;
+	char path[300], comm[64];
+	DIR *dir;
+	FILE *fp;
+
+	dir = opendir("/proc");
+	if (!dir)
+		return 0;
+	while ((de = readdir(dir))) {
+		if (de->d_name[0] < '1' || de->d_name[0] > '9')
+			continue;
+		snprintf(path, sizeof(path), "/proc/%s/stat", de->d_name);
+		fp = fopen(path, "r");
+		if (!fp)
+			continue;
+		if (fscanf(fp, "%*d (%63[^)]) %*c %*d %*d %*d %*d %*d %*u "
+			   "%*u %*u %*u %*u %lu %lu", comm, &utime, &stime) == 3 &&
+		    !strncmp(comm, "kswapd", 6))
+			total += (double)(utime + stime) / ticks;
+		fclose(fp);
+	}
+	closedir(dir);
+	return total;
+}
+
+static int sample(struct vm_counters *c)
+{
+	memset(c, 0, sizeof(*c));
+	if (read_vmstat(c))
+		return -1;
+	c->kswapd_cpu = kswapd_cpu();
+	return 0;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double tv_sec(const struct timeval *tv)
+{
+	return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+static volatile unsigned long sink;
+
+static void touch_range(unsigned char *buf, unsigned long first,
+			unsigned long nr, long page_size, int write)
+{
+	unsigned long i;
+
+	for (i = first; i < first + nr; i++) {
+		if (write)
+			buf[i * page_size]++;
+		else
+			sink += buf[i * page_size];
+	}
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-s size_mb] [-t hot_pct] [-p passes] [-f file -F file_mb]\n"
+		"  -s size_mb  anonymous working set (default 512)\n"
+		"  -t hot_pct  share of it touched on every pass (default 25)\n"
+		"  -p passes   passes over the hot set (default 8)\n"
+		"  -f file     file to map and stream through, created if needed\n"
+		"  -F file_mb  size of the file (default 256)\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long size_mb = 512, file_mb = 256, passes = 8, pass;
+	unsigned long nr_pages, nr_hot, nr_cold, nr_file = 0;
+	unsigned long cold_slice, file_slice;
+	long page_size = sysconf(_SC_PAGESIZE);
+	struct vm_counters before, after;
+	struct rusage ru_before, ru_after;
+	const char *file = NULL;
+	unsigned char *buf, *fbuf = NULL;
+	double start, elapsed, hot_time = 0, t, sys, reclaim_cpu;
+	unsigned long long steal, scan, pswpin, refault;
+	int hot_pct = 25, fd = -1, opt;
+
+	while ((opt = getopt(argc, argv, "s:t:p:f:F:h")) != -1) {
+		switch (opt) {
+		case 's':
+			size_mb = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			hot_pct = atoi(optarg);
+			if (hot_pct < 1 || hot_pct > 100)
+				usage(argv[0]);
+			break;
+		case 'p':
+			passes = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			file = optarg;
+			break;
+		case 'F':
+			file_mb = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!passes)
+		usage(argv[0]);
+
+	nr_pages = (size_mb << 20) / page_size;
+	nr_hot = nr_pages * hot_pct / 100;
+	nr_cold = nr_pages - nr_hot;
+	buf = mmap(NULL, nr_pages * page_size, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buf == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+
+	if (file) {
+		nr_file = (file_mb << 20) / page_size;
+		fd = open(file, O_RDWR | O_CREAT, 0600);
+		if (fd < 0 || ftruncate(fd, nr_file * page_size)) {
+			perror(file);
+			return 1;
+		}
+		fbuf = mmap(NULL, nr_file * page_size, PROT_READ | PROT_WRITE,
+			    MAP_SHARED, fd, 0);
+		if (fbuf == MAP_FAILED) {
+			perror("mmap file");
+			return 1;
+		}
+		/* give the file real blocks so that it is read back */
+		touch_range(fbuf, 0, nr_file, page_size, 1);
+		msync(fbuf, nr_file * page_size, MS_SYNC);
+	}
+
+	/* populate the anonymous set once, cold part first */
+	touch_range(buf, nr_hot, nr_cold, page_size, 1);
+	touch_range(buf, 0, nr_hot, page_size, 1);
+
+	cold_slice = (nr_cold + passes - 1) / passes;
+	file_slice = (nr_file + passes - 1) / passes;
+
+	if (sample(&before))
+		return 1;
+	getrusage(RUSAGE_SELF, &ru_before);
+	start = now();
+
+	for (pass = 0; pass < passes; pass++) {
+		unsigned long first;
+
+		t = now();
+		touch_range(buf, 0, nr_hot, page_size, 1);
+		hot_time += now() - t;
+
+		first = pass * cold_slice;
+		if (first < nr_cold)
+			touch_range(buf, nr_hot + first,
+				    first + cold_slice > nr_cold ?
+				    nr_cold - first : cold_slice,
+				    page_size, 1);
+
+		first = pass * file_slice;
+		if (first < nr_file)
+			touch_range(fbuf, first,
+				    first + file_slice > nr_file ?
+				    nr_file - first : file_slice,
+				    page_size, 0);
+	}
+
+	elapsed = now() - start;
+	getrusage(RUSAGE_SELF, &ru_after);
+	if (sample(&after))
+		return 1;
+
+	steal = after.steal - before.steal;
+	scan = after.scan - before.scan;
+	pswpin = after.pswpin - before.pswpin;
+	refault = after.refault - before.refault;
+	sys = tv_sec(&ru_after.ru_stime) - tv_sec(&ru_before.ru_stime);
+	reclaim_cpu = after.kswapd_cpu - before.kswapd_cpu + sys;
+
+	printf("working set      : %lu MB anon (%d%% hot), %lu MB file, %lu passes\n",
+	       size_mb, hot_pct, nr_file * page_size >> 20, passes);
+	printf("elapsed          : %.2f s, hot set %.2f s\n", elapsed, hot_time);
+	printf("reclaim cpu      : %.2f s (kswapd %.2f s, own system %.2f s)\n",
+	       reclaim_cpu, after.kswapd_cpu - before.kswapd_cpu, sys);
+	printf("pages reclaimed  : %llu (%.1f us cpu/page)\n",
+	       steal, steal ? reclaim_cpu * 1e6 / steal : 0.0);
+	printf("pages scanned    : %llu (efficiency %.1f%%)\n",
+	       scan, scan ? 100.0 * steal / scan : 0.0);
+	printf("swap out         : %llu\n", after.pswpout - before.pswpout);
+	printf("anon refaults    : %llu (%.1f%% of reclaimed)\n",
+	       pswpin, steal ? 100.0 * pswpin / steal : 0.0);
+	printf("file refaults    : %llu (%llu activated)\n",
+	       refault, after.activate - before.activate);
+	printf("major faults     : %llu\n", after.majfault - before.majfault);
+
+	if (fbuf) {
+		munmap(fbuf, nr_file * page_size);
+		close(fd);
+	}
+	munmap(buf, nr_pages * page_size);
+	return 0;
+}
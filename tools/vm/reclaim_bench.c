@@ -0,0 +1,187 @@
+/*
+ * reclaim_bench.c - measure anonymous page reclaim throughput
+ *
+ * Maps an anonymous working set larger than the memory left to it (run it
+ * in a memory cgroup, or size it above free RAM), fills it with data of a
+ * chosen compressibility and sweeps over it repeatedly, forcing the kernel
+ * to reclaim it to swap (zram) and fault it back.  The reclaim and swap
+ * counters of /proc/vmstat are sampled around the run and reported as
+ * pages per second.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/mman.h>
+
+struct vm_counters {
+	unsigned long long steal;	/* pgsteal_kswapd_* + pgsteal_direct_* */
+	unsigned long long scan;	/* pgscan_kswapd_* + pgscan_direct_* */
+	unsigned long long pswpout;
+	unsigned long long pswpin;
+	unsigned long long allocstall;
+};
+
+static int read_vmstat(struct vm_counters *c)
+{
+	char name[64];
+	unsigned long long val;
+	FILE *fp;
+
+	memset(c, 0, sizeof(*c));
+	fp = fopen("/proc/vmstat", "r");
+	if (!fp) {
+		perror("/proc/vmstat");
+		return -1;
+	}
+	while (fscanf(fp, "%63s %llu", name, &val) == 2) {
+		if (!strncmp(name, "pgsteal_", 8))
+			c->steal += val;
+		else if (!strncmp(name, "pgscan_kswapd", 13) ||
+			 !strncmp(name, "pgscan_direct_", 14))
+			c->scan += val;
+		else if (!strcmp(name, "pswpout"))
+			c->pswpout = val;
+		else if (!strcmp(name, "pswpin"))
+			c->pswpin = val;
+		else if (!strcmp(name, "allocstall"))
+			c->allocstall = val;
+	}
+	fclose(fp);
+	return 0;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* fill a page so that roughly @ratio percent of it is compressible */
+static void fill_page(unsigned char *p, long page_size, int ratio,
+		      unsigned int *seed)
+{
+	long random_bytes = page_size * (100 - ratio) / 100;
+	long i;
+
+	for (i = 0; i < random_bytes; i++)
+		p[i] = rand_r(seed);
+	memset(p + random_bytes, 0x5a, page_size - random_bytes);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-s size_mb] [-p passes] [-c compress_pct] [-r]\n"
+		"  -s size_mb      anonymous working set (default 512)\n"
+		"  -p passes       sweeps over the working set (default 4)\n"
+		"  -c compress_pct compressible share of each page (default 50)\n"
+		"  -r              sweep in random page order\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long size_mb = 512, passes = 4, nr_pages, i, pass;
+	int ratio = 50, random_order = 0, opt;
+	long page_size = sysconf(_SC_PAGESIZE);
+	struct vm_counters before, after;
+	unsigned int seed = 1;
+	unsigned long *order;
+	unsigned char *buf;
+	double start, elapsed;
+	unsigned long long steal, scan;
+
+	while ((opt = getopt(argc, argv, "s:p:c:rh")) != -1) {
+		switch (opt) {
+		case 's':
+			size_mb = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			passes = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			ratio = atoi(optarg);
+			if (ratio < 0 || ratio > 100)
+				usage(argv[0]);
+			break;
+		case 'r':
+			random_order = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	nr_pages = (size_mb << 20) / page_size;
+	buf = mmap(NULL, nr_pages * page_size, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buf == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+
+	order = malloc(nr_pages * sizeof(*order));
+	if (!order) {
+		perror("malloc");
+		return 1;
+	}
+	for (i = 0; i < nr_pages; i++)
+		order[i] = i;
+	if (random_order) {
+		for (i = nr_pages - 1; i > 0; i--) {
+			unsigned long j = rand_r(&seed) % (i + 1);
+			unsigned long tmp = order[i];
+
+			order[i] = order[j];
+			order[j] = tmp;
+		}
+	}
+
+	if (read_vmstat(&before))
+		return 1;
+	start = now();
+
+	for (i = 0; i < nr_pages; i++)
+		fill_page(buf + i * page_size, page_size, ratio, &seed);
+
+	for (pass = 0; pass < passes; pass++)
+		for (i = 0; i < nr_pages; i++)
+			buf[order[i] * page_size]++;
+
+	elapsed = now() - start;
+	if (read_vmstat(&after))
+		return 1;
+
+	steal = after.steal - before.steal;
+	scan = after.scan - before.scan;
+
+	printf("working set      : %lu MB (%lu pages), %lu passes, %s order\n",
+	       size_mb, nr_pages, passes, random_order ? "random" : "linear");
+	printf("elapsed          : %.2f s\n", elapsed);
+	printf("pages reclaimed  : %llu (%.0f pages/s)\n",
+	       steal, steal / elapsed);
+	printf("pages scanned    : %llu (efficiency %.1f%%)\n",
+	       scan, scan ? 100.0 * steal / scan : 0.0);
+	printf("swap out         : %llu (%.0f pages/s)\n",
+	       after.pswpout - before.pswpout,
+	       (after.pswpout - before.pswpout) / elapsed);
+	printf("swap in          : %llu (%.0f pages/s)\n",
+	       after.pswpin - before.pswpin,
+	       (after.pswpin - before.pswpin) / elapsed);
+	printf("direct reclaims  : %llu\n",
+	       after.allocstall - before.allocstall);
+
+	munmap(buf, nr_pages * page_size);
+	free(order);
+	return 0;
+}